@@ -0,0 +1,443 @@
+//===-- DCPU16AsmParser.cpp - Parse DCPU16 assembly to MCInst instructions ===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file parses the syntax DCPU16InstPrinter prints: upper case mnemonics
+// and registers, PEEK and PICK n for stack slots, [reg], [reg+disp] and
+// [addr] for memory, and .dat for data. Labels are the usual "name:" ones.
+//
+//===----------------------------------------------------------------------===//
+
+#include "DCPU16.h"
+#include "MCTargetDesc/DCPU16MCTargetDesc.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/MC/MCContext.h"
+#include "llvm/MC/MCExpr.h"
+#include "llvm/MC/MCInst.h"
+#include "llvm/MC/MCParser/MCAsmLexer.h"
+#include "llvm/MC/MCParser/MCAsmParser.h"
+#include "llvm/MC/MCParser/MCParsedAsmOperand.h"
+#include "llvm/MC/MCParser/MCTargetAsmParser.h"
+#include "llvm/MC/MCStreamer.h"
+#include "llvm/MC/MCSubtargetInfo.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/raw_ostream.h"
+using namespace llvm;
+
+namespace {
+struct DCPU16Operand;
+
+class DCPU16AsmParser : public MCTargetAsmParser {
+  const MCSubtargetInfo &STI;
+  MCAsmParser &Parser;
+
+  MCAsmParser &getParser() const { return Parser; }
+  MCAsmLexer &getLexer() const { return Parser.getLexer(); }
+
+  bool Error(SMLoc L, const Twine &Msg) { return Parser.Error(L, Msg); }
+
+  bool ParseOperand(OperandVector &Operands);
+  bool ParseMemOperand(OperandVector &Operands);
+  bool ParseDirectiveDat(SMLoc L);
+
+  bool MatchAndEmitInstruction(SMLoc IDLoc, unsigned &Opcode,
+                               OperandVector &Operands, MCStreamer &Out,
+                               uint64_t &ErrorInfo,
+                               bool MatchingInlineAsm) override;
+
+  /// @name Auto-generated Matcher Functions
+  /// {
+
+#define GET_ASSEMBLER_HEADER
+#include "DCPU16GenAsmMatcher.inc"
+
+  /// }
+
+public:
+  DCPU16AsmParser(const MCSubtargetInfo &_STI, MCAsmParser &_Parser,
+                  const MCInstrInfo &MII, const MCTargetOptions &Options)
+    : MCTargetAsmParser(Options, _STI), STI(_STI), Parser(_Parser) {
+    // Initialize the set of available features.
+    setAvailableFeatures(ComputeAvailableFeatures(STI.getFeatureBits()));
+  }
+
+  bool ParseRegister(unsigned &RegNo, SMLoc &StartLoc,
+                     SMLoc &EndLoc) override;
+  bool ParseInstruction(ParseInstructionInfo &Info, StringRef Name,
+                        SMLoc NameLoc, OperandVector &Operands) override;
+  bool ParseDirective(AsmToken DirectiveID) override;
+};
+
+/// DCPU16Operand - A parsed DCPU16 machine instruction operand.
+struct DCPU16Operand : public MCParsedAsmOperand {
+  enum KindTy {
+    k_Token,
+    k_Register,
+    k_Immediate,
+    k_Memory
+  } Kind;
+
+  SMLoc StartLoc, EndLoc;
+
+  /// The storage of a mnemonic token, which is upper-cased.
+  std::string Mnemonic;
+
+  union {
+    struct {
+      const char *Data;
+      unsigned Length;
+    } Tok;
+
+    struct {
+      unsigned RegNum;
+    } Reg;
+
+    struct {
+      const MCExpr *Val;
+    } Imm;
+
+    struct {
+      unsigned BaseReg; // 0 for an absolute address.
+      const MCExpr *Disp;
+    } Mem;
+  };
+
+  DCPU16Operand(KindTy K) : MCParsedAsmOperand(), Kind(K) {}
+
+  SMLoc getStartLoc() const override { return StartLoc; }
+  SMLoc getEndLoc() const override { return EndLoc; }
+
+  bool isToken() const override { return Kind == k_Token; }
+  bool isReg() const override { return Kind == k_Register; }
+  bool isImm() const override { return Kind == k_Immediate; }
+  bool isMem() const override { return Kind == k_Memory; }
+
+  StringRef getToken() const {
+    assert(Kind == k_Token && "Invalid access!");
+    return StringRef(Tok.Data, Tok.Length);
+  }
+
+  unsigned getReg() const override {
+    assert(Kind == k_Register && "Invalid access!");
+    return Reg.RegNum;
+  }
+
+  const MCExpr *getImm() const {
+    assert(Kind == k_Immediate && "Invalid access!");
+    return Imm.Val;
+  }
+
+  void addExpr(MCInst &Inst, const MCExpr *Expr) const {
+    // Constants are immediates, so that small ones can be encoded inline.
+    if (const MCConstantExpr *CE = dyn_cast<MCConstantExpr>(Expr))
+      Inst.addOperand(MCOperand::createImm(CE->getValue()));
+    else
+      Inst.addOperand(MCOperand::createExpr(Expr));
+  }
+
+  void addRegOperands(MCInst &Inst, unsigned N) const {
+    assert(N == 1 && "Invalid number of operands!");
+    Inst.addOperand(MCOperand::createReg(getReg()));
+  }
+
+  void addImmOperands(MCInst &Inst, unsigned N) const {
+    assert(N == 1 && "Invalid number of operands!");
+    addExpr(Inst, getImm());
+  }
+
+  void addMemOperands(MCInst &Inst, unsigned N) const {
+    assert(N == 2 && "Invalid number of operands!");
+    Inst.addOperand(MCOperand::createReg(Mem.BaseReg));
+    addExpr(Inst, Mem.Disp);
+  }
+
+  void print(raw_ostream &OS) const override {
+    switch (Kind) {
+    case k_Token:
+      OS << "'" << getToken() << "'";
+      break;
+    case k_Register:
+      OS << "<register " << getReg() << ">";
+      break;
+    case k_Immediate:
+      OS << *getImm();
+      break;
+    case k_Memory:
+      OS << "<memory " << Mem.BaseReg << " + " << *Mem.Disp << ">";
+      break;
+    }
+  }
+
+  static std::unique_ptr<DCPU16Operand> CreateToken(StringRef Str, SMLoc S) {
+    auto Op = make_unique<DCPU16Operand>(k_Token);
+    Op->Tok.Data = Str.data();
+    Op->Tok.Length = Str.size();
+    Op->StartLoc = S;
+    Op->EndLoc = S;
+    return Op;
+  }
+
+  static std::unique_ptr<DCPU16Operand> CreateMnemonic(StringRef Name,
+                                                       SMLoc S) {
+    auto Op = make_unique<DCPU16Operand>(k_Token);
+    Op->Mnemonic = Name.upper();
+    Op->Tok.Data = Op->Mnemonic.data();
+    Op->Tok.Length = Op->Mnemonic.size();
+    Op->StartLoc = S;
+    Op->EndLoc = S;
+    return Op;
+  }
+
+  static std::unique_ptr<DCPU16Operand> CreateReg(unsigned RegNum, SMLoc S,
+                                                  SMLoc E) {
+    auto Op = make_unique<DCPU16Operand>(k_Register);
+    Op->Reg.RegNum = RegNum;
+    Op->StartLoc = S;
+    Op->EndLoc = E;
+    return Op;
+  }
+
+  static std::unique_ptr<DCPU16Operand> CreateImm(const MCExpr *Val, SMLoc S,
+                                                  SMLoc E) {
+    auto Op = make_unique<DCPU16Operand>(k_Immediate);
+    Op->Imm.Val = Val;
+    Op->StartLoc = S;
+    Op->EndLoc = E;
+    return Op;
+  }
+
+  static std::unique_ptr<DCPU16Operand>
+  CreateMem(unsigned BaseReg, const MCExpr *Disp, SMLoc S, SMLoc E) {
+    auto Op = make_unique<DCPU16Operand>(k_Memory);
+    Op->Mem.BaseReg = BaseReg;
+    Op->Mem.Disp = Disp;
+    Op->StartLoc = S;
+    Op->EndLoc = E;
+    return Op;
+  }
+};
+
+} // end anonymous namespace
+
+static unsigned MatchRegisterName(StringRef Name);
+
+bool DCPU16AsmParser::ParseRegister(unsigned &RegNo, SMLoc &StartLoc,
+                                    SMLoc &EndLoc) {
+  const AsmToken &Tok = Parser.getTok();
+  StartLoc = Tok.getLoc();
+  EndLoc = Tok.getEndLoc();
+  RegNo = 0;
+  if (Tok.isNot(AsmToken::Identifier))
+    return true;
+  RegNo = MatchRegisterName(Tok.getString());
+  if (RegNo == 0)
+    return true;
+  Parser.Lex(); // Eat the register.
+  return false;
+}
+
+/// ParseMemOperand - Parse [reg], [reg+disp] or [addr].
+bool DCPU16AsmParser::ParseMemOperand(OperandVector &Operands) {
+  SMLoc S = Parser.getTok().getLoc();
+  Parser.Lex(); // Eat '['.
+
+  unsigned BaseReg = 0;
+  const MCExpr *Disp = 0;
+  SMLoc RegS, RegE;
+  if (getLexer().is(AsmToken::Identifier) &&
+      !ParseRegister(BaseReg, RegS, RegE)) {
+    if (getLexer().is(AsmToken::Plus)) {
+      Parser.Lex(); // Eat '+'.
+      if (getParser().parseExpression(Disp))
+        return true;
+    }
+  } else if (getParser().parseExpression(Disp)) {
+    return true;
+  }
+  if (!Disp)
+    Disp = MCConstantExpr::create(0, getParser().getContext());
+
+  if (getLexer().isNot(AsmToken::RBrac))
+    return Error(Parser.getTok().getLoc(), "expected ']' in memory operand");
+  SMLoc E = Parser.getTok().getEndLoc();
+  Parser.Lex(); // Eat ']'.
+
+  if (BaseReg == DCPU16::EX)
+    return Error(RegS, "EX cannot be the base of a memory operand");
+  Operands.push_back(DCPU16Operand::CreateMem(BaseReg, Disp, S, E));
+  return false;
+}
+
+bool DCPU16AsmParser::ParseOperand(OperandVector &Operands) {
+  SMLoc S = Parser.getTok().getLoc();
+
+  if (getLexer().is(AsmToken::LBrac))
+    return ParseMemOperand(Operands);
+
+  if (getLexer().is(AsmToken::Identifier)) {
+    StringRef Id = Parser.getTok().getString();
+
+    // PC, PUSH and POP are part of the instructions that use them.
+    if (Id == "PC" || Id == "PUSH" || Id == "POP") {
+      Parser.Lex();
+      Operands.push_back(DCPU16Operand::CreateToken(Id, S));
+      return false;
+    }
+
+    // PEEK is [SP] and PICK n is [SP+n].
+    if (Id == "PEEK" || Id == "PICK") {
+      SMLoc E = Parser.getTok().getEndLoc();
+      Parser.Lex();
+      const MCExpr *Disp = MCConstantExpr::create(0, getParser().getContext());
+      if (Id == "PICK") {
+        E = Parser.getTok().getEndLoc();
+        if (getParser().parseExpression(Disp))
+          return true;
+      }
+      Operands.push_back(DCPU16Operand::CreateMem(DCPU16::SP, Disp, S, E));
+      return false;
+    }
+
+    unsigned RegNo;
+    SMLoc RegS, RegE;
+    if (!ParseRegister(RegNo, RegS, RegE)) {
+      Operands.push_back(DCPU16Operand::CreateReg(RegNo, RegS, RegE));
+      return false;
+    }
+  }
+
+  // Anything else is a literal or a symbol.
+  const MCExpr *Val;
+  SMLoc E = Parser.getTok().getEndLoc();
+  if (getParser().parseExpression(Val))
+    return true;
+  Operands.push_back(DCPU16Operand::CreateImm(Val, S, E));
+  return false;
+}
+
+bool DCPU16AsmParser::
+ParseInstruction(ParseInstructionInfo &Info, StringRef Name, SMLoc NameLoc,
+                 OperandVector &Operands) {
+  // The generic parser lower-cases the mnemonic, while the instructions are
+  // spelled in upper case.
+  Operands.push_back(DCPU16Operand::CreateMnemonic(Name, NameLoc));
+
+  if (getLexer().isNot(AsmToken::EndOfStatement)) {
+    if (ParseOperand(Operands)) {
+      Parser.eatToEndOfStatement();
+      return true;
+    }
+
+    while (getLexer().is(AsmToken::Comma)) {
+      Parser.Lex(); // Eat the comma.
+      if (ParseOperand(Operands)) {
+        Parser.eatToEndOfStatement();
+        return true;
+      }
+    }
+
+    if (getLexer().isNot(AsmToken::EndOfStatement)) {
+      SMLoc Loc = getLexer().getLoc();
+      Parser.eatToEndOfStatement();
+      return Error(Loc, "unexpected token in argument list");
+    }
+  }
+  Parser.Lex(); // Consume the EndOfStatement.
+
+  // RFI ignores its operand, and the instruction printer prints it as 0.
+  if (Name.equals_lower("RFI") && Operands.size() == 2) {
+    DCPU16Operand &Op = static_cast<DCPU16Operand &>(*Operands[1]);
+    const MCConstantExpr *CE =
+      Op.isImm() ? dyn_cast<MCConstantExpr>(Op.getImm()) : nullptr;
+    if (CE && CE->getValue() == 0)
+      Operands[1] = DCPU16Operand::CreateToken("0", Op.getStartLoc());
+  }
+  return false;
+}
+
+/// ParseDirectiveDat
+///  ::= .dat [ expression | string ] (, [ expression | string ])*
+bool DCPU16AsmParser::ParseDirectiveDat(SMLoc L) {
+  if (getLexer().isNot(AsmToken::EndOfStatement)) {
+    for (;;) {
+      if (getLexer().is(AsmToken::String)) {
+        // A string is one word per character.
+        StringRef Str = Parser.getTok().getStringContents();
+        for (unsigned i = 0, e = Str.size(); i != e; ++i)
+          getParser().getStreamer().EmitIntValue(Str[i], 2);
+        Parser.Lex();
+      } else {
+        const MCExpr *Value;
+        if (getParser().parseExpression(Value))
+          return true;
+        getParser().getStreamer().EmitValue(Value, 2);
+      }
+
+      if (getLexer().is(AsmToken::EndOfStatement))
+        break;
+
+      if (getLexer().isNot(AsmToken::Comma))
+        return Error(L, "unexpected token in directive");
+      Parser.Lex();
+    }
+  }
+
+  Parser.Lex();
+  return false;
+}
+
+bool DCPU16AsmParser::ParseDirective(AsmToken DirectiveID) {
+  StringRef IDVal = DirectiveID.getIdentifier();
+  if (IDVal == ".dat")
+    return ParseDirectiveDat(DirectiveID.getLoc());
+  return true;
+}
+
+bool DCPU16AsmParser::
+MatchAndEmitInstruction(SMLoc IDLoc, unsigned &Opcode,
+                        OperandVector &Operands, MCStreamer &Out,
+                        uint64_t &ErrorInfo, bool MatchingInlineAsm) {
+  MCInst Inst;
+  switch (MatchInstructionImpl(Operands, Inst, ErrorInfo,
+                               MatchingInlineAsm)) {
+  default: break;
+  case Match_Success:
+    Out.EmitInstruction(Inst, STI);
+    Opcode = Inst.getOpcode();
+    return false;
+  case Match_MissingFeature:
+    return Error(IDLoc, "instruction requires a CPU feature not currently "
+                 "enabled");
+  case Match_InvalidOperand: {
+    SMLoc ErrorLoc = IDLoc;
+    if (ErrorInfo != ~0ULL) {
+      if (ErrorInfo >= Operands.size())
+        return Error(IDLoc, "too few operands for instruction");
+
+      ErrorLoc = ((DCPU16Operand &)*Operands[ErrorInfo]).getStartLoc();
+      if (ErrorLoc == SMLoc())
+        ErrorLoc = IDLoc;
+    }
+    return Error(ErrorLoc, "invalid operand for instruction");
+  }
+  case Match_MnemonicFail:
+    return Error(IDLoc, "invalid instruction");
+  }
+
+  llvm_unreachable("Implement any new match types added!");
+}
+
+extern "C" void LLVMInitializeDCPU16AsmParser() {
+  RegisterMCAsmParser<DCPU16AsmParser> X(TheDCPU16Target);
+}
+
+#define GET_REGISTER_MATCHER
+#define GET_MATCHER_IMPLEMENTATION
+#include "DCPU16GenAsmMatcher.inc"
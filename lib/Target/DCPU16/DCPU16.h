@@ -15,8 +15,6 @@
 #ifndef LLVM_TARGET_DCPU16_H
 #define LLVM_TARGET_DCPU16_H
 
-#define DEBUG_TYPE "dcpu16-lower"
-
 #include "MCTargetDesc/DCPU16MCTargetDesc.h"
 #include "llvm/Target/TargetMachine.h"
 
@@ -50,6 +48,7 @@ namespace llvm {
 
   FunctionPass *createDCPU16ISelDag(DCPU16TargetMachine &TM, CodeGenOpt::Level OptLevel);
   FunctionPass *createDCPU16Peephole();
+  FunctionPass *createDCPU16IfConversion();
 
 } // end namespace llvm;
 
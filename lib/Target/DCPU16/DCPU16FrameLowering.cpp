@@ -39,7 +39,7 @@ bool DCPU16FrameLowering::hasReservedCallFrame(const MachineFunction &MF) const
 }
 
 void DCPU16FrameLowering::emitPrologue(MachineFunction &MF, MachineBasicBlock &MBB) const {
-  MachineFrameInfo MFI = MF.getFrameInfo();
+  MachineFrameInfo &MFI = MF.getFrameInfo();
   DCPU16MachineFunctionInfo *DCPU16FI = MF.getInfo<DCPU16MachineFunctionInfo>();
   const DCPU16InstrInfo &TII =
     *static_cast<const DCPU16InstrInfo*>(MF.getSubtarget().getInstrInfo());
@@ -98,7 +98,7 @@ void DCPU16FrameLowering::emitPrologue(MachineFunction &MF, MachineBasicBlock &M
 
 void DCPU16FrameLowering::emitEpilogue(MachineFunction &MF,
                                        MachineBasicBlock &MBB) const {
-  const MachineFrameInfo MFI = MF.getFrameInfo();
+  const MachineFrameInfo &MFI = MF.getFrameInfo();
   DCPU16MachineFunctionInfo *DCPU16FI = MF.getInfo<DCPU16MachineFunctionInfo>();
   const DCPU16InstrInfo &TII =
     *static_cast<const DCPU16InstrInfo*>(MF.getSubtarget().getInstrInfo());
@@ -163,6 +163,68 @@ void DCPU16FrameLowering::emitEpilogue(MachineFunction &MF,
   }
 }
 
+MachineBasicBlock::iterator DCPU16FrameLowering::eliminateCallFramePseudoInstr(
+    MachineFunction &MF, MachineBasicBlock &MBB,
+    MachineBasicBlock::iterator I) const {
+  const DCPU16InstrInfo &TII =
+    *static_cast<const DCPU16InstrInfo*>(MF.getSubtarget().getInstrInfo());
+  unsigned StackAlign = getStackAlignment();
+
+  if (!hasReservedCallFrame(MF)) {
+    // If the stack pointer can be changed after prologue, turn the
+    // adjcallstackup instruction into a 'sub SP, <amt>' and the
+    // adjcallstackdown instruction into 'add SP, <amt>'
+    // TODO: consider using push / pop instead of sub + store / add
+    MachineInstr &Old = *I;
+    uint64_t Amount = Old.getOperand(0).getImm();
+    if (Amount != 0) {
+      // We need to keep the stack aligned properly.  To do this, we round the
+      // amount of space needed for the outgoing arguments up to the next
+      // alignment boundary.
+      Amount = (Amount+StackAlign-1)/StackAlign*StackAlign;
+
+      MachineInstr *New = nullptr;
+      if (Old.getOpcode() == TII.getCallFrameSetupOpcode()) {
+        New = BuildMI(MF, Old.getDebugLoc(),
+                      TII.get(DCPU16::SUB16ri), DCPU16::SP)
+          .addReg(DCPU16::SP).addImm(Amount);
+      } else {
+        assert(Old.getOpcode() == TII.getCallFrameDestroyOpcode());
+        // factor out the amount the callee already popped.
+        uint64_t CalleeAmt = Old.getOperand(1).getImm();
+        Amount -= CalleeAmt;
+        if (Amount)
+          New = BuildMI(MF, Old.getDebugLoc(),
+                        TII.get(DCPU16::ADD16ri), DCPU16::SP)
+            .addReg(DCPU16::SP).addImm(Amount);
+      }
+
+      if (New) {
+        // The SRW implicit def is dead.
+        New->getOperand(3).setIsDead();
+
+        // Replace the pseudo instruction with a new instruction...
+        MBB.insert(I, New);
+      }
+    }
+  } else if (I->getOpcode() == TII.getCallFrameDestroyOpcode()) {
+    // If we are performing frame pointer elimination and if the callee pops
+    // something off the stack pointer, add it back.
+    if (uint64_t CalleeAmt = I->getOperand(1).getImm()) {
+      MachineInstr &Old = *I;
+      MachineInstr *New =
+        BuildMI(MF, Old.getDebugLoc(), TII.get(DCPU16::SUB16ri),
+                DCPU16::SP).addReg(DCPU16::SP).addImm(CalleeAmt);
+      // The SRW implicit def is dead.
+      New->getOperand(3).setIsDead();
+
+      MBB.insert(I, New);
+    }
+  }
+
+  return MBB.erase(I);
+}
+
 // FIXME: Can we eleminate these in favour of generic code?
 bool
 DCPU16FrameLowering::spillCalleeSavedRegisters(MachineBasicBlock &MBB,
@@ -211,8 +273,8 @@ DCPU16FrameLowering::restoreCalleeSavedRegisters(MachineBasicBlock &MBB,
 }
 
 void
-DCPU16FrameLowering::processFunctionBeforeFrameFinalized(MachineFunction &MF)
-                                                                         const {
+DCPU16FrameLowering::processFunctionBeforeFrameFinalized(MachineFunction &MF,
+                                                         RegScavenger *) const {
   // Create a frame entry for the J register that must be saved.
   if (hasFP(MF)) {
     int FrameIdx = MF.getFrameInfo().CreateFixedObject(1, -1, true);
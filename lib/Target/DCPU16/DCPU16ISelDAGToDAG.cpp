@@ -31,6 +31,8 @@
 #include "llvm/Support/raw_ostream.h"
 using namespace llvm;
 
+#define DEBUG_TYPE "dcpu16-isel"
+
 namespace {
   struct DCPU16ISelAddressMode {
     enum {
@@ -90,16 +92,11 @@ namespace {
 ///
 namespace {
   class DCPU16DAGToDAGISel : public SelectionDAGISel {
-    const DCPU16TargetLowering &Lowering;
-    const DCPU16Subtarget &Subtarget;
-
   public:
     DCPU16DAGToDAGISel(DCPU16TargetMachine &TM, CodeGenOpt::Level OptLevel)
-      : SelectionDAGISel(TM, OptLevel),
-        Lowering(*TM.getTargetLowering()),
-        Subtarget(*TM.getSubtargetImpl()) { }
+      : SelectionDAGISel(TM, OptLevel) {}
 
-    virtual StringRef getPassName() const {
+    StringRef getPassName() const override {
       return "DCPU16 DAG->DAG Pattern Instruction Selection";
     }
 
@@ -107,15 +104,14 @@ namespace {
     bool MatchWrapper(SDValue N, DCPU16ISelAddressMode &AM);
     bool MatchAddressBase(SDValue N, DCPU16ISelAddressMode &AM);
 
-    virtual bool
-    SelectInlineAsmMemoryOperand(const SDValue &Op, char ConstraintCode,
-                                 std::vector<SDValue> &OutOps);
+    bool SelectInlineAsmMemoryOperand(const SDValue &Op, unsigned ConstraintID,
+                                      std::vector<SDValue> &OutOps) override;
 
     // Include the pieces autogenerated from the target description.
   #include "DCPU16GenDAGISel.inc"
 
   private:
-    void Select(SDNode *N);
+    void Select(SDNode *N) override;
 
     bool SelectAddr(SDValue Addr, SDValue &Base, SDValue &Disp);
   };
@@ -280,12 +276,12 @@ bool DCPU16DAGToDAGISel::SelectAddr(SDValue N,
 }
 
 bool DCPU16DAGToDAGISel::
-SelectInlineAsmMemoryOperand(const SDValue &Op, char ConstraintCode,
+SelectInlineAsmMemoryOperand(const SDValue &Op, unsigned ConstraintID,
                              std::vector<SDValue> &OutOps) {
   SDValue Op0, Op1;
-  switch (ConstraintCode) {
+  switch (ConstraintID) {
   default: return true;
-  case 'm':   // memory
+  case InlineAsm::Constraint_m: // memory
     if (!SelectAddr(Op, Op0, Op1))
       return true;
     break;
@@ -297,7 +293,7 @@ SelectInlineAsmMemoryOperand(const SDValue &Op, char ConstraintCode,
 }
 
 void DCPU16DAGToDAGISel::Select(SDNode *Node) {
-  DebugLoc dl = Node->getDebugLoc();
+  SDLoc dl(Node);
 
   // Dump information about the Node being selected
   DEBUG(errs() << "Selecting: ");
@@ -309,6 +305,7 @@ void DCPU16DAGToDAGISel::Select(SDNode *Node) {
     DEBUG(errs() << "== ";
           Node->dump(CurDAG);
           errs() << "\n");
+    Node->setNodeId(-1);
     return;
   }
 
@@ -319,32 +316,18 @@ void DCPU16DAGToDAGISel::Select(SDNode *Node) {
     assert(Node->getValueType(0) == MVT::i16);
     int FI = cast<FrameIndexSDNode>(Node)->getIndex();
     SDValue TFI = CurDAG->getTargetFrameIndex(FI, MVT::i16);
-
     if (Node->hasOneUse()) {
-      ReplaceUses(Node, CurDAG->SelectNodeTo(Node, DCPU16::ADD16ri, MVT::i16,
-                                  TFI, CurDAG->getTargetConstant(0, SDLoc(Node), MVT::i16)));
-      CurDAG->RemoveDeadNode(Node);
+      CurDAG->SelectNodeTo(Node, DCPU16::ADD16ri, MVT::i16, TFI,
+                           CurDAG->getTargetConstant(0, dl, MVT::i16));
       return;
     }
-
-    ReplaceUses(Node, CurDAG->getMachineNode(DCPU16::ADD16ri, SDLoc(Node), MVT::i16,
-                                  TFI, CurDAG->getTargetConstant(0, SDLoc(Node), MVT::i16)));
-    CurDAG->RemoveDeadNode(Node);
+    ReplaceNode(Node, CurDAG->getMachineNode(
+                          DCPU16::ADD16ri, dl, MVT::i16, TFI,
+                          CurDAG->getTargetConstant(0, dl, MVT::i16)));
     return;
   }
   }
 
   // Select the default instruction
-  SDNode *ResNode = SelectCode(Node);
-
-  DEBUG(errs() << "=> ");
-  if (ResNode == NULL || ResNode == Node)
-    DEBUG(Node->dump(CurDAG));
-  else
-    DEBUG(ResNode->dump(CurDAG));
-  DEBUG(errs() << "\n");
-
-  ReplaceUses(Node, ResNode);
-  CurDAG->RemoveDeadNode(Node);
-  return;
+  SelectCode(Node);
 }
@@ -36,18 +36,16 @@
 #include "llvm/Support/raw_ostream.h"
 using namespace llvm;
 
-DCPU16TargetLowering::DCPU16TargetLowering(DCPU16TargetMachine &tm) :
-  TargetLowering(tm),
-  Subtarget(*tm.getSubtargetImpl()), TM(tm) {
-
-  TD = tm.getDataLayout();
+DCPU16TargetLowering::DCPU16TargetLowering(const TargetMachine &TM,
+                                           const DCPU16Subtarget &STI)
+    : TargetLowering(TM), Subtarget(STI) {
 
   // Set up the register classes.
   addRegisterClass(MVT::i16, &DCPU16::GR16RegClass);
   addRegisterClass(MVT::i16, &DCPU16::GEXR16RegClass);
 
   // Compute derived properties from the register classes
-  computeRegisterProperties(Subtarget.getRegisterInfo());
+  computeRegisterProperties(STI.getRegisterInfo());
 
   // Provide all sorts of operation actions
 
@@ -88,21 +86,37 @@ DCPU16TargetLowering::DCPU16TargetLowering(DCPU16TargetMachine &tm) :
   setOperationAction(ISD::CTLZ_ZERO_UNDEF,  MVT::i16,   Expand);
   setOperationAction(ISD::CTPOP,            MVT::i16,   Expand);
 
-  setOperationAction(ISD::SHL_PARTS,        MVT::i16,   Expand);
-  setOperationAction(ISD::SRL_PARTS,        MVT::i16,   Expand);
-  setOperationAction(ISD::SRA_PARTS,        MVT::i16,   Expand);
+  // i32 shifts carry the bits from one half into the other through EX.
+  setOperationAction(ISD::SHL_PARTS,        MVT::i16,   Custom);
+  setOperationAction(ISD::SRL_PARTS,        MVT::i16,   Custom);
+  setOperationAction(ISD::SRA_PARTS,        MVT::i16,   Custom);
 
   setOperationAction(ISD::SIGN_EXTEND_INREG, MVT::i1,   Expand);
 
-  // FIXME: Implement efficiently multiplication by a constant
-  setOperationAction(ISD::MULHS,            MVT::i16,   Expand);
-  setOperationAction(ISD::MULHU,            MVT::i16,   Expand);
+  // MUL and MLI leave the high half of the product in EX.
+  setOperationAction(ISD::MULHS,            MVT::i16,   Custom);
+  setOperationAction(ISD::MULHU,            MVT::i16,   Custom);
   setOperationAction(ISD::SMUL_LOHI,        MVT::i16,   Custom);
   setOperationAction(ISD::UMUL_LOHI,        MVT::i16,   Custom);
 
   setOperationAction(ISD::UDIVREM,          MVT::i16,   Expand);
   setOperationAction(ISD::SDIVREM,          MVT::i16,   Expand);
 
+  // i32 division by a constant becomes a multiplication by a magic number.
+  setTargetDAGCombine(ISD::SDIV);
+  setTargetDAGCombine(ISD::UDIV);
+
+  // The integer routines of the runtime library take their arguments in
+  // registers.
+  static const RTLIB::Libcall RegisterLibcalls[] = {
+    RTLIB::SHL_I32,  RTLIB::SHL_I64,  RTLIB::SRL_I32,  RTLIB::SRL_I64,
+    RTLIB::SRA_I32,  RTLIB::SRA_I64,  RTLIB::MUL_I32,  RTLIB::MUL_I64,
+    RTLIB::SDIV_I32, RTLIB::SDIV_I64, RTLIB::UDIV_I32, RTLIB::UDIV_I64,
+    RTLIB::SREM_I32, RTLIB::SREM_I64, RTLIB::UREM_I32, RTLIB::UREM_I64
+  };
+  for (unsigned i = 0; i != array_lengthof(RegisterLibcalls); ++i)
+    setLibcallCallingConv(RegisterLibcalls[i], CallingConv::Fast);
+
   setMinFunctionAlignment(1);
   setPrefFunctionAlignment(1);
 }
@@ -122,6 +136,11 @@ SDValue DCPU16TargetLowering::LowerOperation(SDValue Op,
   case ISD::ROTR:             return LowerROT(Op, DAG, false);
   case ISD::SMUL_LOHI:        return LowerMUL_LOHI(Op, DAG, true);
   case ISD::UMUL_LOHI:        return LowerMUL_LOHI(Op, DAG, false);
+  case ISD::MULHS:            return LowerMULH(Op, DAG, true);
+  case ISD::MULHU:            return LowerMULH(Op, DAG, false);
+  case ISD::SHL_PARTS:
+  case ISD::SRL_PARTS:
+  case ISD::SRA_PARTS:        return LowerShiftParts(Op, DAG);
   case ISD::JumpTable:        return LowerJumpTable(Op, DAG);
   default:
     llvm_unreachable("unimplemented operand");
@@ -135,7 +154,7 @@ SDValue DCPU16TargetLowering::LowerOperation(SDValue Op,
 /// getConstraintType - Given a constraint letter, return the type of
 /// constraint it is for this target.
 TargetLowering::ConstraintType
-DCPU16TargetLowering::getConstraintType(const std::string &Constraint) const {
+DCPU16TargetLowering::getConstraintType(StringRef Constraint) const {
   if (Constraint.size() == 1) {
     switch (Constraint[0]) {
     case 'r':
@@ -150,7 +169,7 @@ DCPU16TargetLowering::getConstraintType(const std::string &Constraint) const {
 std::pair<unsigned, const TargetRegisterClass*>
 DCPU16TargetLowering::getRegForInlineAsmConstraint(
   const TargetRegisterInfo *RI,
-  const StringRef Constraint, MVT VT) const {
+  StringRef Constraint, MVT VT) const {
 
   if (Constraint.size() == 1) {
     // GCC Constraint Letters
@@ -340,6 +359,7 @@ DCPU16TargetLowering::LowerReturn(SDValue Chain,
   CCInfo.AnalyzeReturn(Outs, RetCC_DCPU16);
 
   SDValue Flag;
+  SmallVector<SDValue, 4> RetOps(1, Chain);
 
   // Copy the result values into the output registers.
   for (unsigned i = 0; i != RVLocs.size(); ++i) {
@@ -352,16 +372,19 @@ DCPU16TargetLowering::LowerReturn(SDValue Chain,
     // Guarantee that all emitted copies are stuck together,
     // avoiding something bad.
     Flag = Chain.getValue(1);
+    RetOps.push_back(DAG.getRegister(VA.getLocReg(), VA.getLocVT()));
   }
 
   unsigned Opc = (CallConv == CallingConv::DCPU16_INTR ?
                   DCPU16ISD::RETI_FLAG : DCPU16ISD::RET_FLAG);
 
+  RetOps[0] = Chain;  // Update chain.
+
+  // Add the flag if we have it.
   if (Flag.getNode())
-    return DAG.getNode(Opc, dl, MVT::Other, Chain, Flag);
+    RetOps.push_back(Flag);
 
-  // Return Void
-  return DAG.getNode(Opc, dl, MVT::Other, Chain);
+  return DAG.getNode(Opc, dl, MVT::Other, RetOps);
 }
 
 /// LowerCCCCallTo - functions arguments are copied from virtual regs to
@@ -470,7 +493,7 @@ DCPU16TargetLowering::LowerCCCCallTo(SDValue Chain, SDValue Callee,
                                   RegsToPass[i].second.getValueType()));
 
   // Add a register mask operand representing the call-preserved registers.
-  const TargetRegisterInfo *TRI = getTargetMachine().getSubtargetImpl(*DAG.getMachineFunction().getFunction())->getRegisterInfo();
+  const TargetRegisterInfo *TRI = Subtarget.getRegisterInfo();
   const uint32_t *Mask = TRI->getCallPreservedMask(DAG.getMachineFunction(), CallConv);
   assert(Mask && "Missing call preserved mask for calling convention");
   Ops.push_back(DAG.getRegisterMask(Mask));
@@ -626,6 +649,22 @@ static DCPU16CC::CondCodes GetSimpleCC(ISD::CondCode CC) {
   }
 }
 
+/// GetBitTestCC - IFB and IFC test (a & b) != 0 and (a & b) == 0 directly. If
+/// LHS CC RHS is one of those tests of an AND that has no other use, return
+/// its DCPU16 condition code and replace LHS and RHS by the operands of the
+/// AND.
+static DCPU16CC::CondCodes GetBitTestCC(ISD::CondCode CC,
+                                        SDValue &LHS, SDValue &RHS) {
+  if (CC != ISD::SETEQ && CC != ISD::SETNE)
+    return DCPU16CC::COND_INVALID;
+  if (!isNullConstant(RHS) || LHS.getOpcode() != ISD::AND || !LHS.hasOneUse())
+    return DCPU16CC::COND_INVALID;
+
+  RHS = LHS.getOperand(1);
+  LHS = LHS.getOperand(0);
+  return CC == ISD::SETNE ? DCPU16CC::COND_B : DCPU16CC::COND_C;
+}
+
 SDValue DCPU16TargetLowering::LowerBR_CC(SDValue Op, SelectionDAG &DAG) const {
   SDValue Chain = Op.getOperand(0);
   ISD::CondCode CC = cast<CondCodeSDNode>(Op.getOperand(1))->get();
@@ -634,6 +673,11 @@ SDValue DCPU16TargetLowering::LowerBR_CC(SDValue Op, SelectionDAG &DAG) const {
   SDValue Dest  = Op.getOperand(4);
   SDLoc   dl    = SDLoc(Op);
 
+  DCPU16CC::CondCodes TestCC = GetBitTestCC(CC, LHS, RHS);
+  if (TestCC != DCPU16CC::COND_INVALID)
+    return DAG.getNode(DCPU16ISD::BR_CC, dl, Op.getValueType(), Chain,
+                       DAG.getConstant(TestCC, dl, MVT::i16), LHS, RHS, Dest);
+
   ISD::CondCode nonEqualCC;
   if (NeedsAdditionalEqualityCC(CC, &nonEqualCC, NULL)) {
     SDValue eqCC = DAG.getConstant(DCPU16CC::COND_E, dl, MVT::i16);
@@ -655,12 +699,15 @@ SDValue DCPU16TargetLowering::LowerSELECT_CC(SDValue Op,
   ISD::CondCode CC = cast<CondCodeSDNode>(Op.getOperand(4))->get();
   SDLoc dl       = SDLoc(Op);
 
-  ISD::CondCode reverseCC;
-  if (NeedsAdditionalEqualityCC(CC, NULL, &reverseCC)) {
-    // This makes sure we only need one SELECT_CC node.
-    std::swap(TrueV, FalseV);
+  DCPU16CC::CondCodes simpleCC = GetBitTestCC(CC, LHS, RHS);
+  if (simpleCC == DCPU16CC::COND_INVALID) {
+    ISD::CondCode reverseCC;
+    if (NeedsAdditionalEqualityCC(CC, NULL, &reverseCC)) {
+      // This makes sure we only need one SELECT_CC node.
+      std::swap(TrueV, FalseV);
+    }
+    simpleCC = GetSimpleCC(reverseCC);
   }
-  DCPU16CC::CondCodes simpleCC = GetSimpleCC(reverseCC);
 
   SDVTList VTs = DAG.getVTList(Op.getValueType());
   SmallVector<SDValue, 5> Ops;
@@ -713,7 +760,7 @@ SDValue DCPU16TargetLowering::LowerRETURNADDR(SDValue Op,
   if (Depth > 0) {
     SDValue FrameAddr = LowerFRAMEADDR(Op, DAG);
     SDValue Offset =
-      DAG.getConstant(TD->getPointerSize(), dl, MVT::i16);
+      DAG.getConstant(DAG.getDataLayout().getPointerSize(), dl, MVT::i16);
     return DAG.getLoad(PtrVT, dl, DAG.getEntryNode(),
                        DAG.getNode(ISD::ADD, dl, PtrVT,
                                    FrameAddr, Offset),
@@ -751,12 +798,12 @@ SDValue DCPU16TargetLowering::LowerROT(SDValue Op,
   SDValue LHS    = Op.getOperand(0);
   SDValue RHS    = Op.getOperand(1);
 
-  unsigned Opc = IsLeft ? ISD::SHL : ISD::SRL;
-  SDVTList VTs = DAG.getVTList(VT, MVT::Glue);
-  SDValue Ops[] = {LHS, RHS};
+  unsigned Opc = IsLeft ? DCPU16ISD::SHL : DCPU16ISD::SRL;
+  SDVTList VTs = DAG.getVTList(VT, MVT::Other, MVT::Glue);
+  SDValue Ops[] = {DAG.getEntryNode(), LHS, RHS};
   SDValue ShiftNode = DAG.getNode(Opc, dl, VTs, Ops);
-  SDValue Ex = DAG.getCopyFromReg(DAG.getEntryNode(), dl, DCPU16::EX, VT,
-                                  ShiftNode.getValue(1));
+  SDValue Ex = DAG.getCopyFromReg(ShiftNode.getValue(1), dl, DCPU16::EX, VT,
+                                  ShiftNode.getValue(2));
 
   SDVTList VTs2 = DAG.getVTList(VT);
   SDValue Ops2[] = {ShiftNode, Ex};
@@ -783,6 +830,64 @@ SDValue DCPU16TargetLowering::LowerMUL_LOHI(SDValue Op,
   return DAG.getMergeValues(Ops2, dl);
 }
 
+SDValue DCPU16TargetLowering::LowerMULH(SDValue Op,
+                                        SelectionDAG &DAG,
+                                        bool Signed) const {
+  EVT VT = Op.getValueType();
+  SDLoc dl = SDLoc(Op);
+
+  SDVTList VTs = DAG.getVTList(VT, MVT::Other, MVT::Glue);
+  SDValue Ops[] = {DAG.getEntryNode(), Op.getOperand(0), Op.getOperand(1)};
+  SDValue Lo = DAG.getNode(Signed ? DCPU16ISD::SMUL : DCPU16ISD::UMUL,
+                           dl, VTs, Ops);
+  return DAG.getCopyFromReg(Lo.getValue(1), dl, DCPU16::EX, VT, Lo.getValue(2));
+}
+
+SDValue DCPU16TargetLowering::LowerShiftParts(SDValue Op,
+                                              SelectionDAG &DAG) const {
+  EVT VT = Op.getValueType();
+  SDLoc dl = SDLoc(Op);
+
+  SDValue Lo  = Op.getOperand(0);
+  SDValue Hi  = Op.getOperand(1);
+  SDValue Amt = Op.getOperand(2);
+
+  // Shift the half the bits leave first, and add what it leaves in EX to the
+  // other half. EX gets the bits of a 32-bit shift, so this holds for all the
+  // amounts up to 31:
+  //   SHL lo, amt   SHL hi, amt   BOR hi, EX
+  //   SHR hi, amt   SHR lo, amt   BOR lo, EX
+  bool IsLeft = Op.getOpcode() == ISD::SHL_PARTS;
+  SDValue From = IsLeft ? Lo : Hi;
+  SDValue To   = IsLeft ? Hi : Lo;
+  unsigned FromOpc = IsLeft ? DCPU16ISD::SHL :
+    Op.getOpcode() == ISD::SRA_PARTS ? DCPU16ISD::SRA : DCPU16ISD::SRL;
+  unsigned ToOpc = IsLeft ? DCPU16ISD::SHL : DCPU16ISD::SRL;
+
+  SDVTList VTs = DAG.getVTList(VT, MVT::Other, MVT::Glue);
+  SDValue Ops[] = {DAG.getEntryNode(), From, Amt};
+  SDValue FromOut = DAG.getNode(FromOpc, dl, VTs, Ops);
+  SDValue Ex = DAG.getCopyFromReg(FromOut.getValue(1), dl, DCPU16::EX, VT,
+                                  FromOut.getValue(2));
+  SDValue Ops2[] = {Ex.getValue(1), To, Amt};
+  SDValue ToOut = DAG.getNode(ISD::OR, dl, VT,
+                              DAG.getNode(ToOpc, dl, VTs, Ops2), Ex);
+
+  // ASR leaves the bits in EX without the sign, which the low half needs
+  // once the amount goes past 16.
+  if (FromOpc == DCPU16ISD::SRA) {
+    SDValue Fifteen = DAG.getConstant(15, dl, VT);
+    SDValue Sixteen = DAG.getConstant(16, dl, VT);
+    SDValue Far = DAG.getNode(ISD::SRA, dl, VT, Hi,
+                              DAG.getNode(ISD::AND, dl, VT, Amt, Fifteen));
+    ToOut = DAG.getSelectCC(dl, DAG.getNode(ISD::AND, dl, VT, Amt, Sixteen),
+                            DAG.getConstant(0, dl, VT), Far, ToOut, ISD::SETNE);
+  }
+
+  SDValue Parts[] = {IsLeft ? FromOut : ToOut, IsLeft ? ToOut : FromOut};
+  return DAG.getMergeValues(Parts, dl);
+}
+
 SDValue DCPU16TargetLowering::LowerJumpTable(SDValue Op,
                                              SelectionDAG &DAG) const {
   JumpTableSDNode *JT = cast<JumpTableSDNode>(Op);
@@ -792,9 +897,125 @@ SDValue DCPU16TargetLowering::LowerJumpTable(SDValue Op,
   return DAG.getNode(DCPU16ISD::Wrapper, dl, MVT::i16, TJT);
 }
 
+//===----------------------------------------------------------------------===//
+//                      DCPU16 Optimization Hooks
+//===----------------------------------------------------------------------===//
+
+/// getMULHU32 - Return the high half of the 64-bit product of the i32 value X
+/// and the constant M. It is built from the products of the 16-bit halves,
+/// each of which the type legalizer turns into one MUL and a read of EX.
+static SDValue getMULHU32(SDValue X, uint32_t M, const SDLoc &dl,
+                          SelectionDAG &DAG) {
+  EVT VT = MVT::i32;
+  SDValue Sixteen = DAG.getConstant(16, dl, MVT::i16);
+  SDValue LoMask = DAG.getConstant(0xffff, dl, VT);
+  SDValue XL = DAG.getNode(ISD::AND, dl, VT, X, LoMask);
+  SDValue XH = DAG.getNode(ISD::SRL, dl, VT, X, Sixteen);
+  SDValue ML = DAG.getConstant(M & 0xffff, dl, VT);
+  SDValue MH = DAG.getConstant(M >> 16, dl, VT);
+
+  // Hacker's Delight, mulhu: none of the partial sums overflows 32 bits.
+  SDValue P = DAG.getNode(ISD::MUL, dl, VT, XL, ML);
+  SDValue T = DAG.getNode(ISD::ADD, dl, VT,
+                          DAG.getNode(ISD::MUL, dl, VT, XH, ML),
+                          DAG.getNode(ISD::SRL, dl, VT, P, Sixteen));
+  SDValue U = DAG.getNode(ISD::ADD, dl, VT,
+                          DAG.getNode(ISD::MUL, dl, VT, XL, MH),
+                          DAG.getNode(ISD::AND, dl, VT, T, LoMask));
+  SDValue Hi = DAG.getNode(ISD::ADD, dl, VT,
+                           DAG.getNode(ISD::MUL, dl, VT, XH, MH),
+                           DAG.getNode(ISD::SRL, dl, VT, T, Sixteen));
+  return DAG.getNode(ISD::ADD, dl, VT, Hi,
+                     DAG.getNode(ISD::SRL, dl, VT, U, Sixteen));
+}
+
+/// PerformDIVCombine - Turn an i32 division by a constant into the sequences
+/// of TargetLowering::BuildUDIV and BuildSDIV, which only handle legal types.
+static SDValue PerformDIVCombine(SDNode *N,
+                                 TargetLowering::DAGCombinerInfo &DCI,
+                                 bool Signed) {
+  SelectionDAG &DAG = DCI.DAG;
+  EVT VT = N->getValueType(0);
+  ConstantSDNode *C = dyn_cast<ConstantSDNode>(N->getOperand(1));
+  if (!DCI.isBeforeLegalize() || VT != MVT::i32 || !C)
+    return SDValue();
+
+  // The libcall is smaller.
+  if (DAG.getMachineFunction().getFunction()->optForMinSize())
+    return SDValue();
+
+  // The generic combines handle 0, 1, -1 and the powers of two.
+  const APInt &Divisor = C->getAPIntValue();
+  if (!Divisor || Divisor.isPowerOf2() ||
+      (Signed && (Divisor.isAllOnesValue() || (-Divisor).isPowerOf2())))
+    return SDValue();
+
+  SDLoc dl(N);
+  SDValue X = N->getOperand(0);
+
+  if (!Signed) {
+    APInt::mu Magics = Divisor.magicu();
+    SDValue Q = X;
+
+    // Shifting out the zeros of an even divisor saves the fixup below.
+    if (Magics.a != 0 && !Divisor[0]) {
+      unsigned Shift = Divisor.countTrailingZeros();
+      Q = DAG.getNode(ISD::SRL, dl, VT, Q,
+                      DAG.getConstant(Shift, dl, MVT::i16));
+      Magics = Divisor.lshr(Shift).magicu(Shift);
+    }
+
+    Q = getMULHU32(Q, Magics.m.getZExtValue(), dl, DAG);
+    if (Magics.a == 0)
+      return DAG.getNode(ISD::SRL, dl, VT, Q,
+                         DAG.getConstant(Magics.s, dl, MVT::i16));
+
+    SDValue NPQ = DAG.getNode(ISD::SUB, dl, VT, X, Q);
+    NPQ = DAG.getNode(ISD::SRL, dl, VT, NPQ, DAG.getConstant(1, dl, MVT::i16));
+    NPQ = DAG.getNode(ISD::ADD, dl, VT, NPQ, Q);
+    return DAG.getNode(ISD::SRL, dl, VT, NPQ,
+                       DAG.getConstant(Magics.s - 1, dl, MVT::i16));
+  }
+
+  APInt::ms Magics = Divisor.magic();
+  uint32_t M = Magics.m.getZExtValue();
+
+  // The signed high product is the unsigned one, less M if X is negative and
+  // less X if M is. BuildSDIV then adds X back if M is negative and the
+  // divisor positive, and subtracts it if M is positive and the divisor
+  // negative: together, X is subtracted only for a negative divisor.
+  SDValue Sign = DAG.getNode(ISD::SRA, dl, VT, X,
+                             DAG.getConstant(31, dl, MVT::i16));
+  SDValue Q = getMULHU32(X, M, dl, DAG);
+  Q = DAG.getNode(ISD::SUB, dl, VT, Q,
+                  DAG.getNode(ISD::AND, dl, VT, Sign,
+                              DAG.getConstant(M, dl, VT)));
+  if (Divisor.isNegative())
+    Q = DAG.getNode(ISD::SUB, dl, VT, Q, X);
+
+  if (Magics.s > 0)
+    Q = DAG.getNode(ISD::SRA, dl, VT, Q,
+                    DAG.getConstant(Magics.s, dl, MVT::i16));
+
+  // Add one to a negative quotient.
+  SDValue T = DAG.getNode(ISD::SRL, dl, VT, Q,
+                          DAG.getConstant(31, dl, MVT::i16));
+  return DAG.getNode(ISD::ADD, dl, VT, Q, T);
+}
+
+SDValue DCPU16TargetLowering::PerformDAGCombine(SDNode *N,
+                                                DAGCombinerInfo &DCI) const {
+  switch (N->getOpcode()) {
+  default: break;
+  case ISD::SDIV: return PerformDIVCombine(N, DCI, true);
+  case ISD::UDIV: return PerformDIVCombine(N, DCI, false);
+  }
+  return SDValue();
+}
+
 const char *DCPU16TargetLowering::getTargetNodeName(unsigned Opcode) const {
   switch (Opcode) {
-  default: return NULL;
+  default: return nullptr;
   case DCPU16ISD::RET_FLAG:           return "DCPU16ISD::RET_FLAG";
   case DCPU16ISD::RETI_FLAG:          return "DCPU16ISD::RETI_FLAG";
   case DCPU16ISD::CALL:               return "DCPU16ISD::CALL";
@@ -803,9 +1024,16 @@ const char *DCPU16TargetLowering::getTargetNodeName(unsigned Opcode) const {
   case DCPU16ISD::SELECT_CC:          return "DCPU16ISD::SELECT_CC";
   case DCPU16ISD::SMUL:               return "DCPU16ISD::SMUL";
   case DCPU16ISD::UMUL:               return "DCPU16ISD::UMUL";
+  case DCPU16ISD::SHL:                return "DCPU16ISD::SHL";
+  case DCPU16ISD::SRL:                return "DCPU16ISD::SRL";
+  case DCPU16ISD::SRA:                return "DCPU16ISD::SRA";
   }
 }
 
 bool DCPU16TargetLowering::isIntDivCheap(EVT VT, AttributeSet Attr) const {
-  return true;
+  // DIV and DVI take a constant operand and are no slower than a multiply by
+  // a magic number would be. Wider divisions are libcalls.
+  if (VT == MVT::i16)
+    return true;
+  return Attr.hasAttribute(AttributeSet::FunctionIndex, Attribute::MinSize);
 }
\ No newline at end of file
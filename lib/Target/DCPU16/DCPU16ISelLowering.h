@@ -50,25 +50,36 @@ namespace llvm {
 
       /// Special multiplication operators that produce overflow and a chain.
       /// Operand 0 is the chain, Operands 1 and 2 are the LHS and RHS.
-      SMUL, UMUL
+      SMUL, UMUL,
+
+      /// Shifts that leave the bits shifted out in EX, like the multiplications
+      /// above. The shift amount may be up to 31: the bits of the value go out
+      /// through EX until then.
+      SHL, SRL, SRA
     };
   }
 
   class DCPU16Subtarget;
-  class DCPU16TargetMachine;
 
   class DCPU16TargetLowering : public TargetLowering {
   public:
-    explicit DCPU16TargetLowering(DCPU16TargetMachine &TM);
+    explicit DCPU16TargetLowering(const TargetMachine &TM,
+                                  const DCPU16Subtarget &STI);
 
-    virtual MVT getShiftAmountTy(EVT LHSTy) const { return MVT::i16; }
+    MVT getScalarShiftAmountTy(const DataLayout &, EVT) const override {
+      return MVT::i16;
+    }
 
     /// LowerOperation - Provide custom lowering hooks for some operations.
-    virtual SDValue LowerOperation(SDValue Op, SelectionDAG &DAG) const;
+    SDValue LowerOperation(SDValue Op, SelectionDAG &DAG) const override;
+
+    /// PerformDAGCombine - Replace the i32 divisions by a constant, which
+    /// would otherwise be libcalls, by multiplications with a magic number.
+    virtual SDValue PerformDAGCombine(SDNode *N, DAGCombinerInfo &DCI) const;
 
     /// getTargetNodeName - This method returns the name of a target specific
     /// DAG node.
-    virtual const char *getTargetNodeName(unsigned Opcode) const;
+    const char *getTargetNodeName(unsigned Opcode) const override;
 
     SDValue LowerGlobalAddress(SDValue Op, SelectionDAG &DAG) const;
     SDValue LowerBlockAddress(SDValue Op, SelectionDAG &DAG) const;
@@ -81,15 +92,18 @@ namespace llvm {
     SDValue LowerFRAMEADDR(SDValue Op, SelectionDAG &DAG) const;
     SDValue LowerROT(SDValue Op, SelectionDAG &DAG, bool IsLeft) const;
     SDValue LowerMUL_LOHI(SDValue Op, SelectionDAG &DAG, bool Signed) const;
+    SDValue LowerMULH(SDValue Op, SelectionDAG &DAG, bool Signed) const;
+    SDValue LowerShiftParts(SDValue Op, SelectionDAG &DAG) const;
     SDValue LowerJumpTable(SDValue Op, SelectionDAG &DAG) const;
     SDValue getReturnAddressFrameIndex(SelectionDAG &DAG) const;
 
     TargetLowering::ConstraintType
-    getConstraintType(const std::string &Constraint) const;
+    getConstraintType(StringRef Constraint) const override;
     std::pair<unsigned, const TargetRegisterClass*>
-    getRegForInlineAsmConstraint(const TargetRegisterInfo *RI, const StringRef Constraint, MVT VT) const;
+    getRegForInlineAsmConstraint(const TargetRegisterInfo *RI,
+                                 StringRef Constraint, MVT VT) const override;
 
-    bool isIntDivCheap(EVT VT, AttributeSet Attr) const;
+    bool isIntDivCheap(EVT VT, AttributeSet Attr) const override;
 
   private:
     SDValue LowerCCCCallTo(SDValue Chain, SDValue Callee,
@@ -115,27 +129,25 @@ namespace llvm {
                             const SDLoc &dl, SelectionDAG &DAG,
                             SmallVectorImpl<SDValue> &InVals) const;
 
-    virtual SDValue
+    SDValue
       LowerFormalArguments(SDValue Chain,
                            CallingConv::ID CallConv, bool isVarArg,
                            const SmallVectorImpl<ISD::InputArg> &Ins,
                            const SDLoc &dl, SelectionDAG &DAG,
-                           SmallVectorImpl<SDValue> &InVals) const;
+                           SmallVectorImpl<SDValue> &InVals) const override;
 
-    virtual SDValue
+    SDValue
       LowerCall(TargetLowering::CallLoweringInfo &CLI,
-                SmallVectorImpl<SDValue> &InVals) const;
+                SmallVectorImpl<SDValue> &InVals) const override;
 
-    virtual SDValue
+    SDValue
       LowerReturn(SDValue Chain,
                   CallingConv::ID CallConv, bool isVarArg,
                   const SmallVectorImpl<ISD::OutputArg> &Outs,
                   const SmallVectorImpl<SDValue> &OutVals,
-                  const SDLoc &dl, SelectionDAG &DAG) const;
+                  const SDLoc &dl, SelectionDAG &DAG) const override;
 
     const DCPU16Subtarget &Subtarget;
-    const DCPU16TargetMachine &TM;
-    const DataLayout *TD;
   };
 } // namespace llvm
 
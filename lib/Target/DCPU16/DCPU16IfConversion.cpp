@@ -0,0 +1,349 @@
+//===-- DCPU16IfConversion.cpp - Predicate short blocks with IFs ----------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// An IF of the DCPU16 skips the next instruction when its condition fails,
+// and a skipped IF skips the instruction after it as well. This pass runs
+// after block placement and replaces the branches around a single
+// instruction by an IF in front of it:
+//
+//   IFN A, 0x5                        IFE A, 0x5
+//   SET PC, .LBB0_2          =>       ADD B, 0x3
+//   ADD B, 0x3
+// .LBB0_2:
+//
+// The block that is jumped around may itself start with IFs, so that applied
+// from the inside out, this builds the chains of IFs of && conditions, out of
+// the blocks that the selection DAG creates for them. A BR_CC is an IF and a
+// SET PC, so the branch of such a condition is predicated as well.
+//
+// Diamonds with one instruction on each side become branchless selects:
+//
+//   IFE A, B                          SET C, 0x1
+//   SET PC, .LBB0_2                   IFE A, B
+//   SET C, 0x1               =>       SET C, 0x2
+//   SET PC, .LBB0_3
+// .LBB0_2:
+//   SET C, 0x2
+// .LBB0_3:
+//
+//===----------------------------------------------------------------------===//
+
+#include "DCPU16.h"
+#include "DCPU16InstrInfo.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/CodeGen/MachineFunctionPass.h"
+#include "llvm/CodeGen/MachineInstrBuilder.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetRegisterInfo.h"
+#include "llvm/Target/TargetSubtargetInfo.h"
+using namespace llvm;
+
+#undef DEBUG_TYPE
+#define DEBUG_TYPE "dcpu16-ifcvt"
+
+STATISTIC(NumTriangles, "Number of branches around one instruction removed");
+STATISTIC(NumDiamonds,  "Number of diamonds turned into selects");
+
+static cl::opt<bool> DisableDCPU16IfConversion(
+  "disable-dcpu16-ifcvt",
+  cl::Hidden,
+  cl::init(false),
+  cl::desc("Disable the predication of short blocks with IFs")
+);
+
+namespace {
+  struct DCPU16IfConversion : public MachineFunctionPass {
+    const DCPU16InstrInfo    *TII;
+    const TargetRegisterInfo *TRI;
+
+  public:
+    static char ID;
+    DCPU16IfConversion() : MachineFunctionPass(ID) { }
+
+    bool runOnMachineFunction(MachineFunction &MF);
+
+    StringRef getPassName() const {
+      return "DCPU16 IF predication";
+    }
+
+  private:
+    bool analyzeHead(MachineBasicBlock &MBB, MachineBasicBlock *&TBB,
+                     MachineBasicBlock *&FBB,
+                     SmallVectorImpl<MachineOperand> &Cond) const;
+    MachineInstr *getSkipUnit(MachineBasicBlock &MBB,
+                              MachineBasicBlock *Succ) const;
+    bool isSideBlock(MachineBasicBlock &MBB, MachineBasicBlock &Head) const;
+    bool canSpeculate(MachineInstr &U, MachineInstr &P,
+                      ArrayRef<MachineOperand> Cond) const;
+    void buildIf(MachineBasicBlock &MBB, MachineBasicBlock::iterator I,
+                 ArrayRef<MachineOperand> Cond, const DebugLoc &DL) const;
+    void eraseBlock(MachineBasicBlock &MBB, MachineBasicBlock &Head) const;
+    bool convertTriangle(MachineBasicBlock &Head);
+    bool convertDiamond(MachineBasicBlock &Head);
+  };
+}
+
+char DCPU16IfConversion::ID = 0;
+
+/// isSkippable - Return true if MI is emitted as one instruction, which an
+/// IF skips as a whole. BR_CC is an IF and a SET PC, which an IF in front of
+/// it skips as a whole too.
+static bool isSkippable(const MachineInstr &MI) {
+  switch (MI.getDesc().TSFlags & DCPU16II::SizeMask) {
+  default:
+    return false;
+  case DCPU16II::SizeSpecial:
+    return MI.getOpcode() == DCPU16::NOP;
+  case DCPU16II::Size2Bytes:
+  case DCPU16II::Size4Bytes:
+  case DCPU16II::Size6Bytes:
+    return true;
+  }
+}
+
+/// analyzeHead - Like analyzeBranch, but only for conditional branches.
+bool DCPU16IfConversion::analyzeHead(MachineBasicBlock &MBB,
+                                     MachineBasicBlock *&TBB,
+                                     MachineBasicBlock *&FBB,
+                                     SmallVectorImpl<MachineOperand> &Cond)
+                                       const {
+  TBB = FBB = 0;
+  if (TII->analyzeBranch(MBB, TBB, FBB, Cond, false) || Cond.empty())
+    return true;
+  return TBB == &MBB;
+}
+
+/// getSkipUnit - If MBB is a sequence of IFs followed by one skippable
+/// instruction, and then possibly by a JMP to Succ, return the first
+/// instruction of the sequence. Otherwise, return null.
+MachineInstr *DCPU16IfConversion::getSkipUnit(MachineBasicBlock &MBB,
+                                              MachineBasicBlock *Succ) const {
+  SmallVector<MachineInstr *, 4> Insts;
+  for (MachineBasicBlock::iterator I = MBB.begin(), E = MBB.end();
+       I != E; ++I)
+    if (!I->isDebugValue())
+      Insts.push_back(&*I);
+
+  if (!Insts.empty() && Insts.back()->getOpcode() == DCPU16::JMP) {
+    if (Insts.back()->getOperand(0).getMBB() != Succ)
+      return 0;
+    Insts.pop_back();
+  }
+
+  if (Insts.empty() || Insts.back()->isCompare() || !isSkippable(*Insts.back()))
+    return 0;
+  for (unsigned i = 0, e = Insts.size() - 1; i != e; ++i)
+    if (!Insts[i]->isCompare())
+      return 0;
+  return Insts.front();
+}
+
+/// isSideBlock - Return true if MBB is only entered from Head, and so can be
+/// merged into it.
+bool DCPU16IfConversion::isSideBlock(MachineBasicBlock &MBB,
+                                     MachineBasicBlock &Head) const {
+  return &MBB != &Head && MBB.pred_size() == 1 && *MBB.pred_begin() == &Head &&
+         !MBB.hasAddressTaken() && !MBB.isEHPad();
+}
+
+/// canSpeculate - Return true if the instruction U can run unconditionally in
+/// front of the instruction P, which is predicated on Cond, when U should
+/// only run if P does not: P has to overwrite everything that U writes,
+/// without reading it, and U must not change the operands of Cond.
+bool DCPU16IfConversion::canSpeculate(MachineInstr &U, MachineInstr &P,
+                                      ArrayRef<MachineOperand> Cond) const {
+  if (U.mayStore() || U.isCall() || U.isTerminator() ||
+      U.hasUnmodeledSideEffects() || U.hasOrderedMemoryRef())
+    return false;
+
+  for (unsigned i = 0, e = U.getNumOperands(); i != e; ++i) {
+    const MachineOperand &MO = U.getOperand(i);
+    if (!MO.isReg() || !MO.isDef())
+      continue;
+    unsigned Reg = MO.getReg();
+    if (!P.definesRegister(Reg, TRI) || P.readsRegister(Reg, TRI))
+      return false;
+    if ((Cond[2].isReg() && TRI->regsOverlap(Reg, Cond[2].getReg())) ||
+        (Cond[3].isReg() && TRI->regsOverlap(Reg, Cond[3].getReg())))
+      return false;
+  }
+  return true;
+}
+
+/// buildIf - Insert before I an IF that lets the next instruction run only if
+/// the simple condition Cond holds.
+void DCPU16IfConversion::buildIf(MachineBasicBlock &MBB,
+                                 MachineBasicBlock::iterator I,
+                                 ArrayRef<MachineOperand> Cond,
+                                 const DebugLoc &DL) const {
+  unsigned Opcode = TII->getIfOpcode(Cond[0].getImm(), Cond[1].getImm());
+  assert(Opcode && "Cannot predicate on a complex condition code!");
+
+  // The predicated instruction may still read the operands.
+  MachineOperand LHS = Cond[2], RHS = Cond[3];
+  if (LHS.isReg())
+    LHS.setIsKill(false);
+  if (RHS.isReg())
+    RHS.setIsKill(false);
+  BuildMI(MBB, I, DL, TII->get(Opcode)).addOperand(LHS).addOperand(RHS);
+}
+
+/// eraseBlock - Erase MBB, whose successors Head takes over.
+void DCPU16IfConversion::eraseBlock(MachineBasicBlock &MBB,
+                                    MachineBasicBlock &Head) const {
+  Head.removeSuccessor(&MBB);
+  while (!MBB.succ_empty()) {
+    MachineBasicBlock *Succ = *MBB.succ_begin();
+    if (!Head.isSuccessor(Succ))
+      Head.addSuccessor(Succ);
+    MBB.removeSuccessor(MBB.succ_begin());
+  }
+  MBB.eraseFromParent();
+}
+
+/// convertTriangle - Predicate the block that Head branches around, when it
+/// is a skip unit, and merge it into Head.
+bool DCPU16IfConversion::convertTriangle(MachineBasicBlock &Head) {
+  MachineBasicBlock *TBB, *FBB;
+  SmallVector<MachineOperand, 4> Cond;
+  if (analyzeHead(Head, TBB, FBB, Cond))
+    return false;
+
+  MachineFunction::iterator Next = std::next(Head.getIterator());
+  if (Next == Head.getParent()->end())
+    return false;
+  MachineBasicBlock &Body = *Next;
+  if (TBB == &Body || (FBB && FBB != &Body) || !isSideBlock(Body, Head))
+    return false;
+
+  // The body has to continue at the target of the branch, either through a
+  // JMP or by falling through into it.
+  MachineBasicBlock *Tail = TBB;
+  MachineInstr *First = getSkipUnit(Body, Tail);
+  if (!First || !Body.isSuccessor(Tail))
+    return false;
+  MachineBasicBlock::iterator Last = Body.getLastNonDebugInstr();
+  if (Last->getOpcode() != DCPU16::JMP && !Body.isLayoutSuccessor(Tail))
+    return false;
+
+  // The body runs when the branch is not taken.
+  if (TII->reverseBranchCondition(Cond) ||
+      !TII->getIfOpcode(Cond[0].getImm(), Cond[1].getImm()))
+    return false;
+
+  DEBUG(dbgs() << "IF-predicating BB#" << Body.getNumber()
+               << " into BB#" << Head.getNumber() << '\n');
+  DebugLoc DL = Head.getFirstTerminator()->getDebugLoc();
+  TII->removeBranch(Head);
+  buildIf(Head, Head.end(), Cond, DL);
+  Head.splice(Head.end(), &Body, Body.begin(), Body.end());
+  eraseBlock(Body, Head);
+  ++NumTriangles;
+  return true;
+}
+
+/// convertDiamond - Turn a branch to one of two single instructions, which
+/// both continue at the same block, into a select.
+bool DCPU16IfConversion::convertDiamond(MachineBasicBlock &Head) {
+  MachineBasicBlock *TBB, *FBB;
+  SmallVector<MachineOperand, 4> Cond;
+  if (analyzeHead(Head, TBB, FBB, Cond))
+    return false;
+
+  MachineFunction::iterator Next = std::next(Head.getIterator());
+  if (Next == Head.getParent()->end())
+    return false;
+  MachineBasicBlock &Fall = *Next, &Taken = *TBB;
+  if (&Taken == &Fall || (FBB && FBB != &Fall) ||
+      !isSideBlock(Fall, Head) || !isSideBlock(Taken, Head) ||
+      Fall.succ_size() != 1 || Taken.succ_size() != 1)
+    return false;
+
+  MachineBasicBlock *Tail = *Fall.succ_begin();
+  if (*Taken.succ_begin() != Tail || Tail == &Fall || Tail == &Taken)
+    return false;
+
+  // Each side is one instruction that is not a branch or an IF.
+  MachineInstr *X = getSkipUnit(Fall, Tail), *Y = getSkipUnit(Taken, Tail);
+  if (!X || !Y || X->isBranch() || Y->isBranch() ||
+      X->isCompare() || Y->isCompare())
+    return false;
+
+  SmallVector<MachineOperand, 4> RevCond(Cond.begin(), Cond.end());
+  bool CanReverse = !TII->reverseBranchCondition(RevCond) &&
+                    TII->getIfOpcode(RevCond[0].getImm(), RevCond[1].getImm());
+  bool CanPredicate = TII->getIfOpcode(Cond[0].getImm(), Cond[1].getImm());
+
+  // Prefer running one side unconditionally, and predicating the other one
+  // to overwrite its result. Otherwise, predicate both of them, the second
+  // one on a condition that the first must not have changed.
+  DebugLoc DL = Head.getFirstTerminator()->getDebugLoc();
+  MachineBasicBlock::iterator I = Head.getFirstTerminator();
+  if (CanPredicate && canSpeculate(*X, *Y, Cond)) {
+    Head.splice(I, &Fall, X);
+    buildIf(Head, I, Cond, DL);
+    Head.splice(I, &Taken, Y);
+  } else if (CanReverse && canSpeculate(*Y, *X, RevCond)) {
+    Head.splice(I, &Taken, Y);
+    buildIf(Head, I, RevCond, DL);
+    Head.splice(I, &Fall, X);
+  } else if (CanPredicate && CanReverse && !X->isCall() &&
+             !(Cond[2].isReg() && X->modifiesRegister(Cond[2].getReg(), TRI)) &&
+             !(Cond[3].isReg() && X->modifiesRegister(Cond[3].getReg(), TRI))) {
+    buildIf(Head, I, RevCond, DL);
+    Head.splice(I, &Fall, X);
+    buildIf(Head, I, Cond, DL);
+    Head.splice(I, &Taken, Y);
+  } else {
+    return false;
+  }
+
+  DEBUG(dbgs() << "IF-predicating BB#" << Fall.getNumber() << " and BB#"
+               << Taken.getNumber() << " into BB#" << Head.getNumber() << '\n');
+  TII->removeBranch(Head);
+  eraseBlock(Fall, Head);
+  eraseBlock(Taken, Head);
+  if (!Head.isLayoutSuccessor(Tail))
+    TII->insertBranch(Head, Tail, 0, ArrayRef<MachineOperand>(), DL);
+  ++NumDiamonds;
+  return true;
+}
+
+bool DCPU16IfConversion::runOnMachineFunction(MachineFunction &MF) {
+  if (DisableDCPU16IfConversion)
+    return false;
+
+  TII = static_cast<const DCPU16InstrInfo *>(MF.getSubtarget().getInstrInfo());
+  TRI = MF.getSubtarget().getRegisterInfo();
+
+  // Work from the bottom up, so that the inner blocks of an && chain are
+  // predicated before the conditions in front of them: an IF in front of the
+  // branch of a block keeps it from being analyzed. Merging a block changes
+  // the layout, so start over after each of them.
+  bool Changed = false, LocalChange;
+  do {
+    LocalChange = false;
+    for (MachineFunction::reverse_iterator I = MF.rbegin(), E = MF.rend();
+         I != E; ++I)
+      if (convertTriangle(*I) || convertDiamond(*I)) {
+        LocalChange = true;
+        break;
+      }
+    Changed |= LocalChange;
+  } while (LocalChange);
+
+  return Changed;
+}
+
+FunctionPass *llvm::createDCPU16IfConversion() {
+  return new DCPU16IfConversion();
+}
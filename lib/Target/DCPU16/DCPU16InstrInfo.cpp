@@ -22,14 +22,17 @@
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/TargetRegistry.h"
 
-#define GET_INSTRINFO_CTOR
+#define GET_INSTRINFO_CTOR_DTOR
 #include "DCPU16GenInstrInfo.inc"
 
 using namespace llvm;
 
-DCPU16InstrInfo::DCPU16InstrInfo(DCPU16TargetMachine &tm)
+// Pin the vtable to this file.
+void DCPU16InstrInfo::anchor() {}
+
+DCPU16InstrInfo::DCPU16InstrInfo(DCPU16Subtarget &STI)
   : DCPU16GenInstrInfo(DCPU16::ADJCALLSTACKDOWN, DCPU16::ADJCALLSTACKUP),
-    RI(tm, *this), TM(tm) {}
+    RI() {}
 
 void DCPU16InstrInfo::storeRegToStackSlot(MachineBasicBlock &MBB,
                                           MachineBasicBlock::iterator MI,
@@ -78,34 +81,35 @@ void DCPU16InstrInfo::loadRegFromStackSlot(MachineBasicBlock &MBB,
     llvm_unreachable("Cannot store this register to stack slot!");
 }
 
-unsigned DCPU16InstrInfo::isLoadFromStackSlot(const MachineInstr *MI,
+unsigned DCPU16InstrInfo::isLoadFromStackSlot(const MachineInstr &MI,
                                               int &FrameIndex) const {
-  if (MI->getOpcode() == DCPU16::MOV16rm) {
-    if (MI->getOperand(1).isFI()) {
+  if (MI.getOpcode() == DCPU16::MOV16rm) {
+    if (MI.getOperand(1).isFI()) {
       // MOV reg, [SP+idx]
       // operand 0 is dest reg, 1 is frame index, 2 immediate 0
-      FrameIndex = MI->getOperand(1).getIndex();
-      return MI->getOperand(0).getReg();
+      FrameIndex = MI.getOperand(1).getIndex();
+      return MI.getOperand(0).getReg();
     }
   }
   return 0;
 }
 
-unsigned DCPU16InstrInfo::isStoreToStackSlot(const MachineInstr *MI,
+unsigned DCPU16InstrInfo::isStoreToStackSlot(const MachineInstr &MI,
                                             int &FrameIndex) const {
-  if (MI->getOpcode() == DCPU16::MOV16mr) {
-    if (MI->getOperand(0).isFI()) {
+  if (MI.getOpcode() == DCPU16::MOV16mr) {
+    if (MI.getOperand(0).isFI()) {
       // MOV [SP+idx], reg
       // operand 0 is frame index, 1 is immediate 0, 2 is register
-      FrameIndex = MI->getOperand(0).getIndex();
-      return MI->getOperand(2).getReg();
+      FrameIndex = MI.getOperand(0).getIndex();
+      return MI.getOperand(2).getReg();
     }
   }
   return 0;
 }
 
 void DCPU16InstrInfo::copyPhysReg(MachineBasicBlock &MBB,
-                                  MachineBasicBlock::iterator I, DebugLoc DL,
+                                  MachineBasicBlock::iterator I,
+                                  const DebugLoc &DL,
                                   unsigned DestReg, unsigned SrcReg,
                                   bool KillSrc) const {
 
@@ -129,7 +133,11 @@ static bool isBR_CC(unsigned Opcode) {
   }
 }
 
-unsigned DCPU16InstrInfo::RemoveBranch(MachineBasicBlock &MBB) const {
+unsigned DCPU16InstrInfo::removeBranch(MachineBasicBlock &MBB,
+                                       int *BytesRemoved) const {
+  if (BytesRemoved)
+    *BytesRemoved = 0;
+
   MachineBasicBlock::iterator I = MBB.end();
   unsigned Count = 0;
 
@@ -143,6 +151,8 @@ unsigned DCPU16InstrInfo::RemoveBranch(MachineBasicBlock &MBB) const {
         I->getOpcode() != DCPU16::Bm)
       break;
     // Remove the branch.
+    if (BytesRemoved)
+      *BytesRemoved += getInstSizeInBytes(*I);
     I->eraseFromParent();
     I = MBB.end();
     ++Count;
@@ -152,7 +162,7 @@ unsigned DCPU16InstrInfo::RemoveBranch(MachineBasicBlock &MBB) const {
 }
 
 bool DCPU16InstrInfo::
-ReverseBranchCondition(SmallVectorImpl<MachineOperand> &Cond) const {
+reverseBranchCondition(SmallVectorImpl<MachineOperand> &Cond) const {
   assert(Cond.size() == 4 && "Invalid BR_CC condition!");
 
   DCPU16CC::CondCodes CC = static_cast<DCPU16CC::CondCodes>(Cond[1].getImm());
@@ -217,11 +227,11 @@ static bool AcceptsAdditionalEqualityCheck(DCPU16CC::CondCodes simpleCC,
   *complexCC = simpleCC;
   switch (simpleCC) {
   default: llvm_unreachable("Invalid comparison code!");
+  // Not a simple CC, already contains an equality.
   case DCPU16CC::COND_GE:
   case DCPU16CC::COND_LE:
   case DCPU16CC::COND_AE:
   case DCPU16CC::COND_UE:
-    llvm_unreachable("Not a simple CC, already contains an equality!");
   case DCPU16CC::COND_B:
   case DCPU16CC::COND_C:
   case DCPU16CC::COND_E:
@@ -242,7 +252,16 @@ static bool AcceptsAdditionalEqualityCheck(DCPU16CC::CondCodes simpleCC,
   }
 }
 
-bool DCPU16InstrInfo::AnalyzeBranch(MachineBasicBlock &MBB,
+/// isSameComparison - Return true if the operands LHS and RHS of an IFE are
+/// the ones of the condition Cond, in either order.
+static bool isSameComparison(const MachineOperand &LHS,
+                             const MachineOperand &RHS,
+                             ArrayRef<MachineOperand> Cond) {
+  return (LHS.isIdenticalTo(Cond[2]) && RHS.isIdenticalTo(Cond[3])) ||
+         (LHS.isIdenticalTo(Cond[3]) && RHS.isIdenticalTo(Cond[2]));
+}
+
+bool DCPU16InstrInfo::analyzeBranch(MachineBasicBlock &MBB,
                                     MachineBasicBlock *&TBB,
                                     MachineBasicBlock *&FBB,
                                     SmallVectorImpl<MachineOperand> &Cond,
@@ -256,9 +275,13 @@ bool DCPU16InstrInfo::AnalyzeBranch(MachineBasicBlock &MBB,
       continue;
 
     // Working from the bottom, when we see a non-terminator
-    // instruction, we're done.
-    if (!isUnpredicatedTerminator(*I))
+    // instruction, we're done. If it is an IF, the branches below it are
+    // skipped when it fails, which a condition cannot describe.
+    if (!isUnpredicatedTerminator(*I)) {
+      if (I->isCompare())
+        return true;
       break;
+    }
 
     // A terminator that isn't a branch can't easily be handled
     // by this analysis.
@@ -281,11 +304,11 @@ bool DCPU16InstrInfo::AnalyzeBranch(MachineBasicBlock &MBB,
       while (std::next(I) != MBB.end())
         std::next(I)->eraseFromParent();
       Cond.clear();
-      FBB = 0;
+      FBB = nullptr;
 
       // Delete the JMP if it's equivalent to a fall-through.
       if (MBB.isLayoutSuccessor(I->getOperand(0).getMBB())) {
-        TBB = 0;
+        TBB = nullptr;
         I->eraseFromParent();
         I = MBB.end();
         continue;
@@ -320,17 +343,18 @@ bool DCPU16InstrInfo::AnalyzeBranch(MachineBasicBlock &MBB,
     assert(Cond.size() == 4);
     assert(TBB);
 
-    // Is it a complex CC?
+    // Two conditional branches can only be described together if they make
+    // up a complex CC: an IFE and a strict comparison of the same operands,
+    // to the same block.
     DCPU16CC::CondCodes complexCC;
-    if ((BranchCode == DCPU16CC::COND_E)
-        && AcceptsAdditionalEqualityCheck((DCPU16CC::CondCodes) Cond[1].getImm(), &complexCC)
-        && (TBB == I->getOperand(3).getMBB())
-        // This should actually check for equality but that's just too much code...
-        && (((Cond[2].getType() == LHS.getType()) && (Cond[3].getType() == RHS.getType()))
-          || ((Cond[2].getType() == RHS.getType()) && (Cond[3].getType() == LHS.getType())))) {
-
-      Cond[1] = MachineOperand::CreateImm(complexCC);
-    }
+    if (BranchCode != DCPU16CC::COND_E ||
+        TBB != I->getOperand(3).getMBB() ||
+        !AcceptsAdditionalEqualityCheck(
+          static_cast<DCPU16CC::CondCodes>(Cond[1].getImm()), &complexCC) ||
+        !isSameComparison(LHS, RHS, Cond))
+      return true;
+
+    Cond[1] = MachineOperand::CreateImm(complexCC);
   }
 
   return false;
@@ -366,19 +390,24 @@ static bool IsComplexCC(DCPU16CC::CondCodes cc,
 }
 
 unsigned
-DCPU16InstrInfo::InsertBranch(MachineBasicBlock &MBB, MachineBasicBlock *TBB,
+DCPU16InstrInfo::insertBranch(MachineBasicBlock &MBB, MachineBasicBlock *TBB,
                               MachineBasicBlock *FBB,
-                              const SmallVectorImpl<MachineOperand> &Cond,
-                              DebugLoc DL) const {
+                              ArrayRef<MachineOperand> Cond,
+                              const DebugLoc &DL, int *BytesAdded) const {
   // Shouldn't be a fall through.
-  assert(TBB && "InsertBranch must not be told to insert a fallthrough");
+  assert(TBB && "insertBranch must not be told to insert a fallthrough");
   assert((Cond.size() == 4 || Cond.size() == 0) &&
          "DCPU16 branch conditions have four components!");
 
+  if (BytesAdded)
+    *BytesAdded = 0;
+
   if (Cond.empty()) {
     // Unconditional branch?
     assert(!FBB && "Unconditional branch with multiple successors!");
-    BuildMI(&MBB, DL, get(DCPU16::JMP)).addMBB(TBB);
+    MachineInstr *MI = BuildMI(&MBB, DL, get(DCPU16::JMP)).addMBB(TBB);
+    if (BytesAdded)
+      *BytesAdded += getInstSizeInBytes(*MI);
     return 1;
   }
 
@@ -392,32 +421,66 @@ DCPU16InstrInfo::InsertBranch(MachineBasicBlock &MBB, MachineBasicBlock *TBB,
   // Is it a complex CC?
   DCPU16CC::CondCodes simpleCC;
   if (IsComplexCC(CC, &simpleCC)) {
-    BuildMI(&MBB, DL, get(Opcode))
+    MachineInstr *MI = BuildMI(&MBB, DL, get(Opcode))
       .addImm(DCPU16CC::COND_E)
       .addOperand(LHS).addOperand(RHS)
       .addMBB(TBB);
+    if (BytesAdded)
+      *BytesAdded += getInstSizeInBytes(*MI);
     CC = simpleCC;
     ++Count;
   }
-  BuildMI(&MBB, DL, get(Opcode))
+  MachineInstr *MI = BuildMI(&MBB, DL, get(Opcode))
     .addImm(CC)
     .addOperand(LHS).addOperand(RHS)
     .addMBB(TBB);
+  if (BytesAdded)
+    *BytesAdded += getInstSizeInBytes(*MI);
   ++Count;
 
   if (FBB) {
     // Two-way Conditional branch. Insert the second branch.
-    BuildMI(&MBB, DL, get(DCPU16::JMP)).addMBB(FBB);
+    MI = BuildMI(&MBB, DL, get(DCPU16::JMP)).addMBB(FBB);
+    if (BytesAdded)
+      *BytesAdded += getInstSizeInBytes(*MI);
     ++Count;
   }
   return Count;
 }
 
-/// GetInstSize - Return the number of bytes of code the specified
+unsigned DCPU16InstrInfo::getIfOpcode(unsigned BrOpcode, unsigned CC) const {
+  // The IF instructions by condition code, in the operand forms of BR_CCrr,
+  // BR_CCri, BR_CCir and BR_CCii.
+  static const unsigned IfOpcodes[][4] = {
+    { DCPU16::IFB16rr, DCPU16::IFB16ri, DCPU16::IFB16ir, DCPU16::IFB16ii },
+    { DCPU16::IFC16rr, DCPU16::IFC16ri, DCPU16::IFC16ir, DCPU16::IFC16ii },
+    { DCPU16::IFE16rr, DCPU16::IFE16ri, DCPU16::IFE16ir, DCPU16::IFE16ii },
+    { DCPU16::IFN16rr, DCPU16::IFN16ri, DCPU16::IFN16ir, DCPU16::IFN16ii },
+    { DCPU16::IFG16rr, DCPU16::IFG16ri, DCPU16::IFG16ir, DCPU16::IFG16ii },
+    { DCPU16::IFA16rr, DCPU16::IFA16ri, DCPU16::IFA16ir, DCPU16::IFA16ii },
+    { DCPU16::IFL16rr, DCPU16::IFL16ri, DCPU16::IFL16ir, DCPU16::IFL16ii },
+    { DCPU16::IFU16rr, DCPU16::IFU16ri, DCPU16::IFU16ir, DCPU16::IFU16ii }
+  };
+
+  unsigned Form;
+  switch (BrOpcode) {
+  default: llvm_unreachable("Not a BR_CC opcode!");
+  case DCPU16::BR_CCrr: Form = 0; break;
+  case DCPU16::BR_CCri: Form = 1; break;
+  case DCPU16::BR_CCir: Form = 2; break;
+  case DCPU16::BR_CCii: Form = 3; break;
+  }
+
+  if (CC > DCPU16CC::COND_U)
+    return 0;
+  return IfOpcodes[CC][Form];
+}
+
+/// getInstSizeInBytes - Return the number of bytes of code the specified
 /// instruction may be.  This returns the maximum number of bytes.
 ///
-unsigned DCPU16InstrInfo::GetInstSizeInBytes(const MachineInstr *MI) const {
-  const MCInstrDesc &Desc = MI->getDesc();
+unsigned DCPU16InstrInfo::getInstSizeInBytes(const MachineInstr &MI) const {
+  const MCInstrDesc &Desc = MI.getDesc();
 
   switch (Desc.TSFlags & DCPU16II::SizeMask) {
   default:
@@ -430,9 +493,9 @@ unsigned DCPU16InstrInfo::GetInstSizeInBytes(const MachineInstr *MI) const {
     case TargetOpcode::DBG_VALUE:
       return 0;
     case TargetOpcode::INLINEASM: {
-      const MachineFunction *MF = MI->getParent()->getParent();
+      const MachineFunction *MF = MI.getParent()->getParent();
       const TargetInstrInfo &TII = *MF->getSubtarget().getInstrInfo();
-      return TII.getInlineAsmLength(MI->getOperand(0).getSymbolName(),
+      return TII.getInlineAsmLength(MI.getOperand(0).getSymbolName(),
                                     *MF->getTarget().getMCAsmInfo());
     }
     }
@@ -10,11 +10,10 @@
 //
 //===----------------------------------------------------------------------===//
 
-#define DEBUG_TYPE "DCPU16-peephole"
 #include "DCPU16.h"
 #include "DCPU16TargetMachine.h"
 #include "DCPU16InstrInfo.h"
-#include "llvm/Constants.h"
+#include "llvm/IR/Constants.h"
 #include "llvm/PassSupport.h"
 #include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/Statistic.h"
@@ -31,10 +30,11 @@
 #include "llvm/Target/TargetInstrInfo.h"
 #include "llvm/MC/MCSymbol.h"
 #include <algorithm>
-#include <iostream>
 
 using namespace llvm;
 
+#define DEBUG_TYPE "DCPU16-peephole"
+
 static cl::opt<bool> DisableDCPU16Peephole(
   "disable-dcpu16-peephole",
   cl::Hidden,
@@ -61,15 +61,15 @@ namespace {
     static char ID;
     DCPU16Peephole() : MachineFunctionPass(ID) { }
 
-    bool runOnMachineFunction(MachineFunction &MF);
+    bool runOnMachineFunction(MachineFunction &MF) override;
     void runOptBrcc(MachineBasicBlock *mbb);
     bool swapOptBrcc(MachineInstr *brInstr, MachineInstr *andInstr);
 
-    const char *getPassName() const {
+    StringRef getPassName() const override {
       return "DCPU16 optimize conditional branches";
     }
 
-    void getAnalysisUsage(AnalysisUsage &AU) const {
+    void getAnalysisUsage(AnalysisUsage &AU) const override {
       MachineFunctionPass::getAnalysisUsage(AU);
     }
   };
@@ -129,7 +129,7 @@ void DCPU16Peephole::runOptBrcc(MachineBasicBlock *mbb) {
   DenseMap<unsigned, MachineInstr *> peepholeMap;
   
   for(MachineBasicBlock::iterator miiIter = mbb->begin(); miiIter != mbb->end(); ++miiIter) {
-    MachineInstr *instruction = miiIter;  
+    MachineInstr *instruction = &*miiIter;  
     
     switch(instruction->getOpcode()) {
       // And instructions
@@ -177,8 +177,9 @@ void DCPU16Peephole::runOptBrcc(MachineBasicBlock *mbb) {
 }
 
 bool DCPU16Peephole::runOnMachineFunction(MachineFunction &MF) {
-  QII = static_cast<const DCPU16InstrInfo *>(MF.getTarget().getInstrInfo());
-  QRI = static_cast<const DCPU16RegisterInfo *>(MF.getTarget().getRegisterInfo());
+  QII = static_cast<const DCPU16InstrInfo *>(MF.getSubtarget().getInstrInfo());
+  QRI = static_cast<const DCPU16RegisterInfo *>(
+      MF.getSubtarget().getRegisterInfo());
   MRI = &MF.getRegInfo();
   
   // Disable all peephole optimisations
@@ -186,7 +187,7 @@ bool DCPU16Peephole::runOnMachineFunction(MachineFunction &MF) {
 
   // Loop over all of the basic blocks.
   for(MachineFunction::iterator mbbIter = MF.begin(); mbbIter != MF.end(); ++mbbIter) {
-    MachineBasicBlock *mbb = mbbIter;
+    MachineBasicBlock *mbb = &*mbbIter;
     
     if(!DisableOptBrcc) runOptBrcc(mbb);
   } // Basic Block
@@ -11,43 +11,40 @@
 //
 //===----------------------------------------------------------------------===//
 
-#define DEBUG_TYPE "dcpu16-reg-info"
-
 #include "DCPU16RegisterInfo.h"
 #include "DCPU16.h"
 #include "DCPU16MachineFunctionInfo.h"
 #include "DCPU16TargetMachine.h"
-#include "llvm/Function.h"
 #include "llvm/CodeGen/MachineFrameInfo.h"
 #include "llvm/CodeGen/MachineFunction.h"
 #include "llvm/CodeGen/MachineInstrBuilder.h"
+#include "llvm/IR/Function.h"
 #include "llvm/Target/TargetMachine.h"
 #include "llvm/Target/TargetOptions.h"
 #include "llvm/ADT/BitVector.h"
 #include "llvm/Support/ErrorHandling.h"
 
+using namespace llvm;
+
+#define DEBUG_TYPE "dcpu16-reg-info"
+
 #define GET_REGINFO_TARGET_DESC
 #include "DCPU16GenRegisterInfo.inc"
 
-using namespace llvm;
-
 // FIXME: Provide proper call frame setup / destroy opcodes.
-DCPU16RegisterInfo::DCPU16RegisterInfo(DCPU16TargetMachine &tm,
-                                       const TargetInstrInfo &tii)
-  : DCPU16GenRegisterInfo(DCPU16::A), TM(tm), TII(tii) {
-  StackAlign = TM.getFrameLowering()->getStackAlignment();
-}
+DCPU16RegisterInfo::DCPU16RegisterInfo()
+  : DCPU16GenRegisterInfo(DCPU16::A) {}
 
-const uint16_t*
+const MCPhysReg*
 DCPU16RegisterInfo::getCalleeSavedRegs(const MachineFunction *MF) const {
   const Function* F = MF->getFunction();
-  static const uint16_t CalleeSavedRegs[] = {
+  static const MCPhysReg CalleeSavedRegs[] = {
     DCPU16::X, DCPU16::Y, DCPU16::Z, DCPU16::I, DCPU16::J,
     0
   };
   // In interrupt handlers, the caller has to save all registers except A.
   // This includes EX.
-  static const uint16_t CalleeSavedRegsIntr[] = {
+  static const MCPhysReg CalleeSavedRegsIntr[] = {
     DCPU16::EX,
     DCPU16::B, DCPU16::C,
     DCPU16::X, DCPU16::Y, DCPU16::Z, DCPU16::I, DCPU16::J,
@@ -59,7 +56,8 @@ DCPU16RegisterInfo::getCalleeSavedRegs(const MachineFunction *MF) const {
 }
 
 const uint32_t*
-DCPU16RegisterInfo::getCallPreservedMask(CallingConv::ID CallConv) const {
+DCPU16RegisterInfo::getCallPreservedMask(const MachineFunction &MF,
+                                         CallingConv::ID CallConv) const {
     switch(CallConv) {
         default:
             llvm_unreachable("Unsupported calling convention");
@@ -71,7 +69,7 @@ DCPU16RegisterInfo::getCallPreservedMask(CallingConv::ID CallConv) const {
 
 BitVector DCPU16RegisterInfo::getReservedRegs(const MachineFunction &MF) const {
   BitVector Reserved(getNumRegs());
-  const TargetFrameLowering *TFI = MF.getTarget().getFrameLowering();
+  const TargetFrameLowering *TFI = MF.getSubtarget().getFrameLowering();
 
   // Mark 2 special registers as reserved.
   Reserved.set(DCPU16::EX);
@@ -90,93 +88,29 @@ DCPU16RegisterInfo::getPointerRegClass(const MachineFunction &MF,
   return &DCPU16::GR16RegClass;
 }
 
-void DCPU16RegisterInfo::
-eliminateCallFramePseudoInstr(MachineFunction &MF, MachineBasicBlock &MBB,
-                              MachineBasicBlock::iterator I) const {
-  const TargetFrameLowering *TFI = MF.getTarget().getFrameLowering();
-
-  if (!TFI->hasReservedCallFrame(MF)) {
-    // If the stack pointer can be changed after prologue, turn the
-    // adjcallstackup instruction into a 'sub SP, <amt>' and the
-    // adjcallstackdown instruction into 'add SP, <amt>'
-    // TODO: consider using push / pop instead of sub + store / add
-    MachineInstr *Old = I;
-    uint64_t Amount = Old->getOperand(0).getImm();
-    if (Amount != 0) {
-      // We need to keep the stack aligned properly.  To do this, we round the
-      // amount of space needed for the outgoing arguments up to the next
-      // alignment boundary.
-      Amount = (Amount+StackAlign-1)/StackAlign*StackAlign;
-
-      MachineInstr *New = 0;
-      if (Old->getOpcode() == TII.getCallFrameSetupOpcode()) {
-        New = BuildMI(MF, Old->getDebugLoc(),
-                      TII.get(DCPU16::SUB16ri), DCPU16::SP)
-          .addReg(DCPU16::SP).addImm(Amount);
-      } else {
-        assert(Old->getOpcode() == TII.getCallFrameDestroyOpcode());
-        // factor out the amount the callee already popped.
-        uint64_t CalleeAmt = Old->getOperand(1).getImm();
-        Amount -= CalleeAmt;
-        if (Amount)
-          New = BuildMI(MF, Old->getDebugLoc(),
-                        TII.get(DCPU16::ADD16ri), DCPU16::SP)
-            .addReg(DCPU16::SP).addImm(Amount);
-      }
-
-      if (New) {
-        // The SRW implicit def is dead.
-        New->getOperand(3).setIsDead();
-
-        // Replace the pseudo instruction with a new instruction...
-        MBB.insert(I, New);
-      }
-    }
-  } else if (I->getOpcode() == TII.getCallFrameDestroyOpcode()) {
-    // If we are performing frame pointer elimination and if the callee pops
-    // something off the stack pointer, add it back.
-    if (uint64_t CalleeAmt = I->getOperand(1).getImm()) {
-      MachineInstr *Old = I;
-      MachineInstr *New =
-        BuildMI(MF, Old->getDebugLoc(), TII.get(DCPU16::SUB16ri),
-                DCPU16::SP).addReg(DCPU16::SP).addImm(CalleeAmt);
-      // The SRW implicit def is dead.
-      New->getOperand(3).setIsDead();
-
-      MBB.insert(I, New);
-    }
-  }
-
-  MBB.erase(I);
-}
-
 void
 DCPU16RegisterInfo::eliminateFrameIndex(MachineBasicBlock::iterator II,
                                         int SPAdj, unsigned FIOperandNum,
                                         RegScavenger *RS) const {
   assert(SPAdj == 0 && "Unexpected");
 
-  unsigned i = 0;
   MachineInstr &MI = *II;
   MachineBasicBlock &MBB = *MI.getParent();
   MachineFunction &MF = *MBB.getParent();
-  const TargetFrameLowering *TFI = MF.getTarget().getFrameLowering();
+  const TargetFrameLowering *TFI = MF.getSubtarget().getFrameLowering();
+  const TargetInstrInfo &TII = *MF.getSubtarget().getInstrInfo();
   DebugLoc dl = MI.getDebugLoc();
-  while (!MI.getOperand(i).isFI()) {
-    ++i;
-    assert(i < MI.getNumOperands() && "Instr doesn't have FrameIndex operand!");
-  }
-
+  unsigned i = FIOperandNum;
   int FrameIndex = MI.getOperand(i).getIndex();
 
   unsigned BasePtr = (TFI->hasFP(MF) ? DCPU16::J : DCPU16::SP);
-  int Offset = MF.getFrameInfo()->getObjectOffset(FrameIndex);
+  int Offset = MF.getFrameInfo().getObjectOffset(FrameIndex);
 
   // Skip the saved PC
   Offset += 1;
 
   if (!TFI->hasFP(MF))
-    Offset += MF.getFrameInfo()->getStackSize();
+    Offset += MF.getFrameInfo().getStackSize();
 
   // Fold imm into offset
   Offset += MI.getOperand(i+1).getImm();
@@ -195,10 +129,10 @@ DCPU16RegisterInfo::eliminateFrameIndex(MachineBasicBlock::iterator II,
     // We need to materialize the offset via add instruction.
     unsigned DstReg = MI.getOperand(0).getReg();
     if (Offset < 0)
-      BuildMI(MBB, llvm::next(II), dl, TII.get(DCPU16::SUB16ri), DstReg)
+      BuildMI(MBB, std::next(II), dl, TII.get(DCPU16::SUB16ri), DstReg)
         .addReg(DstReg).addImm(-Offset);
     else
-      BuildMI(MBB, llvm::next(II), dl, TII.get(DCPU16::ADD16ri), DstReg)
+      BuildMI(MBB, std::next(II), dl, TII.get(DCPU16::ADD16ri), DstReg)
         .addReg(DstReg).addImm(Offset);
 
     return;
@@ -209,7 +143,7 @@ DCPU16RegisterInfo::eliminateFrameIndex(MachineBasicBlock::iterator II,
 }
 
 unsigned DCPU16RegisterInfo::getFrameRegister(const MachineFunction &MF) const {
-  const TargetFrameLowering *TFI = MF.getTarget().getFrameLowering();
+  const TargetFrameLowering *TFI = MF.getSubtarget().getFrameLowering();
 
   return TFI->hasFP(MF) ? DCPU16::J : DCPU16::SP;
 }
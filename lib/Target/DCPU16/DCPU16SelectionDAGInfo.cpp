@@ -11,13 +11,10 @@
 //
 //===----------------------------------------------------------------------===//
 
-#define DEBUG_TYPE "dcpu16-selectiondag-info"
-#include "DCPU16TargetMachine.h"
+#include "DCPU16SelectionDAGInfo.h"
 using namespace llvm;
 
-DCPU16SelectionDAGInfo::DCPU16SelectionDAGInfo(const DCPU16TargetMachine &TM)
-  : TargetSelectionDAGInfo(TM) {
-}
+#define DEBUG_TYPE "dcpu16-selectiondag-info"
 
 DCPU16SelectionDAGInfo::~DCPU16SelectionDAGInfo() {
 }
@@ -7,7 +7,7 @@
 //
 //===----------------------------------------------------------------------===//
 //
-// This file defines the DCPU16 subclass for TargetSelectionDAGInfo.
+// This file defines the DCPU16 subclass for SelectionDAGTargetInfo.
 //
 //===----------------------------------------------------------------------===//
 
@@ -18,12 +18,9 @@
 
 namespace llvm {
 
-class DCPU16TargetMachine;
-
 class DCPU16SelectionDAGInfo : public SelectionDAGTargetInfo {
 public:
-  explicit DCPU16SelectionDAGInfo(const DCPU16TargetMachine &TM);
-  ~DCPU16SelectionDAGInfo();
+  ~DCPU16SelectionDAGInfo() override;
 };
 
 }
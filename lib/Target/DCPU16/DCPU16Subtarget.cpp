@@ -15,20 +15,27 @@
 #include "DCPU16.h"
 #include "llvm/Support/TargetRegistry.h"
 
+using namespace llvm;
+
+#define DEBUG_TYPE "dcpu16-subtarget"
+
 #define GET_SUBTARGETINFO_TARGET_DESC
 #define GET_SUBTARGETINFO_CTOR
 #include "DCPU16GenSubtargetInfo.inc"
 
-using namespace llvm;
-
 void DCPU16Subtarget::anchor() { }
 
-DCPU16Subtarget::DCPU16Subtarget(const std::string &TT,
-                                 const std::string &CPU,
-                                 const std::string &FS) :
-  DCPU16GenSubtargetInfo(TT, CPU, FS) {
+DCPU16Subtarget &
+DCPU16Subtarget::initializeSubtargetDependencies(StringRef CPU, StringRef FS) {
+  ExtendedInsts = false;
   std::string CPUName = "generic";
 
   // Parse features string.
   ParseSubtargetFeatures(CPUName, FS);
+  return *this;
 }
+
+DCPU16Subtarget::DCPU16Subtarget(const Triple &TT, const std::string &CPU,
+                                 const std::string &FS, const TargetMachine &TM)
+  : DCPU16GenSubtargetInfo(TT, CPU, FS), FrameLowering(),
+    InstrInfo(initializeSubtargetDependencies(CPU, FS)), TLInfo(TM, *this) {}
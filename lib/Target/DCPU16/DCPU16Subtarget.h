@@ -14,6 +14,12 @@
 #ifndef LLVM_TARGET_DCPU16_SUBTARGET_H
 #define LLVM_TARGET_DCPU16_SUBTARGET_H
 
+#include "DCPU16FrameLowering.h"
+#include "DCPU16ISelLowering.h"
+#include "DCPU16InstrInfo.h"
+#include "DCPU16RegisterInfo.h"
+#include "DCPU16SelectionDAGInfo.h"
+#include "llvm/IR/DataLayout.h"
 #include "llvm/Target/TargetSubtargetInfo.h"
 #include <string>
 
@@ -26,16 +32,37 @@ class StringRef;
 class DCPU16Subtarget : public DCPU16GenSubtargetInfo {
   virtual void anchor();
   bool ExtendedInsts;
+  DCPU16FrameLowering FrameLowering;
+  DCPU16InstrInfo InstrInfo;
+  DCPU16TargetLowering TLInfo;
+  DCPU16SelectionDAGInfo TSInfo;
+
 public:
   /// This constructor initializes the data members to match that
   /// of the specified triple.
   ///
-  DCPU16Subtarget(const std::string &TT, const std::string &CPU,
-                  const std::string &FS);
+  DCPU16Subtarget(const Triple &TT, const std::string &CPU,
+                  const std::string &FS, const TargetMachine &TM);
+
+  DCPU16Subtarget &initializeSubtargetDependencies(StringRef CPU, StringRef FS);
 
   /// ParseSubtargetFeatures - Parses features string setting specified
   /// subtarget options.  Definition of function is auto generated by tblgen.
   void ParseSubtargetFeatures(StringRef CPU, StringRef FS);
+
+  const TargetFrameLowering *getFrameLowering() const override {
+    return &FrameLowering;
+  }
+  const DCPU16InstrInfo *getInstrInfo() const override { return &InstrInfo; }
+  const DCPU16RegisterInfo *getRegisterInfo() const override {
+    return &InstrInfo.getRegisterInfo();
+  }
+  const DCPU16TargetLowering *getTargetLowering() const override {
+    return &TLInfo;
+  }
+  const DCPU16SelectionDAGInfo *getSelectionDAGInfo() const override {
+    return &TSInfo;
+  }
 };
 } // End llvm namespace
 
@@ -13,9 +13,10 @@
 
 #include "DCPU16TargetMachine.h"
 #include "DCPU16.h"
-#include "MCTargetDesc/DCPU16MCAsmInfo.h"
-#include "llvm/PassManager.h"
 #include "llvm/CodeGen/Passes.h"
+#include "llvm/CodeGen/TargetLoweringObjectFileImpl.h"
+#include "llvm/CodeGen/TargetPassConfig.h"
+#include "llvm/IR/LegacyPassManager.h"
 #include "llvm/MC/MCAsmInfo.h"
 #include "llvm/Support/TargetRegistry.h"
 using namespace llvm;
@@ -25,19 +26,30 @@ extern "C" void LLVMInitializeDCPU16Target() {
   RegisterTargetMachine<DCPU16TargetMachine> X(TheDCPU16Target);
 }
 
+static Reloc::Model getEffectiveRelocModel(Optional<Reloc::Model> RM) {
+  if (!RM.hasValue())
+    return Reloc::Static;
+  return *RM;
+}
+
 DCPU16TargetMachine::DCPU16TargetMachine(const Target &T,
-                                         StringRef TT,
+                                         const Triple &TT,
                                          StringRef CPU,
                                          StringRef FS,
                                          const TargetOptions &Options,
-                                         Reloc::Model RM, CodeModel::Model CM,
+                                         Optional<Reloc::Model> RM,
+                                         CodeModel::Model CM,
                                          CodeGenOpt::Level OL)
-  : LLVMTargetMachine(T, TT, CPU, FS, Options, RM, CM, OL),
-    Subtarget(TT, CPU, FS),
-    // FIXME: Check TargetData string.
-    dataLayout("e-p:16:16:16-i8:16:16-i16:16:16-i32:16:16-s0:16:16-n16", 16),
-    InstrInfo(*this), TLInfo(*this), TSInfo(*this),
-    FrameLowering(Subtarget) { }
+  : LLVMTargetMachine(T,
+                      // The DCPU-16 addresses 16-bit words, so a byte is 16 bits.
+                      "B16-e-p:16:16:16-i8:16:16-i16:16:16-i32:16:16-s0:16:16-n16",
+                      TT, CPU, FS, Options, getEffectiveRelocModel(RM), CM, OL),
+    TLOF(make_unique<TargetLoweringObjectFileELF>()),
+    Subtarget(TT, CPU, FS, *this) {
+  initAsmInfo();
+}
+
+DCPU16TargetMachine::~DCPU16TargetMachine() {}
 
 namespace {
 /// DCPU16 Code Generator Pass Configuration Options.
@@ -50,7 +62,8 @@ public:
     return getTM<DCPU16TargetMachine>();
   }
 
-  virtual bool addInstSelector();
+  bool addInstSelector() override;
+  void addPreEmitPass() override;
 };
 } // namespace
 
@@ -65,3 +78,9 @@ bool DCPU16PassConfig::addInstSelector() {
   addPass(createDCPU16Peephole());
   return false;
 }
+
+void DCPU16PassConfig::addPreEmitPass() {
+  // Predicate short blocks with IFs once the layout is final.
+  if (getOptLevel() != CodeGenOpt::None)
+    addPass(createDCPU16IfConversion());
+}
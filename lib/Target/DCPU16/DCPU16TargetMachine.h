@@ -15,13 +15,7 @@
 #ifndef LLVM_TARGET_DCPU16_TARGETMACHINE_H
 #define LLVM_TARGET_DCPU16_TARGETMACHINE_H
 
-#include "DCPU16InstrInfo.h"
-#include "DCPU16ISelLowering.h"
-#include "DCPU16FrameLowering.h"
-#include "DCPU16SelectionDAGInfo.h"
-#include "DCPU16RegisterInfo.h"
 #include "DCPU16Subtarget.h"
-#include "llvm/IR/DataLayout.h"
 #include "llvm/Target/TargetFrameLowering.h"
 #include "llvm/Target/TargetMachine.h"
 
@@ -30,39 +24,25 @@ namespace llvm {
 /// DCPU16TargetMachine
 ///
 class DCPU16TargetMachine : public LLVMTargetMachine {
+  std::unique_ptr<TargetLoweringObjectFile> TLOF;
   DCPU16Subtarget        Subtarget;
-  const DataLayout       dataLayout;       // Calculates type size & alignment
-  DCPU16InstrInfo        InstrInfo;
-  DCPU16TargetLowering   TLInfo;
-  DCPU16SelectionDAGInfo TSInfo;
-  DCPU16FrameLowering    FrameLowering;
 
 public:
-  DCPU16TargetMachine(const Target &T, StringRef TT,
+  DCPU16TargetMachine(const Target &T, const Triple &TT,
                       StringRef CPU, StringRef FS, const TargetOptions &Options,
-                      Reloc::Model RM, CodeModel::Model CM,
+                      Optional<Reloc::Model> RM, CodeModel::Model CM,
                       CodeGenOpt::Level OL);
+  ~DCPU16TargetMachine() override;
 
-  virtual const TargetFrameLowering *getFrameLowering() const {
-    return &FrameLowering;
+  const DCPU16Subtarget *getSubtargetImpl(const Function &F) const override {
+    return &Subtarget;
   }
-  virtual const DCPU16InstrInfo *getInstrInfo() const  { return &InstrInfo; }
-  virtual const DataLayout *getDataLayout() const     { return &dataLayout;}
-  virtual const DCPU16Subtarget *getSubtargetImpl() const { return &Subtarget; }
 
-  virtual const TargetRegisterInfo *getRegisterInfo() const {
-    return &InstrInfo.getRegisterInfo();
-  }
-
-  virtual const DCPU16TargetLowering *getTargetLowering() const {
-    return &TLInfo;
-  }
+  TargetPassConfig *createPassConfig(PassManagerBase &PM) override;
 
-  virtual const DCPU16SelectionDAGInfo* getSelectionDAGInfo() const {
-    return &TSInfo;
+  TargetLoweringObjectFile *getObjFileLowering() const override {
+    return TLOF.get();
   }
-
-  virtual TargetPassConfig *createPassConfig(PassManagerBase &PM);
 }; // DCPU16TargetMachine.
 
 } // end namespace llvm
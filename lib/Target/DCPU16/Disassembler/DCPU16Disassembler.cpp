@@ -0,0 +1,356 @@
+//===-- DCPU16Disassembler.cpp - Disassembler for DCPU16 ------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the DCPU16Disassembler class.
+//
+// Every basic opcode has one instruction per kind of its b and a operands
+// (register, memory or literal), as in DCPU16InstrInfo.td. The decoder reads
+// the word and the next words of a and b, classifies the operands, and picks
+// the instruction from the table below; the MCInst operands are then added in
+// the order of the instruction description, duplicating tied ones.
+//
+//===----------------------------------------------------------------------===//
+
+#include "DCPU16.h"
+#include "MCTargetDesc/DCPU16MCTargetDesc.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/MC/MCDisassembler/MCDisassembler.h"
+#include "llvm/MC/MCInst.h"
+#include "llvm/MC/MCInstrDesc.h"
+#include "llvm/MC/MCRegisterInfo.h"
+#include "llvm/MC/MCSubtargetInfo.h"
+#include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/raw_ostream.h"
+using namespace llvm;
+
+#undef DEBUG_TYPE
+#define DEBUG_TYPE "dcpu16-disassembler"
+
+namespace llvm {
+extern const MCInstrDesc DCPU16Insts[];
+extern const MCRegisterClass DCPU16MCRegisterClasses[];
+}
+
+namespace {
+
+/// DCPU16Disassembler - DCPU16 disassembler for all DCPU16 platforms.
+class DCPU16Disassembler : public MCDisassembler {
+public:
+  DCPU16Disassembler(const MCSubtargetInfo &STI, MCContext &Ctx)
+    : MCDisassembler(STI, Ctx) {}
+
+  ~DCPU16Disassembler() override {}
+
+  /// getInstruction - See MCDisassembler.
+  DecodeStatus getInstruction(MCInst &Instr, uint64_t &Size,
+                              ArrayRef<uint8_t> Bytes, uint64_t Address,
+                              raw_ostream &VStream,
+                              raw_ostream &CStream) const override;
+};
+
+/// A decoded operand field.
+struct DecodedOperand {
+  enum KindTy {
+    Register,
+    Memory,
+    Literal,
+    PushPop,
+    PC
+  } Kind;
+  unsigned Reg;  // The register, or the base of a memory operand.
+  int64_t Value; // The literal, or the displacement of a memory operand.
+};
+
+// The instructions for the operand kinds of b and a. Zero marks a combination
+// that has no instruction.
+enum { RR, RI, RM, IR, II, IM, MR, MI, MM, NumOperandKinds };
+
+struct BasicOpcode {
+  unsigned Op;
+  unsigned Opcodes[NumOperandKinds];
+};
+
+} // end anonymous namespace
+
+static const BasicOpcode BasicOpcodes[] = {
+#define ARITH(OP, NAME) \
+  { OP, { DCPU16::NAME##16rr, DCPU16::NAME##16ri, DCPU16::NAME##16rm, 0, 0, 0, \
+          DCPU16::NAME##16mr, DCPU16::NAME##16mi, DCPU16::NAME##16mm } }
+#define COND(OP, NAME) \
+  { OP, { DCPU16::NAME##16rr, DCPU16::NAME##16ri, DCPU16::NAME##16rm, \
+          DCPU16::NAME##16ir, DCPU16::NAME##16ii, DCPU16::NAME##16im, \
+          DCPU16::NAME##16mr, DCPU16::NAME##16mi, DCPU16::NAME##16mm } }
+  ARITH(0x01, MOV),
+  ARITH(0x02, ADD),
+  ARITH(0x03, SUB),
+  ARITH(0x04, MUL),
+  ARITH(0x05, SMUL),
+  ARITH(0x06, DIV),
+  ARITH(0x07, DVI),
+  ARITH(0x08, UREM),
+  ARITH(0x09, SREM),
+  ARITH(0x0a, AND),
+  ARITH(0x0b, OR),
+  ARITH(0x0c, XOR),
+  ARITH(0x0d, SRL),
+  ARITH(0x0e, SRA),
+  ARITH(0x0f, SHL),
+  COND(0x10, IFB),
+  COND(0x11, IFC),
+  COND(0x12, IFE),
+  COND(0x13, IFN),
+  COND(0x14, IFG),
+  COND(0x15, IFA),
+  COND(0x16, IFL),
+  COND(0x17, IFU),
+  ARITH(0x1a, ADC),
+  ARITH(0x1b, SBC),
+  ARITH(0x1e, STI),
+  ARITH(0x1f, STD)
+#undef COND
+#undef ARITH
+};
+
+// The special opcodes, by operand kind of a.
+static const struct {
+  unsigned Op;
+  unsigned Reg, Lit, Mem;
+} SpecialOpcodes[] = {
+  { 0x01, DCPU16::CALLr, DCPU16::CALLi, DCPU16::CALLm },
+  { 0x08, DCPU16::INTr,  DCPU16::INTi,  DCPU16::INTm  },
+  { 0x09, DCPU16::IAGr,  0,             DCPU16::IAGm  },
+  { 0x0a, DCPU16::IASr,  DCPU16::IASi,  DCPU16::IASm  },
+  { 0x0c, DCPU16::IAQr,  DCPU16::IAQi,  DCPU16::IAQm  },
+  { 0x10, DCPU16::HWNr,  0,             DCPU16::HWNm  },
+  { 0x11, DCPU16::HWQr,  DCPU16::HWQi,  DCPU16::HWQm  },
+  { 0x12, DCPU16::HWIr,  DCPU16::HWIi,  DCPU16::HWIm  }
+};
+
+static const unsigned GPRDecoderTable[] = {
+  DCPU16::A, DCPU16::B, DCPU16::C, DCPU16::X,
+  DCPU16::Y, DCPU16::Z, DCPU16::I, DCPU16::J
+};
+
+static bool readWord(ArrayRef<uint8_t> Bytes, uint64_t Offset,
+                     uint16_t &Word) {
+  if (Bytes.size() < Offset + 2)
+    return false;
+  // Words are stored big-endian.
+  Word = (Bytes[Offset] << 8) | Bytes[Offset + 1];
+  return true;
+}
+
+/// decodeOperand - Decode an operand field, reading its next word, if it has
+/// one, at offset Size of Bytes.
+static bool decodeOperand(unsigned Field, ArrayRef<uint8_t> Bytes,
+                          uint64_t &Size, DecodedOperand &Op) {
+  Op.Reg = 0;
+  Op.Value = 0;
+
+  bool HasNextWord = false;
+  if (Field < 0x08) {
+    Op.Kind = DecodedOperand::Register;
+    Op.Reg = GPRDecoderTable[Field];
+  } else if (Field < 0x10) {
+    Op.Kind = DecodedOperand::Memory;
+    Op.Reg = GPRDecoderTable[Field - 0x08];
+  } else if (Field < 0x18) {
+    Op.Kind = DecodedOperand::Memory;
+    Op.Reg = GPRDecoderTable[Field - 0x10];
+    HasNextWord = true;
+  } else {
+    switch (Field) {
+    case 0x18: Op.Kind = DecodedOperand::PushPop; break;
+    case 0x19: Op.Kind = DecodedOperand::Memory; Op.Reg = DCPU16::SP; break;
+    case 0x1a:
+      Op.Kind = DecodedOperand::Memory;
+      Op.Reg = DCPU16::SP;
+      HasNextWord = true;
+      break;
+    case 0x1b: Op.Kind = DecodedOperand::Register; Op.Reg = DCPU16::SP; break;
+    case 0x1c: Op.Kind = DecodedOperand::PC; break;
+    case 0x1d: Op.Kind = DecodedOperand::Register; Op.Reg = DCPU16::EX; break;
+    case 0x1e: Op.Kind = DecodedOperand::Memory; HasNextWord = true; break;
+    case 0x1f: Op.Kind = DecodedOperand::Literal; HasNextWord = true; break;
+    default:
+      // Literals -1..30, in a only.
+      Op.Kind = DecodedOperand::Literal;
+      Op.Value = int64_t(Field) - 0x21;
+      break;
+    }
+  }
+
+  if (HasNextWord) {
+    uint16_t Word;
+    if (!readWord(Bytes, Size, Word))
+      return false;
+    Op.Value = Word;
+    Size += 2;
+  }
+  return true;
+}
+
+/// addOperands - Add the decoded operands to MI, in the order its description
+/// gives them.
+static MCDisassembler::DecodeStatus
+addOperands(MCInst &MI, const DecodedOperand *Ops, unsigned NumOps) {
+  const MCInstrDesc &Desc = DCPU16Insts[MI.getOpcode()];
+  unsigned NextOp = 0;
+  for (unsigned i = 0, e = Desc.getNumOperands(); i != e; ++i) {
+    int TiedTo = Desc.getOperandConstraint(i, MCOI::TIED_TO);
+    if (TiedTo != -1) {
+      MI.addOperand(MI.getOperand(TiedTo));
+      continue;
+    }
+
+    assert(NextOp < NumOps && "Too few operands decoded");
+    const DecodedOperand &Op = Ops[NextOp++];
+    switch (Op.Kind) {
+    default: llvm_unreachable("Operand without an MCInst operand");
+    case DecodedOperand::Register: {
+      const MCRegisterClass &RC =
+        DCPU16MCRegisterClasses[Desc.OpInfo[i].RegClass];
+      if (!RC.contains(Op.Reg))
+        return MCDisassembler::Fail;
+      MI.addOperand(MCOperand::createReg(Op.Reg));
+      break;
+    }
+    case DecodedOperand::Memory:
+      MI.addOperand(MCOperand::createReg(Op.Reg));
+      MI.addOperand(MCOperand::createImm(Op.Value));
+      ++i;
+      break;
+    case DecodedOperand::Literal:
+      MI.addOperand(MCOperand::createImm(Op.Value));
+      break;
+    }
+  }
+  assert(NextOp == NumOps && "Decoded operand without an MCInst operand");
+  return MCDisassembler::Success;
+}
+
+static unsigned getKindIndex(DecodedOperand::KindTy K) {
+  switch (K) {
+  case DecodedOperand::Register: return 0;
+  case DecodedOperand::Literal:  return 1;
+  case DecodedOperand::Memory:   return 2;
+  default:                       return ~0U;
+  }
+}
+
+/// decodeSet - Decode the SET instructions that write PC or PUSH, or read
+/// POP, which have instructions of their own.
+static MCDisassembler::DecodeStatus
+decodeSet(MCInst &MI, const DecodedOperand &B, const DecodedOperand &A) {
+  if (B.Kind == DecodedOperand::PC) {
+    switch (A.Kind) {
+    case DecodedOperand::PushPop:  MI.setOpcode(DCPU16::RET); return addOperands(MI, 0, 0);
+    case DecodedOperand::Register: MI.setOpcode(DCPU16::Br);  break;
+    case DecodedOperand::Literal:  MI.setOpcode(DCPU16::Bi);  break;
+    case DecodedOperand::Memory:   MI.setOpcode(DCPU16::Bm);  break;
+    default: return MCDisassembler::Fail;
+    }
+    return addOperands(MI, &A, 1);
+  }
+  if (B.Kind == DecodedOperand::PushPop) {
+    if (A.Kind != DecodedOperand::Register)
+      return MCDisassembler::Fail;
+    MI.setOpcode(DCPU16::PUSH16r);
+    return addOperands(MI, &A, 1);
+  }
+  if (B.Kind != DecodedOperand::Register)
+    return MCDisassembler::Fail;
+  MI.setOpcode(DCPU16::POP16r);
+  return addOperands(MI, &B, 1);
+}
+
+MCDisassembler::DecodeStatus
+DCPU16Disassembler::getInstruction(MCInst &MI, uint64_t &Size,
+                                   ArrayRef<uint8_t> Bytes,
+                                   uint64_t Address,
+                                   raw_ostream &VStream,
+                                   raw_ostream &CStream) const {
+  uint16_t Word;
+  Size = 0;
+  if (!readWord(Bytes, 0, Word))
+    return Fail;
+  Size = 2;
+
+  unsigned Op = Word & 0x1f;
+  unsigned BField = (Word >> 5) & 0x1f;
+  unsigned AField = Word >> 10;
+
+  // The next word of a comes before the one of b.
+  DecodedOperand A, B;
+  if (!decodeOperand(AField, Bytes, Size, A))
+    return Fail;
+
+  if (Op == 0) {
+    // Special instructions: the opcode is in the field of b.
+    if (BField == 0x0b) {
+      // RFI ignores its operand; RETI is the one with 0.
+      if (AField != 0x21)
+        return Fail;
+      MI.setOpcode(DCPU16::RETI);
+      return addOperands(MI, 0, 0);
+    }
+    for (unsigned i = 0, e = array_lengthof(SpecialOpcodes); i != e; ++i) {
+      if (SpecialOpcodes[i].Op != BField)
+        continue;
+      unsigned Opcode = 0;
+      switch (A.Kind) {
+      case DecodedOperand::Register: Opcode = SpecialOpcodes[i].Reg; break;
+      case DecodedOperand::Literal:  Opcode = SpecialOpcodes[i].Lit; break;
+      case DecodedOperand::Memory:   Opcode = SpecialOpcodes[i].Mem; break;
+      default: break;
+      }
+      if (!Opcode)
+        return Fail;
+      MI.setOpcode(Opcode);
+      return addOperands(MI, &A, 1);
+    }
+    return Fail;
+  }
+
+  if (!decodeOperand(BField, Bytes, Size, B))
+    return Fail;
+
+  if (Op == 0x01 && (B.Kind == DecodedOperand::PC ||
+                     B.Kind == DecodedOperand::PushPop ||
+                     A.Kind == DecodedOperand::PushPop))
+    return decodeSet(MI, B, A);
+
+  unsigned BKind = getKindIndex(B.Kind), AKind = getKindIndex(A.Kind);
+  if (BKind == ~0U || AKind == ~0U)
+    return Fail;
+
+  for (unsigned i = 0, e = array_lengthof(BasicOpcodes); i != e; ++i) {
+    if (BasicOpcodes[i].Op != Op)
+      continue;
+    unsigned Opcode = BasicOpcodes[i].Opcodes[BKind * 3 + AKind];
+    if (!Opcode)
+      return Fail;
+    MI.setOpcode(Opcode);
+    DecodedOperand Ops[2] = { B, A };
+    return addOperands(MI, Ops, 2);
+  }
+  return Fail;
+}
+
+static MCDisassembler *createDCPU16Disassembler(const Target &T,
+                                                const MCSubtargetInfo &STI,
+                                                MCContext &Ctx) {
+  return new DCPU16Disassembler(STI, Ctx);
+}
+
+extern "C" void LLVMInitializeDCPU16Disassembler() {
+  // Register the disassembler.
+  TargetRegistry::RegisterMCDisassembler(TheDCPU16Target,
+                                         createDCPU16Disassembler);
+}
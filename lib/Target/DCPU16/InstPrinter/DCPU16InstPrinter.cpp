@@ -26,7 +26,7 @@ using namespace llvm;
 #include "DCPU16GenAsmWriter.inc"
 
 void DCPU16InstPrinter::printInst(const MCInst *MI, raw_ostream &O,
-                                  StringRef Annot) {
+                                  StringRef Annot, const MCSubtargetInfo &STI) {
   printInstruction(MI, O);
   printAnnotation(O, Annot);
 }
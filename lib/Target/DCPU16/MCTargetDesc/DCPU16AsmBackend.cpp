@@ -0,0 +1,101 @@
+//===-- DCPU16AsmBackend.cpp - DCPU16 Assembler Backend -------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MCTargetDesc/DCPU16MCTargetDesc.h"
+#include "MCTargetDesc/DCPU16FixupKinds.h"
+#include "llvm/MC/MCAsmBackend.h"
+#include "llvm/MC/MCFixupKindInfo.h"
+#include "llvm/MC/MCObjectWriter.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/raw_ostream.h"
+using namespace llvm;
+
+namespace {
+
+class DCPU16AsmBackend : public MCAsmBackend {
+public:
+  DCPU16AsmBackend(const Target &T) : MCAsmBackend() {}
+
+  MCObjectWriter *createObjectWriter(raw_pwrite_stream &OS) const override {
+    return createDCPU16FlatObjectWriter(OS);
+  }
+
+  unsigned getNumFixupKinds() const override { return DCPU16::NumTargetFixupKinds; }
+
+  const MCFixupKindInfo &getFixupKindInfo(MCFixupKind Kind) const override {
+    const static MCFixupKindInfo Infos[DCPU16::NumTargetFixupKinds] = {
+      // name                    offset bits  flags
+      { "fixup_dcpu16_word",     0,     16,   0 }
+    };
+
+    if (Kind < FirstTargetFixupKind)
+      return MCAsmBackend::getFixupKindInfo(Kind);
+
+    assert(unsigned(Kind - FirstTargetFixupKind) < getNumFixupKinds() &&
+           "Invalid kind!");
+    return Infos[Kind - FirstTargetFixupKind];
+  }
+
+  void applyFixup(const MCFixup &Fixup, char *Data, unsigned DataSize,
+                  uint64_t Value, bool IsPCRel) const override;
+
+  // Every operand with a next word keeps it: the instruction sizes are final
+  // when they are emitted.
+  bool mayNeedRelaxation(const MCInst &Inst) const override { return false; }
+
+  bool fixupNeedsRelaxation(const MCFixup &Fixup, uint64_t Value,
+                            const MCRelaxableFragment *DF,
+                            const MCAsmLayout &Layout) const override {
+    llvm_unreachable("DCPU16 instructions are never relaxed");
+  }
+
+  void relaxInstruction(const MCInst &Inst, const MCSubtargetInfo &STI,
+                        MCInst &Res) const override {
+    llvm_unreachable("DCPU16 instructions are never relaxed");
+  }
+
+  bool writeNopData(uint64_t Count, MCObjectWriter *OW) const override;
+};
+
+} // end anonymous namespace
+
+void DCPU16AsmBackend::applyFixup(const MCFixup &Fixup, char *Data,
+                                  unsigned DataSize, uint64_t Value,
+                                  bool IsPCRel) const {
+  switch ((unsigned)Fixup.getKind()) {
+  default: llvm_unreachable("Unknown fixup kind!");
+  case FK_Data_2:
+  case DCPU16::fixup_dcpu16_word:
+    break;
+  }
+
+  unsigned Offset = Fixup.getOffset();
+  assert(Offset + 2 <= DataSize && "Invalid fixup offset!");
+
+  // Words are stored big-endian.
+  Data[Offset] = uint8_t(Value >> 8);
+  Data[Offset + 1] = uint8_t(Value);
+}
+
+bool DCPU16AsmBackend::writeNopData(uint64_t Count, MCObjectWriter *OW) const {
+  // There is no way to pad with half a word.
+  if (Count % 2 != 0)
+    return false;
+
+  for (uint64_t i = 0; i != Count; i += 2)
+    OW->write16(0x0001); // SET A, A
+  return true;
+}
+
+MCAsmBackend *llvm::createDCPU16AsmBackend(const Target &T,
+                                           const MCRegisterInfo &MRI,
+                                           const Triple &TT, StringRef CPU,
+                                           const MCTargetOptions &Options) {
+  return new DCPU16AsmBackend(T);
+}
@@ -0,0 +1,29 @@
+//===-- DCPU16FixupKinds.h - DCPU16 Specific Fixup Entries ------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_DCPU16_DCPU16FIXUPKINDS_H
+#define LLVM_DCPU16_DCPU16FIXUPKINDS_H
+
+#include "llvm/MC/MCFixup.h"
+
+namespace llvm {
+namespace DCPU16 {
+  enum Fixups {
+    // The next word of an operand: an absolute word address or a literal.
+    // DCPU16 has no PC-relative operands.
+    fixup_dcpu16_word = FirstTargetFixupKind,
+
+    // Marker
+    LastTargetFixupKind,
+    NumTargetFixupKinds = LastTargetFixupKind - FirstTargetFixupKind
+  };
+} // end namespace DCPU16
+} // end namespace llvm
+
+#endif
@@ -0,0 +1,144 @@
+//===-- DCPU16FlatObjectWriter.cpp - DCPU16 flat image writer -------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements an object writer that produces a memory image of the
+// DCPU16, to be loaded at address 0: the sections one after the other, with
+// every symbol resolved, in big-endian words.
+//
+// The sections are laid out in the order of the assembler, with the zero-fill
+// sections and then the common symbols after the ones that have contents.
+// Those are not written out, as the loader clears the rest of memory.
+//
+// Addresses on the DCPU16 count words, which are two bytes of the object
+// file, while the constant part of an expression already counts words, as it
+// does in assembly.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MCTargetDesc/DCPU16MCTargetDesc.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/MC/MCAsmLayout.h"
+#include "llvm/MC/MCAssembler.h"
+#include "llvm/MC/MCExpr.h"
+#include "llvm/MC/MCObjectWriter.h"
+#include "llvm/MC/MCSection.h"
+#include "llvm/MC/MCSymbol.h"
+#include "llvm/MC/MCValue.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/MathExtras.h"
+#include <algorithm>
+using namespace llvm;
+
+namespace {
+
+class DCPU16FlatObjectWriter : public MCObjectWriter {
+  /// The address of each section and common symbol in the image, in bytes.
+  DenseMap<const MCSection *, uint64_t> SectionAddress;
+  DenseMap<const MCSymbol *, uint64_t> CommonAddress;
+
+  uint64_t getSymbolAddress(const MCAsmLayout &Layout,
+                            const MCSymbol &S) const;
+
+public:
+  DCPU16FlatObjectWriter(raw_pwrite_stream &OS)
+    : MCObjectWriter(OS, /*IsLittleEndian=*/false) {}
+
+  void executePostLayoutBinding(MCAssembler &Asm,
+                                const MCAsmLayout &Layout) override;
+
+  void recordRelocation(MCAssembler &Asm, const MCAsmLayout &Layout,
+                        const MCFragment *Fragment, const MCFixup &Fixup,
+                        MCValue Target, bool &IsPCRel,
+                        uint64_t &FixedValue) override;
+
+  void writeObject(MCAssembler &Asm, const MCAsmLayout &Layout) override;
+};
+
+} // end anonymous namespace
+
+uint64_t DCPU16FlatObjectWriter::getSymbolAddress(const MCAsmLayout &Layout,
+                                                  const MCSymbol &S) const {
+  // Look through aliases, which may name a common symbol.
+  const MCSymbol *Sym = &S;
+  while (Sym->isVariable())
+    if (const MCSymbolRefExpr *Ref =
+          dyn_cast<MCSymbolRefExpr>(Sym->getVariableValue()))
+      Sym = &Ref->getSymbol();
+    else
+      break;
+
+  if (Sym->isCommon()) {
+    DenseMap<const MCSymbol *, uint64_t>::const_iterator I =
+      CommonAddress.find(Sym);
+    assert(I != CommonAddress.end() && "common symbol without an address");
+    return I->second;
+  }
+
+  if (!Sym->isInSection())
+    report_fatal_error("undefined symbol '" + Twine(Sym->getName()) +
+                       "' in DCPU16 image");
+
+  return SectionAddress.lookup(Sym->getFragment()->getParent()) +
+         Layout.getSymbolOffset(*Sym);
+}
+
+void DCPU16FlatObjectWriter::executePostLayoutBinding(MCAssembler &Asm,
+                                                      const MCAsmLayout &Layout) {
+  uint64_t Address = 0;
+  for (unsigned Virtual = 0; Virtual != 2; ++Virtual) {
+    for (const MCSection &Sec : Asm) {
+      if (Sec.isVirtualSection() != bool(Virtual))
+        continue;
+      Address = alignTo(Address, std::max(Sec.getAlignment(), 2U));
+      SectionAddress[&Sec] = Address;
+      Address += Layout.getSectionAddressSize(&Sec);
+    }
+  }
+
+  for (const MCSymbol &Sym : Asm.symbols()) {
+    if (!Sym.isCommon())
+      continue;
+    Address = alignTo(Address, std::max(Sym.getCommonAlignment(), 2U));
+    CommonAddress[&Sym] = Address;
+    Address += alignTo(Sym.getCommonSize(), 2);
+  }
+}
+
+void DCPU16FlatObjectWriter::recordRelocation(MCAssembler &Asm,
+                                              const MCAsmLayout &Layout,
+                                              const MCFragment *Fragment,
+                                              const MCFixup &Fixup,
+                                              MCValue Target, bool &IsPCRel,
+                                              uint64_t &FixedValue) {
+  // Nothing is left to relocate: every symbol is resolved to its word address.
+  int64_t Value = Target.getConstant();
+  if (const MCSymbolRefExpr *A = Target.getSymA())
+    Value += getSymbolAddress(Layout, A->getSymbol()) / 2;
+  if (const MCSymbolRefExpr *B = Target.getSymB())
+    Value -= getSymbolAddress(Layout, B->getSymbol()) / 2;
+  FixedValue = Value;
+}
+
+void DCPU16FlatObjectWriter::writeObject(MCAssembler &Asm,
+                                         const MCAsmLayout &Layout) {
+  uint64_t Written = 0;
+  for (const MCSection &Sec : Asm) {
+    if (Sec.isVirtualSection())
+      continue;
+    uint64_t Address = SectionAddress.lookup(&Sec);
+    WriteZeros(Address - Written);
+    Asm.writeSectionData(&Sec, Layout);
+    Written = Address + Layout.getSectionFileSize(&Sec);
+  }
+}
+
+MCObjectWriter *llvm::createDCPU16FlatObjectWriter(raw_pwrite_stream &OS) {
+  return new DCPU16FlatObjectWriter(OS);
+}
@@ -12,31 +12,29 @@
 //===----------------------------------------------------------------------===//
 
 #include "DCPU16MCAsmInfo.h"
-#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/Triple.h"
 using namespace llvm;
 
 void DCPU16MCAsmInfo::anchor() { }
 
-DCPU16MCAsmInfo::DCPU16MCAsmInfo(const Target &T, StringRef TT) {
+DCPU16MCAsmInfo::DCPU16MCAsmInfo(const Triple &TT) {
   LabelPrefix = ":";
   LabelSuffix = "";
   PointerSize = 2;
+  IsLittleEndian = false;
 
   PrivateGlobalPrefix = "_L"; // There might be some incompatibility with sublabels and stuff
   WeakRefDirective ="\t.weak\t";
-  PCSymbol=".";
   CommentString = ";";
 
   AlignmentIsInBytes = false;
   // TODO(krasin): support .align
   // https://github.com/krasin/llvm-dcpu16/issues/52
-  AlignDirective = "\t; .align\t";
-  AllowNameToStartWithDigit = true;
   UsesELFSectionDirectiveForBSS = false;
   HasDotTypeDotSizeDirective = false;
 
   // Use .lcomm instead of .local .comm (required for binutils support)
-  LCOMMDirectiveAlignmentType = LCOMM::NoAlignment;
+  LCOMMDirectiveAlignmentType = LCOMM::ByteAlignment;
 
   Data8bitsDirective = "\t.dat\t";
   Data16bitsDirective = "\t.dat\t";
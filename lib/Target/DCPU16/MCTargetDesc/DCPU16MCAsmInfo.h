@@ -17,13 +17,12 @@
 #include "llvm/MC/MCAsmInfo.h"
 
 namespace llvm {
-  class StringRef;
-  class Target;
+  class Triple;
 
   class DCPU16MCAsmInfo : public MCAsmInfo {
     virtual void anchor();
   public:
-    explicit DCPU16MCAsmInfo(const Target &T, StringRef TT);
+    explicit DCPU16MCAsmInfo(const Triple &TT);
   };
 
 } // namespace llvm
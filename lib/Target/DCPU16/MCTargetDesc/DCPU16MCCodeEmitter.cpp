@@ -0,0 +1,294 @@
+//===-- DCPU16MCCodeEmitter.cpp - Convert DCPU16 code to machine code -----===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements the DCPU16MCCodeEmitter class.
+//
+// An instruction is one word holding the opcode and the fields of its b
+// (destination) and a (source) operands, followed by the next word of a and
+// then the one of b, for operands that need one:
+//
+//   aaaaaabbbbbooooo [a next word] [b next word]
+//
+// Words are emitted big-endian. The opcode and any fixed operands come from
+// the encodings in DCPU16InstrFormats.td; the operand fields they leave zero
+// are filled from the MCInst operands here, b before a.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "mccodeemitter"
+#include "DCPU16.h"
+#include "MCTargetDesc/DCPU16FixupKinds.h"
+#include "MCTargetDesc/DCPU16MCTargetDesc.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/MC/MCCodeEmitter.h"
+#include "llvm/MC/MCContext.h"
+#include "llvm/MC/MCExpr.h"
+#include "llvm/MC/MCInst.h"
+#include "llvm/MC/MCInstrInfo.h"
+#include "llvm/MC/MCRegisterInfo.h"
+#include "llvm/MC/MCSubtargetInfo.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/raw_ostream.h"
+using namespace llvm;
+
+STATISTIC(MCNumEmitted, "Number of MC instructions emitted");
+
+namespace {
+
+// Operand field values that are not registers.
+enum {
+  OpRegInd      = 0x08, // [reg]
+  OpRegIndNext  = 0x10, // [reg + next word]
+  OpPushPop     = 0x18, // PUSH as b, POP as a
+  OpPeek        = 0x19, // [SP]
+  OpPick        = 0x1a, // [SP + next word]
+  OpPC          = 0x1c,
+  OpIndNext     = 0x1e, // [next word]
+  OpNext        = 0x1f, // next word
+  OpLiteral     = 0x21  // -1..30 are encoded as 0x20..0x3f, in a only
+};
+
+/// An encoded operand: its field in the instruction word and its next word,
+/// which is either Word or, if Expr is set, the value of Expr.
+struct OperandValue {
+  unsigned Field;
+  bool HasNextWord;
+  uint16_t Word;
+  const MCExpr *Expr;
+
+  explicit OperandValue(unsigned Field)
+    : Field(Field), HasNextWord(false), Word(0), Expr(0) {}
+};
+
+class DCPU16MCCodeEmitter : public MCCodeEmitter {
+  DCPU16MCCodeEmitter(const DCPU16MCCodeEmitter &) = delete;
+  void operator=(const DCPU16MCCodeEmitter &) = delete;
+  const MCInstrInfo &MCII;
+  const MCRegisterInfo &MRI;
+
+public:
+  DCPU16MCCodeEmitter(const MCInstrInfo &mcii, const MCRegisterInfo &mri)
+    : MCII(mcii), MRI(mri) {}
+
+  ~DCPU16MCCodeEmitter() override {}
+
+  // getBinaryCodeForInstr - TableGen'erated function for getting the
+  // binary encoding for an instruction.
+  uint64_t getBinaryCodeForInstr(const MCInst &MI,
+                                 SmallVectorImpl<MCFixup> &Fixups,
+                                 const MCSubtargetInfo &STI) const;
+
+  void encodeInstruction(const MCInst &MI, raw_ostream &OS,
+                         SmallVectorImpl<MCFixup> &Fixups,
+                         const MCSubtargetInfo &STI) const override;
+
+private:
+  OperandValue getOperandValue(const MCOperand &MO, bool IsA) const;
+  OperandValue getMemOperandValue(const MCOperand &Base,
+                                  const MCOperand &Disp) const;
+
+  void EmitWord(uint16_t Word, unsigned &CurByte, raw_ostream &OS) const {
+    OS << char(Word >> 8) << char(Word & 0xff);
+    CurByte += 2;
+  }
+
+  void EmitNextWord(const OperandValue &Op, unsigned &CurByte, raw_ostream &OS,
+                    SmallVectorImpl<MCFixup> &Fixups) const;
+
+  void EmitInstruction(unsigned Opcode, const OperandValue &B,
+                       const OperandValue &A, unsigned &CurByte,
+                       raw_ostream &OS,
+                       SmallVectorImpl<MCFixup> &Fixups) const;
+};
+
+} // end anonymous namespace
+
+MCCodeEmitter *llvm::createDCPU16MCCodeEmitter(const MCInstrInfo &MCII,
+                                               const MCRegisterInfo &MRI,
+                                               MCContext &Ctx) {
+  return new DCPU16MCCodeEmitter(MCII, MRI);
+}
+
+/// getCondOpcode - Return the opcode of the IF instruction that tests CC.
+static unsigned getCondOpcode(int64_t CC) {
+  switch (CC) {
+  default: llvm_unreachable("Unsupported CC code");
+  case DCPU16CC::COND_B:  return 0x10; // IFB
+  case DCPU16CC::COND_C:  return 0x11; // IFC
+  case DCPU16CC::COND_E:  return 0x12; // IFE
+  case DCPU16CC::COND_NE: return 0x13; // IFN
+  case DCPU16CC::COND_G:  return 0x14; // IFG
+  case DCPU16CC::COND_A:  return 0x15; // IFA
+  case DCPU16CC::COND_L:  return 0x16; // IFL
+  case DCPU16CC::COND_U:  return 0x17; // IFU
+  }
+}
+
+OperandValue
+DCPU16MCCodeEmitter::getOperandValue(const MCOperand &MO, bool IsA) const {
+  if (MO.isReg())
+    return OperandValue(MRI.getEncodingValue(MO.getReg()));
+
+  OperandValue Op(OpNext);
+  Op.HasNextWord = true;
+  if (MO.isImm()) {
+    int16_t Imm = MO.getImm();
+    // Small literals fit in the field of a, saving the next word.
+    if (IsA && Imm >= -1 && Imm <= 30)
+      return OperandValue(OpLiteral + Imm);
+    Op.Word = Imm;
+    return Op;
+  }
+
+  assert(MO.isExpr() && "unknown operand kind in getOperandValue");
+  Op.Expr = MO.getExpr();
+  return Op;
+}
+
+OperandValue
+DCPU16MCCodeEmitter::getMemOperandValue(const MCOperand &Base,
+                                        const MCOperand &Disp) const {
+  bool IsZeroDisp = Disp.isImm() && Disp.getImm() == 0;
+  unsigned Reg = Base.getReg();
+  if (Reg == DCPU16::SP && IsZeroDisp)
+    return OperandValue(OpPeek);
+  if (Reg && Reg != DCPU16::SP && IsZeroDisp)
+    return OperandValue(OpRegInd + MRI.getEncodingValue(Reg));
+
+  OperandValue Op(OpIndNext);
+  if (Reg == DCPU16::SP)
+    Op.Field = OpPick;
+  else if (Reg)
+    Op.Field = OpRegIndNext + MRI.getEncodingValue(Reg);
+  Op.HasNextWord = true;
+  if (Disp.isImm()) {
+    Op.Word = Disp.getImm();
+  } else {
+    assert(Disp.isExpr() &&
+           "Expected immediate or expression in displacement field");
+    Op.Expr = Disp.getExpr();
+  }
+  return Op;
+}
+
+void DCPU16MCCodeEmitter::EmitNextWord(const OperandValue &Op,
+                                       unsigned &CurByte, raw_ostream &OS,
+                                       SmallVectorImpl<MCFixup> &Fixups) const {
+  if (!Op.HasNextWord)
+    return;
+  if (Op.Expr) {
+    Fixups.push_back(MCFixup::create(CurByte, Op.Expr,
+                                     MCFixupKind(DCPU16::fixup_dcpu16_word)));
+    EmitWord(0, CurByte, OS);
+    return;
+  }
+  EmitWord(Op.Word, CurByte, OS);
+}
+
+void DCPU16MCCodeEmitter::EmitInstruction(unsigned Opcode,
+                                          const OperandValue &B,
+                                          const OperandValue &A,
+                                          unsigned &CurByte, raw_ostream &OS,
+                                          SmallVectorImpl<MCFixup> &Fixups) const {
+  EmitWord((A.Field << 10) | (B.Field << 5) | Opcode, CurByte, OS);
+  EmitNextWord(A, CurByte, OS, Fixups);
+  EmitNextWord(B, CurByte, OS, Fixups);
+  ++MCNumEmitted;
+}
+
+void DCPU16MCCodeEmitter::
+encodeInstruction(const MCInst &MI, raw_ostream &OS,
+                  SmallVectorImpl<MCFixup> &Fixups,
+                  const MCSubtargetInfo &STI) const {
+  const unsigned SET = 0x01;
+  unsigned CurByte = 0;
+
+  switch (MI.getOpcode()) {
+  default: break;
+  case DCPU16::NOP:
+    // SET A, A
+    EmitInstruction(SET, OperandValue(0), OperandValue(0), CurByte, OS, Fixups);
+    return;
+  case DCPU16::BR_CCrr:
+  case DCPU16::BR_CCri:
+  case DCPU16::BR_CCir:
+  case DCPU16::BR_CCii:
+    // IFcc lhs, rhs
+    // SET PC, dst
+    EmitInstruction(getCondOpcode(MI.getOperand(0).getImm()),
+                    getOperandValue(MI.getOperand(1), false),
+                    getOperandValue(MI.getOperand(2), true),
+                    CurByte, OS, Fixups);
+    EmitInstruction(SET, OperandValue(OpPC),
+                    getOperandValue(MI.getOperand(3), true),
+                    CurByte, OS, Fixups);
+    return;
+  case DCPU16::Select16rrrr:
+  case DCPU16::Select16rirr:
+  case DCPU16::Select16irrr:
+  case DCPU16::Select16rrii:
+  case DCPU16::Select16riii:
+  case DCPU16::Select16irii: {
+    // SET dst, falseV
+    // IFcc lhs, rhs
+    // SET dst, trueV
+    OperandValue Dst = getOperandValue(MI.getOperand(0), false);
+    EmitInstruction(SET, Dst, getOperandValue(MI.getOperand(5), true),
+                    CurByte, OS, Fixups);
+    EmitInstruction(getCondOpcode(MI.getOperand(1).getImm()),
+                    getOperandValue(MI.getOperand(2), false),
+                    getOperandValue(MI.getOperand(3), true),
+                    CurByte, OS, Fixups);
+    EmitInstruction(SET, Dst, getOperandValue(MI.getOperand(4), true),
+                    CurByte, OS, Fixups);
+    return;
+  }
+  }
+
+  // Opcode 0 with a special opcode of 0 is reserved, so an all-zero encoding
+  // is one of the pseudos that must be expanded before emission.
+  unsigned Bits = getBinaryCodeForInstr(MI, Fixups, STI);
+  if (Bits == 0)
+    report_fatal_error("Unsupported instruction in DCPU16 code emission");
+
+  // Collect the operands that are encoded, skipping the ones tied to a def:
+  // ADD A, B has the operands A, A, B, and only encodes A and B.
+  const MCInstrDesc &Desc = MCII.get(MI.getOpcode());
+  SmallVector<std::pair<unsigned, bool>, 2> Ops; // Operand number, is memory.
+  for (unsigned i = 0, e = Desc.getNumOperands(); i != e; ++i) {
+    if (Desc.getOperandConstraint(i, MCOI::TIED_TO) != -1)
+      continue;
+    bool IsMem = Desc.OpInfo[i].OperandType == MCOI::OPERAND_MEMORY;
+    Ops.push_back(std::make_pair(i, IsMem));
+    // A memory operand is a base register and a displacement.
+    if (IsMem)
+      ++i;
+  }
+
+  unsigned NextOp = 0;
+  OperandValue Fields[2] = { OperandValue((Bits >> 5) & 0x1f),
+                             OperandValue(Bits >> 10) };
+  for (unsigned IsA = 0; IsA != 2; ++IsA) {
+    if (Fields[IsA].Field != 0 || NextOp == Ops.size())
+      continue;
+    unsigned OpNo = Ops[NextOp].first;
+    if (Ops[NextOp].second)
+      Fields[IsA] = getMemOperandValue(MI.getOperand(OpNo),
+                                       MI.getOperand(OpNo + 1));
+    else
+      Fields[IsA] = getOperandValue(MI.getOperand(OpNo), IsA);
+    ++NextOp;
+  }
+  assert(NextOp == Ops.size() && "Operand without a field in the encoding");
+
+  EmitInstruction(Bits & 0x1f, Fields[0], Fields[1], CurByte, OS, Fixups);
+}
+
+#include "DCPU16GenMCCodeEmitter.inc"
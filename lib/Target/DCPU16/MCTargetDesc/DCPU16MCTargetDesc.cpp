@@ -14,7 +14,6 @@
 #include "DCPU16MCTargetDesc.h"
 #include "DCPU16MCAsmInfo.h"
 #include "InstPrinter/DCPU16InstPrinter.h"
-#include "llvm/MC/MCCodeGenInfo.h"
 #include "llvm/MC/MCInstrInfo.h"
 #include "llvm/MC/MCRegisterInfo.h"
 #include "llvm/MC/MCSubtargetInfo.h"
@@ -37,46 +36,31 @@ static MCInstrInfo *createDCPU16MCInstrInfo() {
   return X;
 }
 
-static MCRegisterInfo *createDCPU16MCRegisterInfo(StringRef TT) {
+static MCRegisterInfo *createDCPU16MCRegisterInfo(const Triple &TT) {
   MCRegisterInfo *X = new MCRegisterInfo();
   InitDCPU16MCRegisterInfo(X, DCPU16::A);
   return X;
 }
 
-static MCSubtargetInfo *createDCPU16MCSubtargetInfo(StringRef TT, StringRef CPU,
-                                                    StringRef FS) {
-  MCSubtargetInfo *X = new MCSubtargetInfo();
-  InitDCPU16MCSubtargetInfo(X, TT, CPU, FS);
-  return X;
-}
-
-static MCCodeGenInfo *createDCPU16MCCodeGenInfo(StringRef TT, Reloc::Model RM,
-                                                CodeModel::Model CM,
-                                                CodeGenOpt::Level OL) {
-  MCCodeGenInfo *X = new MCCodeGenInfo();
-  X->InitMCCodeGenInfo(RM, CM, OL);
-  return X;
+static MCSubtargetInfo *
+createDCPU16MCSubtargetInfo(const Triple &TT, StringRef CPU, StringRef FS) {
+  return createDCPU16MCSubtargetInfoImpl(TT, CPU, FS);
 }
 
-static MCInstPrinter *createDCPU16MCInstPrinter(const Target &T,
+static MCInstPrinter *createDCPU16MCInstPrinter(const Triple &T,
                                                 unsigned SyntaxVariant,
                                                 const MCAsmInfo &MAI,
                                                 const MCInstrInfo &MII,
-                                                const MCRegisterInfo &MRI,
-                                                const MCSubtargetInfo &STI) {
+                                                const MCRegisterInfo &MRI) {
   if (SyntaxVariant == 0)
     return new DCPU16InstPrinter(MAI, MII, MRI);
-  return 0;
+  return nullptr;
 }
 
 extern "C" void LLVMInitializeDCPU16TargetMC() {
   // Register the MC asm info.
   RegisterMCAsmInfo<DCPU16MCAsmInfo> X(TheDCPU16Target);
 
-  // Register the MC codegen info.
-  TargetRegistry::RegisterMCCodeGenInfo(TheDCPU16Target,
-                                        createDCPU16MCCodeGenInfo);
-
   // Register the MC instruction info.
   TargetRegistry::RegisterMCInstrInfo(TheDCPU16Target, createDCPU16MCInstrInfo);
 
@@ -91,4 +75,12 @@ extern "C" void LLVMInitializeDCPU16TargetMC() {
   // Register the MCInstPrinter.
   TargetRegistry::RegisterMCInstPrinter(TheDCPU16Target,
                                         createDCPU16MCInstPrinter);
+
+  // Register the MC code emitter.
+  TargetRegistry::RegisterMCCodeEmitter(TheDCPU16Target,
+                                        createDCPU16MCCodeEmitter);
+
+  // Register the asm backend.
+  TargetRegistry::RegisterMCAsmBackend(TheDCPU16Target,
+                                       createDCPU16AsmBackend);
 }
@@ -15,10 +15,33 @@
 #define DCPU16MCTARGETDESC_H
 
 namespace llvm {
+class MCAsmBackend;
+class MCCodeEmitter;
+class MCContext;
+class MCInstrInfo;
+class MCObjectWriter;
+class MCRegisterInfo;
+class MCSubtargetInfo;
+class MCTargetOptions;
+class StringRef;
 class Target;
+class Triple;
+class raw_pwrite_stream;
 
 extern Target TheDCPU16Target;
 
+MCCodeEmitter *createDCPU16MCCodeEmitter(const MCInstrInfo &MCII,
+                                         const MCRegisterInfo &MRI,
+                                         MCContext &Ctx);
+
+MCAsmBackend *createDCPU16AsmBackend(const Target &T,
+                                     const MCRegisterInfo &MRI,
+                                     const Triple &TT, StringRef CPU,
+                                     const MCTargetOptions &Options);
+
+/// createDCPU16FlatObjectWriter - Construct a writer of memory images.
+MCObjectWriter *createDCPU16FlatObjectWriter(raw_pwrite_stream &OS);
+
 } // End llvm namespace
 
 // Defines symbolic names for DCPU16 registers.
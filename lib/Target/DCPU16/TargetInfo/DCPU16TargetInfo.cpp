@@ -8,7 +8,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "DCPU16.h"
-#include "llvm/Module.h"
+#include "llvm/IR/Module.h"
 #include "llvm/Support/TargetRegistry.h"
 using namespace llvm;
 
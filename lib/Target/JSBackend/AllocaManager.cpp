@@ -17,6 +17,7 @@
 
 #define DEBUG_TYPE "allocamanager"
 #include "AllocaManager.h"
+#include "llvm/ADT/PostOrderIterator.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/IR/DataLayout.h"
 #include "llvm/IR/IntrinsicInst.h"
@@ -29,6 +30,7 @@
 using namespace llvm;
 
 STATISTIC(NumAllocas, "Number of allocas eliminated");
+STATISTIC(NumBytesSaved, "Number of stack frame bytes saved by merging allocas");
 
 static const char *TimerGroupName = "AllocaManager";
 static const char *TimerGroupDesc = "Alloca manager";
@@ -160,9 +162,12 @@ void AllocaManager::collectMarkedAllocas() {
   //
   // And so, instead of just walking the entry block to find all the static
   // allocas, we walk the whole body to find the intrinsics so we can find the
-  // set of static allocas referenced in the intrinsics.
+  // set of static allocas referenced in the intrinsics. We record the markers
+  // of each block as we go, so that the liveness computations below don't
+  // have to walk the whole body and dig through the pointers again.
   for (Function::const_iterator FI = F->begin(), FE = F->end();
        FI != FE; ++FI) {
+    BlockLifetimeInfo &BLI = BlockLiveness[&*FI];
     for (BasicBlock::const_iterator BI = FI->begin(), BE = FI->end();
          BI != BE; ++BI) {
       const CallInst *CI = dyn_cast<CallInst>(BI);
@@ -171,14 +176,17 @@ void AllocaManager::collectMarkedAllocas() {
       const Value *Callee = CI->getCalledValue();
       if (Callee == LifetimeStart || Callee == LifetimeEnd) {
         if (const Value *Ptr = getPointerFromIntrinsic(CI)) {
-          if (const AllocaInst *AI = isFavorableAlloca(Ptr))
+          if (const AllocaInst *AI = isFavorableAlloca(Ptr)) {
             Allocas.insert(std::make_pair(AI, 0));
+            BLI.Markers.push_back(LifetimeMarker(AI, Callee == LifetimeStart));
+          }
         } else if (isa<Instruction>(CI->getArgOperand(1)->stripPointerCasts())) {
           // Oh noes, There's a lifetime intrinsics with something that
           // doesn't appear to resolve to an alloca. This means that it's
           // possible that it may be declaring a lifetime for some escaping
           // alloca. Look out!
           Allocas.clear();
+          BlockLiveness.clear();
           assert(AllocasByIndex.empty());
           return;
         }
@@ -206,6 +214,21 @@ void AllocaManager::collectMarkedAllocas() {
   assert(AllocasByIndex.size() == Allocas.size());
 }
 
+// Add a block to the worklist for propagating liveness forwards. Unreachable
+// blocks are left out, as their liveness doesn't matter.
+void AllocaManager::addToTopDownWorklist(const BasicBlock *BB) {
+  DenseMap<const BasicBlock *, unsigned>::const_iterator I = RPONumbers.find(BB);
+  if (I != RPONumbers.end())
+    InterBlockTopDownWorklist.set(I->second);
+}
+
+// Add a block to the worklist for propagating liveness backwards.
+void AllocaManager::addToBottomUpWorklist(const BasicBlock *BB) {
+  DenseMap<const BasicBlock *, unsigned>::const_iterator I = RPONumbers.find(BB);
+  if (I != RPONumbers.end())
+    InterBlockBottomUpWorklist.set(BlocksInRPO.size() - 1 - I->second);
+}
+
 // Calculate the starting point from which inter-block liveness will be
 // computed.
 void AllocaManager::collectBlocks() {
@@ -214,6 +237,15 @@ void AllocaManager::collectBlocks() {
 
   size_t AllocaCount = AllocasByIndex.size();
 
+  ReversePostOrderTraversal<const Function *> RPOT(F);
+  for (ReversePostOrderTraversal<const Function *>::rpo_iterator
+       I = RPOT.begin(), E = RPOT.end(); I != E; ++I) {
+    RPONumbers[*I] = BlocksInRPO.size();
+    BlocksInRPO.push_back(*I);
+  }
+  InterBlockTopDownWorklist.resize(BlocksInRPO.size());
+  InterBlockBottomUpWorklist.resize(BlocksInRPO.size());
+
   BitVector Seen(AllocaCount);
 
   for (Function::const_iterator I = F->begin(), E = F->end(); I != E; ++I) {
@@ -228,39 +260,19 @@ void AllocaManager::collectBlocks() {
     // live-in.
     Seen.reset();
 
-    // Walk the instructions and compute the Start and End sets.
-    for (BasicBlock::const_iterator BI = BB->begin(), BE = BB->end();
-         BI != BE; ++BI) {
-      const CallInst *CI = dyn_cast<CallInst>(BI);
-      if (!CI) continue;
-
-      const Value *Callee = CI->getCalledValue();
-      if (Callee == LifetimeStart) {
-        if (const Value *Ptr = getPointerFromIntrinsic(CI)) {
-          if (const AllocaInst *AI = isFavorableAlloca(Ptr)) {
-            AllocaMap::const_iterator MI = Allocas.find(AI);
-            if (MI != Allocas.end()) {
-              size_t AllocaIndex = MI->second;
-              if (!Seen.test(AllocaIndex)) {
-                BLI.Start.set(AllocaIndex);
-              }
-              BLI.End.reset(AllocaIndex);
-              Seen.set(AllocaIndex);
-            }
-          }
-        }
-      } else if (Callee == LifetimeEnd) {
-        if (const Value *Ptr = getPointerFromIntrinsic(CI)) {
-          if (const AllocaInst *AI = isFavorableAlloca(Ptr)) {
-            AllocaMap::const_iterator MI = Allocas.find(AI);
-            if (MI != Allocas.end()) {
-              size_t AllocaIndex = MI->second;
-              BLI.End.set(AllocaIndex);
-              Seen.set(AllocaIndex);
-            }
-          }
+    // Walk the markers and compute the Start and End sets.
+    for (SmallVectorImpl<LifetimeMarker>::const_iterator MI = BLI.Markers.begin(),
+         ME = BLI.Markers.end(); MI != ME; ++MI) {
+      size_t AllocaIndex = Allocas[MI->AI];
+      if (MI->IsStart) {
+        if (!Seen.test(AllocaIndex)) {
+          BLI.Start.set(AllocaIndex);
         }
+        BLI.End.reset(AllocaIndex);
+      } else {
+        BLI.End.set(AllocaIndex);
       }
+      Seen.set(AllocaIndex);
     }
 
     // Lifetimes that start in this block and do not end here are live-out.
@@ -269,7 +281,7 @@ void AllocaManager::collectBlocks() {
     if (BLI.LiveOut.any()) {
       for (succ_const_iterator SI = succ_begin(BB), SE = succ_end(BB);
            SI != SE; ++SI) {
-        InterBlockTopDownWorklist.insert(*SI);
+        addToTopDownWorklist(*SI);
       }
     }
 
@@ -281,7 +293,7 @@ void AllocaManager::collectBlocks() {
     if (BLI.LiveIn.any()) {
       for (const_pred_iterator PI = pred_begin(BB), PE = pred_end(BB);
            PI != PE; ++PI) {
-        InterBlockBottomUpWorklist.insert(*PI);
+        addToBottomUpWorklist(*PI);
       }
     }
   }
@@ -297,8 +309,10 @@ void AllocaManager::computeInterBlockLiveness() {
   BitVector Temp(AllocaCount);
 
   // Proporgate liveness backwards.
-  while (!InterBlockBottomUpWorklist.empty()) {
-    const BasicBlock *BB = InterBlockBottomUpWorklist.pop_back_val();
+  for (int i = InterBlockBottomUpWorklist.find_first(); i >= 0;
+       i = InterBlockBottomUpWorklist.find_first()) {
+    InterBlockBottomUpWorklist.reset(i);
+    const BasicBlock *BB = BlocksInRPO[BlocksInRPO.size() - 1 - i];
     BlockLifetimeInfo &BLI = BlockLiveness[BB];
 
     // Compute the new live-out set.
@@ -314,15 +328,17 @@ void AllocaManager::computeInterBlockLiveness() {
       BLI.LiveIn |= Temp;
       for (const_pred_iterator PI = pred_begin(BB), PE = pred_end(BB);
            PI != PE; ++PI) {
-        InterBlockBottomUpWorklist.insert(*PI);
+        addToBottomUpWorklist(*PI);
       }
     }
     Temp.reset();
   }
 
   // Proporgate liveness forwards.
-  while (!InterBlockTopDownWorklist.empty()) {
-    const BasicBlock *BB = InterBlockTopDownWorklist.pop_back_val();
+  for (int i = InterBlockTopDownWorklist.find_first(); i >= 0;
+       i = InterBlockTopDownWorklist.find_first()) {
+    InterBlockTopDownWorklist.reset(i);
+    const BasicBlock *BB = BlocksInRPO[i];
     BlockLifetimeInfo &BLI = BlockLiveness[BB];
 
     // Compute the new live-in set.
@@ -340,7 +356,7 @@ void AllocaManager::computeInterBlockLiveness() {
       BLI.LiveOut |= Temp;
       for (succ_const_iterator SI = succ_begin(BB), SE = succ_end(BB);
            SI != SE; ++SI) {
-        InterBlockTopDownWorklist.insert(*SI);
+        addToTopDownWorklist(*SI);
       }
     }
     Temp.reset();
@@ -356,46 +372,42 @@ void AllocaManager::computeIntraBlockLiveness() {
 
   BitVector Current(AllocaCount);
 
-  AllocaCompatibility.resize(AllocaCount, BitVector(AllocaCount, true));
+  AllocaInterference.resize(AllocaCount, BitVector(AllocaCount));
 
+  // Everything live at the same time at any point we walk over interferes, so
+  // when a block continues straight on from the one we just walked, with no
+  // new allocas live on entry, there is nothing to add for its live-in set.
+  const BasicBlock *Prev = NULL;
   for (Function::const_iterator I = F->begin(), E = F->end(); I != E; ++I) {
     const BasicBlock *BB = &*I;
     const BlockLifetimeInfo &BLI = BlockLiveness[BB];
 
+    bool Continues = Prev && BB->getSinglePredecessor() == Prev &&
+                     !BLI.LiveIn.test(Current);
     Current = BLI.LiveIn;
+    Prev = BB;
 
-    for (int i = Current.find_first(); i >= 0; i = Current.find_next(i)) {
-      AllocaCompatibility[i].reset(Current);
+    if (!Continues) {
+      for (int i = Current.find_first(); i >= 0; i = Current.find_next(i)) {
+        AllocaInterference[i] |= Current;
+      }
     }
 
-    for (BasicBlock::const_iterator BI = BB->begin(), BE = BB->end();
-         BI != BE; ++BI) {
-      const CallInst *CI = dyn_cast<CallInst>(BI);
-      if (!CI) continue;
-
-      const Value *Callee = CI->getCalledValue();
-      if (Callee == LifetimeStart) {
-        if (const Value *Ptr = getPointerFromIntrinsic(CI)) {
-          if (const AllocaInst *AI = isFavorableAlloca(Ptr)) {
-            size_t AIndex = Allocas[AI];
-            // We conflict with everything else that's currently live.
-            AllocaCompatibility[AIndex].reset(Current);
-            // Everything else that's currently live conflicts with us.
-            for (int i = Current.find_first(); i >= 0; i = Current.find_next(i)) {
-              AllocaCompatibility[i].reset(AIndex);
-            }
-            // We're now live.
-            Current.set(AIndex);
-          }
-        }
-      } else if (Callee == LifetimeEnd) {
-        if (const Value *Ptr = getPointerFromIntrinsic(CI)) {
-          if (const AllocaInst *AI = isFavorableAlloca(Ptr)) {
-            size_t AIndex = Allocas[AI];
-            // We're no longer live.
-            Current.reset(AIndex);
-          }
+    for (SmallVectorImpl<LifetimeMarker>::const_iterator MI = BLI.Markers.begin(),
+         ME = BLI.Markers.end(); MI != ME; ++MI) {
+      size_t AIndex = Allocas[MI->AI];
+      if (MI->IsStart) {
+        // We conflict with everything else that's currently live.
+        AllocaInterference[AIndex] |= Current;
+        // Everything else that's currently live conflicts with us.
+        for (int i = Current.find_first(); i >= 0; i = Current.find_next(i)) {
+          AllocaInterference[i].set(AIndex);
         }
+        // We're now live.
+        Current.set(AIndex);
+      } else {
+        // We're no longer live.
+        Current.reset(AIndex);
       }
     }
   }
@@ -403,40 +415,84 @@ void AllocaManager::computeIntraBlockLiveness() {
 
 // Decide which allocas will represent which other allocas, and if so what their
 // size and alignment will need to be.
+//
+// Allocas that are live at the same time interfere, and we color the
+// interference graph, giving each color a slot in the frame that is as big as
+// the biggest alloca it holds. We visit the allocas from the biggest down and
+// put each into the first slot it doesn't interfere with, so that slots are
+// sized by the first alloca placed in them and smaller ones fill in around
+// them without making them grow.
 void AllocaManager::computeRepresentatives() {
   NamedRegionTimer Timer("compute-representatives", "Compute Representatives",
                          TimerGroupName, TimerGroupDesc, TimePassesIsEnabled);
 
-  for (size_t i = 0, e = AllocasByIndex.size(); i != e; ++i) {
-    // If we've already represented this alloca with another, don't visit it.
-    if (AllocasByIndex[i].isForwarded()) continue;
-    if (i > size_t(INT_MAX)) continue;
+  size_t AllocaCount = AllocasByIndex.size();
 
-    // Find compatible allocas. This is a simple greedy algorithm.
-    for (int j = int(i); ; ) {
-      assert(j >= int(i));
-      j = AllocaCompatibility[i].find_next(j);
-      assert(j != int(i));
-      if (j < 0) break;
-      if (!AllocaCompatibility[j][i]) continue;
+  SmallVector<size_t, 32> Order;
+  uint64_t TotalSize = 0;
+  for (size_t i = 0; i != AllocaCount; ++i) {
+    Order.push_back(i);
+    TotalSize += AllocasByIndex[i].getSize();
+  }
+  std::stable_sort(Order.begin(), Order.end(), [this](size_t l, size_t r) {
+    const AllocaInfo &li = AllocasByIndex[l], &ri = AllocasByIndex[r];
+    if (li.getSize() != ri.getSize()) return li.getSize() > ri.getSize();
+    return li.getAlignment() > ri.getAlignment();
+  });
+
+  // Each slot is identified by its first alloca, and the row of that alloca in
+  // AllocaInterference accumulates the interference of everything in the slot.
+  SmallVector<size_t, 32> Slots;
+  SmallVector<size_t, 32> SlotOf(AllocaCount);
+  for (size_t j : Order) {
+    size_t Slot = AllocaCount;
+    for (size_t s : Slots) {
+      if (!AllocaInterference[s].test(j)) {
+        Slot = s;
+        break;
+      }
+    }
+    if (Slot == AllocaCount) {
+      Slots.push_back(j);
+      SlotOf[j] = j;
+      continue;
+    }
+    SlotOf[j] = Slot;
+    AllocaInterference[Slot] |= AllocaInterference[j];
+  }
 
-      DEBUG(dbgs() << "Allocas: "
-                      "Representing "
-                   << AllocasByIndex[j].getInst()->getName() << " "
-                      "with "
-                   << AllocasByIndex[i].getInst()->getName() << "\n");
-      ++NumAllocas;
+  // The representative of a slot is its first alloca in the entry block, so
+  // that it is defined before any of the others are used, and it takes on the
+  // size and alignment of the whole slot.
+  SmallVector<size_t, 32> Representative(AllocaCount, AllocaCount);
+  for (size_t j = 0; j != AllocaCount; ++j) {
+    size_t &i = Representative[SlotOf[j]];
+    if (i == AllocaCount) {
+      i = j;
+      continue;
+    }
 
-      assert(!AllocasByIndex[j].isForwarded());
+    DEBUG(dbgs() << "Allocas: "
+                    "Representing "
+                 << AllocasByIndex[j].getInst()->getName() << " "
+                    "with "
+                 << AllocasByIndex[i].getInst()->getName() << "\n");
+    ++NumAllocas;
 
-      AllocasByIndex[i].mergeSize(AllocasByIndex[j].getSize());
-      AllocasByIndex[i].mergeAlignment(AllocasByIndex[j].getAlignment());
-      AllocasByIndex[j].forward(i);
+    assert(!AllocasByIndex[j].isForwarded());
+
+    AllocasByIndex[i].mergeSize(AllocasByIndex[j].getSize());
+    AllocasByIndex[i].mergeAlignment(AllocasByIndex[j].getAlignment());
+    AllocasByIndex[j].forward(i);
+  }
 
-      AllocaCompatibility[i] &= AllocaCompatibility[j];
-      AllocaCompatibility[j].reset();
+  uint64_t ColoredSize = 0;
+  for (size_t i = 0; i != AllocaCount; ++i) {
+    if (!AllocasByIndex[i].isForwarded()) {
+      ColoredSize += AllocasByIndex[i].getSize();
     }
   }
+  NumBytesSaved += TotalSize - ColoredSize;
 }
 
 void AllocaManager::computeFrameOffsets() {
@@ -530,7 +586,7 @@ void AllocaManager::analyze(const Function &Func, const DataLayout &Layout,
 
   assert(Allocas.empty());
   assert(AllocasByIndex.empty());
-  assert(AllocaCompatibility.empty());
+  assert(AllocaInterference.empty());
   assert(BlockLiveness.empty());
   assert(StaticAllocas.empty());
   assert(SortedAllocas.empty());
@@ -562,8 +618,11 @@ void AllocaManager::analyze(const Function &Func, const DataLayout &Layout,
       BlockLiveness.clear();
 
       computeRepresentatives();
-      AllocaCompatibility.clear();
+      AllocaInterference.clear();
     }
+    BlockLiveness.clear();
+    BlocksInRPO.clear();
+    RPONumbers.clear();
   }
 
   computeFrameOffsets();
@@ -17,7 +17,6 @@
 #include "llvm/ADT/BitVector.h"
 #include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/SmallVector.h"
-#include "llvm/ADT/SetVector.h"
 
 namespace llvm {
 
@@ -35,8 +34,16 @@ class AllocaManager {
   const Function *LifetimeEnd;
   const Function *F;
 
+  // A lifetime start or end for one of the allocas we are coloring.
+  struct LifetimeMarker {
+    const AllocaInst *AI;
+    bool IsStart;
+    LifetimeMarker(const AllocaInst *A, bool S) : AI(A), IsStart(S) {}
+  };
+
   // Per-block lifetime information.
   struct BlockLifetimeInfo {
+    SmallVector<LifetimeMarker, 4> Markers;
     BitVector Start;
     BitVector End;
     BitVector LiveIn;
@@ -45,10 +52,17 @@ class AllocaManager {
   typedef DenseMap<const BasicBlock *, BlockLifetimeInfo> LivenessMap;
   LivenessMap BlockLiveness;
 
-  // Worklist for inter-block liveness analysis.
-  typedef SmallSetVector<const BasicBlock *, 8> InterBlockWorklistVec;
-  InterBlockWorklistVec InterBlockTopDownWorklist;
-  InterBlockWorklistVec InterBlockBottomUpWorklist;
+  // Blocks in reverse post-order, and their positions in it.
+  typedef SmallVector<const BasicBlock *, 32> BlockVec;
+  BlockVec BlocksInRPO;
+  DenseMap<const BasicBlock *, unsigned> RPONumbers;
+
+  // Worklists for inter-block liveness analysis. These are sets of positions
+  // in BlocksInRPO (reversed, for the bottom-up one), and we always take the
+  // first one, so that each block usually sees all the changes from its
+  // predecessors (or successors) at once instead of being revisited for each.
+  BitVector InterBlockTopDownWorklist;
+  BitVector InterBlockBottomUpWorklist;
 
   // Map allocas to their index in AllocasByIndex.
   typedef DenseMap<const AllocaInst *, size_t> AllocaMap;
@@ -111,11 +125,11 @@ class AllocaManager {
   typedef SmallVector<AllocaInfo, 32> AllocaVec;
   AllocaVec AllocasByIndex;
 
-  // For each alloca, which allocas can it safely represent? Allocas are
-  // identified by AllocasByIndex index.
-  // TODO: Vector-of-vectors isn't the fastest data structure possible here.
-  typedef SmallVector<BitVector, 32> AllocaCompatibilityVec;
-  AllocaCompatibilityVec AllocaCompatibility;
+  // For each alloca, which allocas are live at the same time as it? Allocas
+  // are identified by AllocasByIndex index. Rows are only ever updated and
+  // combined a whole live set at a time, which BitVector does a word at a time.
+  typedef SmallVector<BitVector, 32> AllocaInterferenceVec;
+  AllocaInterferenceVec AllocaInterference;
 
   // This is for allocas that will eventually be sorted.
   SmallVector<AllocaInfo, 32> SortedAllocas;
@@ -140,6 +154,8 @@ class AllocaManager {
   static int AllocaSort(const AllocaInfo *l, const AllocaInfo *r);
 
   void collectMarkedAllocas();
+  void addToTopDownWorklist(const BasicBlock *BB);
+  void addToBottomUpWorklist(const BasicBlock *BB);
   void collectBlocks();
   void computeInterBlockLiveness();
   void computeIntraBlockLiveness();
@@ -127,16 +127,18 @@ DEF_CALL_HANDLER(__default__, {
     Name = "invoke_" + Sig;
     NeedCasts = true;
   }
-  std::string text = Name;
-  if (!Emulated) text += "(";
+  SmallString<128> Text;
+  raw_svector_ostream TextStream(Text);
+  TextStream << Name;
+  if (!Emulated) TextStream << "(";
   if (Invoke) {
     // add first param
     if (F) {
-      text += relocateFunctionPointer(utostr(getFunctionIndex(F))); // convert to function pointer
+      TextStream << relocateFunctionPointer(getFunctionIndexStr(F)); // convert to function pointer
     } else {
-      text += getValueAsCastStr(CV); // already a function pointer
+      TextStream << streamValueAsCast(CV); // already a function pointer
     }
-    if (NumArgs > 0) text += ",";
+    if (NumArgs > 0) TextStream << ",";
   }
   // this is an ffi call if we need casts, and it is not a special Math_ builtin or wasm-only intrinsic
   bool FFI = NeedCasts;
@@ -152,13 +154,13 @@ DEF_CALL_HANDLER(__default__, {
   unsigned FFI_OUT = FFI ? ASM_FFI_OUT : 0;
   for (int i = 0; i < NumArgs; i++) {
     if (!NeedCasts) {
-      text += getValueAsStr(CI->getOperand(i));
+      TextStream << streamValue(CI->getOperand(i));
     } else {
-      text += getValueAsCastParenStr(CI->getOperand(i), ASM_NONSPECIFIC | FFI_OUT);
+      TextStream << streamValueAsCastParen(CI->getOperand(i), ASM_NONSPECIFIC | FFI_OUT);
     }
-    if (i < NumArgs - 1) text += ",";
+    if (i < NumArgs - 1) TextStream << ",";
   }
-  text += ")";
+  TextStream << ")";
   // handle return value
   Type *InstRT = CI->getType();
   Type *ActualRT = FT->getReturnType();
@@ -169,9 +171,14 @@ DEF_CALL_HANDLER(__default__, {
                            // it should have 0 uses, but just to be safe
   } else if (!ActualRT->isVoidTy()) {
     unsigned FFI_IN = FFI ? ASM_FFI_IN : 0;
-    text = getAssignIfNeeded(CI) + "(" + getCast(text, ActualRT, ASM_NONSPECIFIC | FFI_IN) + ")";
+    SmallString<128> Call;
+    raw_svector_ostream CallStream(Call);
+    printAssignIfNeeded(CallStream, CI) << "(";
+    printCastPrefix(CallStream, ActualRT, ASM_NONSPECIFIC | FFI_IN) << Text;
+    printCastSuffix(CallStream, ActualRT, ASM_NONSPECIFIC | FFI_IN) << ")";
+    return Call.str().str();
   }
-  return text;
+  return Text.str().str();
 })
 
 // exceptions support
@@ -557,7 +564,7 @@ DEF_CALL_HANDLER(llvm_dbg_declare, {
 
   if (auto const *ValAsAssign = dyn_cast<LocalAsMetadata>(AssignedValue)) {
     Declares.insert("metadata_llvm_dbg_value_local");
-    auto LocalVarName = getJSName(ValAsAssign->getValue()->stripPointerCasts());
+    std::string LocalVarName = getJSName(ValAsAssign->getValue()->stripPointerCasts());
     return "_metadata_llvm_dbg_value_local(" + LocalVarName + "," + VarMD + ")";
   } else if (auto const *ValAsAssign = dyn_cast<ConstantAsMetadata>(AssignedValue)) {
     Declares.insert("metadata_llvm_dbg_value_constant");
@@ -586,7 +593,7 @@ DEF_CALL_HANDLER(llvm_dbg_value, {
 
   if (auto const *ValAsAssign = dyn_cast<LocalAsMetadata>(AssignedValue)) {
     Declares.insert("metadata_llvm_dbg_value_local");
-    auto LocalVarName = getJSName(ValAsAssign->getValue()->stripPointerCasts());
+    std::string LocalVarName = getJSName(ValAsAssign->getValue()->stripPointerCasts());
     return "_metadata_llvm_dbg_value_local(" + LocalVarName + "," + VarMD + ")";
   } else if (auto const *ValAsAssign = dyn_cast<ConstantAsMetadata>(AssignedValue)) {
     Declares.insert("metadata_llvm_dbg_value_constant");
@@ -670,6 +677,23 @@ DEF_CALL_HANDLER(llvm_cttz_i64, {
   return CH___default__(CI, "_llvm_cttz_i64");
 })
 
+std::string swapBytes32(const std::string &V) {
+  return "((" + V + " << 24) | ((" + V + " & 65280) << 8) | ((" + V + " >>> 8) & 65280) | (" + V + " >>> 24))";
+}
+
+DEF_CALL_HANDLER(llvm_bswap_i64, {
+  if (OnlyWebAssembly) {
+    // library functions cannot receive or return an i64, so swap the bytes
+    // of each half with i32 operations, then swap the halves
+    std::string V = getValueAsStr(CI->getOperand(0));
+    std::string Low = swapBytes32("i64_trunc(" + V + ")");
+    std::string High = swapBytes32("i64_trunc(i64_lshr(" + V + ",i64_const(32,0)))");
+    return getAssign(CI) + "i64_or(i64_shl(i64_zext(" + Low + ">>>0),i64_const(32,0)),i64_zext(" + High + ">>>0))";
+  }
+  Declares.insert("llvm_bswap_i64");
+  return CH___default__(CI, "_llvm_bswap_i64");
+})
+
 DEF_CALL_HANDLER(llvm_ctpop_i32, {
   if (OnlyWebAssembly) {
     return CH___default__(CI, "i32_ctpop", 1);
@@ -720,7 +744,7 @@ std::string handleAsmConst(const Instruction *CI) {
     Sig += getFunctionSignatureLetter(CI->getOperand(i)->getType());
   }
   std::string func = "emscripten_asm_const_" + Sig;
-  std::string ret = "_" + func + "(" + utostr(getAsmConstId(CI->getOperand(0), Sig));
+  std::string ret = "_" + func + "(" + getAsmConstIdStr(CI->getOperand(0), Sig);
   for (unsigned i = 1; i < Num; i++) {
     ret += ", " + getValueAsCastParenStr(CI->getOperand(i), ASM_NONSPECIFIC);
   }
@@ -1645,6 +1669,7 @@ void setupCallHandlers() {
   SETUP_CALL_HANDLER(llvm_cttz_i64);
   SETUP_CALL_HANDLER(llvm_ctpop_i32);
   SETUP_CALL_HANDLER(llvm_ctpop_i64);
+  SETUP_CALL_HANDLER(llvm_bswap_i64);
   SETUP_CALL_HANDLER(llvm_maxnum_f32);
   SETUP_CALL_HANDLER(llvm_maxnum_f64);
   SETUP_CALL_HANDLER(llvm_copysign_f32);
@@ -2201,7 +2226,7 @@ std::string handleCall(const Instruction *CI) {
   // Get the name to call this function by. If it's a direct call, meaning
   // which know which Function we're calling, avoid calling getValueAsStr, as
   // we don't need to use a function index.
-  const std::string &Name = isa<Function>(CV) ? getJSName(CV) : getValueAsStr(CV);
+  const std::string &Name = isa<Function>(CV) ? getJSName(CV).str() : getValueAsStr(CV);
 
   CallHandlerMap::iterator CH = CallHandlers.find("___default__");
   if (isa<Function>(CV)) {
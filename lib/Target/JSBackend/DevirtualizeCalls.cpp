@@ -0,0 +1,141 @@
+//===-- DevirtualizeCalls.cpp - Speculative devirtualization ----*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// An indirect call in asm.js goes through the function table of its signature,
+//
+//   FUNCTION_TABLE_ii[x & 7](a)
+//
+// and only functions whose address is taken are ever added to a table. When
+// just one such function has the signature of an indirect call, that function
+// is the only one the call can reach through the tables we emit, so we call it
+// directly, which lets the JS engine inline it:
+//
+//   if ((x|0) == 5) r = _f(a)|0; else r = FUNCTION_TABLE_ii[x & 7](a)|0;
+//
+// The original call is kept on the other side of the guard, as functions may
+// still be added to the tables at runtime (reserved function pointers, dynamic
+// linking), and a bad pointer must still fail the way it did.
+//
+// Virtual calls that type metadata proves to have a single target are turned
+// into unguarded direct calls earlier, by WholeProgramDevirt.
+//
+//===----------------------------------------------------------------------===//
+
+#include "OptPasses.h"
+
+#include "llvm/ADT/Statistic.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+
+#include <vector>
+
+#define DEBUG_TYPE "emscripten-devirtualize-calls"
+
+namespace llvm {
+
+STATISTIC(NumSpeculated, "Number of indirect calls speculatively devirtualized");
+
+namespace {
+
+struct DevirtualizeCalls : public ModulePass {
+  static char ID; // Pass identification, replacement for typeid
+  DevirtualizeCalls() : ModulePass(ID) {}
+
+  bool runOnModule(Module &M) override;
+
+  StringRef getPassName() const override { return "DevirtualizeCalls"; }
+};
+
+char DevirtualizeCalls::ID = 0;
+
+// The address-taken function in a function table, or null if there are none
+// or several.
+struct TableTarget {
+  Function *Only = nullptr;
+  bool Many = false;
+};
+
+} // end anonymous namespace
+
+// Splits the block at CI, calling Target directly when the callee is Target
+// and through the original pointer otherwise.
+static void speculate(CallInst *CI, Function *Target) {
+  Value *Callee = CI->getCalledValue();
+  ICmpInst *IsTarget = new ICmpInst(CI, ICmpInst::ICMP_EQ, Callee, Target, "is_target");
+  IsTarget->setDebugLoc(CI->getDebugLoc());
+
+  TerminatorInst *ThenTerm, *ElseTerm;
+  SplitBlockAndInsertIfThenElse(IsTarget, CI, &ThenTerm, &ElseTerm);
+  BasicBlock *Tail = CI->getParent();
+
+  CallInst *Direct = cast<CallInst>(CI->clone());
+  Direct->setCalledFunction(Target);
+  Direct->insertBefore(ThenTerm);
+  CI->moveBefore(ElseTerm);
+
+  if (!CI->getType()->isVoidTy() && !CI->use_empty()) {
+    PHINode *Result = PHINode::Create(CI->getType(), 2, "", &Tail->front());
+    CI->replaceAllUsesWith(Result);
+    Result->addIncoming(Direct, Direct->getParent());
+    Result->addIncoming(CI, CI->getParent());
+    Result->takeName(CI);
+  }
+}
+
+bool DevirtualizeCalls::runOnModule(Module &M) {
+  // Keyed by the name JSWriter gives the table, so two functions share a key
+  // exactly when they share a table.
+  StringMap<TableTarget> Targets;
+  for (Function &F : M) {
+    if (F.isIntrinsic() || !F.hasAddressTaken()) continue;
+    TableTarget &Target = Targets[getJSFunctionSignature(F.getFunctionType())];
+    if (Target.Only) {
+      Target.Many = true;
+    }
+    Target.Only = &F;
+  }
+
+  std::vector<std::pair<CallInst*, Function*>> Calls;
+  for (Function &F : M) {
+    for (BasicBlock &BB : F) {
+      for (Instruction &I : BB) {
+        CallInst *CI = dyn_cast<CallInst>(&I);
+        if (!CI || CI->isMustTailCall() || CI->isInlineAsm()) continue;
+        // Calls through constants are direct calls or absolute addresses.
+        if (isa<Constant>(CI->getCalledValue())) continue;
+        auto T = Targets.find(getJSFunctionSignature(CI->getFunctionType()));
+        if (T == Targets.end() || T->second.Many) continue;
+        Function *Target = T->second.Only;
+        // A call with another IR type would need its arguments cast; leave it
+        // to the table.
+        if (Target->getFunctionType() != CI->getFunctionType()) continue;
+        Calls.push_back(std::make_pair(CI, Target));
+      }
+    }
+  }
+
+  for (auto &Call : Calls) {
+    speculate(Call.first, Call.second);
+    NumSpeculated++;
+  }
+
+  return !Calls.empty();
+}
+
+//
+
+extern ModulePass *createEmscriptenDevirtualizeCallsPass() {
+  return new DevirtualizeCalls();
+}
+
+} // End llvm namespace
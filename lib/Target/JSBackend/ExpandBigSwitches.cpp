@@ -1,4 +1,4 @@
-//===-- ExpandBigSwitches.cpp - Alloca optimization ---------------*- C++ -*-===//
+//===-- ExpandBigSwitches.cpp - Switch lowering for JS ------------*- C++ -*-===//
 //
 //                     The LLVM Compiler Infrastructure
 //
@@ -7,23 +7,71 @@
 //
 //===-----------------------------------------------------------------------===//
 //
-// Very large switches can be a problem for JS engines. We split them up here.
+// Very large or sparse switches can be a problem for JS engines: a JS switch
+// is only an indexed jump when its cases are dense, and after asm2wasm every
+// hole in its range is a br_table slot. We split such switches into clusters,
+// in the spirit of SelectionDAGBuilder's jump table and bit test clustering:
+//
+//  * dense runs of cases stay JS switches, which are table lookups,
+//  * small runs going to a few destinations become bit tests, as in
+//      if ((1 << (x - 10)) & 0x2a) ...
+//  * everything else becomes range and equality tests,
+//
+// and dispatch to the clusters with a balanced binary search tree. Switches
+// that are best left as a single table are not touched.
 //
 //===-----------------------------------------------------------------------===//
 
 #include "OptPasses.h"
 
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/Statistic.h"
 #include "llvm/IR/Instruction.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/Function.h"
+#include "llvm/IR/CFG.h"
 #include "llvm/IR/Constants.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
 
 #include <vector>
 #include <algorithm>
 
+#define DEBUG_TYPE "expand-big-switches"
+
 namespace llvm {
 
+STATISTIC(NumSwitchesClustered, "Number of switches split into clusters");
+STATISTIC(NumJumpTables, "Number of JS switches emitted for dense clusters");
+STATISTIC(NumBitTests, "Number of bit test clusters");
+STATISTIC(NumRangeTests, "Number of range and equality test clusters");
+
+static cl::opt<unsigned>
+MinTableDensity("emscripten-switch-min-table-density",
+                cl::desc("Minimum percentage of a switch's range that must be covered by cases for it to stay a table (40% when optimizing for size)"),
+                cl::init(10));
+
+// The cost model, in units of one compare and branch on the dispatch path.
+// A JS switch on dense integers is a bounds check and an indexed jump in the
+// engines (and a br_table after asm2wasm), which is worth a few compares; below
+// a handful of cases the compares are as fast and smaller.
+static const unsigned CompareCost = 1;
+static const unsigned TableCost = 3;
+static const unsigned MinTableCases = 4;
+
+// Limits on a single table, beyond which JS engines stop compiling switches
+// well. These were the limits at which the switch used to be split in half.
+static const uint64_t MaxTableRange = 10*1024;
+static const unsigned MaxTableCases = 1024;
+
+// Bit tests work on 32-bit JS integers, and test for at most this many
+// destinations after one range check.
+static const unsigned BitTestWidth = 32;
+static const unsigned MaxBitTestDests = 3;
+
 struct ExpandBigSwitches : public FunctionPass {
   static char ID; // Pass identification, replacement for typeid
   ExpandBigSwitches() : FunctionPass(ID) {}
@@ -36,114 +84,453 @@ struct ExpandBigSwitches : public FunctionPass {
 
 char ExpandBigSwitches::ID = 0;
 
-// Check if we need to split a switch. If so, return the median, on which we will do so
-static bool ConsiderSplit(const SwitchInst *SI, int64_t& Median) {
-  int64_t Minn = INT64_MAX, Maxx = INT64_MIN;
-  std::vector<int64_t> Values;
-  for (SwitchInst::ConstCaseIt i = SI->case_begin(), e = SI->case_end(); i != e; ++i) {
-    int64_t Curr = i.getCaseValue()->getSExtValue();
-    if (Curr < Minn) Minn = Curr;
-    if (Curr > Maxx) Maxx = Curr;
-    Values.push_back(Curr);
-  }
-  int64_t Range = Maxx - Minn;
-  int Num = SI->getNumCases();
-  if (Num < 1024 && Range <= 10*1024 && (Range/Num) <= 1024) return false;
-  // this is either too big, or too rangey
-  std::sort(Values.begin(), Values.end());
-  Median = Values[Values.size()/2];
-  return true;
-}
+namespace {
+
+// A run of the sorted cases of a switch, [First, Last], and how to test for
+// it. Range clusters cover consecutive values going to a single destination.
+struct CaseCluster {
+  enum ClusterKind { Range, Table, BitTests } Kind;
+  unsigned First, Last;
+  int64_t Low, High;
+  uint64_t Weight;
+};
+
+struct SwitchCase {
+  int64_t Value;
+  BasicBlock *Dest;
+  uint64_t Weight;
+};
 
-static void DoSplit(SwitchInst *SI, int64_t Median) {
-  // switch (x) { ..very many.. }
-  //
-  //   ==>
-  //
-  // if (x < median) {
-  //   switch (x) { ..first half.. }
-  // } else {
-  //   switch (x) { ..second half.. }
-  // }
-
-  BasicBlock *SwitchBB = SI->getParent();
-  Function *F = SwitchBB->getParent();
-  Value *Condition = SI->getOperand(0);
-  BasicBlock *DD = SI->getDefaultDest();
-  unsigned NumItems = SI->getNumCases();
-  Type *T = Condition->getType();
-
-  Instruction *Check = new ICmpInst(SI, ICmpInst::ICMP_SLT, Condition, ConstantInt::get(T, Median), "switch-split");
-  BasicBlock *LowBB = BasicBlock::Create(SI->getContext(), "switchsplit_low", F);
-  BasicBlock *HighBB = BasicBlock::Create(SI->getContext(), "switchsplit_high", F);
-  BranchInst *Br = BranchInst::Create(LowBB, HighBB, Check, SwitchBB);
-
-  SwitchInst *LowSI = SwitchInst::Create(Condition, DD, NumItems/2, LowBB);
-  SwitchInst *HighSI = SwitchInst::Create(Condition, DD, NumItems/2, HighBB);
+class SwitchLowering {
+  SwitchInst *SI;
+  BasicBlock *SwitchBB;
+  BasicBlock *Default;
+  Value *Condition;
+  IntegerType *T;
+  bool HasProfile;
+  bool OptForSize;
+  uint64_t DefaultWeight; // of the default and the cases that go to it
+  std::vector<SwitchCase> Cases;
+  std::vector<CaseCluster> Clusters;
+  std::vector<BasicBlock*> NewBlocks;
 
+  void collectCases();
+  void rangeify();
+  unsigned getNumCases(unsigned First, unsigned Last) const;
+  bool isDense(unsigned First, unsigned Last) const;
+  bool canBitTest(unsigned First, unsigned Last, uint64_t *Cmps) const;
+  CaseCluster merge(CaseCluster::ClusterKind Kind, unsigned First, unsigned Last) const;
+  void findJumpTables();
+  void findBitTests();
+
+  BasicBlock *createBlock(const char *Name);
+  void setWeights(BranchInst *Br, uint64_t TrueWeight, uint64_t FalseWeight);
+  void branch(BasicBlock *BB, Value *Cond, BasicBlock *True, BasicBlock *False, uint64_t TrueWeight, uint64_t FalseWeight);
+  Value *getOffset(BasicBlock *BB, int64_t Low);
+  void lowerCluster(const CaseCluster &C, BasicBlock *BB, BasicBlock *Next, int64_t KnownLow, int64_t KnownHigh, uint64_t NextWeight);
+  void lowerTree(ArrayRef<CaseCluster> Tree, BasicBlock *BB, int64_t KnownLow, int64_t KnownHigh, uint64_t TreeDefaultWeight);
+
+public:
+  SwitchLowering(SwitchInst *S);
+  bool run();
+};
+
+} // end anonymous namespace
+
+SwitchLowering::SwitchLowering(SwitchInst *S)
+  : SI(S), SwitchBB(S->getParent()), Default(S->getDefaultDest()),
+    Condition(S->getCondition()), T(cast<IntegerType>(S->getCondition()->getType())),
+    HasProfile(false), OptForSize(SwitchBB->getParent()->optForSize()), DefaultWeight(0) {}
+
+void SwitchLowering::collectCases() {
+  MDNode *Weights = SI->getMetadata(LLVMContext::MD_prof);
+  if (Weights && Weights->getNumOperands() == SI->getNumCases() + 2) {
+    MDString *Name = dyn_cast<MDString>(Weights->getOperand(0));
+    HasProfile = Name && Name->getString() == "branch_weights";
+  }
+  if (HasProfile) {
+    DefaultWeight = mdconst::extract<ConstantInt>(Weights->getOperand(1))->getZExtValue();
+  }
   for (SwitchInst::CaseIt i = SI->case_begin(), e = SI->case_end(); i != e; ++i) {
-    BasicBlock *BB = i.getCaseSuccessor();
-    auto Value = i.getCaseValue();
-    SwitchInst *NewSI = Value->getSExtValue() < Median ? LowSI : HighSI;
-    NewSI->addCase(Value, BB);
-    // update phis
-    BasicBlock *NewBB = NewSI->getParent();
-    for (BasicBlock::iterator I = BB->begin(); I != BB->end(); ++I) {
+    BasicBlock *Dest = i.getCaseSuccessor();
+    uint64_t Weight = 1;
+    if (HasProfile) {
+      Weight = mdconst::extract<ConstantInt>(Weights->getOperand(i.getCaseIndex() + 2))->getZExtValue();
+    }
+    if (Dest == Default) {
+      // The default is where we end up anyhow, but the case adds to its weight.
+      if (HasProfile) DefaultWeight += Weight;
+      continue;
+    }
+    Cases.push_back(SwitchCase{i.getCaseValue()->getSExtValue(), Dest, Weight});
+  }
+  std::sort(Cases.begin(), Cases.end(), [](const SwitchCase &A, const SwitchCase &B) {
+    return A.Value < B.Value;
+  });
+}
+
+// Merge consecutive cases going to the same block into one range cluster.
+void SwitchLowering::rangeify() {
+  for (unsigned i = 0; i < Cases.size(); i++) {
+    if (!Clusters.empty()) {
+      CaseCluster &Prev = Clusters.back();
+      if (Cases[Prev.Last].Dest == Cases[i].Dest && Prev.High + 1 == Cases[i].Value) {
+        Prev.Last = i;
+        Prev.High = Cases[i].Value;
+        Prev.Weight += Cases[i].Weight;
+        continue;
+      }
+    }
+    Clusters.push_back(CaseCluster{CaseCluster::Range, i, i, Cases[i].Value, Cases[i].Value, Cases[i].Weight});
+  }
+}
+
+unsigned SwitchLowering::getNumCases(unsigned First, unsigned Last) const {
+  return Clusters[Last].Last - Clusters[First].First + 1;
+}
+
+// Whether clusters [First, Last] are worth a JS switch of their own.
+bool SwitchLowering::isDense(unsigned First, unsigned Last) const {
+  uint64_t Range = uint64_t(Clusters[Last].High) - uint64_t(Clusters[First].Low);
+  if (Range >= MaxTableRange) return false;
+  unsigned NumCases = getNumCases(First, Last);
+  if (NumCases < MinTableCases || NumCases > MaxTableCases) return false;
+  uint64_t Density = OptForSize ? std::max(40u, unsigned(MinTableDensity)) : unsigned(MinTableDensity);
+  return NumCases * 100 >= (Range + 1) * Density;
+}
+
+// Whether clusters [First, Last] can be tested with one range check and a bit
+// mask per destination, and if so, how many compares that replaces.
+bool SwitchLowering::canBitTest(unsigned First, unsigned Last, uint64_t *Cmps) const {
+  uint64_t Range = uint64_t(Clusters[Last].High) - uint64_t(Clusters[First].Low);
+  if (Range >= std::min(BitTestWidth, T->getBitWidth())) return false;
+  SmallVector<BasicBlock*, MaxBitTestDests> Dests;
+  *Cmps = 0;
+  for (unsigned i = First; i <= Last; i++) {
+    const CaseCluster &C = Clusters[i];
+    *Cmps += C.Low == C.High ? 1 : 2;
+    BasicBlock *Dest = Cases[C.First].Dest;
+    if (std::find(Dests.begin(), Dests.end(), Dest) == Dests.end()) {
+      if (Dests.size() == MaxBitTestDests) return false;
+      Dests.push_back(Dest);
+    }
+  }
+  // The same thresholds as SelectionDAGBuilder: each destination costs a mask
+  // test on top of the range check and the shift.
+  switch (Dests.size()) {
+    case 1: return *Cmps >= 3;
+    case 2: return *Cmps >= 5;
+    default: return *Cmps >= 6;
+  }
+}
+
+CaseCluster SwitchLowering::merge(CaseCluster::ClusterKind Kind, unsigned First, unsigned Last) const {
+  CaseCluster Merged{Kind, Clusters[First].First, Clusters[Last].Last,
+                     Clusters[First].Low, Clusters[Last].High, 0};
+  for (unsigned i = First; i <= Last; i++) Merged.Weight += Clusters[i].Weight;
+  return Merged;
+}
+
+// Partition the range clusters into tables and lone clusters, minimizing the
+// total cost. MinCost[i] is the cheapest way to test for clusters [i, N).
+// Tables are bounded in size, so this is linear in the number of clusters.
+void SwitchLowering::findJumpTables() {
+  unsigned N = Clusters.size();
+  std::vector<uint64_t> MinCost(N + 1);
+  std::vector<unsigned> LastElement(N);
+  MinCost[N] = 0;
+  for (int i = N - 1; i >= 0; i--) {
+    MinCost[i] = CompareCost + MinCost[i + 1];
+    LastElement[i] = i;
+    for (unsigned j = i + 1; j < N; j++) {
+      if (uint64_t(Clusters[j].High) - uint64_t(Clusters[i].Low) >= MaxTableRange ||
+          getNumCases(i, j) > MaxTableCases) {
+        break;
+      }
+      if (!isDense(i, j)) continue;
+      uint64_t Cost = TableCost + MinCost[j + 1];
+      if (Cost < MinCost[i]) {
+        MinCost[i] = Cost;
+        LastElement[i] = j;
+      }
+    }
+  }
+  std::vector<CaseCluster> Partitioned;
+  for (unsigned i = 0; i < N; i = LastElement[i] + 1) {
+    if (LastElement[i] == i) {
+      Partitioned.push_back(Clusters[i]);
+    } else {
+      Partitioned.push_back(merge(CaseCluster::Table, i, LastElement[i]));
+    }
+  }
+  Clusters.swap(Partitioned);
+}
+
+// Look for bit tests among the runs of range clusters left between tables,
+// again minimizing the number of tests.
+void SwitchLowering::findBitTests() {
+  std::vector<CaseCluster> Partitioned;
+  unsigned N = Clusters.size();
+  for (unsigned Begin = 0; Begin < N; ) {
+    if (Clusters[Begin].Kind != CaseCluster::Range) {
+      Partitioned.push_back(Clusters[Begin++]);
+      continue;
+    }
+    unsigned End = Begin;
+    while (End < N && Clusters[End].Kind == CaseCluster::Range) End++;
+    std::vector<uint64_t> MinCost(End - Begin + 1);
+    std::vector<unsigned> LastElement(End - Begin);
+    MinCost[End - Begin] = 0;
+    for (int i = End - 1; i >= int(Begin); i--) {
+      unsigned Index = i - Begin;
+      MinCost[Index] = CompareCost + MinCost[Index + 1];
+      LastElement[Index] = i;
+      for (unsigned j = i + 1; j < End; j++) {
+        uint64_t Cmps;
+        if (uint64_t(Clusters[j].High) - uint64_t(Clusters[i].Low) >= BitTestWidth) break;
+        if (!canBitTest(i, j, &Cmps)) continue;
+        uint64_t Cost = CompareCost + MinCost[j - Begin + 1];
+        if (Cost < MinCost[Index]) {
+          MinCost[Index] = Cost;
+          LastElement[Index] = j;
+        }
+      }
+    }
+    for (unsigned i = Begin; i < End; i = LastElement[i - Begin] + 1) {
+      unsigned Last = LastElement[i - Begin];
+      if (Last == i) {
+        Partitioned.push_back(Clusters[i]);
+      } else {
+        Partitioned.push_back(merge(CaseCluster::BitTests, i, Last));
+      }
+    }
+    Begin = End;
+  }
+  Clusters.swap(Partitioned);
+}
+
+BasicBlock *SwitchLowering::createBlock(const char *Name) {
+  BasicBlock *InsertBefore = NewBlocks.empty() ? SwitchBB->getNextNode() : NewBlocks.back()->getNextNode();
+  BasicBlock *BB = BasicBlock::Create(SwitchBB->getContext(), Name, SwitchBB->getParent(), InsertBefore);
+  NewBlocks.push_back(BB);
+  return BB;
+}
+
+void SwitchLowering::setWeights(BranchInst *Br, uint64_t TrueWeight, uint64_t FalseWeight) {
+  if (!HasProfile) return;
+  // Branch weights are 32-bit.
+  while (TrueWeight > UINT32_MAX || FalseWeight > UINT32_MAX) {
+    TrueWeight >>= 1;
+    FalseWeight >>= 1;
+  }
+  Br->setMetadata(LLVMContext::MD_prof, MDBuilder(SwitchBB->getContext()).createBranchWeights(TrueWeight, FalseWeight));
+}
+
+void SwitchLowering::branch(BasicBlock *BB, Value *Cond, BasicBlock *True, BasicBlock *False, uint64_t TrueWeight, uint64_t FalseWeight) {
+  setWeights(BranchInst::Create(True, False, Cond, BB), TrueWeight, FalseWeight);
+}
+
+Value *SwitchLowering::getOffset(BasicBlock *BB, int64_t Low) {
+  if (Low == 0) return Condition;
+  return BinaryOperator::Create(Instruction::Sub, Condition, ConstantInt::get(T, Low), "switch_off", BB);
+}
+
+// Emit code in BB that branches to the destination of C if the condition is in
+// it, and to Next otherwise. The condition is known to be in [KnownLow,
+// KnownHigh], which lets us drop checks.
+void SwitchLowering::lowerCluster(const CaseCluster &C, BasicBlock *BB, BasicBlock *Next, int64_t KnownLow, int64_t KnownHigh, uint64_t NextWeight) {
+  switch (C.Kind) {
+    case CaseCluster::Range: {
+      NumRangeTests++;
+      BasicBlock *Dest = Cases[C.First].Dest;
+      Value *Cond;
+      if (C.Low == KnownLow && C.High == KnownHigh) {
+        BranchInst::Create(Dest, BB);
+        return;
+      } else if (C.Low == C.High) {
+        Cond = new ICmpInst(*BB, ICmpInst::ICMP_EQ, Condition, ConstantInt::get(T, C.Low), "switch_eq");
+      } else if (C.Low == KnownLow) {
+        Cond = new ICmpInst(*BB, ICmpInst::ICMP_SLE, Condition, ConstantInt::get(T, C.High), "switch_le");
+      } else if (C.High == KnownHigh) {
+        Cond = new ICmpInst(*BB, ICmpInst::ICMP_SGE, Condition, ConstantInt::get(T, C.Low), "switch_ge");
+      } else {
+        Cond = new ICmpInst(*BB, ICmpInst::ICMP_ULE, getOffset(BB, C.Low), ConstantInt::get(T, C.High - C.Low), "switch_in");
+      }
+      branch(BB, Cond, Dest, Next, C.Weight, NextWeight);
+      return;
+    }
+    case CaseCluster::Table: {
+      NumJumpTables++;
+      SwitchInst *Table = SwitchInst::Create(Condition, Next, C.Last - C.First + 1, BB);
+      for (unsigned i = C.First; i <= C.Last; i++) {
+        Table->addCase(ConstantInt::get(T, Cases[i].Value), Cases[i].Dest);
+      }
+      if (HasProfile) {
+        SmallVector<uint32_t, 16> Weights;
+        Weights.push_back(std::min<uint64_t>(NextWeight, UINT32_MAX));
+        for (unsigned i = C.First; i <= C.Last; i++) {
+          Weights.push_back(std::min<uint64_t>(Cases[i].Weight, UINT32_MAX));
+        }
+        Table->setMetadata(LLVMContext::MD_prof, MDBuilder(SwitchBB->getContext()).createBranchWeights(Weights));
+      }
+      return;
+    }
+    case CaseCluster::BitTests: {
+      NumBitTests++;
+      // Collect a mask of the offsets from Low per destination, heaviest first.
+      SmallVector<BasicBlock*, MaxBitTestDests> Dests;
+      SmallVector<uint64_t, MaxBitTestDests> Masks, Weights;
+      for (unsigned i = C.First; i <= C.Last; i++) {
+        unsigned Index = std::find(Dests.begin(), Dests.end(), Cases[i].Dest) - Dests.begin();
+        if (Index == Dests.size()) {
+          Dests.push_back(Cases[i].Dest);
+          Masks.push_back(0);
+          Weights.push_back(0);
+        }
+        Masks[Index] |= uint64_t(1) << (Cases[i].Value - C.Low);
+        Weights[Index] += Cases[i].Weight;
+      }
+      SmallVector<unsigned, MaxBitTestDests> Order;
+      for (unsigned i = 0; i < Dests.size(); i++) Order.push_back(i);
+      std::stable_sort(Order.begin(), Order.end(), [&](unsigned A, unsigned B) {
+        return Weights[A] > Weights[B];
+      });
+      // if ((x - Low) >>> 0 <= High - Low) { bit = 1 << (x - Low); ... }
+      Value *Offset = getOffset(BB, C.Low);
+      if (C.Low != KnownLow || C.High != KnownHigh) {
+        BasicBlock *TestBB = createBlock("switch_bits");
+        Value *InRange = new ICmpInst(*BB, ICmpInst::ICMP_ULE, Offset, ConstantInt::get(T, C.High - C.Low), "switch_in");
+        branch(BB, InRange, TestBB, Next, C.Weight, NextWeight);
+        BB = TestBB;
+      }
+      Value *Bit = BinaryOperator::Create(Instruction::Shl, ConstantInt::get(T, 1), Offset, "switch_bit", BB);
+      uint64_t RestWeight = C.Weight + NextWeight;
+      for (unsigned i = 0; i < Order.size(); i++) {
+        unsigned Index = Order[i];
+        RestWeight -= Weights[Index];
+        BasicBlock *Else = i + 1 < Order.size() ? createBlock("switch_bits") : Next;
+        Value *Masked = BinaryOperator::Create(Instruction::And, Bit, ConstantInt::get(T, Masks[Index]), "switch_mask", BB);
+        Value *Cond = new ICmpInst(*BB, ICmpInst::ICMP_NE, Masked, ConstantInt::get(T, 0), "switch_hit");
+        branch(BB, Cond, Dests[Index], Else, Weights[Index], RestWeight);
+        BB = Else;
+      }
+      return;
+    }
+  }
+}
+
+// Emit a binary search over the clusters in Tree, all of which lie within
+// [KnownLow, KnownHigh], starting in BB. A few clusters are just tested in
+// order, heaviest first. TreeDefaultWeight is the part of the default's weight
+// that is reached through this tree: as in SelectionDAGBuilder, we assume that
+// the default is reached as often from either side of a pivot.
+void SwitchLowering::lowerTree(ArrayRef<CaseCluster> Tree, BasicBlock *BB, int64_t KnownLow, int64_t KnownHigh, uint64_t TreeDefaultWeight) {
+  if (Tree.size() <= 3) {
+    SmallVector<const CaseCluster*, 3> Order;
+    uint64_t RestWeight = TreeDefaultWeight;
+    for (const CaseCluster &C : Tree) {
+      Order.push_back(&C);
+      RestWeight += C.Weight;
+    }
+    std::stable_sort(Order.begin(), Order.end(), [](const CaseCluster *A, const CaseCluster *B) {
+      return A->Weight > B->Weight;
+    });
+    for (unsigned i = 0; i < Order.size(); i++) {
+      RestWeight -= Order[i]->Weight;
+      BasicBlock *Next = i + 1 < Order.size() ? createBlock("switch_leaf") : Default;
+      lowerCluster(*Order[i], BB, Next, KnownLow, KnownHigh, RestWeight);
+      BB = Next;
+    }
+    return;
+  }
+  // Pivot where the weights on either side are the most even.
+  uint64_t LeftDefaultWeight = TreeDefaultWeight / 2;
+  uint64_t Total = TreeDefaultWeight;
+  for (const CaseCluster &C : Tree) Total += C.Weight;
+  unsigned Pivot = 1;
+  uint64_t Left = LeftDefaultWeight + Tree[0].Weight, BestDiff = UINT64_MAX;
+  for (unsigned i = 1; i < Tree.size(); i++) {
+    uint64_t Right = Total - Left;
+    uint64_t Diff = Left > Right ? Left - Right : Right - Left;
+    if (Diff < BestDiff) {
+      BestDiff = Diff;
+      Pivot = i;
+    }
+    Left += Tree[i].Weight;
+  }
+  uint64_t LeftWeight = LeftDefaultWeight;
+  for (unsigned i = 0; i < Pivot; i++) LeftWeight += Tree[i].Weight;
+  int64_t PivotValue = Tree[Pivot].Low;
+  BasicBlock *LowBB = createBlock("switch_low");
+  BasicBlock *HighBB = createBlock("switch_high");
+  Value *Cond = new ICmpInst(*BB, ICmpInst::ICMP_SLT, Condition, ConstantInt::get(T, PivotValue), "switch_lt");
+  branch(BB, Cond, LowBB, HighBB, LeftWeight, Total - LeftWeight);
+  lowerTree(Tree.slice(0, Pivot), LowBB, KnownLow, PivotValue - 1, LeftDefaultWeight);
+  lowerTree(Tree.slice(Pivot), HighBB, PivotValue, KnownHigh, TreeDefaultWeight - LeftDefaultWeight);
+}
+
+bool SwitchLowering::run() {
+  if (T->getBitWidth() > 64) return false;
+  collectCases();
+  // Engines handle a few cases well, unless they are very spread out.
+  if (Cases.empty() ||
+      (Cases.size() < MinTableCases && uint64_t(Cases.back().Value) - uint64_t(Cases[0].Value) < MaxTableRange)) {
+    return false;
+  }
+  rangeify();
+  findJumpTables();
+  // Leave switches that are a single table alone.
+  if (Clusters.size() == 1 && Clusters[0].Kind == CaseCluster::Table) return false;
+  findBitTests();
+  NumSwitchesClustered++;
+
+  // Phis in the destinations get a copy of their incoming value from the
+  // switch for each new edge.
+  DenseMap<BasicBlock*, SmallVector<std::pair<PHINode*, Value*>, 2>> Phis;
+  SmallPtrSet<BasicBlock*, 16> Dests;
+  for (BasicBlock *Dest : successors(SwitchBB)) {
+    if (!Dests.insert(Dest).second) continue;
+    for (BasicBlock::iterator I = Dest->begin(); I != Dest->end(); ++I) {
       PHINode *Phi = dyn_cast<PHINode>(I);
       if (!Phi) break;
       int Index = Phi->getBasicBlockIndex(SwitchBB);
       if (Index < 0) continue;
-      Phi->addIncoming(Phi->getIncomingValue(Index), NewBB);
-      Phi->removeIncomingValue(Index);
+      Phis[Dest].push_back(std::make_pair(Phi, Phi->getIncomingValue(Index)));
+      while ((Index = Phi->getBasicBlockIndex(SwitchBB)) >= 0) {
+        Phi->removeIncomingValue(Index, false);
+      }
     }
   }
 
-  // fix default dest
-  for (BasicBlock::iterator I = DD->begin(); I != DD->end(); ++I) {
-    PHINode *Phi = dyn_cast<PHINode>(I);
-    if (!Phi) break;
-    int Index = Phi->getBasicBlockIndex(SwitchBB);
-    if (Index < 0) continue;
-    Phi->addIncoming(Phi->getIncomingValue(Index), LowBB);
-    Phi->addIncoming(Phi->getIncomingValue(Index), HighBB);
-    Phi->removeIncomingValue(Index);
-  }
-
-  // finish up
   SI->eraseFromParent();
-  assert(SwitchBB->getTerminator() == Br);
-  assert(LowSI->getNumCases() + HighSI->getNumCases() == NumItems);
-  assert(LowSI->getNumCases() < HighSI->getNumCases() + 2);
-  assert(HighSI->getNumCases() < LowSI->getNumCases() + 2);
+  int64_t Min = APInt::getSignedMinValue(T->getBitWidth()).getSExtValue();
+  int64_t Max = APInt::getSignedMaxValue(T->getBitWidth()).getSExtValue();
+  lowerTree(Clusters, SwitchBB, Min, Max, DefaultWeight);
+
+  NewBlocks.push_back(SwitchBB);
+  for (BasicBlock *BB : NewBlocks) {
+    TerminatorInst *TI = BB->getTerminator();
+    for (unsigned i = 0, e = TI->getNumSuccessors(); i < e; i++) {
+      auto I = Phis.find(TI->getSuccessor(i));
+      if (I == Phis.end()) continue;
+      for (auto &Incoming : I->second) Incoming.first->addIncoming(Incoming.second, BB);
+    }
+  }
+  return true;
 }
 
 bool ExpandBigSwitches::runOnFunction(Function &Func) {
   bool Changed = false;
 
-  struct SplitInfo {
-    SwitchInst *SI;
-    int64_t Median;
-  };
-
-  while (1) { // repetively split in 2
-    std::vector<SplitInfo> ToSplit;
-    // find switches we need to split
-    for (Function::iterator B = Func.begin(), E = Func.end(); B != E; ++B) {
-      Instruction *I = B->getTerminator();
-      SwitchInst *SI = dyn_cast<SwitchInst>(I);
-      if (!SI) continue;
-      SplitInfo Curr;
-      if (!ConsiderSplit(SI, Curr.Median)) continue;
-      Curr.SI = SI;
-      Changed = true;
-      ToSplit.push_back(Curr);
-    }
-    if (ToSplit.size() == 0) break;
-    // split them
-    for (auto& Curr : ToSplit) {
-      DoSplit(Curr.SI, Curr.Median);
+  std::vector<SwitchInst*> Switches;
+  for (Function::iterator B = Func.begin(), E = Func.end(); B != E; ++B) {
+    if (SwitchInst *SI = dyn_cast<SwitchInst>(B->getTerminator())) {
+      Switches.push_back(SI);
     }
   }
+  for (SwitchInst *SI : Switches) {
+    Changed |= SwitchLowering(SI).run();
+  }
 
   return Changed;
 }
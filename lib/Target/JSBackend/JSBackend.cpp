@@ -17,36 +17,56 @@
 #include "JSTargetMachine.h"
 #include "MCTargetDesc/JSBackendMCTargetDesc.h"
 #include "AllocaManager.h"
+#include "LocalCoalescer.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/BranchProbabilityInfo.h"
+#include "llvm/Analysis/LoopInfo.h"
 #include "llvm/Analysis/ValueTracking.h"
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/SmallString.h"
 #include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSet.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/Config/config.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Dominators.h"
 #include "llvm/IR/InlineAsm.h"
 #include "llvm/IR/Instruction.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/Intrinsics.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Operator.h"
+#include "llvm/IR/TypeFinder.h"
 #include "llvm/Pass.h"
 #include "llvm/IR/LegacyPassManager.h"
 #include "llvm/IR/CallSite.h"
+#include "llvm/Support/Allocator.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/FileSystem.h"
 #include "llvm/IR/GetElementPtrTypeIterator.h"
 #include "llvm/Support/MathExtras.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/SHA1.h"
 #include "llvm/Support/ScopedPrinter.h"
+#include "llvm/Support/StringSaver.h"
 #include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/ThreadPool.h"
 #include "llvm/IR/DebugInfo.h"
 #include "llvm/Transforms/IPO.h"
 #include "llvm/Transforms/NaCl.h"
 #include "llvm/Transforms/Scalar.h"
 #include <algorithm>
+#include <atomic>
 #include <cstdio>
+#include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <set> // TODO: unordered_set?
 #include <sstream>
 using namespace llvm;
@@ -164,6 +184,145 @@ OnlyWebAssembly("emscripten-only-wasm",
                 cl::desc("Generate code that will only ever be used as WebAssembly, and is not valid JS or asm.js"),
                 cl::init(false));
 
+static cl::opt<bool>
+WasmSIMD("emscripten-wasm-simd",
+         cl::desc("Emit vector operations as WebAssembly SIMD operations instead of SIMD.js (requires -emscripten-only-wasm)"),
+         cl::init(false));
+
+static cl::opt<unsigned>
+EmitThreads("emscripten-emit-threads",
+            cl::desc("Number of threads to emit function bodies on (0 or 1 emits them serially; the output is identical either way)"),
+            cl::init(0));
+
+static cl::opt<std::string>
+EmitCacheDir("emscripten-emit-cache-dir",
+             cl::desc("Directory in which to cache the emitted code of each function, keyed by a hash of its IR, what it refers to and the options that affect it"),
+             cl::init(""));
+
+static cl::opt<bool>
+EnableOutlining("emscripten-outline",
+                cl::desc("Outline repeated instruction sequences into shared helper functions when that makes the output smaller"),
+                cl::init(false));
+
+static cl::opt<bool>
+WholeProgramDevirt("emscripten-whole-program-devirt",
+                   cl::desc("Turn virtual calls that type metadata (-fwhole-program-vtables) proves to have a single target into direct calls (ignored with -emscripten-relocatable)"),
+                   cl::init(false));
+
+static cl::opt<bool>
+DevirtualizeCalls("emscripten-devirtualize-calls",
+                  cl::desc("Call the only address-taken function of an indirect call's function table directly, behind a check of the pointer"),
+                  cl::init(false));
+
+enum MemInitFormatKind { MemInitArray, MemInitBase64, MemInitFile };
+
+static cl::opt<MemInitFormatKind>
+MemInitFormat("emscripten-mem-init-format",
+              cl::desc("How to emit the memory initializer"),
+              cl::values(clEnumValN(MemInitArray, "array", "A list of bytes passed to allocate()"),
+                         clEnumValN(MemInitBase64, "base64", "Base64 strings decoded at startup, leaving out long runs of zeros"),
+                         clEnumValN(MemInitFile, "file", "A binary file loaded at startup (see -emscripten-mem-init-file and emscripten --memory-init-file)")),
+              cl::init(MemInitArray));
+
+static cl::opt<std::string>
+MemInitFileName("emscripten-mem-init-file",
+                cl::desc("Where to write the memory initializer with -emscripten-mem-init-format=file; the output refers to it by its file name"),
+                cl::init(""));
+
+static cl::opt<bool>
+MergeConstants("emscripten-merge-constants",
+               cl::desc("Give constant globals whose address is not significant and whose contents are identical a single copy in memory"),
+               cl::init(true));
+
+static cl::opt<bool>
+CoalesceLocals("emscripten-coalesce-locals",
+               cl::desc("Let values whose live ranges do not overlap share a local variable, so that functions declare fewer locals"),
+               cl::init(false));
+
+static cl::opt<bool>
+FoldExpressions("emscripten-fold-expressions",
+                cl::desc("Emit values that have a single use as part of the expression that uses them, instead of in a local variable of their own"),
+                cl::init(false));
+
+static cl::opt<bool>
+RelooperProfile("emscripten-relooper-profile",
+                cl::desc("Order the relooper's checks by branch probabilities and block frequencies (from profile data when present), and keep cold code out of the way of hot code"),
+                cl::init(false));
+
+static cl::opt<bool>
+LayoutGlobalsByUse("emscripten-layout-globals-by-use",
+                   cl::desc("Lay out global variables in order of how often they are accessed, estimated from the code (and profile data when present), so that hot data is packed together"),
+                   cl::init(false));
+
+
+// Calls Fn on each option that can change the code emitted for a function,
+// which is every option but those that only say where the output goes. The
+// emit cache key is made from these, so a new option must be added here too.
+template<typename CallbackT>
+static void forEachCodegenOption(CallbackT &&Fn) {
+  Fn(PreciseF32);
+  Fn(EnablePthreads);
+  Fn(WarnOnUnaligned);
+  Fn(WarnOnNoncanonicalNans);
+  Fn(ReservedFunctionPointers);
+  Fn(EmulatedFunctionPointers);
+  Fn(EmscriptenAssertions);
+  Fn(NoAliasingFunctionPointers);
+  Fn(GlobalBase);
+  Fn(Relocatable);
+  Fn(SideModule);
+  Fn(StackSize);
+  Fn(EnableSjLjEH);
+  Fn(EnableEmCxxExceptions);
+  Fn(EnableEmAsyncify);
+  Fn(NoExitRuntime);
+  Fn(EnableCyberDWARF);
+  Fn(EnableCyberDWARFIntrinsics);
+  Fn(WebAssembly);
+  Fn(OnlyWebAssembly);
+  Fn(WasmSIMD);
+  Fn(EnableOutlining);
+  Fn(WholeProgramDevirt);
+  Fn(DevirtualizeCalls);
+  Fn(MergeConstants);
+  Fn(CoalesceLocals);
+  Fn(FoldExpressions);
+  Fn(RelooperProfile);
+  Fn(LayoutGlobalsByUse);
+}
+
+char llvm::getJSFunctionSignatureLetter(Type *T) {
+  if (T->isVoidTy()) return 'v';
+  else if (T->isFloatingPointTy()) {
+    if (PreciseF32 && T->isFloatTy()) {
+      return 'f';
+    } else {
+      return 'd';
+    }
+  } else if (VectorType *VT = dyn_cast<VectorType>(T)) {
+    if (VT->getElementType()->isIntegerTy()) {
+      return 'I';
+    } else {
+      return 'F';
+    }
+  } else {
+    if (OnlyWebAssembly && T->isIntegerTy() && T->getIntegerBitWidth() == 64) {
+      return 'j';
+    } else {
+      return 'i';
+    }
+  }
+}
+
+std::string llvm::getJSFunctionSignature(const FunctionType *F) {
+  std::string Ret;
+  Ret += getJSFunctionSignatureLetter(F->getReturnType());
+  for (FunctionType::param_iterator AI = F->param_begin(),
+         AE = F->param_end(); AI != AE; ++AI) {
+    Ret += getJSFunctionSignatureLetter(*AI);
+  }
+  return Ret;
+}
 
 extern "C" void LLVMInitializeJSBackendTarget() {
   // Register the target.
@@ -180,8 +339,8 @@ namespace {
   #define ASM_FORCE_FLOAT_AS_INTBITS 32 // if the value is a float, it should be returned as an integer representing the float bits (or NaN canonicalization will eat them away). This flag cannot be used with ASM_UNSIGNED set.
   typedef unsigned AsmCast;
 
-  typedef std::map<const Value*,std::string> ValueMap;
-  typedef std::set<std::string> NameSet;
+  typedef DenseMap<const Value*, StringRef> ValueMap; // names live in JSNames
+  typedef StringSet<> NameSet; // iterate with getSortedKeys for deterministic output
   typedef std::set<int> IntSet;
   typedef std::vector<unsigned char> HeapData;
   typedef std::map<int, HeapData> HeapDataMap;
@@ -192,11 +351,14 @@ namespace {
     Address() {}
     Address(unsigned Offset, unsigned Alignment, bool ZeroInit) : Offset(Offset), Alignment(Alignment), ZeroInit(ZeroInit) {}
   };
-  typedef std::map<std::string, Type *> VarMap;
-  typedef std::map<std::string, Address> GlobalAddressMap;
+  // The locals of the function being emitted. Entries come from a bump
+  // allocator that is reset with the map, so that declaring a local does not
+  // allocate once the first few functions have been emitted.
+  typedef StringMap<Type *, BumpPtrAllocator> VarMap;
+  typedef StringMap<Address> GlobalAddressMap;
   typedef std::vector<std::string> FunctionTable;
-  typedef std::map<std::string, FunctionTable> FunctionTableMap;
-  typedef std::map<std::string, std::string> StringMap;
+  typedef StringMap<FunctionTable> FunctionTableMap;
+  typedef StringMap<std::string> NameMap;
   typedef std::map<std::string, unsigned> NameIntMap;
   typedef std::map<unsigned, IntSet> IntIntSetMap;
   typedef std::map<const BasicBlock*, unsigned> BlockIndexMap;
@@ -206,6 +368,56 @@ namespace {
     int Id;
     std::set<std::string> Sigs;
   };
+  // A request for something that is assigned lazily, in emission order, made
+  // while emitting a function on a worker thread. The worker emits a
+  // placeholder instead, and the main writer resolves the requests in module
+  // order, so the output is the same as when emitting serially.
+  struct DeferredRequest {
+    enum RequestKind {
+      FunctionIndex,
+      AsmConstId,
+      BlockAddr,
+      FunctionTable
+    } Kind;
+    const Value *V;
+    const BasicBlock *BB;
+    std::string Sig;
+  };
+  typedef std::vector<DeferredRequest> DeferredRequestList;
+
+  // Function code on a worker refers to a deferred request through a marker,
+  // the request's index between these two bytes. The writer never emits
+  // control characters otherwise, so markers can't be confused with code.
+  const char DeferredMarkerBegin = '\x01';
+  const char DeferredMarkerEnd = '\x02';
+
+  // What emitting one function on a worker produced: its code, with the
+  // markers taken out and their places recorded, and what it added to the
+  // module-level state. This is also what the emit cache stores.
+  struct EmittedFunction {
+    std::string Code;
+    DeferredRequestList Requests;
+    std::vector<std::pair<size_t, unsigned>> Placeholders; // offset in Code, index in Requests
+    std::vector<std::string> Externals;
+    std::vector<std::string> Declares;
+    std::vector<std::pair<std::string, std::string>> Redirects;
+    std::vector<std::string> Exports;
+    std::string CantValidate;
+    unsigned SIMDUses; // see JSWriter::getSIMDUses
+  };
+
+  // StringMap iteration order depends on hashing, so anything we emit from
+  // one must be visited in sorted order.
+  template<typename MapTy>
+  std::vector<StringRef> getSortedKeys(const MapTy &Map) {
+    std::vector<StringRef> Keys;
+    Keys.reserve(Map.size());
+    for (auto &I : Map) {
+      Keys.push_back(I.getKey());
+    }
+    std::sort(Keys.begin(), Keys.end());
+    return Keys;
+  }
 
   /// JSWriter - This class is the main chunk of code that converts an LLVM
   /// module to JavaScript.
@@ -215,27 +427,42 @@ namespace {
     unsigned UniqueNum;
     unsigned NextFunctionIndex; // used with NoAliasingFunctionPointers
     ValueMap ValueNames;
+    BumpPtrAllocator JSNameAllocator;
+    StringSaver JSNames; // the names in ValueNames, kept until the next function
     VarMap UsedVars;
     AllocaManager Allocas;
+    LocalCoalescer Locals;
     HeapDataMap GlobalDataMap;
     std::vector<int> ZeroInitSizes; // alignment => used offset in the zeroinit zone
     AlignedHeapStartMap AlignedHeapStarts, ZeroInitStarts;
     GlobalAddressMap GlobalAddresses;
     NameSet Externals; // vars
     NameSet Declares; // funcs
-    StringMap Redirects; // library function redirects actually used, needed for wrapper funcs in tables
+    NameMap Redirects; // library function redirects actually used, needed for wrapper funcs in tables
     std::vector<std::string> PostSets;
     NameIntMap NamedGlobals; // globals that we export as metadata to JS, so it can access them by name
-    std::map<std::string, unsigned> IndexedFunctions; // name -> index
+    StringMap<unsigned> IndexedFunctions; // name -> index
     FunctionTableMap FunctionTables; // sig => list of functions
     std::vector<std::string> GlobalInitializers;
     std::vector<std::string> Exports; // additional exports
-    StringMap Aliases;
+    NameMap Aliases;
     BlockAddressMap BlockAddresses;
-    std::map<std::string, AsmConstInfo> AsmConsts; // code => { index, list of seen sigs }
-    NameSet FuncRelocatableExterns; // which externals are accessed in this function; we load them once at the beginning (avoids a potential call in a heap access, and might be faster)
+    StringMap<AsmConstInfo> AsmConsts; // code => { index, list of seen sigs }
+    std::set<std::string> FuncRelocatableExterns; // which externals are accessed in this function; we load them once at the beginning (avoids a potential call in a heap access, and might be faster)
     std::vector<std::string> ExtraFunctions;
     std::set<const Function*> DeclaresNeedingTypeDeclarations; // list of declared funcs whose type we must declare asm.js-style with a usage, as they may not have another usage
+    bool IsWorker; // whether we emit functions on a worker thread, see printFunctionsOnWorkers
+    DeferredRequestList DeferredRequests; // requests made by the function being emitted on a worker
+
+    // How often blocks and the edges between them are expected to run, for the
+    // relooper (with RelooperProfile). The analyses put value handles on the
+    // blocks, so this is computed up front on the main thread, and the workers
+    // share it.
+    struct BranchProfile {
+      DenseMap<const BasicBlock*, uint64_t> BlockFrequencies;
+      DenseMap<std::pair<const BasicBlock*, const BasicBlock*>, uint64_t> EdgeWeights;
+    };
+    std::shared_ptr<const BranchProfile> Profile;
 
     struct {
       // 0 is reserved for void type
@@ -268,6 +495,7 @@ namespace {
     int MaxGlobalAlign;
     int StaticBump;
     const Instruction* CurrInstruction;
+    SmallString<1024> BlockCode; // scratch buffer for the code of the block being emitted
     Type* i32; // the type of i32
 
     #include "CallHandlers.h"
@@ -275,7 +503,7 @@ namespace {
   public:
     static char ID;
     JSWriter(raw_pwrite_stream &o, CodeGenOpt::Level OptLevel)
-      : ModulePass(ID), Out(o), UniqueNum(0), NextFunctionIndex(0), CantValidate(""),
+      : ModulePass(ID), Out(o), UniqueNum(0), NextFunctionIndex(0), JSNames(JSNameAllocator), IsWorker(false), CantValidate(""),
         UsesSIMDUint8x16(false), UsesSIMDInt8x16(false), UsesSIMDUint16x8(false),
         UsesSIMDInt16x8(false), UsesSIMDUint32x4(false), UsesSIMDInt32x4(false),
         UsesSIMDFloat32x4(false), UsesSIMDFloat64x2(false), UsesSIMDBool8x16(false),
@@ -314,10 +542,13 @@ namespace {
       return V->stripPointerCasts();
     }
 
-    void printCommaSeparated(const HeapData v);
+    void printCommaSeparated(const HeapData& v);
+    void getMemoryInitializer(HeapData& Data);
+    void printMemoryInitializer(const HeapData& Data);
 
     // parsing of constants has two phases: calculate, and then emit
     void parseConstant(const std::string& name, const Constant* CV, int Alignment, bool calculate);
+    void sortGlobalsByUse(std::vector<const GlobalVariable*>& Globals);
 
     #define DEFAULT_MEM_ALIGN 8
 
@@ -380,39 +611,25 @@ namespace {
       return a.Offset;
     }
     char getFunctionSignatureLetter(Type *T) {
-      if (T->isVoidTy()) return 'v';
-      else if (T->isFloatingPointTy()) {
-        if (PreciseF32 && T->isFloatTy()) {
-          return 'f';
-        } else {
-          return 'd';
-        }
-      } else if (VectorType *VT = dyn_cast<VectorType>(T)) {
-        checkVectorType(VT);
-        if (VT->getElementType()->isIntegerTy()) {
-          return 'I';
-        } else {
-          return 'F';
-        }
-      } else {
-        if (OnlyWebAssembly && T->isIntegerTy() && T->getIntegerBitWidth() == 64) {
-          return 'j';
-        } else {
-          return 'i';
-        }
-      }
+      if (T->isVectorTy()) checkVectorType(T);
+      return getJSFunctionSignatureLetter(T);
     }
     std::string getFunctionSignature(const FunctionType *F) {
-      std::string Ret;
-      Ret += getFunctionSignatureLetter(F->getReturnType());
-      for (FunctionType::param_iterator AI = F->param_begin(),
-             AE = F->param_end(); AI != AE; ++AI) {
-        Ret += getFunctionSignatureLetter(*AI);
+      for (Type *T : F->params()) {
+        if (T->isVectorTy()) checkVectorType(T);
       }
-      return Ret;
+      if (F->getReturnType()->isVectorTy()) checkVectorType(F->getReturnType());
+      return getJSFunctionSignature(F);
     }
     FunctionTable& ensureFunctionTable(const FunctionType *FT) {
-      std::string Sig = getFunctionSignature(FT);
+      return ensureFunctionTable(getFunctionSignature(FT));
+    }
+    FunctionTable& ensureFunctionTable(std::string Sig) {
+      if (IsWorker) {
+        // the table must exist in the output even if nothing is ever added to it
+        DeferredRequest R = { DeferredRequest::FunctionTable, nullptr, nullptr, Sig };
+        DeferredRequests.push_back(R);
+      }
       if (WebAssembly && EmulatedFunctionPointers) {
         // wasm function pointer emulation uses a single simple wasm table. ensure the specific tables
         // exist (so we have properly typed calls to the outside), but only fill in the singleton.
@@ -444,7 +661,7 @@ namespace {
     }
     std::string makeFloat32Legalizer(const Function *F) {
       auto* FT = F->getFunctionType();
-      const std::string& Name = getJSName(F);
+      std::string Name = getJSName(F);
       std::string LegalName = Name + "$legalf32";
       std::string LegalFunc = "function " + LegalName + "(";
       std::string Declares = "";
@@ -474,8 +691,10 @@ namespace {
       return LegalName;
     }
     unsigned getFunctionIndex(const Function *F) {
-      const std::string &Name = getJSName(F);
-      if (IndexedFunctions.find(Name) != IndexedFunctions.end()) return IndexedFunctions[Name];
+      assert(!IsWorker);
+      StringRef Name = getJSName(F);
+      auto IF = IndexedFunctions.find(Name);
+      if (IF != IndexedFunctions.end()) return IF->second;
       FunctionTable& Table = ensureFunctionTable(F->getFunctionType());
       if (NoAliasingFunctionPointers) {
         while (Table.size() < NextFunctionIndex) Table.push_back("0");
@@ -530,6 +749,7 @@ namespace {
     }
 
     unsigned getBlockAddress(const Function *F, const BasicBlock *BB) {
+      assert(!IsWorker);
       BlockIndexMap& Blocks = BlockAddresses[F];
       if (Blocks.find(BB) == Blocks.end()) {
         Blocks[BB] = Blocks.size(); // block addresses start from 0
@@ -623,6 +843,7 @@ namespace {
     // into an id. We emit a map of id => string contents, and emscripten
     // wraps it up so that calling that id calls that function.
     unsigned getAsmConstId(const Value *V, std::string Sig) {
+      assert(!IsWorker);
       V = resolveFully(V);
       const Constant *CI = cast<GlobalVariable>(V)->getInitializer();
       std::string code;
@@ -649,18 +870,34 @@ namespace {
           }
         }
       }
-      unsigned Id;
-      if (AsmConsts.count(code) > 0) {
-        auto& Info = AsmConsts[code];
-        Id = Info.Id;
-        Info.Sigs.insert(Sig);
-      } else {
-        AsmConstInfo Info;
-        Info.Id = Id = AsmConsts.size();
-        Info.Sigs.insert(Sig);
-        AsmConsts[code] = Info;
+      auto Inserted = AsmConsts.insert(std::make_pair(code, AsmConstInfo()));
+      AsmConstInfo& Info = Inserted.first->second;
+      if (Inserted.second) {
+        Info.Id = AsmConsts.size() - 1;
       }
-      return Id;
+      Info.Sigs.insert(Sig);
+      return Info.Id;
+    }
+
+    // Function bodies refer to the lazily assigned indices above through
+    // these. On a worker we can't assign them yet, so we log the request and
+    // emit a placeholder, which printFunctionsOnWorkers replaces later.
+    std::string deferRequest(DeferredRequest::RequestKind Kind, const Value *V, const BasicBlock *BB, const std::string& Sig) {
+      DeferredRequest R = { Kind, V, BB, Sig };
+      DeferredRequests.push_back(R);
+      return DeferredMarkerBegin + utostr(DeferredRequests.size() - 1) + DeferredMarkerEnd;
+    }
+    std::string getFunctionIndexStr(const Function *F) {
+      if (IsWorker) return deferRequest(DeferredRequest::FunctionIndex, F, nullptr, "");
+      return utostr(getFunctionIndex(F));
+    }
+    std::string getBlockAddressStr(const Function *F, const BasicBlock *BB) {
+      if (IsWorker) return deferRequest(DeferredRequest::BlockAddr, F, BB, "");
+      return utostr(getBlockAddress(F, BB));
+    }
+    std::string getAsmConstIdStr(const Value *V, const std::string& Sig) {
+      if (IsWorker) return deferRequest(DeferredRequest::AsmConstId, V, nullptr, Sig);
+      return utostr(getAsmConstId(V, Sig));
     }
 
     // Test whether the given value is known to be an absolute value or one we turn into an absolute value
@@ -687,16 +924,17 @@ namespace {
              VT->getElementType()->getPrimitiveSizeInBits() == 1);
       assert(VT->getBitWidth() <= 128);
       assert(VT->getNumElements() <= 16);
+      bool *Uses = nullptr;
       if (VT->getElementType()->isIntegerTy())
       {
-        if (VT->getNumElements() <= 16 && VT->getElementType()->getPrimitiveSizeInBits() == 8) UsesSIMDInt8x16 = true;
-        else if (VT->getNumElements() <= 8 && VT->getElementType()->getPrimitiveSizeInBits() == 16) UsesSIMDInt16x8 = true;
-        else if (VT->getNumElements() <= 4 && VT->getElementType()->getPrimitiveSizeInBits() == 32) UsesSIMDInt32x4 = true;
+        if (VT->getNumElements() <= 16 && VT->getElementType()->getPrimitiveSizeInBits() == 8) Uses = &UsesSIMDInt8x16;
+        else if (VT->getNumElements() <= 8 && VT->getElementType()->getPrimitiveSizeInBits() == 16) Uses = &UsesSIMDInt16x8;
+        else if (VT->getNumElements() <= 4 && VT->getElementType()->getPrimitiveSizeInBits() == 32) Uses = &UsesSIMDInt32x4;
         else if (VT->getElementType()->getPrimitiveSizeInBits() == 1) {
-          if (VT->getNumElements() == 16) UsesSIMDBool8x16 = true;
-          else if (VT->getNumElements() == 8) UsesSIMDBool16x8 = true;
-          else if (VT->getNumElements() == 4) UsesSIMDBool32x4 = true;
-          else if (VT->getNumElements() == 2) UsesSIMDBool64x2 = true;
+          if (VT->getNumElements() == 16) Uses = &UsesSIMDBool8x16;
+          else if (VT->getNumElements() == 8) Uses = &UsesSIMDBool16x8;
+          else if (VT->getNumElements() == 4) Uses = &UsesSIMDBool32x4;
+          else if (VT->getNumElements() == 2) Uses = &UsesSIMDBool64x2;
           else report_fatal_error("Unsupported boolean vector type with numElems: " + Twine(VT->getNumElements()) + ", primitiveSize: " + Twine(VT->getElementType()->getPrimitiveSizeInBits()) + "!");
         } else if (VT->getElementType()->getPrimitiveSizeInBits() != 1 && VT->getElementType()->getPrimitiveSizeInBits() != 128) {
           report_fatal_error("Unsupported integer vector type with numElems: " + Twine(VT->getNumElements()) + ", primitiveSize: " + Twine(VT->getElementType()->getPrimitiveSizeInBits()) + "!");
@@ -704,10 +942,12 @@ namespace {
       }
       else
       {
-        if (VT->getNumElements() <= 4 && VT->getElementType()->getPrimitiveSizeInBits() == 32) UsesSIMDFloat32x4 = true;
-        else if (VT->getNumElements() <= 2 && VT->getElementType()->getPrimitiveSizeInBits() == 64) UsesSIMDFloat64x2 = true;
+        if (VT->getNumElements() <= 4 && VT->getElementType()->getPrimitiveSizeInBits() == 32) Uses = &UsesSIMDFloat32x4;
+        else if (VT->getNumElements() <= 2 && VT->getElementType()->getPrimitiveSizeInBits() == 64) Uses = &UsesSIMDFloat64x2;
         else report_fatal_error("Unsupported floating point vector type numElems: " + Twine(VT->getNumElements()) + ", primitiveSize: " + Twine(VT->getElementType()->getPrimitiveSizeInBits()) + "!");
       }
+      // WebAssembly SIMD operations need none of the SIMD.js types.
+      if (Uses && !WasmSIMD) *Uses = true;
     }
 
     std::string ensureCast(std::string S, Type *T, AsmCast sign) {
@@ -774,7 +1014,7 @@ namespace {
       return Str.str().str();
     }
 
-    std::string getPtrLoad(const Value* Ptr);
+    raw_ostream &printPtrLoad(raw_ostream &OS, const Value* Ptr);
 
     /// Given a pointer to memory, returns the HEAP object and index to that object that is used to access that memory.
     /// @param Ptr [in] The heap object.
@@ -793,10 +1033,13 @@ namespace {
 
     std::string getShiftedPtr(const Value *Ptr, unsigned Bytes);
 
-    /// Returns a string expression for accessing the given memory address.
-    std::string getPtrUse(const Value* Ptr);
+    /// Prints the heap index of the given memory address, as returned by getHeapNameAndIndex().
+    raw_ostream &printHeapIndex(raw_ostream &OS, const Value *Ptr, unsigned Bytes, bool Integer);
+
+    /// Prints an expression for accessing the given memory address.
+    raw_ostream &printPtrUse(raw_ostream &OS, const Value* Ptr);
 
-    /// Like getPtrUse(), but for pointers represented in string expression form.
+    /// Like printPtrUse(), but for pointers represented in string expression form.
     static std::string getHeapAccess(const std::string& Name, unsigned Bytes, bool Integer=true);
 
     std::string getUndefValue(Type* T, AsmCast sign=ASM_SIGNED);
@@ -808,7 +1051,8 @@ namespace {
     std::string getValueAsParenStr(const Value*);
     std::string getValueAsCastParenStr(const Value*, AsmCast sign=ASM_SIGNED);
 
-    const std::string &getJSName(const Value* val);
+    StringRef getJSName(const Value* val);
+    Type *getLocalType(const Instruction *I);
 
     std::string getPhiCode(const BasicBlock *From, const BasicBlock *To);
 
@@ -818,28 +1062,109 @@ namespace {
 
     std::string getAdHocAssign(const StringRef &, Type *);
     std::string getAssign(const Instruction *I);
+    raw_ostream &printAssign(raw_ostream &OS, const Instruction *I);
+    raw_ostream &printAssignIfNeeded(raw_ostream &OS, const Value *V);
+    raw_ostream &printValue(raw_ostream &OS, const Value *V, AsmCast sign);
+    raw_ostream &printValueAsCast(raw_ostream &OS, const Value *V, AsmCast sign);
+    raw_ostream &printValueAsParen(raw_ostream &OS, const Value *V);
+    raw_ostream &printValueAsCastParen(raw_ostream &OS, const Value *V, AsmCast sign);
+
+    // Expressions are written straight into the block's code stream, as in
+    //   Code << streamAssign(I) << streamValue(A) << " + " << streamValue(B);
+    // which avoids building a temporary string for every name and operand.
+    // The forms are those of getValueAsStr, getValueAsCastStr,
+    // getValueAsParenStr and getValueAsCastParenStr.
+    enum ValueForm { VF_Plain, VF_Cast, VF_Paren, VF_CastParen };
+    struct StreamedValue {
+      JSWriter *W;
+      const Value *V;
+      AsmCast Sign;
+      ValueForm Form;
+    };
+    struct StreamedAssign {
+      JSWriter *W;
+      const Instruction *I;
+    };
+    StreamedValue streamValue(const Value *V, AsmCast sign=ASM_SIGNED) {
+      StreamedValue S = { this, V, sign, VF_Plain };
+      return S;
+    }
+    StreamedValue streamValueAsCast(const Value *V, AsmCast sign=ASM_SIGNED) {
+      StreamedValue S = { this, V, sign, VF_Cast };
+      return S;
+    }
+    StreamedValue streamValueAsParen(const Value *V) {
+      StreamedValue S = { this, V, ASM_SIGNED, VF_Paren };
+      return S;
+    }
+    StreamedValue streamValueAsCastParen(const Value *V, AsmCast sign=ASM_SIGNED) {
+      StreamedValue S = { this, V, sign, VF_CastParen };
+      return S;
+    }
+    StreamedAssign streamAssign(const Instruction *I) {
+      StreamedAssign S = { this, I };
+      return S;
+    }
+    friend raw_ostream &operator<<(raw_ostream &OS, const StreamedValue &S) {
+      switch (S.Form) {
+        case VF_Plain:     return S.W->printValue(OS, S.V, S.Sign);
+        case VF_Cast:      return S.W->printValueAsCast(OS, S.V, S.Sign);
+        case VF_Paren:     return S.W->printValueAsParen(OS, S.V);
+        case VF_CastParen: return S.W->printValueAsCastParen(OS, S.V, S.Sign);
+      }
+      llvm_unreachable("bad value form");
+    }
+    friend raw_ostream &operator<<(raw_ostream &OS, const StreamedAssign &S) {
+      return S.W->printAssign(OS, S.I);
+    }
     std::string getAssignIfNeeded(const Value *V);
     std::string getCast(const StringRef &, Type *, AsmCast sign=ASM_SIGNED);
+    // getCast(s) is the prefix, then s, then the suffix; printing the two
+    // halves lets the caller stream what goes in between.
+    raw_ostream &printCastPrefix(raw_ostream &OS, Type *, AsmCast sign=ASM_SIGNED);
+    raw_ostream &printCastSuffix(raw_ostream &OS, Type *, AsmCast sign=ASM_SIGNED);
     std::string getParenCast(const StringRef &, Type *, AsmCast sign=ASM_SIGNED);
     std::string getDoubleToInt(const StringRef &);
     std::string getIMul(const Value *, const Value *);
+    std::string getIMul(const Value *, unsigned);
+    std::string getConstantIMul(const std::string &, unsigned);
     std::string getLoad(const Instruction *I, const Value *P, Type *T, unsigned Alignment, char sep=';');
     std::string getStore(const Instruction *I, const Value *P, Type *T, const std::string& VS, unsigned Alignment, char sep=';');
+    raw_ostream &printLoad(raw_ostream &Code, const Instruction *I, const Value *P, Type *T, unsigned Alignment, char sep=';');
+    raw_ostream &printStore(raw_ostream &Code, const Instruction *I, const Value *P, Type *T, StringRef VS, unsigned Alignment, char sep=';');
     std::string getStackBump(unsigned Size);
     std::string getStackBump(const std::string &Size);
 
     void addBlock(const BasicBlock *BB, Relooper& R, LLVMToRelooperMap& LLVMToRelooper);
+    void calculateBranchProfile();
+    uint64_t getBlockFrequency(const BasicBlock *BB);
+    uint64_t getEdgeWeight(const BasicBlock *From, const BasicBlock *To);
     void printFunctionBody(const Function *F);
-    void generateInsertElementExpression(const InsertElementInst *III, raw_string_ostream& Code);
-    void generateExtractElementExpression(const ExtractElementInst *EEI, raw_string_ostream& Code);
+    void printFunctionsOnWorkers();
+    std::string resolveDeferredRequest(const DeferredRequest &R);
+    unsigned getSIMDUses() const;
+    void addSIMDUses(unsigned Uses);
+    void takeEmittedFunction(SmallVectorImpl<char> &Code, EmittedFunction &EF);
+    void printEmittedFunction(const EmittedFunction &EF);
+    std::string getEmitCacheKey(const Function *F, StringRef Salt);
+    bool readEmitCache(StringRef Path, EmittedFunction &EF);
+    void writeEmitCache(StringRef Path, const EmittedFunction &EF);
+    void generateInsertElementExpression(const InsertElementInst *III, raw_ostream& Code);
+    void generateExtractElementExpression(const ExtractElementInst *EEI, raw_ostream& Code);
     std::string getSIMDCast(VectorType *fromType, VectorType *toType, const std::string &valueStr, bool signExtend);
-    void generateShuffleVectorExpression(const ShuffleVectorInst *SVI, raw_string_ostream& Code);
-    void generateICmpExpression(const ICmpInst *I, raw_string_ostream& Code);
-    void generateFCmpExpression(const FCmpInst *I, raw_string_ostream& Code);
-    void generateShiftExpression(const BinaryOperator *I, raw_string_ostream& Code);
-    void generateUnrolledExpression(const User *I, raw_string_ostream& Code);
-    bool generateSIMDExpression(const User *I, raw_string_ostream& Code);
-    void generateExpression(const User *I, raw_string_ostream& Code);
+    void generateShuffleVectorExpression(const ShuffleVectorInst *SVI, raw_ostream& Code);
+    void generateICmpExpression(const ICmpInst *I, raw_ostream& Code);
+    void generateFCmpExpression(const FCmpInst *I, raw_ostream& Code);
+    void generateShiftExpression(const BinaryOperator *I, raw_ostream& Code);
+    void generateUnrolledExpression(const User *I, raw_ostream& Code);
+    bool generateSIMDExpression(const User *I, raw_ostream& Code);
+    std::string getWasmSIMDConstant(VectorType *VT, const Constant *C);
+    std::string getWasmSIMDLoad(const LoadInst *LI, VectorType *VT);
+    std::string getWasmSIMDStore(const StoreInst *SI, VectorType *VT);
+    void generateWasmICmpExpression(const ICmpInst *I, raw_ostream& Code);
+    void generateWasmFCmpExpression(const FCmpInst *I, raw_ostream& Code);
+    bool generateWasmSIMDExpression(const User *I, raw_ostream& Code);
+    void generateExpression(const User *I, raw_ostream& Code);
 
     // debug information
     std::string generateDebugRecordForVar(Metadata *MD);
@@ -856,6 +1181,21 @@ namespace {
 
     void calculateNativizedVars(const Function *F);
 
+    // expression folding
+
+    typedef SmallPtrSet<const Instruction*, 32> FoldedExpressionSet;
+    FoldedExpressionSet FoldedExpressions; // values emitted as part of their user
+
+    bool isFoldedExpression(const Value *V) {
+      const Instruction *I = dyn_cast<Instruction>(V);
+      return I && FoldedExpressions.count(I);
+    }
+    bool isSimpleHeapAccess(const Instruction *I, const Value *P, Type *T, unsigned Alignment);
+    bool canFoldValue(const Instruction *I);
+    const Instruction *getSingleEmittedUser(const Instruction *V);
+    bool canFoldInto(const Instruction *User);
+    void calculateFoldedExpressions(const Function *F);
+
     // special analyses
 
     bool canReloop(const Function *F);
@@ -939,6 +1279,18 @@ static inline void sanitizeLocal(std::string& str) {
   }
 }
 
+// Whether the parentheses around S enclose all of it, as in "(a + b|0)" but not
+// in "(a|0) < (b|0)".
+static bool isParenthesized(StringRef S) {
+  if (S.empty() || S.front() != '(' || S.back() != ')') return false;
+  int Depth = 0;
+  for (size_t i = 0, e = S.size(); i != e; ++i) {
+    if (S[i] == '(') Depth++;
+    else if (S[i] == ')' && --Depth == 0) return i + 1 == e;
+  }
+  return false;
+}
+
 static inline std::string ensureFloat(const std::string &S, Type *T) {
   if (PreciseF32 && T->isFloatTy()) {
     return "Math_fround(" + S + ')';
@@ -953,6 +1305,14 @@ static inline std::string ensureFloat(const std::string &value, bool wrap) {
   return value;
 }
 
+// Getting a type may create it in the LLVMContext, which is not thread-safe,
+// and function bodies may be emitted on several threads at once.
+static VectorType *getIntegerVectorType(VectorType *VT) {
+  static std::mutex Lock;
+  std::lock_guard<std::mutex> Guard(Lock);
+  return VectorType::getInteger(VT);
+}
+
 void JSWriter::error(const std::string& msg) {
   report_fatal_error(msg);
 }
@@ -980,14 +1340,15 @@ std::string JSWriter::getPhiCode(const BasicBlock *From, const BasicBlock *To) {
     int index = P->getBasicBlockIndex(From);
     if (index < 0) continue;
     // we found it
-    const std::string &name = getJSName(P);
-    assigns[name] = getAssign(P);
+    StringRef name = getJSName(P);
     // Get the operand, and strip pointer casts, since normal expression
     // translation also strips pointer casts, and we want to see the same
     // thing so that we can detect any resulting dependencies.
     const Value *V = P->getIncomingValue(index)->stripPointerCasts();
-    values[name] = V;
     std::string vname = getValueAsStr(V);
+    if (vname == name) continue; // the value is already in the phi's local
+    assigns[name] = getAssign(P);
+    values[name] = V;
     if (const Instruction *VI = dyn_cast<const Instruction>(V)) {
       if (VI->getParent() == To && PhiVars.find(vname) != PhiVars.end()) {
         deps[name] = vname;
@@ -1026,9 +1387,9 @@ std::string JSWriter::getPhiCode(const BasicBlock *From, const BasicBlock *To) {
   return pre + post;
 }
 
-const std::string &JSWriter::getJSName(const Value* val) {
+StringRef JSWriter::getJSName(const Value* val) {
   ValueMap::const_iterator I = ValueNames.find(val);
-  if (I != ValueNames.end() && I->first == val)
+  if (I != ValueNames.end())
     return I->second;
 
   // If this is an alloca we've replaced with another, use the other name.
@@ -1041,6 +1402,14 @@ const std::string &JSWriter::getJSName(const Value* val) {
     }
   }
 
+  // If this value shares its local with another, use the other name.
+  const Value *Rep = Locals.getRepresentative(val);
+  if (Rep != val) {
+    StringRef Name = getJSName(Rep);
+    ValueNames[val] = Name;
+    return Name;
+  }
+
   std::string name;
   if (val->hasName()) {
     name = val->getName().str();
@@ -1054,7 +1423,9 @@ const std::string &JSWriter::getJSName(const Value* val) {
     sanitizeLocal(name);
   }
 
-  return ValueNames[val] = name;
+  StringRef Name = JSNames.save(name);
+  ValueNames[val] = Name;
+  return Name;
 }
 
 std::string JSWriter::getAdHocAssign(const StringRef &s, Type *t) {
@@ -1063,6 +1434,7 @@ std::string JSWriter::getAdHocAssign(const StringRef &s, Type *t) {
 }
 
 std::string JSWriter::getAssign(const Instruction *I) {
+  if (isFoldedExpression(I)) return std::string(); // the user takes the value
   return getAdHocAssign(getJSName(I), I->getType());
 }
 
@@ -1073,6 +1445,20 @@ std::string JSWriter::getAssignIfNeeded(const Value *V) {
   return std::string();
 }
 
+raw_ostream &JSWriter::printAssign(raw_ostream &OS, const Instruction *I) {
+  if (isFoldedExpression(I)) return OS;
+  StringRef Name = getJSName(I);
+  UsedVars[Name] = I->getType();
+  return OS << Name << " = ";
+}
+
+raw_ostream &JSWriter::printAssignIfNeeded(raw_ostream &OS, const Value *V) {
+  if (const Instruction *I = dyn_cast<Instruction>(V)) {
+    if (!I->use_empty()) return printAssign(OS, I);
+  }
+  return OS;
+}
+
 int SIMDNumElements(VectorType *t) {
   assert(t->getElementType()->getPrimitiveSizeInBits() <= 128);
 
@@ -1122,38 +1508,69 @@ const char *SIMDType(VectorType *t) {
   report_fatal_error("Unsupported type!");
 }
 
+// The WebAssembly SIMD interpretation of a vector type. As with SIMD.js, vectors
+// narrower than 128 bits use the low lanes, and vectors of i1 are masks with
+// lanes as wide as those of the compare that produced them.
+static std::string WasmSIMDShape(VectorType *t) {
+  int Lanes = SIMDNumElements(t);
+  if (!t->getElementType()->isIntegerTy()) return Lanes == 2 ? "f64x2" : "f32x4";
+  return "i" + utostr(128 / Lanes) + "x" + utostr(Lanes);
+}
+
 std::string JSWriter::getCast(const StringRef &s, Type *t, AsmCast sign) {
+  SmallString<64> Cast;
+  raw_svector_ostream CastStream(Cast);
+  printCastPrefix(CastStream, t, sign) << s;
+  printCastSuffix(CastStream, t, sign);
+  return Cast.str().str();
+}
+
+raw_ostream &JSWriter::printCastPrefix(raw_ostream &OS, Type *t, AsmCast sign) {
   switch (t->getTypeID()) {
-    default: {
+    default:
       errs() << *t << "\n";
-      assert(false && "Unsupported type");
-    }
+      llvm_unreachable("Unsupported type");
     case Type::VectorTyID:
-      return std::string("SIMD_") + SIMDType(cast<VectorType>(t)) + "_check(" + s.str() + ")";
-    case Type::FloatTyID: {
+      if (WasmSIMD) return OS << "v128(";
+      return OS << "SIMD_" << SIMDType(cast<VectorType>(t)) << "_check(";
+    case Type::FloatTyID:
       if (PreciseF32 && !(sign & ASM_FFI_OUT)) {
-        if (sign & ASM_FFI_IN) {
-          return ("Math_fround(+(" + s + "))").str();
-        } else {
-          return ("Math_fround(" + s + ")").str();
-        }
+        return OS << ((sign & ASM_FFI_IN) ? "Math_fround(+(" : "Math_fround(");
       }
-      // otherwise fall through to double
-    }
-    case Type::DoubleTyID: return ("+" + s).str();
-    case Type::IntegerTyID: {
-      // fall through to the end for nonspecific
+      return OS << '+'; // as a double
+    case Type::DoubleTyID: return OS << '+';
+    case Type::IntegerTyID:
+      if (t->getIntegerBitWidth() == 64) return OS << "i64(";
+      return OS;
+    case Type::PointerTyID:
+      return OS;
+  }
+}
+
+raw_ostream &JSWriter::printCastSuffix(raw_ostream &OS, Type *t, AsmCast sign) {
+  switch (t->getTypeID()) {
+    default:
+    case Type::VectorTyID:
+      return OS << ')';
+    case Type::FloatTyID:
+      if (PreciseF32 && !(sign & ASM_FFI_OUT)) {
+        return OS << ((sign & ASM_FFI_IN) ? "))" : ")");
+      }
+      return OS; // as a double
+    case Type::DoubleTyID: return OS;
+    case Type::IntegerTyID:
+      // nonspecific narrow ints end up like i32
       switch (t->getIntegerBitWidth()) {
-        case 1:  if (!(sign & ASM_NONSPECIFIC)) return sign == ASM_UNSIGNED ? (s + "&1").str()     : (s + "<<31>>31").str();
-        case 8:  if (!(sign & ASM_NONSPECIFIC)) return sign == ASM_UNSIGNED ? (s + "&255").str()   : (s + "<<24>>24").str();
-        case 16: if (!(sign & ASM_NONSPECIFIC)) return sign == ASM_UNSIGNED ? (s + "&65535").str() : (s + "<<16>>16").str();
-        case 32: return (sign == ASM_SIGNED || (sign & ASM_NONSPECIFIC) ? s + "|0" : s + ">>>0").str();
-        case 64: return ("i64(" + s + ")").str();
+        case 1:  if (!(sign & ASM_NONSPECIFIC)) return OS << (sign == ASM_UNSIGNED ? "&1"     : "<<31>>31"); break;
+        case 8:  if (!(sign & ASM_NONSPECIFIC)) return OS << (sign == ASM_UNSIGNED ? "&255"   : "<<24>>24"); break;
+        case 16: if (!(sign & ASM_NONSPECIFIC)) return OS << (sign == ASM_UNSIGNED ? "&65535" : "<<16>>16"); break;
+        case 32: break;
+        case 64: return OS << ')';
         default: llvm_unreachable("Unsupported integer cast bitwidth");
       }
-    }
+      return OS << (sign == ASM_SIGNED || (sign & ASM_NONSPECIFIC) ? "|0" : ">>>0");
     case Type::PointerTyID:
-      return (sign == ASM_SIGNED || (sign & ASM_NONSPECIFIC) ? s + "|0" : s + ">>>0").str();
+      return OS << (sign == ASM_SIGNED || (sign & ASM_NONSPECIFIC) ? "|0" : ">>>0");
   }
 }
 
@@ -1175,21 +1592,37 @@ std::string JSWriter::getIMul(const Value *V1, const Value *V2) {
   }
   // we ignore optimizing the case of multiplying two constants - optimizer would have removed those
   if (CI) {
-    std::string OtherStr = getValueAsStr(Other);
-    unsigned C = CI->getZExtValue();
-    if (C == 0) return "0";
-    if (C == 1) return OtherStr;
-    unsigned Orig = C, Shifts = 0;
-    while (C) {
-      if ((C & 1) && (C != 1)) break; // not power of 2
-      C >>= 1;
-      Shifts++;
-      if (C == 0) return OtherStr + "<<" + utostr(Shifts-1); // power of 2, emit shift
-    }
-    if (Orig < (1<<20)) return "(" + OtherStr + "*" + utostr(Orig) + ")|0"; // small enough, avoid imul
+    std::string Mul = getConstantIMul(getValueAsStr(Other), CI->getZExtValue());
+    if (!Mul.empty()) return Mul;
   }
   return "Math_imul(" + getValueAsStr(V1) + ", " + getValueAsStr(V2) + ")|0"; // unknown or too large, emit imul
 }
+// like getIMul(V, ConstantInt::get(i32, C)), but without creating a constant
+// (function bodies may be emitted in parallel, and must not touch the context)
+std::string JSWriter::getIMul(const Value *V, unsigned C) {
+  std::string VS = getValueAsStr(V);
+  if (OnlyWebAssembly && V->getType()->isIntegerTy(64)) {
+    // an i64 index into a 32-bit address space; only the low bits matter
+    VS = "i64_trunc(" + VS + ")";
+  }
+  std::string Mul = getConstantIMul(VS, C);
+  if (!Mul.empty()) return Mul;
+  return "Math_imul(" + VS + ", " + itostr((int32_t)C) + ")|0"; // too large, emit imul
+}
+// returns an empty string if the multiplication needs Math_imul after all
+std::string JSWriter::getConstantIMul(const std::string &OtherStr, unsigned C) {
+  if (C == 0) return "0";
+  if (C == 1) return OtherStr;
+  unsigned Orig = C, Shifts = 0;
+  while (C) {
+    if ((C & 1) && (C != 1)) break; // not power of 2
+    C >>= 1;
+    Shifts++;
+    if (C == 0) return OtherStr + "<<" + utostr(Shifts-1); // power of 2, emit shift
+  }
+  if (Orig < (1<<20)) return "(" + OtherStr + "*" + utostr(Orig) + ")|0"; // small enough, avoid imul
+  return "";
+}
 
 static inline const char *getHeapName(int Bytes, int Integer)
 {
@@ -1258,6 +1691,17 @@ std::string JSWriter::getHeapNameAndIndex(const Value *Ptr, const char **HeapNam
   return getHeapNameAndIndex(Ptr, HeapName, DL->getTypeAllocSize(t), t->isIntegerTy() || t->isPointerTy());
 }
 
+// Whether a load or store is emitted as an Atomics operation when pthreads are
+// enabled. Volatile accesses are atomic, as with RewriteAtomics. Unordered
+// accesses only need to not tear, which aligned typed array accesses never do,
+// so they stay plain.
+static bool isAtomicAccess(const Instruction *I) {
+  if (const LoadInst *LI = dyn_cast<LoadInst>(I))
+    return LI->isVolatile() || isStrongerThanUnordered(LI->getOrdering());
+  const StoreInst *SI = cast<StoreInst>(I);
+  return SI->isVolatile() || isStrongerThanUnordered(SI->getOrdering());
+}
+
 static const char *heapNameToAtomicTypeName(const char *HeapName)
 {
   if (!strcmp(HeapName, "HEAPF32")) return "f32";
@@ -1266,6 +1710,13 @@ static const char *heapNameToAtomicTypeName(const char *HeapName)
 }
 
 std::string JSWriter::getLoad(const Instruction *I, const Value *P, Type *T, unsigned Alignment, char sep) {
+  SmallString<64> Code;
+  raw_svector_ostream CodeStream(Code);
+  printLoad(CodeStream, I, P, T, Alignment, sep);
+  return Code.str().str();
+}
+
+raw_ostream &JSWriter::printLoad(raw_ostream &Code, const Instruction *I, const Value *P, Type *T, unsigned Alignment, char sep) {
   std::string Assign = getAssign(I);
   unsigned Bytes = DL->getTypeAllocSize(T);
   bool Aligned = Bytes <= Alignment || Alignment == 0;
@@ -1273,49 +1724,52 @@ std::string JSWriter::getLoad(const Instruction *I, const Value *P, Type *T, uns
     if (isAbsolute(P)) {
       // loads from an absolute constants are either intentional segfaults (int x = *((int*)0)), or code problems
       JSWriter::getAssign(I); // ensure the variable is defined, even if it isn't used
-      return "abort() /* segfault, load from absolute addr */";
+      return Code << "abort() /* segfault, load from absolute addr */";
     }
+    Code << Assign;
     if (T->isIntegerTy() || T->isPointerTy()) {
       switch (Bytes) {
-        case 1: return Assign + "load1(" + getValueAsStr(P) + ")";
-        case 2: return Assign + "load2(" + getValueAsStr(P) + (Aligned ? "" : "," + itostr(Alignment)) + ")";
-        case 4: return Assign + "load4(" + getValueAsStr(P) + (Aligned ? "" : "," + itostr(Alignment)) + ")";
-        case 8: return Assign + "load8(" + getValueAsStr(P) + (Aligned ? "" : "," + itostr(Alignment)) + ")";
+        case 1: return Code << "load1(" << streamValue(P) << ")";
+        case 2: Code << "load2(" << streamValue(P); break;
+        case 4: Code << "load4(" << streamValue(P); break;
+        case 8: Code << "load8(" << streamValue(P); break;
         default: llvm_unreachable("invalid wasm-only int load size");
       }
     } else {
       switch (Bytes) {
-        case 4: return Assign + "loadf(" + getValueAsStr(P) + (Aligned ? "" : "," + itostr(Alignment)) + ")";
-        case 8: return Assign + "loadd(" + getValueAsStr(P) + (Aligned ? "" : "," + itostr(Alignment)) + ")";
+        case 4: Code << "loadf(" << streamValue(P); break;
+        case 8: Code << "loadd(" << streamValue(P); break;
         default: llvm_unreachable("invalid wasm-only float load size");
       }
     }
+    if (!Aligned) Code << "," << itostr(Alignment);
+    return Code << ")";
   }
-  std::string text;
   if (Aligned) {
-    if (EnablePthreads && cast<LoadInst>(I)->isVolatile()) {
+    if (EnablePthreads && isAtomicAccess(I)) {
       const char *HeapName;
       std::string Index = getHeapNameAndIndex(P, &HeapName);
       if (!strcmp(HeapName, "HEAPF32") || !strcmp(HeapName, "HEAPF64")) {
         bool fround = PreciseF32 && !strcmp(HeapName, "HEAPF32");
         // TODO: If https://bugzilla.mozilla.org/show_bug.cgi?id=1131613 and https://bugzilla.mozilla.org/show_bug.cgi?id=1131624 are
         // implemented, we could remove the emulation, but until then we must emulate manually.
-        text = Assign + (fround ? "Math_fround(" : "+") + "_emscripten_atomic_load_" + heapNameToAtomicTypeName(HeapName) + "(" + getValueAsStr(P) + (fround ? "))" : ")");
+        Code << Assign << (fround ? "Math_fround(" : "+") << "_emscripten_atomic_load_" << heapNameToAtomicTypeName(HeapName) << "(" << streamValue(P) << (fround ? "))" : ")");
       } else {
-        text = Assign + "(Atomics_load(" + HeapName + ',' + Index + ")|0)";
+        Code << Assign << "(Atomics_load(" << HeapName << ',' << Index << ")|0)";
       }
     } else {
-      text = Assign + getPtrLoad(P);
+      Code << Assign;
+      printPtrLoad(Code, P);
     }
     if (isAbsolute(P)) {
       // loads from an absolute constants are either intentional segfaults (int x = *((int*)0)), or code problems
-      text += "; abort() /* segfault, load from absolute addr */";
+      Code << "; abort() /* segfault, load from absolute addr */";
     }
   } else {
     // unaligned in some manner
 
-    if (EnablePthreads && cast<LoadInst>(I)->isVolatile()) {
-      errs() << "emcc: warning: unable to implement unaligned volatile load as atomic in " << I->getParent()->getParent()->getName() << ":" << *I << " | ";
+    if (EnablePthreads && isAtomicAccess(I)) {
+      errs() << "emcc: warning: unable to implement unaligned atomic load in " << I->getParent()->getParent()->getName() << ":" << *I << " | ";
       emitDebugInfo(errs(), I);
       errs() << "\n";
     }
@@ -1330,46 +1784,46 @@ std::string JSWriter::getLoad(const Instruction *I, const Value *P, Type *T, uns
       case 8: {
         switch (Alignment) {
           case 4: {
-            text = "HEAP32[tempDoublePtr>>2]=HEAP32[" + PS + ">>2]" + sep +
-                    "HEAP32[tempDoublePtr+4>>2]=HEAP32[" + PS + "+4>>2]";
+            Code << "HEAP32[tempDoublePtr>>2]=HEAP32[" << PS << ">>2]" << sep <<
+                    "HEAP32[tempDoublePtr+4>>2]=HEAP32[" << PS << "+4>>2]";
             break;
           }
           case 2: {
-            text = "HEAP16[tempDoublePtr>>1]=HEAP16[" + PS + ">>1]" + sep +
-                   "HEAP16[tempDoublePtr+2>>1]=HEAP16[" + PS + "+2>>1]" + sep +
-                   "HEAP16[tempDoublePtr+4>>1]=HEAP16[" + PS + "+4>>1]" + sep +
-                   "HEAP16[tempDoublePtr+6>>1]=HEAP16[" + PS + "+6>>1]";
+            Code << "HEAP16[tempDoublePtr>>1]=HEAP16[" << PS << ">>1]" << sep <<
+                   "HEAP16[tempDoublePtr+2>>1]=HEAP16[" << PS << "+2>>1]" << sep <<
+                   "HEAP16[tempDoublePtr+4>>1]=HEAP16[" << PS << "+4>>1]" << sep <<
+                   "HEAP16[tempDoublePtr+6>>1]=HEAP16[" << PS << "+6>>1]";
             break;
           }
           case 1: {
-            text = "HEAP8[tempDoublePtr>>0]=HEAP8[" + PS + ">>0]" + sep +
-                   "HEAP8[tempDoublePtr+1>>0]=HEAP8[" + PS + "+1>>0]" + sep +
-                   "HEAP8[tempDoublePtr+2>>0]=HEAP8[" + PS + "+2>>0]" + sep +
-                   "HEAP8[tempDoublePtr+3>>0]=HEAP8[" + PS + "+3>>0]" + sep +
-                   "HEAP8[tempDoublePtr+4>>0]=HEAP8[" + PS + "+4>>0]" + sep +
-                   "HEAP8[tempDoublePtr+5>>0]=HEAP8[" + PS + "+5>>0]" + sep +
-                   "HEAP8[tempDoublePtr+6>>0]=HEAP8[" + PS + "+6>>0]" + sep +
-                   "HEAP8[tempDoublePtr+7>>0]=HEAP8[" + PS + "+7>>0]";
+            Code << "HEAP8[tempDoublePtr>>0]=HEAP8[" << PS << ">>0]" << sep <<
+                   "HEAP8[tempDoublePtr+1>>0]=HEAP8[" << PS << "+1>>0]" << sep <<
+                   "HEAP8[tempDoublePtr+2>>0]=HEAP8[" << PS << "+2>>0]" << sep <<
+                   "HEAP8[tempDoublePtr+3>>0]=HEAP8[" << PS << "+3>>0]" << sep <<
+                   "HEAP8[tempDoublePtr+4>>0]=HEAP8[" << PS << "+4>>0]" << sep <<
+                   "HEAP8[tempDoublePtr+5>>0]=HEAP8[" << PS << "+5>>0]" << sep <<
+                   "HEAP8[tempDoublePtr+6>>0]=HEAP8[" << PS << "+6>>0]" << sep <<
+                   "HEAP8[tempDoublePtr+7>>0]=HEAP8[" << PS << "+7>>0]";
             break;
           }
           default: assert(0 && "bad 8 store");
         }
-        text += sep + Assign + "+HEAPF64[tempDoublePtr>>3]";
+        Code << sep << Assign << "+HEAPF64[tempDoublePtr>>3]";
         break;
       }
       case 4: {
         if (T->isIntegerTy() || T->isPointerTy()) {
           switch (Alignment) {
             case 2: {
-              text = Assign + "HEAPU16[" + PS + ">>1]|" +
-                             "(HEAPU16[" + PS + "+2>>1]<<16)";
+              Code << Assign << "HEAPU16[" << PS << ">>1]|" <<
+                             "(HEAPU16[" << PS << "+2>>1]<<16)";
               break;
             }
             case 1: {
-              text = Assign + "HEAPU8[" + PS + ">>0]|" +
-                             "(HEAPU8[" + PS + "+1>>0]<<8)|" +
-                             "(HEAPU8[" + PS + "+2>>0]<<16)|" +
-                             "(HEAPU8[" + PS + "+3>>0]<<24)";
+              Code << Assign << "HEAPU8[" << PS << ">>0]|" <<
+                             "(HEAPU8[" << PS << "+1>>0]<<8)|" <<
+                             "(HEAPU8[" << PS << "+2>>0]<<16)|" <<
+                             "(HEAPU8[" << PS << "+3>>0]<<24)";
               break;
             }
             default: assert(0 && "bad 4i store");
@@ -1378,83 +1832,91 @@ std::string JSWriter::getLoad(const Instruction *I, const Value *P, Type *T, uns
           assert(T->isFloatingPointTy());
           switch (Alignment) {
             case 2: {
-              text = "HEAP16[tempDoublePtr>>1]=HEAP16[" + PS + ">>1]" + sep +
-                     "HEAP16[tempDoublePtr+2>>1]=HEAP16[" + PS + "+2>>1]";
+              Code << "HEAP16[tempDoublePtr>>1]=HEAP16[" << PS << ">>1]" << sep <<
+                     "HEAP16[tempDoublePtr+2>>1]=HEAP16[" << PS << "+2>>1]";
               break;
             }
             case 1: {
-              text = "HEAP8[tempDoublePtr>>0]=HEAP8[" + PS + ">>0]" + sep +
-                     "HEAP8[tempDoublePtr+1>>0]=HEAP8[" + PS + "+1>>0]" + sep +
-                     "HEAP8[tempDoublePtr+2>>0]=HEAP8[" + PS + "+2>>0]" + sep +
-                     "HEAP8[tempDoublePtr+3>>0]=HEAP8[" + PS + "+3>>0]";
+              Code << "HEAP8[tempDoublePtr>>0]=HEAP8[" << PS << ">>0]" << sep <<
+                     "HEAP8[tempDoublePtr+1>>0]=HEAP8[" << PS << "+1>>0]" << sep <<
+                     "HEAP8[tempDoublePtr+2>>0]=HEAP8[" << PS << "+2>>0]" << sep <<
+                     "HEAP8[tempDoublePtr+3>>0]=HEAP8[" << PS << "+3>>0]";
               break;
             }
             default: assert(0 && "bad 4f store");
           }
-          text += sep + Assign + getCast("HEAPF32[tempDoublePtr>>2]", Type::getFloatTy(TheModule->getContext()));
+          Type *FloatTy = Type::getFloatTy(TheModule->getContext());
+          Code << sep << Assign;
+          printCastPrefix(Code, FloatTy) << "HEAPF32[tempDoublePtr>>2]";
+          printCastSuffix(Code, FloatTy);
         }
         break;
       }
       case 2: {
-        text = Assign + "HEAPU8[" + PS + ">>0]|" +
-                       "(HEAPU8[" + PS + "+1>>0]<<8)";
+        Code << Assign << "HEAPU8[" << PS << ">>0]|" <<
+                       "(HEAPU8[" << PS << "+1>>0]<<8)";
         break;
       }
       default: assert(0 && "bad store");
     }
   }
-  return text;
+  return Code;
 }
 
 std::string JSWriter::getStore(const Instruction *I, const Value *P, Type *T, const std::string& VS, unsigned Alignment, char sep) {
+  SmallString<64> Code;
+  raw_svector_ostream CodeStream(Code);
+  printStore(CodeStream, I, P, T, VS, Alignment, sep);
+  return Code.str().str();
+}
+
+raw_ostream &JSWriter::printStore(raw_ostream &Code, const Instruction *I, const Value *P, Type *T, StringRef VS, unsigned Alignment, char sep) {
   assert(sep == ';'); // FIXME when we need that
   unsigned Bytes = DL->getTypeAllocSize(T);
   bool Aligned = Bytes <= Alignment || Alignment == 0;
   if (OnlyWebAssembly) {
     if (Alignment == 536870912) {
-      return "abort() /* segfault */";
+      return Code << "abort() /* segfault */";
     }
     if (T->isIntegerTy() || T->isPointerTy()) {
       switch (Bytes) {
-        case 1: return "store1(" + getValueAsStr(P) + "," + VS + ")";
-        case 2: return "store2(" + getValueAsStr(P) + "," + VS + (Aligned ? "" : "," + itostr(Alignment)) + ")";
-        case 4: return "store4(" + getValueAsStr(P) + "," + VS + (Aligned ? "" : "," + itostr(Alignment)) + ")";
-        case 8: return "store8(" + getValueAsStr(P) + "," + VS + (Aligned ? "" : "," + itostr(Alignment)) + ")";
+        case 1: return Code << "store1(" << streamValue(P) << "," << VS << ")";
+        case 2: Code << "store2(" << streamValue(P) << "," << VS; break;
+        case 4: Code << "store4(" << streamValue(P) << "," << VS; break;
+        case 8: Code << "store8(" << streamValue(P) << "," << VS; break;
         default: llvm_unreachable("invalid wasm-only int load size");
       }
     } else {
       switch (Bytes) {
-        case 4: return "storef(" + getValueAsStr(P) + "," + VS + (Aligned ? "" : "," + itostr(Alignment)) + ")";
-        case 8: return "stored(" + getValueAsStr(P) + "," + VS + (Aligned ? "" : "," + itostr(Alignment)) + ")";
+        case 4: Code << "storef(" << streamValue(P) << "," << VS; break;
+        case 8: Code << "stored(" << streamValue(P) << "," << VS; break;
         default: llvm_unreachable("invalid wasm-only float load size");
       }
     }
+    if (!Aligned) Code << "," << itostr(Alignment);
+    return Code << ")";
   }
-  std::string text;
   if (Aligned) {
-    if (EnablePthreads && cast<StoreInst>(I)->isVolatile()) {
+    if (EnablePthreads && isAtomicAccess(I)) {
       const char *HeapName;
       std::string Index = getHeapNameAndIndex(P, &HeapName);
       if (!strcmp(HeapName, "HEAPF32") || !strcmp(HeapName, "HEAPF64")) {
         // TODO: If https://bugzilla.mozilla.org/show_bug.cgi?id=1131613 and https://bugzilla.mozilla.org/show_bug.cgi?id=1131624 are
         // implemented, we could remove the emulation, but until then we must emulate manually.
-        text = std::string("_emscripten_atomic_store_") + heapNameToAtomicTypeName(HeapName) + "(" + getValueAsStr(P) + ',' + VS + ')';
-        if (PreciseF32 && !strcmp(HeapName, "HEAPF32"))
-          text = "Math_fround(" + text + ")";
-        else
-          text = "+" + text;
+        bool fround = PreciseF32 && !strcmp(HeapName, "HEAPF32");
+        Code << (fround ? "Math_fround(" : "+") << "_emscripten_atomic_store_" << heapNameToAtomicTypeName(HeapName) << "(" << streamValue(P) << ',' << VS << (fround ? "))" : ")");
       } else {
-        text = std::string("Atomics_store(") + HeapName + ',' + Index + ',' + VS + ")|0";
+        Code << "Atomics_store(" << HeapName << ',' << Index << ',' << VS << ")|0";
       }
     } else {
-      text = getPtrUse(P) + " = " + VS;
+      printPtrUse(Code, P) << " = " << VS;
     }
-    if (Alignment == 536870912) text += "; abort() /* segfault */";
+    if (Alignment == 536870912) Code << "; abort() /* segfault */";
   } else {
     // unaligned in some manner
 
-    if (EnablePthreads && cast<StoreInst>(I)->isVolatile()) {
-      errs() << "emcc: warning: unable to implement unaligned volatile store as atomic in " << I->getParent()->getParent()->getName() << ":" << *I << " | ";
+    if (EnablePthreads && isAtomicAccess(I)) {
+      errs() << "emcc: warning: unable to implement unaligned atomic store in " << I->getParent()->getParent()->getName() << ":" << *I << " | ";
       emitDebugInfo(errs(), I);
       errs() << "\n";
     }
@@ -1467,29 +1929,29 @@ std::string JSWriter::getStore(const Instruction *I, const Value *P, Type *T, co
     std::string PS = getValueAsStr(P);
     switch (Bytes) {
       case 8: {
-        text = "HEAPF64[tempDoublePtr>>3]=" + VS + ';';
+        Code << "HEAPF64[tempDoublePtr>>3]=" << VS << ';';
         switch (Alignment) {
           case 4: {
-            text += "HEAP32[" + PS + ">>2]=HEAP32[tempDoublePtr>>2];" +
-                    "HEAP32[" + PS + "+4>>2]=HEAP32[tempDoublePtr+4>>2]";
+            Code << "HEAP32[" << PS << ">>2]=HEAP32[tempDoublePtr>>2];" <<
+                    "HEAP32[" << PS << "+4>>2]=HEAP32[tempDoublePtr+4>>2]";
             break;
           }
           case 2: {
-            text += "HEAP16[" + PS + ">>1]=HEAP16[tempDoublePtr>>1];" +
-                    "HEAP16[" + PS + "+2>>1]=HEAP16[tempDoublePtr+2>>1];" +
-                    "HEAP16[" + PS + "+4>>1]=HEAP16[tempDoublePtr+4>>1];" +
-                    "HEAP16[" + PS + "+6>>1]=HEAP16[tempDoublePtr+6>>1]";
+            Code << "HEAP16[" << PS << ">>1]=HEAP16[tempDoublePtr>>1];" <<
+                    "HEAP16[" << PS << "+2>>1]=HEAP16[tempDoublePtr+2>>1];" <<
+                    "HEAP16[" << PS << "+4>>1]=HEAP16[tempDoublePtr+4>>1];" <<
+                    "HEAP16[" << PS << "+6>>1]=HEAP16[tempDoublePtr+6>>1]";
             break;
           }
           case 1: {
-            text += "HEAP8[" + PS + ">>0]=HEAP8[tempDoublePtr>>0];" +
-                    "HEAP8[" + PS + "+1>>0]=HEAP8[tempDoublePtr+1>>0];" +
-                    "HEAP8[" + PS + "+2>>0]=HEAP8[tempDoublePtr+2>>0];" +
-                    "HEAP8[" + PS + "+3>>0]=HEAP8[tempDoublePtr+3>>0];" +
-                    "HEAP8[" + PS + "+4>>0]=HEAP8[tempDoublePtr+4>>0];" +
-                    "HEAP8[" + PS + "+5>>0]=HEAP8[tempDoublePtr+5>>0];" +
-                    "HEAP8[" + PS + "+6>>0]=HEAP8[tempDoublePtr+6>>0];" +
-                    "HEAP8[" + PS + "+7>>0]=HEAP8[tempDoublePtr+7>>0]";
+            Code << "HEAP8[" << PS << ">>0]=HEAP8[tempDoublePtr>>0];" <<
+                    "HEAP8[" << PS << "+1>>0]=HEAP8[tempDoublePtr+1>>0];" <<
+                    "HEAP8[" << PS << "+2>>0]=HEAP8[tempDoublePtr+2>>0];" <<
+                    "HEAP8[" << PS << "+3>>0]=HEAP8[tempDoublePtr+3>>0];" <<
+                    "HEAP8[" << PS << "+4>>0]=HEAP8[tempDoublePtr+4>>0];" <<
+                    "HEAP8[" << PS << "+5>>0]=HEAP8[tempDoublePtr+5>>0];" <<
+                    "HEAP8[" << PS << "+6>>0]=HEAP8[tempDoublePtr+6>>0];" <<
+                    "HEAP8[" << PS << "+7>>0]=HEAP8[tempDoublePtr+7>>0]";
             break;
           }
           default: assert(0 && "bad 8 store");
@@ -1500,33 +1962,33 @@ std::string JSWriter::getStore(const Instruction *I, const Value *P, Type *T, co
         if (T->isIntegerTy() || T->isPointerTy()) {
           switch (Alignment) {
             case 2: {
-              text = "HEAP16[" + PS + ">>1]=" + VS + "&65535;" +
-                     "HEAP16[" + PS + "+2>>1]=" + VS + ">>>16";
+              Code << "HEAP16[" << PS << ">>1]=" << VS << "&65535;" <<
+                     "HEAP16[" << PS << "+2>>1]=" << VS << ">>>16";
               break;
             }
             case 1: {
-              text = "HEAP8[" + PS + ">>0]=" + VS + "&255;" +
-                     "HEAP8[" + PS + "+1>>0]=(" + VS + ">>8)&255;" +
-                     "HEAP8[" + PS + "+2>>0]=(" + VS + ">>16)&255;" +
-                     "HEAP8[" + PS + "+3>>0]=" + VS + ">>24";
+              Code << "HEAP8[" << PS << ">>0]=" << VS << "&255;" <<
+                     "HEAP8[" << PS << "+1>>0]=(" << VS << ">>8)&255;" <<
+                     "HEAP8[" << PS << "+2>>0]=(" << VS << ">>16)&255;" <<
+                     "HEAP8[" << PS << "+3>>0]=" << VS << ">>24";
               break;
             }
             default: assert(0 && "bad 4i store");
           }
         } else { // float
           assert(T->isFloatingPointTy());
-          text = "HEAPF32[tempDoublePtr>>2]=" + VS + ';';
+          Code << "HEAPF32[tempDoublePtr>>2]=" << VS << ';';
           switch (Alignment) {
             case 2: {
-              text += "HEAP16[" + PS + ">>1]=HEAP16[tempDoublePtr>>1];" +
-                      "HEAP16[" + PS + "+2>>1]=HEAP16[tempDoublePtr+2>>1]";
+              Code << "HEAP16[" << PS << ">>1]=HEAP16[tempDoublePtr>>1];" <<
+                      "HEAP16[" << PS << "+2>>1]=HEAP16[tempDoublePtr+2>>1]";
               break;
             }
             case 1: {
-              text += "HEAP8[" + PS + ">>0]=HEAP8[tempDoublePtr>>0];" +
-                      "HEAP8[" + PS + "+1>>0]=HEAP8[tempDoublePtr+1>>0];" +
-                      "HEAP8[" + PS + "+2>>0]=HEAP8[tempDoublePtr+2>>0];" +
-                      "HEAP8[" + PS + "+3>>0]=HEAP8[tempDoublePtr+3>>0]";
+              Code << "HEAP8[" << PS << ">>0]=HEAP8[tempDoublePtr>>0];" <<
+                      "HEAP8[" << PS << "+1>>0]=HEAP8[tempDoublePtr+1>>0];" <<
+                      "HEAP8[" << PS << "+2>>0]=HEAP8[tempDoublePtr+2>>0];" <<
+                      "HEAP8[" << PS << "+3>>0]=HEAP8[tempDoublePtr+3>>0]";
               break;
             }
             default: assert(0 && "bad 4f store");
@@ -1535,14 +1997,14 @@ std::string JSWriter::getStore(const Instruction *I, const Value *P, Type *T, co
         break;
       }
       case 2: {
-        text = "HEAP8[" + PS + ">>0]=" + VS + "&255;" +
-               "HEAP8[" + PS + "+1>>0]=" + VS + ">>8";
+        Code << "HEAP8[" << PS << ">>0]=" << VS << "&255;" <<
+               "HEAP8[" << PS << "+1>>0]=" << VS << ">>8";
         break;
       }
       default: assert(0 && "bad store");
     }
   }
-  return text;
+  return Code;
 }
 
 std::string JSWriter::getStackBump(unsigned Size) {
@@ -1561,9 +2023,11 @@ std::string JSWriter::getOpName(const Value* V) { // TODO: remove this
   return getJSName(V);
 }
 
-std::string JSWriter::getPtrLoad(const Value* Ptr) {
+raw_ostream &JSWriter::printPtrLoad(raw_ostream &OS, const Value* Ptr) {
   Type *t = cast<PointerType>(Ptr->getType())->getElementType();
-  return getCast(getPtrUse(Ptr), t, ASM_NONSPECIFIC);
+  printCastPrefix(OS, t, ASM_NONSPECIFIC);
+  printPtrUse(OS, Ptr);
+  return printCastSuffix(OS, t, ASM_NONSPECIFIC);
 }
 
 std::string JSWriter::getHeapAccess(const std::string& Name, unsigned Bytes, bool Integer) {
@@ -1577,16 +2041,28 @@ std::string JSWriter::getShiftedPtr(const Value *Ptr, unsigned Bytes) {
   return getHeapNameAndIndex(Ptr, &HeapName, Bytes, true /* Integer; doesn't matter */);
 }
 
-std::string JSWriter::getPtrUse(const Value* Ptr) {
-  const char *HeapName = 0;
-  std::string Index = getHeapNameAndIndex(Ptr, &HeapName);
-  return std::string(HeapName) + '[' + Index + ']';
+raw_ostream &JSWriter::printHeapIndex(raw_ostream &OS, const Value *Ptr, unsigned Bytes, bool Integer) {
+  const GlobalVariable *GV;
+  if ((GV = dyn_cast<GlobalVariable>(Ptr->stripPointerCasts())) && GV->hasInitializer()) {
+    const char *HeapName = 0; // unused
+    return OS << getHeapNameAndIndexToGlobal(GV, Bytes, Integer, &HeapName);
+  }
+  return printValue(OS, Ptr, ASM_SIGNED) << getHeapShiftStr(Bytes);
+}
+
+raw_ostream &JSWriter::printPtrUse(raw_ostream &OS, const Value* Ptr) {
+  Type *t = cast<PointerType>(Ptr->getType())->getElementType();
+  unsigned Bytes = DL->getTypeAllocSize(t);
+  bool Integer = t->isIntegerTy() || t->isPointerTy();
+  OS << getHeapName(Bytes, Integer) << '[';
+  return printHeapIndex(OS, Ptr, Bytes, Integer) << ']';
 }
 
 std::string JSWriter::getUndefValue(Type* T, AsmCast sign) {
   std::string S;
   if (VectorType *VT = dyn_cast<VectorType>(T)) {
     checkVectorType(VT);
+    if (WasmSIMD) return getWasmSIMDConstant(VT, nullptr);
     S = std::string("SIMD_") + SIMDType(VT) + "_splat(" + ensureFloat("0", !VT->getElementType()->isIntegerTy()) + ')';
   } else {
     if (OnlyWebAssembly && T->isIntegerTy() && T->getIntegerBitWidth() == 64) {
@@ -1604,7 +2080,7 @@ std::string JSWriter::getConstant(const Constant* CV, AsmCast sign) {
   if (isa<ConstantPointerNull>(CV)) return "0";
 
   if (const Function *F = dyn_cast<Function>(CV)) {
-    return relocateFunctionPointer(utostr(getFunctionIndex(F)));
+    return relocateFunctionPointer(getFunctionIndexStr(F));
   }
 
   if (const GlobalValue *GV = dyn_cast<GlobalValue>(CV)) {
@@ -1656,6 +2132,7 @@ std::string JSWriter::getConstant(const Constant* CV, AsmCast sign) {
   } else if (isa<ConstantAggregateZero>(CV)) {
     if (VectorType *VT = dyn_cast<VectorType>(CV->getType())) {
       checkVectorType(VT);
+      if (WasmSIMD) return getWasmSIMDConstant(VT, nullptr);
       return std::string("SIMD_") + SIMDType(VT) + "_splat(" + ensureFloat("0", !VT->getElementType()->isIntegerTy()) + ')';
     } else {
       // something like [0 x i8*] zeroinitializer, which clang can emit for landingpads
@@ -1673,7 +2150,7 @@ std::string JSWriter::getConstant(const Constant* CV, AsmCast sign) {
     CV = CE->getOperand(0); // ignore bitcast
     return getConstant(CV);
   } else if (const BlockAddress *BA = dyn_cast<const BlockAddress>(CV)) {
-    return utostr(getBlockAddress(BA));
+    return getBlockAddressStr(BA->getFunction(), BA->getBasicBlock());
   } else if (const ConstantExpr *CE = dyn_cast<ConstantExpr>(CV)) {
     std::string Code;
     raw_string_ostream CodeStream(Code);
@@ -1699,6 +2176,7 @@ template<> Constant *VectorOperandAccessor<ConstantDataVector>::getOperand(const
 template<typename ConstantVectorType/*= ConstantVector or ConstantDataVector*/>
 std::string JSWriter::getConstantVector(const ConstantVectorType *C) {
   checkVectorType(C->getType());
+  if (WasmSIMD) return getWasmSIMDConstant(C->getType(), C);
   unsigned NumElts = cast<VectorType>(C->getType())->getNumElements();
 
   bool isInt = C->getType()->getElementType()->isIntegerTy();
@@ -1742,7 +2220,7 @@ std::string JSWriter::getConstantVector(const ConstantVectorType *C) {
     if (!hasSpecialNaNs) {
       return std::string("SIMD_") + SIMDType(C->getType()) + "_splat(" + ensureFloat(op0, !isInt) + ')';
     } else {
-      VectorType *IntTy = VectorType::getInteger(C->getType());
+      VectorType *IntTy = getIntegerVectorType(C->getType());
       checkVectorType(IntTy);
       return getSIMDCast(IntTy, C->getType(), std::string("SIMD_") + SIMDType(IntTy) + "_splat(" + op0 + ')', true);
     }
@@ -1763,7 +2241,7 @@ std::string JSWriter::getConstantVector(const ConstantVectorType *C) {
 
     return c + ')';
   } else {
-    VectorType *IntTy = VectorType::getInteger(C->getType());
+    VectorType *IntTy = getIntegerVectorType(C->getType());
     checkVectorType(IntTy);
     c = std::string("SIMD_") + SIMDType(IntTy) + '(' + op0;
     for (unsigned i = 1; i < NumElts; ++i) {
@@ -1785,45 +2263,98 @@ std::string JSWriter::getValueAsStr(const Value* V, AsmCast sign) {
 
   if (const Constant *CV = dyn_cast<Constant>(V)) {
     return getConstant(CV, sign);
+  } else if (isFoldedExpression(V)) {
+    std::string Code;
+    raw_string_ostream CodeStream(Code);
+    printValue(CodeStream, V, sign);
+    return CodeStream.str();
   } else {
     return getJSName(V);
   }
 }
 
+raw_ostream &JSWriter::printValue(raw_ostream &OS, const Value* V, AsmCast sign) {
+  // Like getValueAsStr, but names are written out without copying them.
+  V = stripPointerCastsWithoutSideEffects(V);
+
+  if (const Constant *CV = dyn_cast<Constant>(V)) {
+    return OS << getConstant(CV, sign);
+  } else if (isFoldedExpression(V)) {
+    // Written in place of the name, as the expression generateExpression
+    // would have assigned to it.
+    SmallString<64> Code;
+    raw_svector_ostream CodeStream(Code);
+    generateExpression(cast<Instruction>(V), CodeStream);
+    if (isParenthesized(Code)) return OS << Code;
+    return OS << '(' << Code << ')';
+  } else {
+    return OS << getJSName(V);
+  }
+}
+
 std::string JSWriter::getValueAsCastStr(const Value* V, AsmCast sign) {
+  SmallString<64> Code;
+  raw_svector_ostream CodeStream(Code);
+  printValueAsCast(CodeStream, V, sign);
+  return Code.str().str();
+}
+
+raw_ostream &JSWriter::printValueAsCast(raw_ostream &OS, const Value* V, AsmCast sign) {
   // Skip past no-op bitcasts and zero-index geps.
   V = stripPointerCastsWithoutSideEffects(V);
 
   if (isa<ConstantInt>(V) || isa<ConstantFP>(V)) {
-    return getConstant(cast<Constant>(V), sign);
+    return OS << getConstant(cast<Constant>(V), sign);
   } else {
-    return getCast(getValueAsStr(V), V->getType(), sign);
+    printCastPrefix(OS, V->getType(), sign);
+    printValue(OS, V, ASM_SIGNED);
+    return printCastSuffix(OS, V->getType(), sign);
   }
 }
 
 std::string JSWriter::getValueAsParenStr(const Value* V) {
+  SmallString<64> Code;
+  raw_svector_ostream CodeStream(Code);
+  printValueAsParen(CodeStream, V);
+  return Code.str().str();
+}
+
+raw_ostream &JSWriter::printValueAsParen(raw_ostream &OS, const Value* V) {
   // Skip past no-op bitcasts and zero-index geps.
   V = stripPointerCastsWithoutSideEffects(V);
 
   if (const Constant *CV = dyn_cast<Constant>(V)) {
-    return getConstant(CV);
+    return OS << getConstant(CV);
+  } else if (isFoldedExpression(V)) {
+    return printValue(OS, V, ASM_SIGNED); // already parenthesized
   } else {
-    return "(" + getValueAsStr(V) + ")";
+    return OS << '(' << getJSName(V) << ')';
   }
 }
 
 std::string JSWriter::getValueAsCastParenStr(const Value* V, AsmCast sign) {
+  SmallString<64> Code;
+  raw_svector_ostream CodeStream(Code);
+  printValueAsCastParen(CodeStream, V, sign);
+  return Code.str().str();
+}
+
+raw_ostream &JSWriter::printValueAsCastParen(raw_ostream &OS, const Value* V, AsmCast sign) {
   // Skip past no-op bitcasts and zero-index geps.
   V = stripPointerCastsWithoutSideEffects(V);
 
   if (isa<ConstantInt>(V) || isa<ConstantFP>(V) || isa<UndefValue>(V)) {
-    return getConstant(cast<Constant>(V), sign);
+    return OS << getConstant(cast<Constant>(V), sign);
   } else {
-    return "(" + getCast(getValueAsStr(V), V->getType(), sign) + ")";
+    OS << '(';
+    printCastPrefix(OS, V->getType(), sign);
+    printValue(OS, V, ASM_SIGNED);
+    printCastSuffix(OS, V->getType(), sign);
+    return OS << ')';
   }
 }
 
-void JSWriter::generateInsertElementExpression(const InsertElementInst *III, raw_string_ostream& Code) {
+void JSWriter::generateInsertElementExpression(const InsertElementInst *III, raw_ostream& Code) {
   // LLVM has no vector type constructor operator; it uses chains of
   // insertelement instructions instead. It also has no splat operator; it
   // uses an insertelement followed by a shuffle instead. If this insertelement
@@ -1870,11 +2401,30 @@ void JSWriter::generateInsertElementExpression(const InsertElementInst *III, raw
 
   // Emit code for the chain.
   Code << getAssignIfNeeded(III);
+  if (WasmSIMD) {
+    // There is no constructor, so start from a splat of the first operand if
+    // every lane is set, and replace the other lanes one by one.
+    std::string Shape = WasmSIMDShape(VT);
+    std::string Result;
+    if (NumInserted == NumElems) {
+      Result = Shape + "_splat(" + ensureFloat(getValueAsStr(Operands[0]), !PreciseF32 && VT->getElementType()->isFloatTy()) + ")";
+    } else {
+      Result = getValueAsStr(Base);
+    }
+    for (unsigned Index = 0; Index < NumElems; ++Index) {
+      if (!Operands[Index] || (NumInserted == NumElems && Operands[Index] == Operands[0]))
+        continue;
+      std::string operand = ensureFloat(getValueAsStr(Operands[Index]), !PreciseF32 && VT->getElementType()->isFloatTy());
+      Result = Shape + "_replace_lane(" + Result + ',' + utostr(Index) + ',' + operand + ')';
+    }
+    Code << Result;
+    return;
+  }
   if (NumInserted == NumElems) {
     if (Splat) {
       // Emit splat code.
       if (VT->getElementType()->isIntegerTy()) {
-        Code << std::string("SIMD_") + SIMDType(VT) + "_splat(" << getValueAsStr(Splat) << ")";
+        Code << std::string("SIMD_") + SIMDType(VT) + "_splat(" << streamValue(Splat) << ")";
       } else {
         std::string operand = getValueAsStr(Splat);
         if (!PreciseF32) {
@@ -1916,7 +2466,7 @@ void JSWriter::generateInsertElementExpression(const InsertElementInst *III, raw
   }
 }
 
-void JSWriter::generateExtractElementExpression(const ExtractElementInst *EEI, raw_string_ostream& Code) {
+void JSWriter::generateExtractElementExpression(const ExtractElementInst *EEI, raw_ostream& Code) {
   VectorType *VT = cast<VectorType>(EEI->getVectorOperand()->getType());
   checkVectorType(VT);
   const ConstantInt *IndexInt = dyn_cast<const ConstantInt>(EEI->getIndexOperand());
@@ -1925,7 +2475,15 @@ void JSWriter::generateExtractElementExpression(const ExtractElementInst *EEI, r
     Code << getAssignIfNeeded(EEI);
     std::string OperandCode;
     raw_string_ostream CodeStream(OperandCode);
-    CodeStream << std::string("SIMD_") << SIMDType(VT) << "_extractLane(" << getValueAsStr(EEI->getVectorOperand()) << ',' << Index << ')';
+    if (WasmSIMD) {
+      std::string Shape = WasmSIMDShape(VT);
+      bool Narrow = Shape == "i8x16" || Shape == "i16x8";
+      CodeStream << Shape << (Narrow ? "_extract_lane_s(" : "_extract_lane(") << streamValue(EEI->getVectorOperand()) << ',' << Index << ')';
+      // a lane of a mask is all ones, but an i1 is 0 or 1
+      if (EEI->getType()->isIntegerTy(1)) CodeStream << "&1";
+    } else {
+      CodeStream << std::string("SIMD_") << SIMDType(VT) << "_extractLane(" << streamValue(EEI->getVectorOperand()) << ',' << Index << ')';
+    }
     Code << getCast(CodeStream.str(), EEI->getType());
     return;
   }
@@ -1969,7 +2527,7 @@ std::string JSWriter::getSIMDCast(VectorType *fromType, VectorType *toType, cons
   return std::string("SIMD_") + SIMDType(toType) + "_from" + SIMDType(fromType) + "Bits(" + valueStr + ")";
 }
 
-void JSWriter::generateShuffleVectorExpression(const ShuffleVectorInst *SVI, raw_string_ostream& Code) {
+void JSWriter::generateShuffleVectorExpression(const ShuffleVectorInst *SVI, raw_ostream& Code) {
   Code << getAssignIfNeeded(SVI);
 
   // LLVM has no splat operator, so it makes do by using an insert and a
@@ -1988,7 +2546,11 @@ void JSWriter::generateShuffleVectorExpression(const ShuffleVectorInst *SVI, raw
           // otherwise not being precise about it.
           operand = "Math_fround(" + operand + ")";
         }
-        Code << "SIMD_" << SIMDType(SVI->getType()) << "_splat(" << operand << ')';
+        if (WasmSIMD) {
+          Code << WasmSIMDShape(SVI->getType()) << "_splat(" << operand << ')';
+        } else {
+          Code << "SIMD_" << SIMDType(SVI->getType()) << "_splat(" << operand << ')';
+        }
         return;
       }
     }
@@ -2000,6 +2562,22 @@ void JSWriter::generateShuffleVectorExpression(const ShuffleVectorInst *SVI, raw
   VectorType *op0 = cast<VectorType>(SVI->getOperand(0)->getType());
   int OpNumElements = op0->getNumElements();
   int ResultNumElements = SVI->getType()->getNumElements();
+
+  if (WasmSIMD) {
+    // A byte shuffle of the two operands, lanes past the end of the result
+    // being zero. Lanes of the second operand start at byte 16.
+    int LaneBytes = 16 / SIMDNumElements(SVI->getType());
+    Code << "i8x16_shuffle(" << A << ',' << B;
+    for (int i = 0; i < 16 / LaneBytes; ++i) {
+      int Mask = i < ResultNumElements ? SVI->getMaskValue(i) : -1;
+      int Lane = Mask < 0 ? 0 : Mask < OpNumElements ? Mask : 16 / LaneBytes + Mask - OpNumElements;
+      for (int b = 0; b < LaneBytes; ++b) {
+        Code << ',' << (Mask < 0 ? 0 : Lane * LaneBytes + b);
+      }
+    }
+    Code << ')';
+    return;
+  }
   // Promote smaller than 128-bit vector types to 128-bit since smaller ones do not exist in SIMD.js. (pad with zero lanes)
   const int SIMDJsRetNumElements = SIMDNumElements(cast<VectorType>(SVI->getType()));
   const int SIMDJsOp0NumElements = SIMDNumElements(op0);
@@ -2062,7 +2640,7 @@ void JSWriter::generateShuffleVectorExpression(const ShuffleVectorInst *SVI, raw
   Code << ')';
 }
 
-void JSWriter::generateICmpExpression(const ICmpInst *I, raw_string_ostream& Code) {
+void JSWriter::generateICmpExpression(const ICmpInst *I, raw_ostream& Code) {
   bool Invert = false;
   const char *Name;
   switch (cast<ICmpInst>(I)->getPredicate()) {
@@ -2082,19 +2660,19 @@ void JSWriter::generateICmpExpression(const ICmpInst *I, raw_string_ostream& Cod
   checkVectorType(I->getOperand(0)->getType());
   checkVectorType(I->getOperand(1)->getType());
 
-  Code << getAssignIfNeeded(I);
+  printAssignIfNeeded(Code, I);
 
   if (Invert)
     Code << "SIMD_" << SIMDType(cast<VectorType>(I->getType())) << "_not(";
 
   Code << "SIMD_" << SIMDType(cast<VectorType>(I->getOperand(0)->getType())) << '_' << Name << '('
-       << getValueAsStr(I->getOperand(0)) << ',' << getValueAsStr(I->getOperand(1)) << ')';
+       << streamValue(I->getOperand(0)) << ',' << streamValue(I->getOperand(1)) << ')';
 
   if (Invert)
     Code << ')';
 }
 
-void JSWriter::generateFCmpExpression(const FCmpInst *I, raw_string_ostream& Code) {
+void JSWriter::generateFCmpExpression(const FCmpInst *I, raw_ostream& Code) {
   const char *Name;
   bool Invert = false;
   VectorType *VT = cast<VectorType>(I->getType());
@@ -2129,8 +2707,8 @@ void JSWriter::generateFCmpExpression(const FCmpInst *I, raw_string_ostream& Cod
       checkVectorType(I->getOperand(1)->getType());
       Code << getAssignIfNeeded(I)
            << "SIMD_" << SIMDType(cast<VectorType>(I->getType())) << "_and("
-           << "SIMD_" << SIMDType(cast<VectorType>(I->getOperand(0)->getType())) << "_equal(" << getValueAsStr(I->getOperand(0)) << ',' << getValueAsStr(I->getOperand(0)) << "),"
-           << "SIMD_" << SIMDType(cast<VectorType>(I->getOperand(1)->getType())) << "_equal(" << getValueAsStr(I->getOperand(1)) << ',' << getValueAsStr(I->getOperand(1)) << "))";
+           << "SIMD_" << SIMDType(cast<VectorType>(I->getOperand(0)->getType())) << "_equal(" << streamValue(I->getOperand(0)) << ',' << streamValue(I->getOperand(0)) << "),"
+           << "SIMD_" << SIMDType(cast<VectorType>(I->getOperand(1)->getType())) << "_equal(" << streamValue(I->getOperand(1)) << ',' << streamValue(I->getOperand(1)) << "))";
       return;
 
     case FCmpInst::FCMP_UNO:
@@ -2138,8 +2716,8 @@ void JSWriter::generateFCmpExpression(const FCmpInst *I, raw_string_ostream& Cod
       checkVectorType(I->getOperand(1)->getType());
       Code << getAssignIfNeeded(I)
            << "SIMD_" << SIMDType(cast<VectorType>(I->getType())) << "_or("
-           << "SIMD_" << SIMDType(cast<VectorType>(I->getOperand(0)->getType())) << "_notEqual(" << getValueAsStr(I->getOperand(0)) << ',' << getValueAsStr(I->getOperand(0)) << "),"
-           << "SIMD_" << SIMDType(cast<VectorType>(I->getOperand(1)->getType())) << "_notEqual(" << getValueAsStr(I->getOperand(1)) << ',' << getValueAsStr(I->getOperand(1)) << "))";
+           << "SIMD_" << SIMDType(cast<VectorType>(I->getOperand(0)->getType())) << "_notEqual(" << streamValue(I->getOperand(0)) << ',' << streamValue(I->getOperand(0)) << "),"
+           << "SIMD_" << SIMDType(cast<VectorType>(I->getOperand(1)->getType())) << "_notEqual(" << streamValue(I->getOperand(1)) << ',' << streamValue(I->getOperand(1)) << "))";
       return;
 
     case ICmpInst::FCMP_OEQ:  Name = "equal"; break;
@@ -2158,13 +2736,13 @@ void JSWriter::generateFCmpExpression(const FCmpInst *I, raw_string_ostream& Cod
   checkVectorType(I->getOperand(0)->getType());
   checkVectorType(I->getOperand(1)->getType());
 
-  Code << getAssignIfNeeded(I);
+  printAssignIfNeeded(Code, I);
 
   if (Invert)
     Code << "SIMD_" << SIMDType(cast<VectorType>(I->getType())) << "_not(";
 
   Code << "SIMD_" << SIMDType(cast<VectorType>(I->getOperand(0)->getType())) << "_" << Name << "("
-       << getValueAsStr(I->getOperand(0)) << ", " << getValueAsStr(I->getOperand(1)) << ")";
+       << streamValue(I->getOperand(0)) << ", " << streamValue(I->getOperand(1)) << ")";
 
   if (Invert)
     Code << ")";
@@ -2185,6 +2763,18 @@ static const Value *getSplatValue(const Value *V) {
     if (const Constant *C = dyn_cast<Constant>(V))
         return C->getSplatValue();
 
+    // LLVM's splat idiom, an insertelement into lane 0 and a zero shuffle.
+    if (const ShuffleVectorInst *SVI = dyn_cast<ShuffleVectorInst>(V)) {
+        if (isa<ConstantAggregateZero>(SVI->getMask()) && isa<InsertElementInst>(SVI->getOperand(0))) {
+            const InsertElementInst *IEI = cast<InsertElementInst>(SVI->getOperand(0));
+            if (const ConstantInt *CI = dyn_cast<ConstantInt>(IEI->getOperand(2))) {
+                if (CI->isZero())
+                    return IEI->getOperand(1);
+            }
+        }
+        return NULL;
+    }
+
     VectorType *VTy = cast<VectorType>(V->getType());
     const Value *Result = NULL;
     for (unsigned i = 0; i < VTy->getNumElements(); ++i) {
@@ -2200,7 +2790,7 @@ static const Value *getSplatValue(const Value *V) {
 
 }
 
-void JSWriter::generateShiftExpression(const BinaryOperator *I, raw_string_ostream& Code) {
+void JSWriter::generateShiftExpression(const BinaryOperator *I, raw_ostream& Code) {
     // If we're shifting every lane by the same amount (shifting by a splat value
     // then we can use a ByScalar shift.
     const Value *Count = I->getOperand(1);
@@ -2212,7 +2802,7 @@ void JSWriter::generateShiftExpression(const BinaryOperator *I, raw_string_ostre
             Code << "shiftRightLogicalByScalar";
         else
             Code << "shiftLeftByScalar";
-        Code << "(" << getValueAsStr(I->getOperand(0)) << ", " << getValueAsStr(Splat) << ")";
+        Code << "(" << streamValue(I->getOperand(0)) << ", " << streamValue(Splat) << ")";
         return;
     }
 
@@ -2220,10 +2810,42 @@ void JSWriter::generateShiftExpression(const BinaryOperator *I, raw_string_ostre
     generateUnrolledExpression(I, Code);
 }
 
-void JSWriter::generateUnrolledExpression(const User *I, raw_string_ostream& Code) {
+void JSWriter::generateUnrolledExpression(const User *I, raw_ostream& Code) {
   VectorType *VT = cast<VectorType>(I->getType());
 
-  Code << getAssignIfNeeded(I);
+  printAssignIfNeeded(Code, I);
+
+  if (WasmSIMD) {
+    // Compute each lane as a scalar and replace it in a splat of the first.
+    std::string Shape = WasmSIMDShape(VT);
+    unsigned Opcode = Operator::getOpcode(I);
+    bool Unsigned = Opcode == Instruction::UDiv || Opcode == Instruction::URem || Opcode == Instruction::LShr;
+    bool Narrow = Shape == "i8x16" || Shape == "i16x8";
+    std::string Extract = Shape + (!Narrow ? "_extract_lane(" : Unsigned ? "_extract_lane_u(" : "_extract_lane_s(");
+    std::string A = getValueAsStr(I->getOperand(0));
+    std::string B = getValueAsStr(I->getOperand(1));
+    std::string Result;
+    for (unsigned Index = 0; Index < VT->getNumElements(); ++Index) {
+      std::string X = Extract + A + "," + utostr(Index) + ")";
+      std::string Y = Extract + B + "," + utostr(Index) + ")";
+      std::string Lane;
+      switch (Opcode) {
+        case Instruction::Mul:  Lane = "Math_imul(" + X + "," + Y + ")|0"; break;
+        case Instruction::SDiv: Lane = "((" + X + "|0) / (" + Y + "|0))|0"; break;
+        case Instruction::UDiv: Lane = "((" + X + ">>>0) / (" + Y + ">>>0))>>>0"; break;
+        case Instruction::SRem: Lane = "((" + X + "|0) % (" + Y + "|0))|0"; break;
+        case Instruction::URem: Lane = "((" + X + ">>>0) % (" + Y + ">>>0))>>>0"; break;
+        case Instruction::AShr: Lane = "(" + X + "|0) >> (" + Y + "|0)"; break;
+        case Instruction::LShr: Lane = "(" + X + "|0) >>> (" + Y + "|0)"; break;
+        case Instruction::Shl:  Lane = "(" + X + "|0) << (" + Y + "|0)"; break;
+        default: I->dump(); error("invalid unrolled vector instr"); break;
+      }
+      Result = Index == 0 ? Shape + "_splat(" + Lane + ")"
+                          : Shape + "_replace_lane(" + Result + "," + utostr(Index) + "," + Lane + ")";
+    }
+    Code << Result;
+    return;
+  }
 
   Code << "SIMD_" << SIMDType(VT) << '(';
 
@@ -2249,45 +2871,45 @@ void JSWriter::generateUnrolledExpression(const User *I, raw_string_ostream& Cod
     }
     switch (Operator::getOpcode(I)) {
       case Instruction::SDiv:
-        Code << "(" << Extract << getValueAsStr(I->getOperand(0)) << "," << Index << ")|0)"
+        Code << "(" << Extract << streamValue(I->getOperand(0)) << "," << Index << ")|0)"
                 " / "
-                "(" << Extract << getValueAsStr(I->getOperand(1)) << "," << Index << ")|0)"
+                "(" << Extract << streamValue(I->getOperand(1)) << "," << Index << ")|0)"
                 "|0";
         break;
       case Instruction::UDiv:
-        Code << "(" << Extract << getValueAsStr(I->getOperand(0)) << "," << Index << ")>>>0)"
+        Code << "(" << Extract << streamValue(I->getOperand(0)) << "," << Index << ")>>>0)"
                 " / "
-                "(" << Extract << getValueAsStr(I->getOperand(1)) << "," << Index << ")>>>0)"
+                "(" << Extract << streamValue(I->getOperand(1)) << "," << Index << ")>>>0)"
                 ">>>0";
         break;
       case Instruction::SRem:
-        Code << "(" << Extract << getValueAsStr(I->getOperand(0)) << "," << Index << ")|0)"
+        Code << "(" << Extract << streamValue(I->getOperand(0)) << "," << Index << ")|0)"
                 " % "
-                "(" << Extract << getValueAsStr(I->getOperand(1)) << "," << Index << ")|0)"
+                "(" << Extract << streamValue(I->getOperand(1)) << "," << Index << ")|0)"
                 "|0";
         break;
       case Instruction::URem:
-        Code << "(" << Extract << getValueAsStr(I->getOperand(0)) << "," << Index << ")>>>0)"
+        Code << "(" << Extract << streamValue(I->getOperand(0)) << "," << Index << ")>>>0)"
                 " % "
-                "(" << Extract << getValueAsStr(I->getOperand(1)) << "," << Index << ")>>>0)"
+                "(" << Extract << streamValue(I->getOperand(1)) << "," << Index << ")>>>0)"
                 ">>>0";
         break;
       case Instruction::AShr:
-        Code << "(" << Extract << getValueAsStr(I->getOperand(0)) << "," << Index << ")|0)"
+        Code << "(" << Extract << streamValue(I->getOperand(0)) << "," << Index << ")|0)"
                 " >> "
-                "(" << Extract << getValueAsStr(I->getOperand(1)) << "," << Index << ")|0)"
+                "(" << Extract << streamValue(I->getOperand(1)) << "," << Index << ")|0)"
                 "|0";
         break;
       case Instruction::LShr:
-        Code << "(" << Extract << getValueAsStr(I->getOperand(0)) << "," << Index << ")|0)"
+        Code << "(" << Extract << streamValue(I->getOperand(0)) << "," << Index << ")|0)"
                 " >>> "
-                "(" << Extract << getValueAsStr(I->getOperand(1)) << "," << Index << ")|0)"
+                "(" << Extract << streamValue(I->getOperand(1)) << "," << Index << ")|0)"
                 "|0";
         break;
       case Instruction::Shl:
-        Code << "(" << Extract << getValueAsStr(I->getOperand(0)) << "," << Index << ")|0)"
+        Code << "(" << Extract << streamValue(I->getOperand(0)) << "," << Index << ")|0)"
                 " << "
-                "(" << Extract << getValueAsStr(I->getOperand(1)) << "," << Index << ")|0)"
+                "(" << Extract << streamValue(I->getOperand(1)) << "," << Index << ")|0)"
                 "|0";
         break;
       default: I->dump(); error("invalid unrolled vector instr"); break;
@@ -2300,7 +2922,9 @@ void JSWriter::generateUnrolledExpression(const User *I, raw_string_ostream& Cod
   Code << ")";
 }
 
-bool JSWriter::generateSIMDExpression(const User *I, raw_string_ostream& Code) {
+bool JSWriter::generateSIMDExpression(const User *I, raw_ostream& Code) {
+  if (WasmSIMD) return generateWasmSIMDExpression(I, Code);
+
   VectorType *VT;
   if ((VT = dyn_cast<VectorType>(I->getType()))) {
     // vector-producing instructions
@@ -2334,43 +2958,43 @@ bool JSWriter::generateSIMDExpression(const User *I, raw_string_ostream& Code) {
         // selecting on them is just an elementwise select.
         if (isa<VectorType>(I->getOperand(0)->getType())) {
           if (cast<VectorType>(I->getType())->getElementType()->isIntegerTy()) {
-            Code << getAssignIfNeeded(I) << "SIMD_" << simdType << "_select(" << getValueAsStr(I->getOperand(0)) << "," << getValueAsStr(I->getOperand(1)) << "," << getValueAsStr(I->getOperand(2)) << ")"; break;
+            Code << getAssignIfNeeded(I) << "SIMD_" << simdType << "_select(" << streamValue(I->getOperand(0)) << "," << streamValue(I->getOperand(1)) << "," << streamValue(I->getOperand(2)) << ")"; break;
           } else {
-            Code << getAssignIfNeeded(I) << "SIMD_" << simdType << "_select(" << getValueAsStr(I->getOperand(0)) << "," << getValueAsStr(I->getOperand(1)) << "," << getValueAsStr(I->getOperand(2)) << ")"; break;
+            Code << getAssignIfNeeded(I) << "SIMD_" << simdType << "_select(" << streamValue(I->getOperand(0)) << "," << streamValue(I->getOperand(1)) << "," << streamValue(I->getOperand(2)) << ")"; break;
           }
           return true;
         }
         // Otherwise we have a scalar condition, so it's a ?: operator.
         return false;
-      case Instruction::FAdd: Code << getAssignIfNeeded(I) << "SIMD_" << simdType << "_add(" << getValueAsStr(I->getOperand(0)) << "," << getValueAsStr(I->getOperand(1)) << ")"; break;
-      case Instruction::FMul: Code << getAssignIfNeeded(I) << "SIMD_" << simdType << "_mul(" << getValueAsStr(I->getOperand(0)) << "," << getValueAsStr(I->getOperand(1)) << ")"; break;
-      case Instruction::FDiv: Code << getAssignIfNeeded(I) << "SIMD_" << simdType << "_div(" << getValueAsStr(I->getOperand(0)) << "," << getValueAsStr(I->getOperand(1)) << ")"; break;
-      case Instruction::Add: Code << getAssignIfNeeded(I) << "SIMD_" << simdType << "_add(" << getValueAsStr(I->getOperand(0)) << "," << getValueAsStr(I->getOperand(1)) << ")"; break;
-      case Instruction::Sub: Code << getAssignIfNeeded(I) << "SIMD_" << simdType << "_sub(" << getValueAsStr(I->getOperand(0)) << "," << getValueAsStr(I->getOperand(1)) << ")"; break;
-      case Instruction::Mul: Code << getAssignIfNeeded(I) << "SIMD_" << simdType << "_mul(" << getValueAsStr(I->getOperand(0)) << "," << getValueAsStr(I->getOperand(1)) << ")"; break;
-      case Instruction::And: Code << getAssignIfNeeded(I) << "SIMD_" << simdType << "_and(" << getValueAsStr(I->getOperand(0)) << "," << getValueAsStr(I->getOperand(1)) << ")"; break;
-      case Instruction::Or:  Code << getAssignIfNeeded(I) << "SIMD_" << simdType << "_or(" <<  getValueAsStr(I->getOperand(0)) << "," << getValueAsStr(I->getOperand(1)) << ")"; break;
+      case Instruction::FAdd: Code << getAssignIfNeeded(I) << "SIMD_" << simdType << "_add(" << streamValue(I->getOperand(0)) << "," << streamValue(I->getOperand(1)) << ")"; break;
+      case Instruction::FMul: Code << getAssignIfNeeded(I) << "SIMD_" << simdType << "_mul(" << streamValue(I->getOperand(0)) << "," << streamValue(I->getOperand(1)) << ")"; break;
+      case Instruction::FDiv: Code << getAssignIfNeeded(I) << "SIMD_" << simdType << "_div(" << streamValue(I->getOperand(0)) << "," << streamValue(I->getOperand(1)) << ")"; break;
+      case Instruction::Add: Code << getAssignIfNeeded(I) << "SIMD_" << simdType << "_add(" << streamValue(I->getOperand(0)) << "," << streamValue(I->getOperand(1)) << ")"; break;
+      case Instruction::Sub: Code << getAssignIfNeeded(I) << "SIMD_" << simdType << "_sub(" << streamValue(I->getOperand(0)) << "," << streamValue(I->getOperand(1)) << ")"; break;
+      case Instruction::Mul: Code << getAssignIfNeeded(I) << "SIMD_" << simdType << "_mul(" << streamValue(I->getOperand(0)) << "," << streamValue(I->getOperand(1)) << ")"; break;
+      case Instruction::And: Code << getAssignIfNeeded(I) << "SIMD_" << simdType << "_and(" << streamValue(I->getOperand(0)) << "," << streamValue(I->getOperand(1)) << ")"; break;
+      case Instruction::Or:  Code << getAssignIfNeeded(I) << "SIMD_" << simdType << "_or(" <<  getValueAsStr(I->getOperand(0)) << "," << streamValue(I->getOperand(1)) << ")"; break;
       case Instruction::Xor:
         // LLVM represents a not(x) as -1 ^ x
-        Code << getAssignIfNeeded(I);
+        printAssignIfNeeded(Code, I);
         if (BinaryOperator::isNot(I)) {
-          Code << "SIMD_" << simdType << "_not(" << getValueAsStr(BinaryOperator::getNotArgument(I)) << ")"; break;
+          Code << "SIMD_" << simdType << "_not(" << streamValue(BinaryOperator::getNotArgument(I)) << ")"; break;
         } else {
-          Code << "SIMD_" << simdType << "_xor(" << getValueAsStr(I->getOperand(0)) << "," << getValueAsStr(I->getOperand(1)) << ")"; break;
+          Code << "SIMD_" << simdType << "_xor(" << streamValue(I->getOperand(0)) << "," << streamValue(I->getOperand(1)) << ")"; break;
         }
         break;
       case Instruction::FSub:
         // LLVM represents an fneg(x) as -0.0 - x.
-        Code << getAssignIfNeeded(I);
+        printAssignIfNeeded(Code, I);
         if (BinaryOperator::isFNeg(I)) {
-          Code << "SIMD_" << simdType << "_neg(" << getValueAsStr(BinaryOperator::getFNegArgument(I)) << ")";
+          Code << "SIMD_" << simdType << "_neg(" << streamValue(BinaryOperator::getFNegArgument(I)) << ")";
         } else {
-          Code << "SIMD_" << simdType << "_sub(" << getValueAsStr(I->getOperand(0)) << "," << getValueAsStr(I->getOperand(1)) << ")";
+          Code << "SIMD_" << simdType << "_sub(" << streamValue(I->getOperand(0)) << "," << streamValue(I->getOperand(1)) << ")";
         }
         break;
       case Instruction::BitCast: {
       case Instruction::SIToFP:
-        Code << getAssignIfNeeded(I);
+        printAssignIfNeeded(Code, I);
         Code << getSIMDCast(cast<VectorType>(I->getOperand(0)->getType()), cast<VectorType>(I->getType()), getValueAsStr(I->getOperand(0)), true);
         break;
       }
@@ -2422,7 +3046,7 @@ bool JSWriter::generateSIMDExpression(const User *I, raw_string_ostream& Code) {
       const Value *P = SI->getPointerOperand();
       std::string PS = "temp_" + simdType + "_ptr";
       std::string VS = getValueAsStr(SI->getValueOperand());
-      Code << getAdHocAssign(PS, P->getType()) << getValueAsStr(P) << ';';
+      Code << getAdHocAssign(PS, P->getType()) << streamValue(P) << ';';
       const char *store = "_store";
       if (VT->getElementType()->getPrimitiveSizeInBits() == 32) {
         switch (VT->getNumElements()) {
@@ -2442,6 +3066,377 @@ bool JSWriter::generateSIMDExpression(const User *I, raw_string_ostream& Code) {
   return false;
 }
 
+// Returns the lanes of a vector constant (or zero, if C is null), as a
+// v128.const in the widest integer lanes that fit its elements.
+std::string JSWriter::getWasmSIMDConstant(VectorType *VT, const Constant *C) {
+  int LaneBytes = 16 / SIMDNumElements(VT);
+  uint8_t Bytes[16] = {0};
+  if (C && !isa<ConstantAggregateZero>(C) && !isa<UndefValue>(C)) {
+    for (unsigned i = 0; i < VT->getNumElements(); ++i) {
+      // read the elements without creating constants, as function bodies may
+      // be emitted in parallel
+      uint64_t Bits = 0;
+      if (const ConstantDataVector *CDV = dyn_cast<ConstantDataVector>(C)) {
+        Bits = CDV->getElementType()->isIntegerTy() ? CDV->getElementAsInteger(i)
+                                                    : CDV->getElementAsAPFloat(i).bitcastToAPInt().getZExtValue();
+      } else {
+        const Constant *E = cast<ConstantVector>(C)->getOperand(i);
+        if (const ConstantInt *CI = dyn_cast<ConstantInt>(E)) {
+          Bits = CI->getValue().getZExtValue();
+        } else if (const ConstantFP *CFP = dyn_cast<ConstantFP>(E)) {
+          Bits = CFP->getValueAPF().bitcastToAPInt().getZExtValue();
+        }
+      }
+      if (VT->getElementType()->isIntegerTy(1)) {
+        Bits = Bits ? ~uint64_t(0) : 0; // a mask lane is all ones
+      }
+      for (int b = 0; b < LaneBytes; ++b) {
+        Bytes[i * LaneBytes + b] = uint8_t(Bits >> (8 * b));
+      }
+    }
+  }
+  int ConstBytes = std::min(LaneBytes, 4);
+  std::string Ret = "i" + utostr(8 * ConstBytes) + "x" + utostr(16 / ConstBytes) + "_const(";
+  for (int i = 0; i < 16; i += ConstBytes) {
+    uint32_t Lane = 0;
+    for (int b = 0; b < ConstBytes; ++b) {
+      Lane |= uint32_t(Bytes[i + b]) << (8 * b);
+    }
+    int32_t Signed = ConstBytes == 1 ? int8_t(Lane) : ConstBytes == 2 ? int16_t(Lane) : int32_t(Lane);
+    if (i > 0) Ret += ',';
+    Ret += itostr(Signed);
+  }
+  return Ret + ')';
+}
+
+// Vectors of fewer than four 32-bit lanes are loaded and stored with the
+// partial operations, so they do not touch the memory after them.
+std::string JSWriter::getWasmSIMDLoad(const LoadInst *LI, VectorType *VT) {
+  std::string PS = getValueAsStr(LI->getPointerOperand());
+  unsigned Bytes = DL->getTypeStoreSize(VT);
+  unsigned Alignment = LI->getAlignment();
+  std::string Align = Bytes <= Alignment || Alignment == 0 ? "" : "," + utostr(Alignment);
+  switch (Bytes) {
+    case 4:  return "v128_load32_zero(" + PS + Align + ")";
+    case 8:  return "v128_load64_zero(" + PS + Align + ")";
+    case 12: return "v128_load32_lane((" + PS + "+8)|0,v128_load64_zero(" + PS + Align + "),2" + Align + ")";
+    default: return "v128_load(" + PS + Align + ")";
+  }
+}
+
+std::string JSWriter::getWasmSIMDStore(const StoreInst *SI, VectorType *VT) {
+  std::string PS = "temp_v128_ptr";
+  std::string VS = getValueAsStr(SI->getValueOperand());
+  unsigned Bytes = DL->getTypeStoreSize(VT);
+  unsigned Alignment = SI->getAlignment();
+  std::string Align = Bytes <= Alignment || Alignment == 0 ? "" : "," + utostr(Alignment);
+  std::string Code = getAdHocAssign(PS, SI->getPointerOperand()->getType()) + getValueAsStr(SI->getPointerOperand()) + ';';
+  switch (Bytes) {
+    case 4:  return Code + "v128_store32_lane(" + PS + "," + VS + ",0" + Align + ")";
+    case 8:  return Code + "v128_store64_lane(" + PS + "," + VS + ",0" + Align + ")";
+    case 12: return Code + "v128_store64_lane(" + PS + "," + VS + ",0" + Align + ");" +
+                    "v128_store32_lane((" + PS + "+8)|0," + VS + ",2" + Align + ")";
+    default: return Code + "v128_store(" + PS + "," + VS + Align + ")";
+  }
+}
+
+void JSWriter::generateWasmICmpExpression(const ICmpInst *I, raw_ostream& Code) {
+  std::string Shape = WasmSIMDShape(cast<VectorType>(I->getOperand(0)->getType()));
+  const char *Name;
+  switch (I->getPredicate()) {
+    case ICmpInst::ICMP_EQ:  Name = "eq"; break;
+    case ICmpInst::ICMP_NE:  Name = "ne"; break;
+    case ICmpInst::ICMP_SLE: Name = "le_s"; break;
+    case ICmpInst::ICMP_SGE: Name = "ge_s"; break;
+    case ICmpInst::ICMP_ULE: Name = "le_u"; break;
+    case ICmpInst::ICMP_UGE: Name = "ge_u"; break;
+    case ICmpInst::ICMP_ULT: Name = "lt_u"; break;
+    case ICmpInst::ICMP_SLT: Name = "lt_s"; break;
+    case ICmpInst::ICMP_UGT: Name = "gt_u"; break;
+    case ICmpInst::ICMP_SGT: Name = "gt_s"; break;
+    default: I->dump(); error("invalid vector icmp"); return;
+  }
+  Code << getAssignIfNeeded(I) << Shape << '_' << Name << '('
+       << getValueAsStr(I->getOperand(0)) << ',' << getValueAsStr(I->getOperand(1)) << ')';
+}
+
+void JSWriter::generateWasmFCmpExpression(const FCmpInst *I, raw_ostream& Code) {
+  VectorType *VT = cast<VectorType>(I->getOperand(0)->getType());
+  std::string Shape = WasmSIMDShape(VT);
+  std::string A = getValueAsStr(I->getOperand(0));
+  std::string B = getValueAsStr(I->getOperand(1));
+  // lanes that are not NaN in either operand
+  std::string Ordered = "v128_and(" + Shape + "_eq(" + A + ',' + A + ")," + Shape + "_eq(" + B + ',' + B + "))";
+  Code << getAssignIfNeeded(I);
+  switch (I->getPredicate()) {
+    case FCmpInst::FCMP_FALSE: Code << getWasmSIMDConstant(VT, nullptr); return;
+    case FCmpInst::FCMP_TRUE:  Code << "v128_not(" << getWasmSIMDConstant(VT, nullptr) << ')'; return;
+    case FCmpInst::FCMP_ORD:   Code << Ordered; return;
+    case FCmpInst::FCMP_UNO:   Code << "v128_not(" << Ordered << ')'; return;
+    case FCmpInst::FCMP_ONE:   Code << "v128_and(" << Ordered << ',' << Shape << "_ne(" << A << ',' << B << "))"; return;
+    case FCmpInst::FCMP_UEQ:   Code << "v128_not(v128_and(" << Ordered << ',' << Shape << "_ne(" << A << ',' << B << ")))"; return;
+    case FCmpInst::FCMP_OEQ:   Code << Shape << "_eq(" << A << ',' << B << ')'; return;
+    case FCmpInst::FCMP_OGT:   Code << Shape << "_gt(" << A << ',' << B << ')'; return;
+    case FCmpInst::FCMP_OGE:   Code << Shape << "_ge(" << A << ',' << B << ')'; return;
+    case FCmpInst::FCMP_OLT:   Code << Shape << "_lt(" << A << ',' << B << ')'; return;
+    case FCmpInst::FCMP_OLE:   Code << Shape << "_le(" << A << ',' << B << ')'; return;
+    case FCmpInst::FCMP_UNE:   Code << Shape << "_ne(" << A << ',' << B << ')'; return;
+    // unordered compares are the negation of the opposite ordered compare
+    case FCmpInst::FCMP_UGT:   Code << "v128_not(" << Shape << "_le(" << A << ',' << B << "))"; return;
+    case FCmpInst::FCMP_UGE:   Code << "v128_not(" << Shape << "_lt(" << A << ',' << B << "))"; return;
+    case FCmpInst::FCMP_ULT:   Code << "v128_not(" << Shape << "_ge(" << A << ',' << B << "))"; return;
+    case FCmpInst::FCMP_ULE:   Code << "v128_not(" << Shape << "_gt(" << A << ',' << B << "))"; return;
+    default: I->dump(); error("invalid vector fcmp"); return;
+  }
+}
+
+// Lane-wise operations that WebAssembly has as instructions, but LLVM IR
+// expresses as a select on a compare. Returns the operation, or null, and sets
+// A and B to its operands.
+//
+//   select (icmp slt a, b), a, b                       min_s(a, b), and so on
+//   select (icmp ult (add a, b), a), -1, (add a, b)    add_sat_u(a, b)
+//   select (icmp ugt a, b), (sub a, b), 0              sub_sat_u(a, b)
+static const char *getWasmSIMDSelectOp(const SelectInst *SI, const Value *&A, const Value *&B) {
+  const ICmpInst *Cmp = dyn_cast<ICmpInst>(SI->getCondition());
+  VectorType *VT = dyn_cast<VectorType>(SI->getType());
+  if (!Cmp || !VT || !VT->getElementType()->isIntegerTy() || !isa<VectorType>(Cmp->getType())) return nullptr;
+  unsigned Bits = VT->getElementType()->getIntegerBitWidth();
+  if (Bits != 8 && Bits != 16 && Bits != 32) return nullptr;
+  const Value *T = SI->getTrueValue(), *F = SI->getFalseValue();
+  const Value *L = Cmp->getOperand(0), *R = Cmp->getOperand(1);
+  ICmpInst::Predicate Pred = Cmp->getPredicate();
+
+  // min and max
+  if ((L == T && R == F) || (L == F && R == T)) {
+    if (L == F) Pred = ICmpInst::getInversePredicate(Pred);
+    A = T;
+    B = F;
+    switch (Pred) {
+      case ICmpInst::ICMP_SLT: case ICmpInst::ICMP_SLE: return "min_s";
+      case ICmpInst::ICMP_ULT: case ICmpInst::ICMP_ULE: return "min_u";
+      case ICmpInst::ICMP_SGT: case ICmpInst::ICMP_SGE: return "max_s";
+      case ICmpInst::ICMP_UGT: case ICmpInst::ICMP_UGE: return "max_u";
+      default: return nullptr;
+    }
+  }
+
+  // saturating arithmetic is only there for the narrow lanes, and compares
+  // are turned around so that L is the smaller side
+  if (Bits == 32) return nullptr;
+  if (Pred == ICmpInst::ICMP_UGT || Pred == ICmpInst::ICMP_UGE) {
+    std::swap(L, R);
+    Pred = ICmpInst::getSwappedPredicate(Pred);
+  }
+  if (Pred != ICmpInst::ICMP_ULT && Pred != ICmpInst::ICMP_ULE) return nullptr;
+  auto isOp = [](const Value *V, unsigned Opcode, const Value *X, const Value *Y) {
+    const BinaryOperator *Op = dyn_cast<BinaryOperator>(V);
+    return Op && Op->getOpcode() == Opcode && Op->getOperand(0) == X && Op->getOperand(1) == Y;
+  };
+  auto isConstant = [](const Value *V, bool AllOnes) {
+    const Constant *C = dyn_cast<Constant>(V);
+    return C && (AllOnes ? C->isAllOnesValue() : C->isNullValue());
+  };
+  // a + b < a ? -1 : a + b
+  if (Pred == ICmpInst::ICMP_ULT && L == F && isConstant(T, true) && isa<BinaryOperator>(F) &&
+      (isOp(F, Instruction::Add, R, cast<BinaryOperator>(F)->getOperand(1)) ||
+       isOp(F, Instruction::Add, cast<BinaryOperator>(F)->getOperand(0), R))) {
+    A = cast<BinaryOperator>(F)->getOperand(0);
+    B = cast<BinaryOperator>(F)->getOperand(1);
+    return "add_sat_u";
+  }
+  // b < a ? a - b : 0
+  if (isOp(T, Instruction::Sub, R, L) && isConstant(F, false)) {
+    A = R;
+    B = L;
+    return "sub_sat_u";
+  }
+  // a < b ? 0 : a - b
+  if (isOp(F, Instruction::Sub, L, R) && isConstant(T, false)) {
+    A = L;
+    B = R;
+    return "sub_sat_u";
+  }
+  return nullptr;
+}
+
+// Whether V is only computed for the compares and selects that
+// getWasmSIMDSelectOp folds into one operation, so it needs no code itself.
+static bool isFoldedIntoWasmSIMDSelect(const Value *V) {
+  if (V->use_empty()) return false;
+  for (const User *U : V->users()) {
+    if (const SelectInst *SI = dyn_cast<SelectInst>(U)) {
+      const Value *A, *B;
+      if (!getWasmSIMDSelectOp(SI, A, B) || V == A || V == B) return false;
+    } else if (!isa<ICmpInst>(U) || !isFoldedIntoWasmSIMDSelect(U)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// The type of the local that holds I, for LocalCoalescer. All values that are
+// declared the same way, such as all ints and pointers, share a type.
+Type *JSWriter::getLocalType(const Instruction *I) {
+  Type *T = I->getType();
+  if (T->isVoidTy() || isa<AllocaInst>(I) || stripPointerCastsWithoutSideEffects(I) != I) return nullptr;
+  if (FoldedExpressions.count(I)) return nullptr;
+  if (WasmSIMD && isFoldedIntoWasmSIMDSelect(I)) return nullptr;
+  if (T->isPointerTy() || (T->isIntegerTy() && T->getIntegerBitWidth() <= 32)) return i32;
+  if (T->isFloatTy() && !PreciseF32) return Type::getDoubleTy(T->getContext());
+  return T;
+}
+
+bool JSWriter::generateWasmSIMDExpression(const User *I, raw_ostream& Code) {
+  VectorType *VT;
+  if ((VT = dyn_cast<VectorType>(I->getType()))) {
+    // vector-producing instructions
+    checkVectorType(VT);
+    std::string Shape = WasmSIMDShape(VT);
+    bool IsInt = VT->getElementType()->isIntegerTy();
+
+    if (isa<Instruction>(I) && isFoldedIntoWasmSIMDSelect(I)) return true;
+
+    std::string Name;
+    switch (Operator::getOpcode(I)) {
+      default: I->dump(); error("invalid vector instr"); break;
+      case Instruction::Call: // return value is just a SIMD value, no special handling
+        return false;
+      case Instruction::PHI: // handled separately - we push them back into the relooper branchings
+        break;
+      case Instruction::ICmp:
+        generateWasmICmpExpression(cast<ICmpInst>(I), Code);
+        break;
+      case Instruction::FCmp:
+        generateWasmFCmpExpression(cast<FCmpInst>(I), Code);
+        break;
+      case Instruction::SExt:
+        assert(cast<VectorType>(I->getOperand(0)->getType())->getElementType()->isIntegerTy(1) &&
+               "sign-extension from vector of other than i1 not yet supported");
+        // masks are already sign extended
+        Code << getAssignIfNeeded(I) << getValueAsStr(I->getOperand(0));
+        break;
+      case Instruction::ZExt:
+        assert(cast<VectorType>(I->getOperand(0)->getType())->getElementType()->isIntegerTy(1) &&
+               "sign-extension from vector of other than i1 not yet supported");
+        Code << getAssignIfNeeded(I) << "v128_and(" << getValueAsStr(I->getOperand(0)) << ',' << Shape << "_splat(1))";
+        break;
+      case Instruction::Select: {
+        // Since we represent vectors of i1 as masks, selecting on them is a
+        // bitwise select.
+        if (!isa<VectorType>(I->getOperand(0)->getType())) {
+          // Otherwise we have a scalar condition, so it's a ?: operator.
+          return false;
+        }
+        const Value *A, *B;
+        if (const char *Op = getWasmSIMDSelectOp(cast<SelectInst>(I), A, B)) {
+          Code << getAssignIfNeeded(I) << Shape << '_' << Op << '(' << getValueAsStr(A) << ',' << getValueAsStr(B) << ')';
+        } else {
+          Code << getAssignIfNeeded(I) << "v128_bitselect(" << getValueAsStr(I->getOperand(1)) << ',' << getValueAsStr(I->getOperand(2)) << ',' << getValueAsStr(I->getOperand(0)) << ')';
+        }
+        break;
+      }
+      case Instruction::Mul:
+        if (Shape == "i8x16") {
+          // there is no i8x16.mul
+          generateUnrolledExpression(I, Code);
+          break;
+        }
+        // fall through
+      case Instruction::FAdd:
+      case Instruction::FMul:
+      case Instruction::FDiv:
+      case Instruction::Add:
+      case Instruction::Sub:
+      case Instruction::FSub:
+        switch (Operator::getOpcode(I)) {
+          case Instruction::FAdd: case Instruction::Add: Name = "add"; break;
+          case Instruction::FMul: case Instruction::Mul: Name = "mul"; break;
+          case Instruction::FSub: case Instruction::Sub: Name = "sub"; break;
+          case Instruction::FDiv: Name = "div"; break;
+        }
+        printAssignIfNeeded(Code, I);
+        // LLVM represents an fneg(x) as -0.0 - x.
+        if (BinaryOperator::isFNeg(I)) {
+          Code << Shape << "_neg(" << getValueAsStr(BinaryOperator::getFNegArgument(I)) << ')';
+        } else {
+          Code << Shape << '_' << Name << '(' << getValueAsStr(I->getOperand(0)) << ',' << getValueAsStr(I->getOperand(1)) << ')';
+        }
+        break;
+      case Instruction::And: Code << getAssignIfNeeded(I) << "v128_and(" << getValueAsStr(I->getOperand(0)) << ',' << getValueAsStr(I->getOperand(1)) << ')'; break;
+      case Instruction::Or:  Code << getAssignIfNeeded(I) << "v128_or(" << getValueAsStr(I->getOperand(0)) << ',' << getValueAsStr(I->getOperand(1)) << ')'; break;
+      case Instruction::Xor:
+        // LLVM represents a not(x) as -1 ^ x
+        printAssignIfNeeded(Code, I);
+        if (BinaryOperator::isNot(I)) {
+          Code << "v128_not(" << getValueAsStr(BinaryOperator::getNotArgument(I)) << ')';
+        } else {
+          Code << "v128_xor(" << getValueAsStr(I->getOperand(0)) << ',' << getValueAsStr(I->getOperand(1)) << ')';
+        }
+        break;
+      case Instruction::BitCast:
+        // v128 has no lane type, so bitcasts are free
+        if (cast<VectorType>(I->getOperand(0)->getType())->getBitWidth() != VT->getBitWidth()) {
+          error("Invalid SIMD cast between items of different bit sizes!");
+        }
+        Code << getAssignIfNeeded(I) << getValueAsStr(I->getOperand(0));
+        break;
+      case Instruction::SIToFP:
+      case Instruction::UIToFP:
+      case Instruction::FPToSI:
+      case Instruction::FPToUI: {
+        if (Shape != "f32x4" && Shape != "i32x4") {
+          I->dump();
+          error("only 32-bit vector lanes can be converted between int and float");
+        }
+        const char *Sign = Operator::getOpcode(I) == Instruction::SIToFP || Operator::getOpcode(I) == Instruction::FPToSI ? "_s(" : "_u(";
+        Code << getAssignIfNeeded(I) << (IsInt ? "i32x4_trunc_sat_f32x4" : "f32x4_convert_i32x4") << Sign << getValueAsStr(I->getOperand(0)) << ')';
+        break;
+      }
+      case Instruction::Load:
+        Code << getAssignIfNeeded(I) << getWasmSIMDLoad(cast<LoadInst>(I), VT);
+        break;
+      case Instruction::InsertElement:
+        generateInsertElementExpression(cast<InsertElementInst>(I), Code);
+        break;
+      case Instruction::ShuffleVector:
+        generateShuffleVectorExpression(cast<ShuffleVectorInst>(I), Code);
+        break;
+      case Instruction::SDiv:
+      case Instruction::UDiv:
+      case Instruction::SRem:
+      case Instruction::URem:
+        // There are no vector divisions; emulate them using scalar operations.
+        generateUnrolledExpression(I, Code);
+        break;
+      case Instruction::AShr:
+      case Instruction::LShr:
+      case Instruction::Shl:
+        // Shifting every lane by the same amount is a single operation.
+        if (const Value *Splat = getSplatValue(I->getOperand(1))) {
+          Name = Operator::getOpcode(I) == Instruction::AShr ? "_shr_s(" :
+                 Operator::getOpcode(I) == Instruction::LShr ? "_shr_u(" : "_shl(";
+          Code << getAssignIfNeeded(I) << Shape << Name << getValueAsStr(I->getOperand(0)) << ',' << getValueAsStr(Splat) << ')';
+        } else {
+          generateUnrolledExpression(I, Code);
+        }
+        break;
+    }
+    return true;
+  } else {
+    // vector-consuming instructions
+    if (Operator::getOpcode(I) == Instruction::Store && (VT = dyn_cast<VectorType>(I->getOperand(0)->getType()))) {
+      checkVectorType(VT);
+      Code << getWasmSIMDStore(cast<StoreInst>(I), VT);
+      return true;
+    } else if (Operator::getOpcode(I) == Instruction::ExtractElement) {
+      generateExtractElementExpression(cast<ExtractElementInst>(I), Code);
+      return true;
+    }
+  }
+  return false;
+}
+
 static uint64_t LSBMask(unsigned numBits) {
   return numBits >= 64 ? 0xFFFFFFFFFFFFFFFFULL : (1ULL << numBits) - 1;
 }
@@ -2459,7 +3454,7 @@ static std::string AddOffset(const std::string &base, int32_t Offset) {
 }
 
 // Generate code for and operator, either an Instruction or a ConstantExpr.
-void JSWriter::generateExpression(const User *I, raw_string_ostream& Code) {
+void JSWriter::generateExpression(const User *I, raw_ostream& Code) {
   // To avoid emiting code and variables for the no-op pointer bitcasts
   // and all-zero-index geps that LLVM needs to satisfy its type system, we
   // call stripPointerCasts() on all values before translating them. This
@@ -2517,52 +3512,46 @@ void JSWriter::generateExpression(const User *I, raw_string_ostream& Code) {
   case Instruction::Shl:
   case Instruction::LShr:
   case Instruction::AShr:{
-    Code << getAssignIfNeeded(I);
+    printAssignIfNeeded(Code, I);
     unsigned opcode = Operator::getOpcode(I);
     if (OnlyWebAssembly && I->getType()->isIntegerTy() && I->getType()->getIntegerBitWidth() == 64) {
       switch (opcode) {
-        case Instruction::Add:  Code << "i64_add(" << getValueAsStr(I->getOperand(0)) << "," << getValueAsStr(I->getOperand(1)) << ")"; break;
-        case Instruction::Sub:  Code << "i64_sub(" << getValueAsStr(I->getOperand(0)) << "," << getValueAsStr(I->getOperand(1)) << ")"; break;
-        case Instruction::Mul:  Code << "i64_mul(" << getValueAsStr(I->getOperand(0)) << "," << getValueAsStr(I->getOperand(1)) << ")"; break;
-        case Instruction::UDiv: Code << "i64_udiv(" << getValueAsStr(I->getOperand(0)) << "," << getValueAsStr(I->getOperand(1)) << ")"; break;
-        case Instruction::SDiv: Code << "i64_sdiv(" << getValueAsStr(I->getOperand(0)) << "," << getValueAsStr(I->getOperand(1)) << ")"; break;
-        case Instruction::URem: Code << "i64_urem(" << getValueAsStr(I->getOperand(0)) << "," << getValueAsStr(I->getOperand(1)) << ")"; break;
-        case Instruction::SRem: Code << "i64_srem(" << getValueAsStr(I->getOperand(0)) << "," << getValueAsStr(I->getOperand(1)) << ")"; break;
-        case Instruction::And:  Code << "i64_and(" << getValueAsStr(I->getOperand(0)) << "," << getValueAsStr(I->getOperand(1)) << ")"; break;
-        case Instruction::Or:   Code << "i64_or(" << getValueAsStr(I->getOperand(0)) << "," << getValueAsStr(I->getOperand(1)) << ")"; break;
-        case Instruction::Xor:  Code << "i64_xor(" << getValueAsStr(I->getOperand(0)) << "," << getValueAsStr(I->getOperand(1)) << ")"; break;
-        case Instruction::Shl:  Code << "i64_shl(" << getValueAsStr(I->getOperand(0)) << "," << getValueAsStr(I->getOperand(1)) << ")"; break;
-        case Instruction::AShr: Code << "i64_ashr(" << getValueAsStr(I->getOperand(0)) << "," << getValueAsStr(I->getOperand(1)) << ")"; break;
-        case Instruction::LShr: Code << "i64_lshr(" << getValueAsStr(I->getOperand(0)) << "," << getValueAsStr(I->getOperand(1)) << ")"; break;
+        case Instruction::Add:  Code << "i64_add(" << streamValue(I->getOperand(0)) << "," << streamValue(I->getOperand(1)) << ")"; break;
+        case Instruction::Sub:  Code << "i64_sub(" << streamValue(I->getOperand(0)) << "," << streamValue(I->getOperand(1)) << ")"; break;
+        case Instruction::Mul:  Code << "i64_mul(" << streamValue(I->getOperand(0)) << "," << streamValue(I->getOperand(1)) << ")"; break;
+        case Instruction::UDiv: Code << "i64_udiv(" << streamValue(I->getOperand(0)) << "," << streamValue(I->getOperand(1)) << ")"; break;
+        case Instruction::SDiv: Code << "i64_sdiv(" << streamValue(I->getOperand(0)) << "," << streamValue(I->getOperand(1)) << ")"; break;
+        case Instruction::URem: Code << "i64_urem(" << streamValue(I->getOperand(0)) << "," << streamValue(I->getOperand(1)) << ")"; break;
+        case Instruction::SRem: Code << "i64_srem(" << streamValue(I->getOperand(0)) << "," << streamValue(I->getOperand(1)) << ")"; break;
+        case Instruction::And:  Code << "i64_and(" << streamValue(I->getOperand(0)) << "," << streamValue(I->getOperand(1)) << ")"; break;
+        case Instruction::Or:   Code << "i64_or(" << streamValue(I->getOperand(0)) << "," << streamValue(I->getOperand(1)) << ")"; break;
+        case Instruction::Xor:  Code << "i64_xor(" << streamValue(I->getOperand(0)) << "," << streamValue(I->getOperand(1)) << ")"; break;
+        case Instruction::Shl:  Code << "i64_shl(" << streamValue(I->getOperand(0)) << "," << streamValue(I->getOperand(1)) << ")"; break;
+        case Instruction::AShr: Code << "i64_ashr(" << streamValue(I->getOperand(0)) << "," << streamValue(I->getOperand(1)) << ")"; break;
+        case Instruction::LShr: Code << "i64_lshr(" << streamValue(I->getOperand(0)) << "," << streamValue(I->getOperand(1)) << ")"; break;
         default: error("bad wasm-i64 binary opcode"); break;
       }
       break;
     }
     switch (opcode) {
-      case Instruction::Add:  Code << getParenCast(
-                                        getValueAsParenStr(I->getOperand(0)) +
-                                        " + " +
-                                        getValueAsParenStr(I->getOperand(1)),
-                                        I->getType()
-                                      ); break;
-      case Instruction::Sub:  Code << getParenCast(
-                                        getValueAsParenStr(I->getOperand(0)) +
-                                        " - " +
-                                        getValueAsParenStr(I->getOperand(1)),
-                                        I->getType()
-                                      ); break;
+      case Instruction::Add:
+      case Instruction::Sub:  printCastPrefix(Code, I->getType()) << '(' <<
+                                streamValueAsParen(I->getOperand(0)) <<
+                                (opcode == Instruction::Add ? " + " : " - ") <<
+                                streamValueAsParen(I->getOperand(1)) << ')';
+                              printCastSuffix(Code, I->getType()); break;
       case Instruction::Mul:  Code << getIMul(I->getOperand(0), I->getOperand(1)); break;
       case Instruction::UDiv:
       case Instruction::SDiv:
       case Instruction::URem:
       case Instruction::SRem: Code << "(" <<
-                                      getValueAsCastParenStr(I->getOperand(0), (opcode == Instruction::SDiv || opcode == Instruction::SRem) ? ASM_SIGNED : ASM_UNSIGNED) <<
+                                      streamValueAsCastParen(I->getOperand(0), (opcode == Instruction::SDiv || opcode == Instruction::SRem) ? ASM_SIGNED : ASM_UNSIGNED) <<
                                       ((opcode == Instruction::UDiv || opcode == Instruction::SDiv) ? " / " : " % ") <<
-                                      getValueAsCastParenStr(I->getOperand(1), (opcode == Instruction::SDiv || opcode == Instruction::SRem) ? ASM_SIGNED : ASM_UNSIGNED) <<
+                                      streamValueAsCastParen(I->getOperand(1), (opcode == Instruction::SDiv || opcode == Instruction::SRem) ? ASM_SIGNED : ASM_UNSIGNED) <<
                                       ")&-1"; break;
-      case Instruction::And:  Code << getValueAsStr(I->getOperand(0)) << " & " <<   getValueAsStr(I->getOperand(1)); break;
-      case Instruction::Or:   Code << getValueAsStr(I->getOperand(0)) << " | " <<   getValueAsStr(I->getOperand(1)); break;
-      case Instruction::Xor:  Code << getValueAsStr(I->getOperand(0)) << " ^ " <<   getValueAsStr(I->getOperand(1)); break;
+      case Instruction::And:  Code << streamValue(I->getOperand(0)) << " & " <<   getValueAsStr(I->getOperand(1)); break;
+      case Instruction::Or:   Code << streamValue(I->getOperand(0)) << " | " <<   getValueAsStr(I->getOperand(1)); break;
+      case Instruction::Xor:  Code << streamValue(I->getOperand(0)) << " ^ " <<   getValueAsStr(I->getOperand(1)); break;
       case Instruction::Shl:  {
         std::string Shifted = getValueAsStr(I->getOperand(0)) + " << " +  getValueAsStr(I->getOperand(1));
         if (I->getType()->getIntegerBitWidth() < 32) {
@@ -2601,47 +3590,47 @@ void JSWriter::generateExpression(const User *I, raw_string_ostream& Code) {
     unsigned predicate = isa<ConstantExpr>(I) ?
                          (unsigned)cast<ConstantExpr>(I)->getPredicate() :
                          (unsigned)cast<FCmpInst>(I)->getPredicate();
-    Code << getAssignIfNeeded(I);
+    printAssignIfNeeded(Code, I);
     switch (predicate) {
       // Comparisons which are simple JS operators.
-      case FCmpInst::FCMP_OEQ:   Code << getValueAsStr(I->getOperand(0)) << " == " << getValueAsStr(I->getOperand(1)); break;
-      case FCmpInst::FCMP_UNE:   Code << getValueAsStr(I->getOperand(0)) << " != " << getValueAsStr(I->getOperand(1)); break;
-      case FCmpInst::FCMP_OGT:   Code << getValueAsStr(I->getOperand(0)) << " > "  << getValueAsStr(I->getOperand(1)); break;
-      case FCmpInst::FCMP_OGE:   Code << getValueAsStr(I->getOperand(0)) << " >= " << getValueAsStr(I->getOperand(1)); break;
-      case FCmpInst::FCMP_OLT:   Code << getValueAsStr(I->getOperand(0)) << " < "  << getValueAsStr(I->getOperand(1)); break;
-      case FCmpInst::FCMP_OLE:   Code << getValueAsStr(I->getOperand(0)) << " <= " << getValueAsStr(I->getOperand(1)); break;
+      case FCmpInst::FCMP_OEQ:   Code << streamValue(I->getOperand(0)) << " == " << streamValue(I->getOperand(1)); break;
+      case FCmpInst::FCMP_UNE:   Code << streamValue(I->getOperand(0)) << " != " << streamValue(I->getOperand(1)); break;
+      case FCmpInst::FCMP_OGT:   Code << streamValue(I->getOperand(0)) << " > "  << streamValue(I->getOperand(1)); break;
+      case FCmpInst::FCMP_OGE:   Code << streamValue(I->getOperand(0)) << " >= " << streamValue(I->getOperand(1)); break;
+      case FCmpInst::FCMP_OLT:   Code << streamValue(I->getOperand(0)) << " < "  << streamValue(I->getOperand(1)); break;
+      case FCmpInst::FCMP_OLE:   Code << streamValue(I->getOperand(0)) << " <= " << streamValue(I->getOperand(1)); break;
 
       // Comparisons which are inverses of JS operators.
       case FCmpInst::FCMP_UGT:
-        Code << "!(" << getValueAsStr(I->getOperand(0)) << " <= " << getValueAsStr(I->getOperand(1)) << ")";
+        Code << "!(" << streamValue(I->getOperand(0)) << " <= " << streamValue(I->getOperand(1)) << ")";
         break;
       case FCmpInst::FCMP_UGE:
-        Code << "!(" << getValueAsStr(I->getOperand(0)) << " < "  << getValueAsStr(I->getOperand(1)) << ")";
+        Code << "!(" << streamValue(I->getOperand(0)) << " < "  << streamValue(I->getOperand(1)) << ")";
         break;
       case FCmpInst::FCMP_ULT:
-        Code << "!(" << getValueAsStr(I->getOperand(0)) << " >= " << getValueAsStr(I->getOperand(1)) << ")";
+        Code << "!(" << streamValue(I->getOperand(0)) << " >= " << streamValue(I->getOperand(1)) << ")";
         break;
       case FCmpInst::FCMP_ULE:
-        Code << "!(" << getValueAsStr(I->getOperand(0)) << " > "  << getValueAsStr(I->getOperand(1)) << ")";
+        Code << "!(" << streamValue(I->getOperand(0)) << " > "  << streamValue(I->getOperand(1)) << ")";
         break;
 
       // Comparisons which require explicit NaN checks.
       case FCmpInst::FCMP_UEQ:
-        Code << "(" << getValueAsStr(I->getOperand(0)) << " != " << getValueAsStr(I->getOperand(0)) << ") | " <<
-                "(" << getValueAsStr(I->getOperand(1)) << " != " << getValueAsStr(I->getOperand(1)) << ") |" <<
-                "(" << getValueAsStr(I->getOperand(0)) << " == " << getValueAsStr(I->getOperand(1)) << ")";
+        Code << "(" << streamValue(I->getOperand(0)) << " != " << streamValue(I->getOperand(0)) << ") | " <<
+                "(" << streamValue(I->getOperand(1)) << " != " << streamValue(I->getOperand(1)) << ") |" <<
+                "(" << streamValue(I->getOperand(0)) << " == " << streamValue(I->getOperand(1)) << ")";
         break;
       case FCmpInst::FCMP_ONE:
-        Code << "(" << getValueAsStr(I->getOperand(0)) << " == " << getValueAsStr(I->getOperand(0)) << ") & " <<
-                "(" << getValueAsStr(I->getOperand(1)) << " == " << getValueAsStr(I->getOperand(1)) << ") &" <<
-                "(" << getValueAsStr(I->getOperand(0)) << " != " << getValueAsStr(I->getOperand(1)) << ")";
+        Code << "(" << streamValue(I->getOperand(0)) << " == " << streamValue(I->getOperand(0)) << ") & " <<
+                "(" << streamValue(I->getOperand(1)) << " == " << streamValue(I->getOperand(1)) << ") &" <<
+                "(" << streamValue(I->getOperand(0)) << " != " << streamValue(I->getOperand(1)) << ")";
         break;
 
       // Simple NaN checks.
-      case FCmpInst::FCMP_ORD:   Code << "(" << getValueAsStr(I->getOperand(0)) << " == " << getValueAsStr(I->getOperand(0)) << ") & " <<
-                                         "(" << getValueAsStr(I->getOperand(1)) << " == " << getValueAsStr(I->getOperand(1)) << ")"; break;
-      case FCmpInst::FCMP_UNO:   Code << "(" << getValueAsStr(I->getOperand(0)) << " != " << getValueAsStr(I->getOperand(0)) << ") | " <<
-                                         "(" << getValueAsStr(I->getOperand(1)) << " != " << getValueAsStr(I->getOperand(1)) << ")"; break;
+      case FCmpInst::FCMP_ORD:   Code << "(" << streamValue(I->getOperand(0)) << " == " << streamValue(I->getOperand(0)) << ") & " <<
+                                         "(" << streamValue(I->getOperand(1)) << " == " << streamValue(I->getOperand(1)) << ")"; break;
+      case FCmpInst::FCMP_UNO:   Code << "(" << streamValue(I->getOperand(0)) << " != " << streamValue(I->getOperand(0)) << ") | " <<
+                                         "(" << streamValue(I->getOperand(1)) << " != " << streamValue(I->getOperand(1)) << ")"; break;
 
       // Simple constants.
       case FCmpInst::FCMP_FALSE: Code << "0"; break;
@@ -2656,25 +3645,25 @@ void JSWriter::generateExpression(const User *I, raw_string_ostream& Code) {
                      (CmpInst::Predicate)cast<ConstantExpr>(I)->getPredicate() :
                      cast<ICmpInst>(I)->getPredicate();
     if (OnlyWebAssembly && I->getOperand(0)->getType()->isIntegerTy() && I->getOperand(0)->getType()->getIntegerBitWidth() == 64) {
-      Code << getAssignIfNeeded(I);
+      printAssignIfNeeded(Code, I);
       switch (predicate) {
-        case ICmpInst::ICMP_EQ:  Code << "i64_eq(" << getValueAsStr(I->getOperand(0)) << "," << getValueAsStr(I->getOperand(1)) << ")"; break;
-        case ICmpInst::ICMP_NE:  Code << "i64_ne(" << getValueAsStr(I->getOperand(0)) << "," << getValueAsStr(I->getOperand(1)) << ")"; break;
-        case ICmpInst::ICMP_ULE: Code << "i64_ule(" << getValueAsStr(I->getOperand(0)) << "," << getValueAsStr(I->getOperand(1)) << ")"; break;
-        case ICmpInst::ICMP_SLE: Code << "i64_sle(" << getValueAsStr(I->getOperand(0)) << "," << getValueAsStr(I->getOperand(1)) << ")"; break;
-        case ICmpInst::ICMP_UGE: Code << "i64_uge(" << getValueAsStr(I->getOperand(0)) << "," << getValueAsStr(I->getOperand(1)) << ")"; break;
-        case ICmpInst::ICMP_SGE: Code << "i64_sge(" << getValueAsStr(I->getOperand(0)) << "," << getValueAsStr(I->getOperand(1)) << ")"; break;
-        case ICmpInst::ICMP_ULT: Code << "i64_ult(" << getValueAsStr(I->getOperand(0)) << "," << getValueAsStr(I->getOperand(1)) << ")"; break;
-        case ICmpInst::ICMP_SLT: Code << "i64_slt(" << getValueAsStr(I->getOperand(0)) << "," << getValueAsStr(I->getOperand(1)) << ")"; break;
-        case ICmpInst::ICMP_UGT: Code << "i64_ugt(" << getValueAsStr(I->getOperand(0)) << "," << getValueAsStr(I->getOperand(1)) << ")"; break;
-        case ICmpInst::ICMP_SGT: Code << "i64_sgt(" << getValueAsStr(I->getOperand(0)) << "," << getValueAsStr(I->getOperand(1)) << ")"; break;
+        case ICmpInst::ICMP_EQ:  Code << "i64_eq(" << streamValue(I->getOperand(0)) << "," << streamValue(I->getOperand(1)) << ")"; break;
+        case ICmpInst::ICMP_NE:  Code << "i64_ne(" << streamValue(I->getOperand(0)) << "," << streamValue(I->getOperand(1)) << ")"; break;
+        case ICmpInst::ICMP_ULE: Code << "i64_ule(" << streamValue(I->getOperand(0)) << "," << streamValue(I->getOperand(1)) << ")"; break;
+        case ICmpInst::ICMP_SLE: Code << "i64_sle(" << streamValue(I->getOperand(0)) << "," << streamValue(I->getOperand(1)) << ")"; break;
+        case ICmpInst::ICMP_UGE: Code << "i64_uge(" << streamValue(I->getOperand(0)) << "," << streamValue(I->getOperand(1)) << ")"; break;
+        case ICmpInst::ICMP_SGE: Code << "i64_sge(" << streamValue(I->getOperand(0)) << "," << streamValue(I->getOperand(1)) << ")"; break;
+        case ICmpInst::ICMP_ULT: Code << "i64_ult(" << streamValue(I->getOperand(0)) << "," << streamValue(I->getOperand(1)) << ")"; break;
+        case ICmpInst::ICMP_SLT: Code << "i64_slt(" << streamValue(I->getOperand(0)) << "," << streamValue(I->getOperand(1)) << ")"; break;
+        case ICmpInst::ICMP_UGT: Code << "i64_ugt(" << streamValue(I->getOperand(0)) << "," << streamValue(I->getOperand(1)) << ")"; break;
+        case ICmpInst::ICMP_SGT: Code << "i64_sgt(" << streamValue(I->getOperand(0)) << "," << streamValue(I->getOperand(1)) << ")"; break;
         default: llvm_unreachable("Invalid ICmp-64 predicate");
       }
       break;
     }
     AsmCast sign = CmpInst::isUnsigned(predicate) ? ASM_UNSIGNED : ASM_SIGNED;
-    Code << getAssignIfNeeded(I) << "(" <<
-      getValueAsCastStr(I->getOperand(0), sign) <<
+    printAssignIfNeeded(Code, I) << "(" <<
+      streamValueAsCast(I->getOperand(0), sign) <<
     ")";
     switch (predicate) {
     case ICmpInst::ICMP_EQ:  Code << "==";  break;
@@ -2690,7 +3679,7 @@ void JSWriter::generateExpression(const User *I, raw_string_ostream& Code) {
     default: llvm_unreachable("Invalid ICmp predicate");
     }
     Code << "(" <<
-      getValueAsCastStr(I->getOperand(1), sign) <<
+      streamValueAsCast(I->getOperand(1), sign) <<
     ")";
     break;
   }
@@ -2715,7 +3704,7 @@ void JSWriter::generateExpression(const User *I, raw_string_ostream& Code) {
     if (AI->isStaticAlloca()) {
       uint64_t Offset;
       if (Allocas.getFrameOffset(AI, &Offset)) {
-        Code << getAssign(AI);
+        Code << streamAssign(AI);
         if (Allocas.getMaxAlignment() <= STACK_ALIGN) {
           Code << "sp";
         } else {
@@ -2742,7 +3731,7 @@ void JSWriter::generateExpression(const User *I, raw_string_ostream& Code) {
     } else {
       Size = stackAlignStr("((" + utostr(BaseSize) + '*' + getValueAsStr(AS) + ")|0)");
     }
-    Code << getAssign(AI) << "STACKTOP; " << getStackBump(Size);
+    Code << streamAssign(AI) << "STACKTOP; " << getStackBump(Size);
     break;
   }
   case Instruction::Load: {
@@ -2750,9 +3739,9 @@ void JSWriter::generateExpression(const User *I, raw_string_ostream& Code) {
     const Value *P = LI->getPointerOperand();
     unsigned Alignment = LI->getAlignment();
     if (NativizedVars.count(P)) {
-      Code << getAssign(LI) << getValueAsStr(P);
+      Code << streamAssign(LI) << streamValue(P);
     } else {
-      Code << getLoad(LI, P, LI->getType(), Alignment);
+      printLoad(Code, LI, P, LI->getType(), Alignment);
     }
     break;
   }
@@ -2763,9 +3752,9 @@ void JSWriter::generateExpression(const User *I, raw_string_ostream& Code) {
     unsigned Alignment = SI->getAlignment();
     std::string VS = getValueAsStr(V);
     if (NativizedVars.count(P)) {
-      Code << getValueAsStr(P) << " = " << VS;
+      Code << streamValue(P) << " = " << VS;
     } else {
-      Code << getStore(SI, P, V->getType(), VS, Alignment);
+      printStore(Code, SI, P, V->getType(), VS, Alignment);
     }
 
     Type *T = V->getType();
@@ -2776,7 +3765,7 @@ void JSWriter::generateExpression(const User *I, raw_string_ostream& Code) {
     break;
   }
   case Instruction::GetElementPtr: {
-    Code << getAssignIfNeeded(I);
+    printAssignIfNeeded(Code, I);
     const GEPOperator *GEP = cast<GEPOperator>(I);
     gep_type_iterator GTI = gep_type_begin(GEP);
     int32_t ConstantOffset = 0;
@@ -2814,7 +3803,7 @@ void JSWriter::generateExpression(const User *I, raw_string_ostream& Code) {
           ConstantOffset = 0;
 
           // Now add the scaled dynamic index.
-          std::string Mul = getIMul(Index, ConstantInt::get(i32, ElementSize));
+          std::string Mul = getIMul(Index, ElementSize);
           text = text.empty() ? Mul : ("(" + text + " + (" + Mul + ")|0)");
         }
       }
@@ -2830,19 +3819,19 @@ void JSWriter::generateExpression(const User *I, raw_string_ostream& Code) {
   case Instruction::PtrToInt: {
     if (OnlyWebAssembly && I->getType()->getIntegerBitWidth() == 64) {
       // it is valid in LLVM IR to convert a pointer into an i64, it zexts
-      Code << getAssignIfNeeded(I) << "i64_zext(" << getValueAsStr(I->getOperand(0)) << ')';
+      Code << getAssignIfNeeded(I) << "i64_zext(" << streamValue(I->getOperand(0)) << ')';
       break;
     }
-    Code << getAssignIfNeeded(I) << getValueAsStr(I->getOperand(0));
+    Code << getAssignIfNeeded(I) << streamValue(I->getOperand(0));
     break;
   }
   case Instruction::IntToPtr: {
     if (OnlyWebAssembly && I->getOperand(0)->getType()->getIntegerBitWidth() == 64) {
       // it is valid in LLVM IR to convert an i64 into a 32-bit pointer, it truncates
-      Code << getAssignIfNeeded(I) << "i64_trunc(" << getValueAsStr(I->getOperand(0)) << ')';
+      Code << getAssignIfNeeded(I) << "i64_trunc(" << streamValue(I->getOperand(0)) << ')';
       break;
     }
-    Code << getAssignIfNeeded(I) << getValueAsStr(I->getOperand(0));
+    Code << getAssignIfNeeded(I) << streamValue(I->getOperand(0));
     break;
   }
   case Instruction::Trunc:
@@ -2854,14 +3843,14 @@ void JSWriter::generateExpression(const User *I, raw_string_ostream& Code) {
   case Instruction::FPToSI:
   case Instruction::UIToFP:
   case Instruction::SIToFP: {
-    Code << getAssignIfNeeded(I);
+    printAssignIfNeeded(Code, I);
     if (OnlyWebAssembly &&
         ((I->getType()->isIntegerTy() && I->getType()->getIntegerBitWidth() == 64) ||
          (I->getOperand(0)->getType()->isIntegerTy() && I->getOperand(0)->getType()->getIntegerBitWidth() == 64))) {
       switch (Operator::getOpcode(I)) {
         case Instruction::Trunc: {
           unsigned outBits = I->getType()->getIntegerBitWidth();
-          Code << "i64_trunc(" << getValueAsStr(I->getOperand(0)) << ')';
+          Code << "i64_trunc(" << streamValue(I->getOperand(0)) << ')';
           if (outBits < 32) {
             Code << "&" << utostr(LSBMask(outBits));
           }
@@ -2870,7 +3859,7 @@ void JSWriter::generateExpression(const User *I, raw_string_ostream& Code) {
         case Instruction::SExt: {
           unsigned inBits = I->getOperand(0)->getType()->getIntegerBitWidth();
           std::string bits = utostr(32 - inBits);
-          Code << "i64_sext(" << getValueAsStr(I->getOperand(0));
+          Code << "i64_sext(" << streamValue(I->getOperand(0));
           if (inBits < 32) {
             Code << " << " << bits << " >> " << bits;
           }
@@ -2881,10 +3870,10 @@ void JSWriter::generateExpression(const User *I, raw_string_ostream& Code) {
           Code << "i64_zext(" << getValueAsCastStr(I->getOperand(0), ASM_UNSIGNED) << ')';
           break;
         }
-        case Instruction::SIToFP: Code << (I->getType()->isFloatTy() ? "i64_s2f(" : "i64_s2d(") << getValueAsStr(I->getOperand(0)) << ')'; break;
-        case Instruction::UIToFP: Code << (I->getType()->isFloatTy() ? "i64_u2f(" : "i64_u2d(") << getValueAsStr(I->getOperand(0)) << ')'; break;
-        case Instruction::FPToSI: Code << (I->getOperand(0)->getType()->isFloatTy() ? "i64_f2s(" : "i64_d2s(") << getValueAsStr(I->getOperand(0)) << ')'; break;
-        case Instruction::FPToUI: Code << (I->getOperand(0)->getType()->isFloatTy() ? "i64_f2u(" : "i64_d2u(") << getValueAsStr(I->getOperand(0)) << ')'; break;
+        case Instruction::SIToFP: Code << (I->getType()->isFloatTy() ? "i64_s2f(" : "i64_s2d(") << streamValue(I->getOperand(0)) << ')'; break;
+        case Instruction::UIToFP: Code << (I->getType()->isFloatTy() ? "i64_u2f(" : "i64_u2d(") << streamValue(I->getOperand(0)) << ')'; break;
+        case Instruction::FPToSI: Code << (I->getOperand(0)->getType()->isFloatTy() ? "i64_f2s(" : "i64_d2s(") << streamValue(I->getOperand(0)) << ')'; break;
+        case Instruction::FPToUI: Code << (I->getOperand(0)->getType()->isFloatTy() ? "i64_f2u(" : "i64_d2u(") << streamValue(I->getOperand(0)) << ')'; break;
         default: llvm_unreachable("Unreachable-i64");
       }
       break;
@@ -2893,23 +3882,23 @@ void JSWriter::generateExpression(const User *I, raw_string_ostream& Code) {
     case Instruction::Trunc: {
       //unsigned inBits = V->getType()->getIntegerBitWidth();
       unsigned outBits = I->getType()->getIntegerBitWidth();
-      Code << getValueAsStr(I->getOperand(0)) << "&" << utostr(LSBMask(outBits));
+      Code << streamValue(I->getOperand(0)) << "&" << utostr(LSBMask(outBits));
       break;
     }
     case Instruction::SExt: {
       std::string bits = utostr(32 - I->getOperand(0)->getType()->getIntegerBitWidth());
-      Code << getValueAsStr(I->getOperand(0)) << " << " << bits << " >> " << bits;
+      Code << streamValue(I->getOperand(0)) << " << " << bits << " >> " << bits;
       break;
     }
     case Instruction::ZExt: {
-      Code << getValueAsCastStr(I->getOperand(0), ASM_UNSIGNED);
+      Code << streamValueAsCast(I->getOperand(0), ASM_UNSIGNED);
       break;
     }
     case Instruction::FPExt: {
       if (PreciseF32) {
-        Code << "+" << getValueAsStr(I->getOperand(0)); break;
+        Code << "+" << streamValue(I->getOperand(0)); break;
       } else {
-        Code << getValueAsStr(I->getOperand(0)); break;
+        Code << streamValue(I->getOperand(0)); break;
       }
       break;
     }
@@ -2917,18 +3906,22 @@ void JSWriter::generateExpression(const User *I, raw_string_ostream& Code) {
       Code << ensureFloat(getValueAsStr(I->getOperand(0)), I->getType());
       break;
     }
-    case Instruction::SIToFP:   Code << '(' << getCast(getValueAsCastParenStr(I->getOperand(0), ASM_SIGNED),   I->getType()) << ')'; break;
-    case Instruction::UIToFP:   Code << '(' << getCast(getValueAsCastParenStr(I->getOperand(0), ASM_UNSIGNED), I->getType()) << ')'; break;
+    case Instruction::SIToFP:
+    case Instruction::UIToFP:
+      Code << '(';
+      printCastPrefix(Code, I->getType()) << streamValueAsCastParen(I->getOperand(0), Operator::getOpcode(I) == Instruction::SIToFP ? ASM_SIGNED : ASM_UNSIGNED);
+      printCastSuffix(Code, I->getType()) << ')';
+      break;
     case Instruction::FPToSI:   Code << '(' << getDoubleToInt(getValueAsParenStr(I->getOperand(0))) << ')'; break;
     case Instruction::FPToUI:   Code << '(' << getCast(getDoubleToInt(getValueAsParenStr(I->getOperand(0))), I->getType(), ASM_UNSIGNED) << ')'; break;
-    case Instruction::PtrToInt: Code << '(' << getValueAsStr(I->getOperand(0)) << ')'; break;
-    case Instruction::IntToPtr: Code << '(' << getValueAsStr(I->getOperand(0)) << ')'; break;
+    case Instruction::PtrToInt: Code << '(' << streamValue(I->getOperand(0)) << ')'; break;
+    case Instruction::IntToPtr: Code << '(' << streamValue(I->getOperand(0)) << ')'; break;
     default: llvm_unreachable("Unreachable");
     }
     break;
   }
   case Instruction::BitCast: {
-    Code << getAssignIfNeeded(I);
+    printAssignIfNeeded(Code, I);
     // Most bitcasts are no-ops for us. However, the exception is int to float and float to int
     Type *InType = I->getOperand(0)->getType();
     Type *OutType = I->getType();
@@ -2968,7 +3961,7 @@ void JSWriter::generateExpression(const User *I, raw_string_ostream& Code) {
     break;
   }
   case Instruction::Select: {
-    Code << getAssignIfNeeded(I) << getValueAsStr(I->getOperand(0)) << " ? " <<
+    Code << getAssignIfNeeded(I) << streamValue(I->getOperand(0)) << " ? " <<
                                     getValueAsStr(I->getOperand(1)) << " : " <<
                                     getValueAsStr(I->getOperand(2));
     break;
@@ -3003,26 +3996,27 @@ void JSWriter::generateExpression(const User *I, raw_string_ostream& Code) {
         // TODO: If https://bugzilla.mozilla.org/show_bug.cgi?id=1131613 and https://bugzilla.mozilla.org/show_bug.cgi?id=1131624 are
         // implemented, we could remove the emulation, but until then we must emulate manually.
         bool fround = PreciseF32 && !strcmp(HeapName, "HEAPF32");
-        Code << Assign << (fround ? "Math_fround(" : "+") << "_emscripten_atomic_" << atomicFunc << "_" << heapNameToAtomicTypeName(HeapName) << "(" << getValueAsStr(P) << ", " << VS << (fround ? "))" : ")"); break;
+        Code << Assign << (fround ? "Math_fround(" : "+") << "_emscripten_atomic_" << atomicFunc << "_" << heapNameToAtomicTypeName(HeapName) << "(" << streamValue(P) << ", " << VS << (fround ? "))" : ")"); break;
 
       // TODO: Remove the following two lines once https://bugzilla.mozilla.org/show_bug.cgi?id=1141986 is implemented!
       } else if (rmwi->getOperation() == AtomicRMWInst::Xchg && !strcmp(HeapName, "HEAP32")) {
-        Code << Assign << "_emscripten_atomic_exchange_u32(" << getValueAsStr(P) << ", " << VS << ")|0"; break;
+        Code << Assign << "_emscripten_atomic_exchange_u32(" << streamValue(P) << ", " << VS << ")|0"; break;
 
       } else {
         Code << Assign << "(Atomics_" << atomicFunc << "(" << HeapName << ", " << Index << ", " << VS << ")|0)"; break;
       }
     } else {
       Code << getLoad(rmwi, P, I->getType(), 0) << ';';
+      std::string Name = getJSName(I);
       // Most bitcasts are no-ops for us. However, the exception is int to float and float to int
       switch (rmwi->getOperation()) {
         case AtomicRMWInst::Xchg: Code << getStore(rmwi, P, I->getType(), VS, 0); break;
-        case AtomicRMWInst::Add:  Code << getStore(rmwi, P, I->getType(), "((" + getJSName(I) + '+' + VS + ")|0)", 0); break;
-        case AtomicRMWInst::Sub:  Code << getStore(rmwi, P, I->getType(), "((" + getJSName(I) + '-' + VS + ")|0)", 0); break;
-        case AtomicRMWInst::And:  Code << getStore(rmwi, P, I->getType(), "(" + getJSName(I) + '&' + VS + ")", 0); break;
-        case AtomicRMWInst::Nand: Code << getStore(rmwi, P, I->getType(), "(~(" + getJSName(I) + '&' + VS + "))", 0); break;
-        case AtomicRMWInst::Or:   Code << getStore(rmwi, P, I->getType(), "(" + getJSName(I) + '|' + VS + ")", 0); break;
-        case AtomicRMWInst::Xor:  Code << getStore(rmwi, P, I->getType(), "(" + getJSName(I) + '^' + VS + ")", 0); break;
+        case AtomicRMWInst::Add:  Code << getStore(rmwi, P, I->getType(), "((" + Name + '+' + VS + ")|0)", 0); break;
+        case AtomicRMWInst::Sub:  Code << getStore(rmwi, P, I->getType(), "((" + Name + '-' + VS + ")|0)", 0); break;
+        case AtomicRMWInst::And:  Code << getStore(rmwi, P, I->getType(), "(" + Name + '&' + VS + ")", 0); break;
+        case AtomicRMWInst::Nand: Code << getStore(rmwi, P, I->getType(), "(~(" + Name + '&' + VS + "))", 0); break;
+        case AtomicRMWInst::Or:   Code << getStore(rmwi, P, I->getType(), "(" + Name + '|' + VS + ")", 0); break;
+        case AtomicRMWInst::Xor:  Code << getStore(rmwi, P, I->getType(), "(" + Name + '^' + VS + ")", 0); break;
         case AtomicRMWInst::Max:
         case AtomicRMWInst::Min:
         case AtomicRMWInst::UMax:
@@ -3039,6 +4033,7 @@ void JSWriter::generateExpression(const User *I, raw_string_ostream& Code) {
   }
 
   if (const Instruction *Inst = dyn_cast<Instruction>(I)) {
+    if (FoldedExpressions.count(Inst)) return; // part of its user's statement
     Code << ';';
     // append debug info
     emitDebugInfo(Code, Inst);
@@ -3058,22 +4053,56 @@ static const Value *considerConditionVar(const Instruction *I) {
 }
 
 void JSWriter::addBlock(const BasicBlock *BB, Relooper& R, LLVMToRelooperMap& LLVMToRelooper) {
-  std::string Code;
-  raw_string_ostream CodeStream(Code);
+  // BlockCode is reused from block to block, so that its storage only grows
+  // to the size of the largest block instead of being reallocated each time.
+  BlockCode.clear();
+  raw_svector_ostream CodeStream(BlockCode);
   for (BasicBlock::const_iterator II = BB->begin(), E = BB->end();
        II != E; ++II) {
     auto I = &*II;
-    if (stripPointerCastsWithoutSideEffects(I) == I) {
+    if (stripPointerCastsWithoutSideEffects(I) == I && !FoldedExpressions.count(I)) {
       CurrInstruction = I;
       generateExpression(I, CodeStream);
     }
   }
   CurrInstruction = nullptr;
-  CodeStream.flush();
   const Value* Condition = considerConditionVar(BB->getTerminator());
-  Block *Curr = new Block(Code.c_str(), Condition ? getValueAsCastStr(Condition).c_str() : NULL);
-  LLVMToRelooper[BB] = Curr;
-  R.AddBlock(Curr);
+  LLVMToRelooper[BB] = R.AddBlock(BlockCode.c_str(), Condition ? getValueAsCastStr(Condition).c_str() : NULL);
+  LLVMToRelooper[BB]->Frequency = getBlockFrequency(BB);
+}
+
+void JSWriter::calculateBranchProfile() {
+  std::shared_ptr<BranchProfile> Result = std::make_shared<BranchProfile>();
+  for (Function &F : *TheModule) {
+    if (F.isDeclaration()) continue;
+    DominatorTree DT(F);
+    LoopInfo LI(DT);
+    BranchProbabilityInfo BPI(F, LI);
+    BlockFrequencyInfo BFI(F, BPI, LI);
+    for (const BasicBlock &BB : F) {
+      BlockFrequency Freq = BFI.getBlockFreq(&BB);
+      Result->BlockFrequencies[&BB] = Freq.getFrequency();
+      const TerminatorInst *TI = BB.getTerminator();
+      for (unsigned i = 0, e = TI->getNumSuccessors(); i < e; i++) {
+        // a switch may reach the same block through several cases
+        uint64_t &Weight = Result->EdgeWeights[std::make_pair(&BB, TI->getSuccessor(i))];
+        Weight = SaturatingAdd(Weight, (Freq * BPI.getEdgeProbability(&BB, i)).getFrequency());
+      }
+    }
+  }
+  Profile = Result;
+}
+
+uint64_t JSWriter::getBlockFrequency(const BasicBlock *BB) {
+  if (!Profile) return 0;
+  auto I = Profile->BlockFrequencies.find(BB);
+  return I != Profile->BlockFrequencies.end() ? I->second : 0;
+}
+
+uint64_t JSWriter::getEdgeWeight(const BasicBlock *From, const BasicBlock *To) {
+  if (!Profile) return 0;
+  auto I = Profile->EdgeWeights.find(std::make_pair(From, To));
+  return I != Profile->EdgeWeights.end() ? I->second : 0;
 }
 
 void JSWriter::printFunctionBody(const Function *F) {
@@ -3120,12 +4149,12 @@ void JSWriter::printFunctionBody(const Function *F) {
           BasicBlock *S1 = br->getSuccessor(1);
           std::string P0 = getPhiCode(&*BI, S0);
           std::string P1 = getPhiCode(&*BI, S1);
-          LLVMToRelooper[&*BI]->AddBranchTo(LLVMToRelooper[&*S0], getValueAsStr(TI->getOperand(0)).c_str(), P0.size() > 0 ? P0.c_str() : NULL);
-          LLVMToRelooper[&*BI]->AddBranchTo(LLVMToRelooper[&*S1], NULL,                                     P1.size() > 0 ? P1.c_str() : NULL);
+          LLVMToRelooper[&*BI]->AddBranchTo(LLVMToRelooper[&*S0], getValueAsStr(TI->getOperand(0)).c_str(), P0.size() > 0 ? P0.c_str() : NULL, getEdgeWeight(&*BI, S0));
+          LLVMToRelooper[&*BI]->AddBranchTo(LLVMToRelooper[&*S1], NULL,                                     P1.size() > 0 ? P1.c_str() : NULL, getEdgeWeight(&*BI, S1));
         } else if (br->getNumOperands() == 1) {
           BasicBlock *S = br->getSuccessor(0);
           std::string P = getPhiCode(&*BI, S);
-          LLVMToRelooper[&*BI]->AddBranchTo(LLVMToRelooper[&*S], NULL, P.size() > 0 ? P.c_str() : NULL);
+          LLVMToRelooper[&*BI]->AddBranchTo(LLVMToRelooper[&*S], NULL, P.size() > 0 ? P.c_str() : NULL, getEdgeWeight(&*BI, S));
         } else {
           error("Branch with 2 operands?");
         }
@@ -3145,9 +4174,9 @@ void JSWriter::printFunctionBody(const Function *F) {
           if (!SetDefault) {
             SetDefault = true;
           } else {
-            Target = "case " + utostr(getBlockAddress(F, S)) + ": ";
+            Target = "case " + getBlockAddressStr(F, S) + ": ";
           }
-          LLVMToRelooper[&*BI]->AddBranchTo(LLVMToRelooper[&*S], Target.size() > 0 ? Target.c_str() : NULL, P.size() > 0 ? P.c_str() : NULL);
+          LLVMToRelooper[&*BI]->AddBranchTo(LLVMToRelooper[&*S], Target.size() > 0 ? Target.c_str() : NULL, P.size() > 0 ? P.c_str() : NULL, getEdgeWeight(&*BI, S));
         }
         break;
       }
@@ -3156,7 +4185,7 @@ void JSWriter::printFunctionBody(const Function *F) {
         bool UseSwitch = !!considerConditionVar(SI);
         BasicBlock *DD = SI->getDefaultDest();
         std::string P = getPhiCode(&*BI, DD);
-        LLVMToRelooper[&*BI]->AddBranchTo(LLVMToRelooper[&*DD], NULL, P.size() > 0 ? P.c_str() : NULL);
+        LLVMToRelooper[&*BI]->AddBranchTo(LLVMToRelooper[&*DD], NULL, P.size() > 0 ? P.c_str() : NULL, getEdgeWeight(&*BI, DD));
         typedef std::map<const BasicBlock*, std::string> BlockCondMap;
         BlockCondMap BlocksToConditions;
         for (SwitchInst::ConstCaseIt i = SI->case_begin(), e = SI->case_end(); i != e; ++i) {
@@ -3182,7 +4211,7 @@ void JSWriter::printFunctionBody(const Function *F) {
           if (!alreadyProcessed.insert(BB).second) continue;
           if (BB == DD) continue; // ok to eliminate this, default dest will get there anyhow
           std::string P = getPhiCode(&*BI, BB);
-          LLVMToRelooper[&*BI]->AddBranchTo(LLVMToRelooper[&*BB], BlocksToConditions[BB].c_str(), P.size() > 0 ? P.c_str() : NULL);
+          LLVMToRelooper[&*BI]->AddBranchTo(LLVMToRelooper[&*BB], BlocksToConditions[BB].c_str(), P.size() > 0 ? P.c_str() : NULL, getEdgeWeight(&*BI, BB));
         }
         break;
       }
@@ -3203,8 +4232,16 @@ void JSWriter::printFunctionBody(const Function *F) {
   }
   UsedVars["label"] = i32;
   if (!UsedVars.empty()) {
+    // Declare them sorted by name, so the output does not depend on hashing.
+    SmallVector<const VarMap::value_type *, 64> SortedVars;
+    for (const VarMap::value_type &Var : UsedVars)
+      SortedVars.push_back(&Var);
+    std::sort(SortedVars.begin(), SortedVars.end(),
+              [](const VarMap::value_type *A, const VarMap::value_type *B) {
+                return A->getKey() < B->getKey();
+              });
     unsigned Count = 0;
-    for (VarMap::const_iterator VI = UsedVars.begin(); VI != UsedVars.end(); ++VI) {
+    for (const VarMap::value_type *VI : SortedVars) {
       if (Count == 20) {
         Out << ";\n";
         Count = 0;
@@ -3214,7 +4251,7 @@ void JSWriter::printFunctionBody(const Function *F) {
         Out << ", ";
       }
       Count++;
-      Out << VI->first << " = ";
+      Out << VI->getKey() << " = ";
       switch (VI->second->getTypeID()) {
         default:
           llvm_unreachable("unsupported variable initializer type");
@@ -3240,6 +4277,10 @@ void JSWriter::printFunctionBody(const Function *F) {
           break;
         case Type::VectorTyID: {
           VectorType *VT = cast<VectorType>(VI->second);
+          if (WasmSIMD) {
+            Out << getWasmSIMDConstant(VT, nullptr);
+            break;
+          }
           Out << "SIMD_" << SIMDType(VT) << "(0";
 
           // SIMD.js has only a fixed set of SIMD types, and no arbitrary vector sizes like <float x 3> or <i8 x 7>, so
@@ -3263,10 +4304,9 @@ void JSWriter::printFunctionBody(const Function *F) {
   }
 
   {
-    static bool Warned = false;
-    if (!Warned && OptLevel < 2 && UsedVars.size() > 2000) {
+    static std::atomic<bool> Warned(false);
+    if (OptLevel < 2 && UsedVars.size() > 2000 && !Warned.exchange(true)) {
       prettyWarning() << "emitted code will contain very large numbers of local variables, which is bad for performance (build to JS with -O2 or above to avoid this - make sure to do so both on source files, and during 'linking')\n";
-      Warned = true;
     }
   }
 
@@ -3305,7 +4345,7 @@ void JSWriter::printFunctionBody(const Function *F) {
     if (!LastCurly) LastCurly = buffer;
     char *FinalReturn = strstr(LastCurly, "return ");
     if (!FinalReturn) {
-      Out << " return " << getParenCast(getConstant(UndefValue::get(RT)), RT, ASM_NONSPECIFIC) << ";\n";
+      Out << " return " << getParenCast(getUndefValue(RT), RT, ASM_NONSPECIFIC) << ";\n";
     }
   }
 
@@ -3316,6 +4356,38 @@ void JSWriter::printFunctionBody(const Function *F) {
   }
 }
 
+// Orders globals by an estimate of how often they are accessed, hottest first.
+// Each instruction using a global counts 8 to the power of its loop depth,
+// scaled by its function's entry count when there is profile data.
+void JSWriter::sortGlobalsByUse(std::vector<const GlobalVariable*>& Globals) {
+  std::map<const GlobalVariable*, uint64_t> Accesses;
+  for (const GlobalVariable *GV : Globals) Accesses[GV] = 0;
+  std::function<void (const Value*, uint64_t)> CountAccess = [&](const Value *V, uint64_t Weight) {
+    if (const GlobalVariable *GV = dyn_cast<GlobalVariable>(V)) {
+      auto I = Accesses.find(GV);
+      if (I != Accesses.end()) I->second = SaturatingAdd(I->second, Weight);
+    } else if (const ConstantExpr *CE = dyn_cast<ConstantExpr>(V)) {
+      for (const Value *Op : CE->operands()) CountAccess(Op, Weight);
+    }
+  };
+  for (Function &F : *TheModule) {
+    if (F.isDeclaration()) continue;
+    DominatorTree DT(F);
+    LoopInfo LI(DT);
+    uint64_t Scale = 1;
+    if (Optional<uint64_t> Count = F.getEntryCount()) Scale = std::max<uint64_t>(*Count, 1);
+    for (const BasicBlock &BB : F) {
+      uint64_t Weight = SaturatingMultiply(Scale, uint64_t(1) << std::min(3 * LI.getLoopDepth(&BB), 30u));
+      for (const Instruction &I : BB) {
+        for (const Value *Op : I.operands()) CountAccess(Op, Weight);
+      }
+    }
+  }
+  std::stable_sort(Globals.begin(), Globals.end(), [&](const GlobalVariable *A, const GlobalVariable *B) {
+    return Accesses[A] > Accesses[B];
+  });
+}
+
 void JSWriter::processConstants() {
   // Ensure a name for each global
   for (Module::global_iterator I = TheModule->global_begin(),
@@ -3336,11 +4408,34 @@ void JSWriter::processConstants() {
     }
   }
   // First, calculate the address of each constant
+  std::vector<const GlobalVariable*> Globals;
   for (Module::const_global_iterator I = TheModule->global_begin(),
          E = TheModule->global_end(); I != E; ++I) {
     if (I->hasInitializer()) {
-      parseConstant(I->getName().str(), I->getInitializer(), I->getAlignment(), true);
+      Globals.push_back(&*I);
+    }
+  }
+  if (LayoutGlobalsByUse) {
+    sortGlobalsByUse(Globals);
+  }
+  // Constant data whose address is not significant is laid out once for each
+  // distinct contents; later copies share its address if it is aligned enough.
+  // ConstantMerge ran before FlattenGlobals, but globals of different types
+  // may only become identical bytes now.
+  std::map<StringRef, std::pair<std::string, unsigned>> MergedConstants;
+  for (const GlobalVariable *GV : Globals) {
+    std::string Name = GV->getName().str();
+    const ConstantDataSequential *CDS = dyn_cast<ConstantDataSequential>(GV->getInitializer());
+    if (MergeConstants && CDS && GV->isConstant() && GV->hasGlobalUnnamedAddr()) {
+      unsigned Alignment = GV->getAlignment() ? GV->getAlignment() : DEFAULT_MEM_ALIGN;
+      auto Merged = MergedConstants.find(CDS->getRawDataValues());
+      if (Merged != MergedConstants.end() && Merged->second.second >= Alignment) {
+        GlobalAddresses[Name] = GlobalAddresses[Merged->second.first];
+        continue;
+      }
+      MergedConstants[CDS->getRawDataValues()] = std::make_pair(Name, Alignment);
     }
+    parseConstant(Name, GV->getInitializer(), GV->getAlignment(), true);
   }
   if (WebAssembly && SideModule && StackSize > 0) {
     // allocate the stack
@@ -3411,10 +4506,12 @@ void JSWriter::processConstants() {
 
 void JSWriter::printFunction(const Function *F) {
   ValueNames.clear();
+  JSNameAllocator.Reset();
 
   // Prepare and analyze function
 
   UsedVars.clear();
+  UsedVars.getAllocator().Reset();
   UniqueNum = 0;
 
   // When optimizing, the regular optimizer (mem2reg, SROA, GVN, and others)
@@ -3425,6 +4522,12 @@ void JSWriter::printFunction(const Function *F) {
   // Do alloca coloring at -O1 and higher.
   Allocas.analyze(*F, *DL, OptLevel != CodeGenOpt::None);
 
+  if (FoldExpressions)
+    calculateFoldedExpressions(F);
+
+  if (CoalesceLocals)
+    Locals.analyze(*F, [this](const Instruction *I) { return getLocalType(I); });
+
   // Emit the function
 
   std::string Name = F->getName();
@@ -3449,9 +4552,447 @@ void JSWriter::printFunction(const Function *F) {
   nl(Out);
 
   Allocas.clear();
+  Locals.clear();
+  FoldedExpressions.clear();
   StackBumped = false;
 }
 
+std::string JSWriter::resolveDeferredRequest(const DeferredRequest &R) {
+  switch (R.Kind) {
+    case DeferredRequest::FunctionIndex: return utostr(getFunctionIndex(cast<Function>(R.V)));
+    case DeferredRequest::AsmConstId:    return utostr(getAsmConstId(R.V, R.Sig));
+    case DeferredRequest::BlockAddr:     return utostr(getBlockAddress(cast<Function>(R.V), R.BB));
+    case DeferredRequest::FunctionTable: ensureFunctionTable(R.Sig); return "";
+  }
+  llvm_unreachable("invalid deferred request");
+}
+
+// The SIMD types a function used, one bit per UsesSIMD* flag.
+unsigned JSWriter::getSIMDUses() const {
+  bool Flags[] = { UsesSIMDUint8x16, UsesSIMDInt8x16, UsesSIMDUint16x8, UsesSIMDInt16x8,
+                   UsesSIMDUint32x4, UsesSIMDInt32x4, UsesSIMDFloat32x4, UsesSIMDFloat64x2,
+                   UsesSIMDBool8x16, UsesSIMDBool16x8, UsesSIMDBool32x4, UsesSIMDBool64x2 };
+  unsigned Uses = 0;
+  for (unsigned i = 0; i < array_lengthof(Flags); i++) {
+    if (Flags[i]) Uses |= 1 << i;
+  }
+  return Uses;
+}
+
+void JSWriter::addSIMDUses(unsigned Uses) {
+  bool *Flags[] = { &UsesSIMDUint8x16, &UsesSIMDInt8x16, &UsesSIMDUint16x8, &UsesSIMDInt16x8,
+                    &UsesSIMDUint32x4, &UsesSIMDInt32x4, &UsesSIMDFloat32x4, &UsesSIMDFloat64x2,
+                    &UsesSIMDBool8x16, &UsesSIMDBool16x8, &UsesSIMDBool32x4, &UsesSIMDBool64x2 };
+  for (unsigned i = 0; i < array_lengthof(Flags); i++) {
+    if (Uses & (1 << i)) *Flags[i] = true;
+  }
+}
+
+// On a worker, after emitting a function into Code, move what it produced
+// into EF, leaving the worker ready for the next function.
+void JSWriter::takeEmittedFunction(SmallVectorImpl<char> &Code, EmittedFunction &EF) {
+  StringRef Text(Code.data(), Code.size());
+  EF.Code.reserve(Text.size());
+  while (1) {
+    size_t Begin = Text.find(DeferredMarkerBegin);
+    EF.Code += Text.slice(0, Begin);
+    if (Begin == StringRef::npos) break;
+    size_t End = Text.find(DeferredMarkerEnd, Begin);
+    unsigned Index;
+    bool Invalid = End == StringRef::npos || Text.slice(Begin + 1, End).getAsInteger(10, Index);
+    assert(!Invalid && Index < DeferredRequests.size() && "bad deferred request marker");
+    (void)Invalid;
+    EF.Placeholders.push_back(std::make_pair(EF.Code.size(), Index));
+    Text = Text.drop_front(End + 1);
+  }
+  Code.clear();
+  EF.Requests = std::move(DeferredRequests);
+  DeferredRequests.clear();
+  for (StringRef E : getSortedKeys(Externals)) EF.Externals.push_back(E);
+  Externals.clear();
+  for (StringRef D : getSortedKeys(Declares)) EF.Declares.push_back(D);
+  Declares.clear();
+  for (StringRef R : getSortedKeys(Redirects)) EF.Redirects.push_back(std::make_pair(R.str(), Redirects[R]));
+  Redirects.clear();
+  EF.Exports = std::move(Exports);
+  Exports.clear();
+  EF.CantValidate = CantValidate;
+  CantValidate = "";
+  EF.SIMDUses = getSIMDUses();
+  UsesSIMDUint8x16 = UsesSIMDInt8x16 = UsesSIMDUint16x8 = UsesSIMDInt16x8 = false;
+  UsesSIMDUint32x4 = UsesSIMDInt32x4 = UsesSIMDFloat32x4 = UsesSIMDFloat64x2 = false;
+  UsesSIMDBool8x16 = UsesSIMDBool16x8 = UsesSIMDBool32x4 = UsesSIMDBool64x2 = false;
+}
+
+// Writes out a function emitted on a worker, resolving the requests it
+// deferred, and merges what it contributed to the module. Functions must be
+// printed in module order, as things are numbered in the order requested.
+void JSWriter::printEmittedFunction(const EmittedFunction &EF) {
+  std::vector<std::string> Resolved;
+  for (const DeferredRequest &R : EF.Requests) {
+    Resolved.push_back(resolveDeferredRequest(R));
+  }
+  StringRef Code(EF.Code);
+  size_t Pos = 0;
+  for (auto &P : EF.Placeholders) {
+    Out << Code.slice(Pos, P.first) << Resolved[P.second];
+    Pos = P.first;
+  }
+  Out << Code.substr(Pos);
+
+  for (auto& E : EF.Externals) Externals.insert(E);
+  for (auto& D : EF.Declares) Declares.insert(D);
+  for (auto& R : EF.Redirects) Redirects.insert(R);
+  Exports.insert(Exports.end(), EF.Exports.begin(), EF.Exports.end());
+  if (!EF.CantValidate.empty()) CantValidate = EF.CantValidate;
+  addSIMDUses(EF.SIMDUses);
+}
+
+// The emit cache key of a function: its IR, and everything outside of it that
+// its code depends on - the options, the data layout, and the names, kinds and
+// addresses of the globals it refers to. Lazily assigned things such as
+// function table indices are deferred requests, which are resolved afresh when
+// the entry is used, so they are not part of the key. Salt identifies the
+// compiler itself, so entries from another build are never reused.
+namespace {
+// Writes an option to an emit cache key, one per line, so that no two
+// different settings can print the same.
+struct EmitCacheKeyOption {
+  raw_ostream &OS;
+  template<typename T>
+  void operator()(const cl::opt<T> &O) const {
+    OS << O.ArgStr << '=' << O.getValue() << '\n';
+  }
+};
+} // end anonymous namespace
+
+std::string JSWriter::getEmitCacheKey(const Function *F, StringRef Salt) {
+  std::string Text;
+  raw_string_ostream OS(Text);
+  OS << Salt << '\n' << DL->getStringRepresentation() << '\n'
+     << "O=" << OptLevel << '\n';
+  forEachCodegenOption(EmitCacheKeyOption{OS});
+  F->print(OS);
+
+  // The printed IR refers to profile metadata without showing it, so add what
+  // the relooper was given.
+  if (Profile) {
+    for (const BasicBlock &BB : *F) {
+      OS << getBlockFrequency(&BB);
+      for (const BasicBlock *Succ : successors(&BB)) OS << ' ' << getEdgeWeight(&BB, Succ);
+      OS << '\n';
+    }
+  }
+
+  // Visit the globals F refers to, directly or through constant expressions
+  // and aggregates.
+  SmallPtrSet<const Value*, 32> Visited;
+  SmallVector<const Value*, 32> Worklist;
+  for (const BasicBlock &BB : *F) {
+    for (const Instruction &I : BB) {
+      for (const Use &U : I.operands()) {
+        if (isa<Constant>(U.get()) && Visited.insert(U.get()).second) Worklist.push_back(U.get());
+      }
+    }
+  }
+  std::vector<std::string> Globals;
+  while (!Worklist.empty()) {
+    const Value *V = Worklist.pop_back_val();
+    if (const GlobalValue *GV = dyn_cast<GlobalValue>(V)) {
+      std::string Desc;
+      raw_string_ostream DS(Desc);
+      DS << GV->getName() << ' ' << GV->getLinkage() << ' ' << GV->isDeclaration() << ' ';
+      GV->getValueType()->print(DS);
+      if (isa<GlobalVariable>(GV) && GlobalAddresses.count(GV->getName())) {
+        DS << ' ' << getGlobalAddress(GV->getName().str());
+      }
+      // the contents of constants may be read at compile time, as for asm
+      // consts
+      const GlobalVariable *GVar = dyn_cast<GlobalVariable>(GV);
+      if (GVar && GVar->isConstant() && GVar->hasInitializer()) {
+        DS << ' ';
+        GVar->getInitializer()->printAsOperand(DS, false);
+      }
+      Globals.push_back(DS.str());
+      // An alias is emitted as whatever it points to.
+      if (const GlobalAlias *GA = dyn_cast<GlobalAlias>(GV)) {
+        if (Visited.insert(GA->getAliasee()).second) Worklist.push_back(GA->getAliasee());
+      }
+    } else if (const User *CU = dyn_cast<User>(V)) {
+      for (const Use &U : CU->operands()) {
+        if (Visited.insert(U.get()).second) Worklist.push_back(U.get());
+      }
+    }
+  }
+  std::sort(Globals.begin(), Globals.end());
+  for (auto &G : Globals) OS << G << '\n';
+
+  SHA1 Hasher;
+  Hasher.update(OS.str());
+  return toHex(Hasher.result());
+}
+
+// Cache entries are a sequence of length-prefixed fields, "<length>:<bytes>".
+static void writeEmitCacheField(raw_ostream &OS, StringRef Field) {
+  OS << Field.size() << ':' << Field;
+}
+
+static bool readEmitCacheField(StringRef &In, StringRef &Field) {
+  size_t Colon = In.find(':');
+  size_t Length;
+  if (Colon == StringRef::npos || In.slice(0, Colon).getAsInteger(10, Length) ||
+      Colon + 1 + Length > In.size()) {
+    return false;
+  }
+  Field = In.substr(Colon + 1, Length);
+  In = In.drop_front(Colon + 1 + Length);
+  return true;
+}
+
+static bool readEmitCacheField(StringRef &In, unsigned &Value) {
+  StringRef Field;
+  return readEmitCacheField(In, Field) && !Field.getAsInteger(10, Value);
+}
+
+static bool readEmitCacheFields(StringRef &In, std::vector<std::string> &Fields) {
+  unsigned Count;
+  if (!readEmitCacheField(In, Count)) return false;
+  for (unsigned i = 0; i < Count; i++) {
+    StringRef Field;
+    if (!readEmitCacheField(In, Field)) return false;
+    Fields.push_back(Field);
+  }
+  return true;
+}
+
+static const char *EmitCacheMagic = "JSEC2";
+
+// Loads a cache entry, returning false if there is none or it does not fit
+// this module, in which case the function must be emitted.
+bool JSWriter::readEmitCache(StringRef Path, EmittedFunction &EF) {
+  auto Buffer = MemoryBuffer::getFile(Path);
+  if (!Buffer) return false;
+  StringRef In = (*Buffer)->getBuffer();
+  StringRef Field;
+  unsigned Count;
+  if (!readEmitCacheField(In, Field) || Field != EmitCacheMagic) return false;
+  if (!readEmitCacheField(In, Field)) return false;
+  EF.Code = Field;
+  if (!readEmitCacheField(In, Count)) return false;
+  for (unsigned i = 0; i < Count; i++) {
+    unsigned Offset, Index;
+    if (!readEmitCacheField(In, Offset) || !readEmitCacheField(In, Index) ||
+        Offset > EF.Code.size() || (i > 0 && Offset < EF.Placeholders.back().first)) {
+      return false;
+    }
+    EF.Placeholders.push_back(std::make_pair(Offset, Index));
+  }
+  if (!readEmitCacheField(In, Count)) return false;
+  for (unsigned i = 0; i < Count; i++) {
+    unsigned Kind, BlockIndex;
+    StringRef Name, Sig;
+    if (!readEmitCacheField(In, Kind) || !readEmitCacheField(In, Name) ||
+        !readEmitCacheField(In, BlockIndex) || !readEmitCacheField(In, Sig)) {
+      return false;
+    }
+    DeferredRequest R = { DeferredRequest::RequestKind(Kind), nullptr, nullptr, Sig };
+    switch (R.Kind) {
+      case DeferredRequest::FunctionIndex:
+      case DeferredRequest::BlockAddr: {
+        const Function *F = TheModule->getFunction(Name);
+        if (!F) return false;
+        R.V = F;
+        if (R.Kind == DeferredRequest::BlockAddr) {
+          if (BlockIndex >= F->size()) return false;
+          R.BB = &*std::next(F->begin(), BlockIndex);
+        }
+        break;
+      }
+      case DeferredRequest::AsmConstId:
+        R.V = TheModule->getNamedGlobal(Name);
+        if (!R.V) return false;
+        break;
+      case DeferredRequest::FunctionTable:
+        break;
+      default:
+        return false;
+    }
+    EF.Requests.push_back(R);
+  }
+  for (auto &P : EF.Placeholders) {
+    if (P.second >= EF.Requests.size()) return false;
+  }
+  std::vector<std::string> Redirects;
+  if (!readEmitCacheFields(In, EF.Externals) || !readEmitCacheFields(In, EF.Declares) ||
+      !readEmitCacheFields(In, Redirects) || Redirects.size() % 2 ||
+      !readEmitCacheFields(In, EF.Exports) || !readEmitCacheField(In, Field) ||
+      !readEmitCacheField(In, EF.SIMDUses) || !In.empty()) {
+    return false;
+  }
+  for (unsigned i = 0; i < Redirects.size(); i += 2) {
+    EF.Redirects.push_back(std::make_pair(Redirects[i], Redirects[i + 1]));
+  }
+  EF.CantValidate = Field;
+  return true;
+}
+
+// Stores a cache entry. It is written to a temporary file and renamed into
+// place, so that concurrent builds sharing the directory never see a partial
+// entry. Failing to write it is not an error, it is just not cached.
+void JSWriter::writeEmitCache(StringRef Path, const EmittedFunction &EF) {
+  std::string Entry;
+  raw_string_ostream OS(Entry);
+  writeEmitCacheField(OS, EmitCacheMagic);
+  writeEmitCacheField(OS, EF.Code);
+  writeEmitCacheField(OS, utostr(EF.Placeholders.size()));
+  for (auto &P : EF.Placeholders) {
+    writeEmitCacheField(OS, utostr(P.first));
+    writeEmitCacheField(OS, utostr(P.second));
+  }
+  writeEmitCacheField(OS, utostr(EF.Requests.size()));
+  for (const DeferredRequest &R : EF.Requests) {
+    StringRef Name;
+    unsigned BlockIndex = 0;
+    if (R.Kind == DeferredRequest::AsmConstId) {
+      Name = resolveFully(R.V)->getName();
+    } else if (R.V) {
+      Name = R.V->getName();
+    }
+    if (R.BB) {
+      for (const BasicBlock &BB : *cast<Function>(R.V)) {
+        if (&BB == R.BB) break;
+        BlockIndex++;
+      }
+    }
+    // unnamed values can't be found again in another module
+    if (R.V && Name.empty()) return;
+    writeEmitCacheField(OS, utostr(R.Kind));
+    writeEmitCacheField(OS, Name);
+    writeEmitCacheField(OS, utostr(BlockIndex));
+    writeEmitCacheField(OS, R.Sig);
+  }
+  writeEmitCacheField(OS, utostr(EF.Externals.size()));
+  for (auto &E : EF.Externals) writeEmitCacheField(OS, E);
+  writeEmitCacheField(OS, utostr(EF.Declares.size()));
+  for (auto &D : EF.Declares) writeEmitCacheField(OS, D);
+  writeEmitCacheField(OS, utostr(EF.Redirects.size() * 2));
+  for (auto &R : EF.Redirects) {
+    writeEmitCacheField(OS, R.first);
+    writeEmitCacheField(OS, R.second);
+  }
+  writeEmitCacheField(OS, utostr(EF.Exports.size()));
+  for (auto &E : EF.Exports) writeEmitCacheField(OS, E);
+  writeEmitCacheField(OS, EF.CantValidate);
+  writeEmitCacheField(OS, utostr(EF.SIMDUses));
+  OS.flush();
+
+  int FD;
+  SmallString<128> TempPath;
+  if (sys::fs::createUniqueFile(Path + ".tmp%%%%%%", FD, TempPath)) return;
+  {
+    raw_fd_ostream File(FD, /*shouldClose=*/true);
+    File << Entry;
+    File.close();
+    if (File.has_error()) {
+      File.clear_error();
+      sys::fs::remove(TempPath);
+      return;
+    }
+  }
+  if (sys::fs::rename(TempPath, Path)) sys::fs::remove(TempPath);
+}
+
+// Emits the function bodies on worker JSWriters, on EmitThreads threads, or
+// takes them from the emit cache. Each worker emits a contiguous run of
+// functions; we then stitch their output together in module order,
+// resolving the requests they deferred as we go, so that everything is
+// numbered exactly as in a serial emission.
+void JSWriter::printFunctionsOnWorkers() {
+  // DataLayout computes struct layouts lazily. Compute them all now, so that
+  // the workers only ever read them.
+  TypeFinder StructTypes;
+  StructTypes.run(*TheModule, false);
+  for (StructType *ST : StructTypes) {
+    if (ST->isSized()) DL->getStructLayout(ST);
+  }
+
+  std::vector<const Function*> Functions;
+  for (const Function &F : *TheModule) {
+    if (!F.isDeclaration()) Functions.push_back(&F);
+  }
+  if (Functions.empty()) return;
+
+  // Entries are specific to this build of the compiler.
+  std::string CacheSalt;
+  if (!EmitCacheDir.empty()) {
+    std::string Executable = sys::fs::getMainExecutable(nullptr, (void*)&LLVMInitializeJSBackendTarget);
+    sys::fs::file_status Status;
+    if (sys::fs::create_directories(EmitCacheDir) || Executable.empty() ||
+        sys::fs::status(Executable, Status)) {
+      prettyWarning() << "cannot use the emit cache in " << EmitCacheDir << "\n";
+    } else {
+      CacheSalt = Executable + " " + utostr(Status.getSize()) + " " +
+                  utostr(sys::toTimeT(Status.getLastModificationTime()));
+    }
+  }
+
+  struct Batch {
+    unsigned Begin, End; // range in Functions
+    std::unique_ptr<JSWriter> Writer;
+  };
+  std::vector<EmittedFunction> Emitted(Functions.size());
+  // several batches per thread, to even out functions of different sizes
+  unsigned NumThreads = std::max(1u, (unsigned)EmitThreads);
+  unsigned NumBatches = std::min<size_t>(Functions.size(), NumThreads * 4);
+  std::vector<Batch> Batches(NumBatches);
+  for (unsigned i = 0; i < NumBatches; i++) {
+    Batches[i].Begin = Functions.size() * i / NumBatches;
+    Batches[i].End = Functions.size() * (i + 1) / NumBatches;
+  }
+
+  ThreadPool Pool(NumThreads);
+  std::vector<std::shared_future<void>> Done;
+  for (unsigned i = 0; i < NumBatches; i++) {
+    Done.push_back(Pool.async([this, &Functions, &Batches, &Emitted, &CacheSalt, i]() {
+      Batch &B = Batches[i];
+      SmallVector<char, 0> Code;
+      raw_svector_ostream Stream(Code);
+      B.Writer.reset(new JSWriter(Stream, OptLevel));
+      JSWriter &W = *B.Writer;
+      W.IsWorker = true;
+      W.TheModule = TheModule;
+      W.DL = DL;
+      W.i32 = i32;
+      W.GlobalAddresses = GlobalAddresses;
+      W.AlignedHeapStarts = AlignedHeapStarts;
+      W.ZeroInitStarts = ZeroInitStarts;
+      W.Profile = Profile;
+      W.setupCallHandlers();
+      for (unsigned j = B.Begin; j < B.End; j++) {
+        SmallString<128> Path;
+        if (!CacheSalt.empty()) {
+          sys::path::append(Path, EmitCacheDir, W.getEmitCacheKey(Functions[j], CacheSalt));
+          if (W.readEmitCache(Path, Emitted[j])) continue;
+          Emitted[j] = EmittedFunction();
+        }
+        W.printFunction(Functions[j]);
+        W.takeEmittedFunction(Code, Emitted[j]);
+        if (!Path.empty()) W.writeEmitCache(Path, Emitted[j]);
+      }
+    }));
+  }
+
+  for (unsigned i = 0; i < NumBatches; i++) {
+    Done[i].wait();
+    Batch &B = Batches[i];
+    for (unsigned j = B.Begin; j < B.End; j++) {
+      printEmittedFunction(Emitted[j]);
+      Emitted[j] = EmittedFunction();
+    }
+    B.Writer.reset();
+  }
+}
+
 void JSWriter::printModuleBody() {
   processConstants();
 
@@ -3466,11 +5007,16 @@ void JSWriter::printModuleBody() {
   }
 
   // Emit function bodies.
+  if (RelooperProfile) calculateBranchProfile();
   nl(Out) << "// EMSCRIPTEN_START_FUNCTIONS"; nl(Out);
-  for (Module::const_iterator II = TheModule->begin(), E = TheModule->end();
-       II != E; ++II) {
-    auto I = &*II;
-    if (!I->isDeclaration()) printFunction(I);
+  if ((EmitThreads > 1 || !EmitCacheDir.empty()) && !EnableCyberDWARF && !TimePassesIsEnabled) {
+    printFunctionsOnWorkers();
+  } else {
+    for (Module::const_iterator II = TheModule->begin(), E = TheModule->end();
+         II != E; ++II) {
+      auto I = &*II;
+      if (!I->isDeclaration()) printFunction(I);
+    }
   }
   // Emit postSets, split up into smaller functions to avoid one massive one that is slow to compile (more likely to occur in dynamic linking, as more postsets)
   {
@@ -3522,7 +5068,7 @@ void JSWriter::printModuleBody() {
     if (DeclaresNeedingTypeDeclarations.size() > 0) {
       Out << "function __emscripten_dceable_type_decls() {\n";
       for (auto& Decl : DeclaresNeedingTypeDeclarations) {
-        std::string Call = getJSName(Decl) + "(";
+        std::string Call = getJSName(Decl).str() + "(";
         bool First = true;
         auto* FT = Decl->getFunctionType();
         for (auto AI = FT->param_begin(), AE = FT->param_end(); AI != AE; ++AI) {
@@ -3551,36 +5097,9 @@ void JSWriter::printModuleBody() {
   if (EnablePthreads) {
     Out << "if (!ENVIRONMENT_IS_PTHREAD) {\n";
   }
-  Out << "/* memory initializer */ allocate([";
-  if (MaxGlobalAlign > 0) {
-    bool First = true;
-    for (int i = 0; i < GlobalBasePadding; i++) {
-      if (First) {
-        First = false;
-      } else {
-        Out << ",";
-      }
-      Out << "0";
-    }
-    int Curr = MaxGlobalAlign;
-    while (Curr > 0) {
-      if (GlobalDataMap.find(Curr) == GlobalDataMap.end()) {
-        Curr = Curr/2;
-        continue;
-      }
-      HeapData* GlobalData = &GlobalDataMap[Curr];
-      if (GlobalData->size() > 0) {
-        if (First) {
-          First = false;
-        } else {
-          Out << ",";
-        }
-        printCommaSeparated(*GlobalData);
-      }
-      Curr = Curr/2;
-    }
-  }
-  Out << "], \"i8\", ALLOC_NONE, Runtime.GLOBAL_BASE);\n";
+  HeapData MemInit;
+  getMemoryInitializer(MemInit);
+  printMemoryInitializer(MemInit);
   if (EnablePthreads) {
     Out << "}\n";
   }
@@ -3622,7 +5141,7 @@ void JSWriter::printModuleBody() {
       // name").
       std::string fullName = std::string("_") + I->getName().str();
       if (CallHandlers.count(fullName) > 0) {
-        if (IndexedFunctions.find(fullName) == IndexedFunctions.end()) {
+        if (!IndexedFunctions.count(fullName)) {
           continue;
         }
       }
@@ -3635,40 +5154,37 @@ void JSWriter::printModuleBody() {
       Out << "\"" << I->getName() << "\"";
     }
   }
-  for (NameSet::const_iterator I = Declares.begin(), E = Declares.end();
-       I != E; ++I) {
+  for (StringRef Name : getSortedKeys(Declares)) {
     if (first) {
       first = false;
     } else {
       Out << ", ";
     }
-    Out << "\"" << *I << "\"";
+    Out << "\"" << Name << "\"";
   }
   Out << "],";
 
   Out << "\"redirects\": {";
   first = true;
-  for (StringMap::const_iterator I = Redirects.begin(), E = Redirects.end();
-       I != E; ++I) {
+  for (StringRef Name : getSortedKeys(Redirects)) {
     if (first) {
       first = false;
     } else {
       Out << ", ";
     }
-    Out << "\"_" << I->first << "\": \"" << I->second << "\"";
+    Out << "\"_" << Name << "\": \"" << Redirects[Name] << "\"";
   }
   Out << "},";
 
   Out << "\"externs\": [";
   first = true;
-  for (NameSet::const_iterator I = Externals.begin(), E = Externals.end();
-       I != E; ++I) {
+  for (StringRef Name : getSortedKeys(Externals)) {
     if (first) {
       first = false;
     } else {
       Out << ", ";
     }
-    Out << "\"" << *I << "\"";
+    Out << "\"" << Name << "\"";
   }
   Out << "],";
 
@@ -3691,11 +5207,11 @@ void JSWriter::printModuleBody() {
 
   Out << "\"tables\": {";
   unsigned Num = FunctionTables.size();
-  for (FunctionTableMap::iterator I = FunctionTables.begin(), E = FunctionTables.end(); I != E; ++I) {
-    Out << "  \"" << I->first << "\": \"var FUNCTION_TABLE_" << I->first << " = [";
+  for (StringRef Sig : getSortedKeys(FunctionTables)) {
+    Out << "  \"" << Sig << "\": \"var FUNCTION_TABLE_" << Sig << " = [";
     // wasm emulated function pointers use just one table
-    if (!(WebAssembly && EmulatedFunctionPointers && I->first != "X")) {
-      FunctionTable &Table = I->second;
+    if (!(WebAssembly && EmulatedFunctionPointers && Sig != "X")) {
+      FunctionTable &Table = FunctionTables[Sig];
       // ensure power of two
       unsigned Size = 1;
       while (Size < Table.size()) Size <<= 1;
@@ -3737,14 +5253,13 @@ void JSWriter::printModuleBody() {
 
   Out << "\"aliases\": {";
   first = true;
-  for (StringMap::const_iterator I = Aliases.begin(), E = Aliases.end();
-       I != E; ++I) {
+  for (StringRef Name : getSortedKeys(Aliases)) {
     if (first) {
       first = false;
     } else {
       Out << ", ";
     }
-    Out << "\"" << I->first << "\": \"" << I->second << "\"";
+    Out << "\"" << Name << "\": \"" << Aliases[Name] << "\"";
   }
   Out << "},";
 
@@ -3780,14 +5295,15 @@ void JSWriter::printModuleBody() {
 
   Out << "\"asmConsts\": {";
   first = true;
-  for (auto& I : AsmConsts) {
+  for (StringRef Code : getSortedKeys(AsmConsts)) {
     if (first) {
       first = false;
     } else {
       Out << ", ";
     }
-    Out << "\"" << utostr(I.second.Id) << "\": [\"" << I.first.c_str() << "\", [";
-    auto& Sigs = I.second.Sigs;
+    const AsmConstInfo& Info = AsmConsts[Code];
+    Out << "\"" << utostr(Info.Id) << "\": [\"" << Code.substr(0, Code.find('\0')) << "\", ["; // up to the C string's terminator
+    auto& Sigs = Info.Sigs;
     bool innerFirst = true;
     for (auto& Sig : Sigs) {
       if (innerFirst) {
@@ -4258,6 +5774,165 @@ void JSWriter::calculateNativizedVars(const Function *F) {
   }
 }
 
+// expression folding
+
+// Trees deeper than this are split with locals, which bounds the recursion in
+// generateExpression and the nesting the JS engine has to parse.
+static const unsigned MaxFoldedDepth = 16;
+
+// Whether a value of this type is a plain int, float or double in asm.js.
+static bool isScalarJSType(Type *T) {
+  return T->isPointerTy() || T->isFloatTy() || T->isDoubleTy() ||
+         (T->isIntegerTy() && T->getIntegerBitWidth() <= 32);
+}
+
+static bool hasVectorOperand(const Instruction *I) {
+  for (const Value *Op : I->operands()) {
+    if (Op->getType()->isVectorTy()) return true;
+  }
+  return false;
+}
+
+// The instruction that reads V, if V has a single use, looking through the
+// pointer casts that JSWriter does not emit.
+const Instruction *JSWriter::getSingleEmittedUser(const Instruction *V) {
+  const Instruction *U = V;
+  do {
+    if (!U->hasOneUse()) return nullptr;
+    U = dyn_cast<Instruction>(U->user_back());
+  } while (U && stripPointerCastsWithoutSideEffects(U) != U);
+  return U;
+}
+
+// Whether getLoad or getStore emit this access as a single heap access, which
+// refers to the pointer (and the stored value) once.
+bool JSWriter::isSimpleHeapAccess(const Instruction *I, const Value *P, Type *T, unsigned Alignment) {
+  if (T->isVectorTy() || isAbsolute(P)) return false;
+  if (const LoadInst *LI = dyn_cast<LoadInst>(I)) {
+    if (!LI->isSimple()) return false;
+  } else if (!cast<StoreInst>(I)->isSimple()) {
+    return false;
+  }
+  return Alignment == 0 || Alignment >= DL->getTypeAllocSize(T);
+}
+
+// Whether I can be emitted in place of its name, with no other effect than
+// computing its value.
+bool JSWriter::canFoldValue(const Instruction *I) {
+  if (stripPointerCastsWithoutSideEffects(I) != I) return false;
+  if (!isScalarJSType(I->getType()) || hasVectorOperand(I)) return false;
+  if (const LoadInst *LI = dyn_cast<LoadInst>(I)) {
+    return isSimpleHeapAccess(LI, LI->getPointerOperand(), LI->getType(), LI->getAlignment());
+  }
+  if (isa<BitCastInst>(I)) {
+    // Moving between the int and float views goes through tempDoublePtr.
+    return I->getType()->isFloatingPointTy() == I->getOperand(0)->getType()->isFloatingPointTy();
+  }
+  return isa<BinaryOperator>(I) || isa<CmpInst>(I) || isa<CastInst>(I) ||
+         isa<GetElementPtrInst>(I) || isa<SelectInst>(I);
+}
+
+// Whether generateExpression writes each operand of User once, in a single
+// statement, so that an operand's expression can take the place of its name.
+bool JSWriter::canFoldInto(const Instruction *User) {
+  if (User->getType()->isVectorTy() || hasVectorOperand(User)) return false;
+  switch (User->getOpcode()) {
+    case Instruction::FCmp:
+      switch (cast<FCmpInst>(User)->getPredicate()) {
+        case FCmpInst::FCMP_UEQ:
+        case FCmpInst::FCMP_ONE:
+        case FCmpInst::FCMP_ORD:
+        case FCmpInst::FCMP_UNO: return false; // these test operands for NaN
+        default: return true;
+      }
+    case Instruction::Load: {
+      const LoadInst *LI = cast<LoadInst>(User);
+      return isSimpleHeapAccess(LI, LI->getPointerOperand(), LI->getType(), LI->getAlignment());
+    }
+    case Instruction::Store: {
+      const StoreInst *SI = cast<StoreInst>(User);
+      return isSimpleHeapAccess(SI, SI->getPointerOperand(), SI->getValueOperand()->getType(), SI->getAlignment());
+    }
+    case Instruction::Call: {
+      const Value *CV = getActuallyCalledValue(User);
+      if (isa<InlineAsm>(CV)) return false;
+      // Intrinsics and library functions with call handlers may refer to
+      // their arguments any number of times.
+      const Function *F = dyn_cast<Function>(CV);
+      return !F || (!F->isIntrinsic() && !CallHandlers.count(getJSName(F)));
+    }
+    case Instruction::Br:
+    case Instruction::Ret:
+    case Instruction::ICmp:
+    case Instruction::GetElementPtr:
+    case Instruction::Select: return true;
+    default:
+      return isa<BinaryOperator>(User) || isa<CastInst>(User);
+  }
+}
+
+// Find the values to emit as part of the expression of their single user.
+// Only the user's block is considered, where nothing but phi copies, which
+// happen after the terminator, can assign the locals that a value reads. The
+// value is then computed where its user is, so a load may not be moved past
+// anything that may write memory.
+void JSWriter::calculateFoldedExpressions(const Function *F) {
+  FoldedExpressions.clear();
+
+  DenseMap<const Instruction*, unsigned> Positions;
+  SmallVector<unsigned, 64> WritesBefore; // the number of writes to memory before each instruction
+  SmallVector<unsigned, 64> Evaluated; // where each instruction is actually computed
+  SmallVector<unsigned, 64> Depths;
+  for (const BasicBlock &BB : *F) {
+    Positions.clear();
+    WritesBefore.clear();
+    unsigned Writes = 0;
+    for (const Instruction &I : BB) {
+      Positions[&I] = WritesBefore.size();
+      WritesBefore.push_back(Writes);
+      if (I.mayWriteToMemory()) Writes++;
+    }
+
+    // Bottom-up, so that where the user is computed is known.
+    unsigned N = WritesBefore.size();
+    Evaluated.resize(N);
+    unsigned Pos = N;
+    for (auto II = BB.rbegin(), E = BB.rend(); II != E; ++II) {
+      const Instruction *I = &*II;
+      --Pos;
+      Evaluated[Pos] = Pos;
+      if (!canFoldValue(I)) continue;
+      const Instruction *User = getSingleEmittedUser(I);
+      if (!User || User->getParent() != &BB || !canFoldInto(User)) continue;
+      unsigned At = Evaluated[Positions[User]];
+      if (isa<LoadInst>(I) && WritesBefore[At] != WritesBefore[Pos]) continue;
+      FoldedExpressions.insert(I);
+      Evaluated[Pos] = At;
+    }
+
+    // Top-down, cutting trees that get too deep. A value that is computed
+    // earlier than planned is still computed after its loads.
+    Depths.assign(N, 0);
+    Pos = 0;
+    for (const Instruction &I : BB) {
+      unsigned Depth = 0;
+      if (FoldedExpressions.count(&I)) {
+        for (const Value *Op : I.operands()) {
+          const Instruction *OpI = dyn_cast<Instruction>(stripPointerCastsWithoutSideEffects(Op));
+          if (OpI && FoldedExpressions.count(OpI)) {
+            Depth = std::max(Depth, Depths[Positions[OpI]]);
+          }
+        }
+        if (++Depth > MaxFoldedDepth) {
+          FoldedExpressions.erase(&I);
+          Depth = 0;
+        }
+      }
+      Depths[Pos++] = Depth;
+    }
+  }
+}
+
 // special analyses
 
 bool JSWriter::canReloop(const Function *F) {
@@ -4266,7 +5941,7 @@ bool JSWriter::canReloop(const Function *F) {
 
 // main entry
 
-void JSWriter::printCommaSeparated(const HeapData data) {
+void JSWriter::printCommaSeparated(const HeapData& data) {
   for (HeapData::const_iterator I = data.begin();
        I != data.end(); ++I) {
     if (I != data.begin()) {
@@ -4276,6 +5951,109 @@ void JSWriter::printCommaSeparated(const HeapData data) {
   }
 }
 
+// The initial contents of memory from GLOBAL_BASE: the padding, then the data of
+// each alignment, largest first. Memory starts out zeroed, so this stops at the
+// last nonzero byte.
+void JSWriter::getMemoryInitializer(HeapData& Data) {
+  if (MaxGlobalAlign == 0) return;
+  Data.assign(GlobalBasePadding, 0);
+  for (int Curr = MaxGlobalAlign; Curr > 0; Curr = Curr/2) {
+    HeapDataMap::const_iterator I = GlobalDataMap.find(Curr);
+    if (I != GlobalDataMap.end()) {
+      Data.insert(Data.end(), I->second.begin(), I->second.end());
+    }
+  }
+  while (!Data.empty() && Data.back() == 0) Data.pop_back();
+}
+
+// Runs of zeros at least this long are left out of the base64 memory
+// initializer, as starting a new segment, ',123,""', is shorter than the
+// base64 for the zeros.
+static const unsigned MinElidedZeros = 64;
+
+static void printBase64(raw_ostream& Out, const unsigned char *Data, size_t Size) {
+  static const char Digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  size_t i = 0;
+  for (; i + 3 <= Size; i += 3) {
+    unsigned Bits = (Data[i] << 16) | (Data[i + 1] << 8) | Data[i + 2];
+    Out << Digits[Bits >> 18] << Digits[(Bits >> 12) & 63] << Digits[(Bits >> 6) & 63] << Digits[Bits & 63];
+  }
+  // No padding, the decoder just stops at the end.
+  if (Size - i == 1) {
+    Out << Digits[Data[i] >> 2] << Digits[(Data[i] & 3) << 4];
+  } else if (Size - i == 2) {
+    unsigned Bits = (Data[i] << 8) | Data[i + 1];
+    Out << Digits[Bits >> 10] << Digits[(Bits >> 4) & 63] << Digits[(Bits & 15) << 2];
+  }
+}
+
+void JSWriter::printMemoryInitializer(const HeapData& Data) {
+  MemInitFormatKind Format = Data.empty() ? MemInitArray : MemInitFormat;
+  switch (Format) {
+    case MemInitArray: {
+      Out << "/* memory initializer */ allocate([";
+      printCommaSeparated(Data);
+      Out << "], \"i8\", ALLOC_NONE, Runtime.GLOBAL_BASE);\n";
+      break;
+    }
+    case MemInitBase64: {
+      // Segments are pairs of an offset from GLOBAL_BASE and the base64 of the
+      // bytes there, without padding.
+      Out << "/* memory initializer */ (function(segments) {\n"
+             " for (var i = 0; i < segments.length; i += 2) {\n"
+             "  var ptr = Runtime.GLOBAL_BASE + segments[i], data = segments[i + 1], bits = 0, value = 0;\n"
+             "  for (var j = 0; j < data.length; j++) {\n"
+             "   var c = data.charCodeAt(j);\n"
+             "   value = (value << 6) | (c > 96 ? c - 71 : c > 64 ? c - 65 : c > 47 ? c + 4 : c == 43 ? 62 : 63);\n"
+             "   bits += 6;\n"
+             "   if (bits >= 8) {\n"
+             "    bits -= 8;\n"
+             "    HEAPU8[ptr++] = value >> bits;\n"
+             "   }\n"
+             "  }\n"
+             " }\n"
+             "})([";
+      size_t Start = 0;
+      bool First = true;
+      while (Data[Start] == 0) Start++;
+      while (Start < Data.size()) {
+        // Find the next long run of zeros, or the end; the data ends in a nonzero byte.
+        size_t End = Start, Zeros = 0;
+        while (End + Zeros < Data.size() && Zeros < MinElidedZeros) {
+          if (Data[End + Zeros] == 0) {
+            Zeros++;
+          } else {
+            End += Zeros + 1;
+            Zeros = 0;
+          }
+        }
+        if (!First) Out << ",";
+        First = false;
+        Out << Start << ",\"";
+        printBase64(Out, &Data[Start], End - Start);
+        Out << "\"";
+        Start = End;
+        while (Start < Data.size() && Data[Start] == 0) Start++;
+      }
+      Out << "]);\n";
+      break;
+    }
+    case MemInitFile: {
+      if (MemInitFileName.empty()) {
+        report_fatal_error("-emscripten-mem-init-format=file needs -emscripten-mem-init-file");
+      }
+      std::error_code EC;
+      raw_fd_ostream File(MemInitFileName, EC, sys::fs::F_None);
+      if (EC) {
+        report_fatal_error("cannot write memory initializer to " + Twine(MemInitFileName) + ": " + EC.message());
+      }
+      File.write(reinterpret_cast<const char*>(Data.data()), Data.size());
+      Out << "/* memory initializer */ memoryInitializer = \"" << sys::path::filename(MemInitFileName) << "\";\n";
+      break;
+    }
+  }
+}
+
 void JSWriter::printProgram(const std::string& fname,
                              const std::string& mName) {
   printModule(fname,mName);
@@ -4294,6 +6072,7 @@ bool JSWriter::runOnModule(Module &M) {
   // sanity checks on options
   assert(Relocatable ? GlobalBase == 0 : true);
   assert(Relocatable ? EmulatedFunctionPointers : true);
+  assert(WasmSIMD ? OnlyWebAssembly : true);
 
   // Build debug data first, so that inline metadata can reuse the indicies
   if (EnableCyberDWARF)
@@ -4339,6 +6118,14 @@ bool JSTargetMachine::addPassesToEmitFile(
 
   PM.add(createCheckTriplePass());
 
+  // Devirtualize the virtual calls that type metadata (from
+  // -fwhole-program-vtables) proves to have a single target. This must see the
+  // vtables before legalization flattens them and drops their metadata. A
+  // relocatable module is not the whole program: a module linked in later may
+  // derive from its classes.
+  if (WholeProgramDevirt && !Relocatable && getOptLevel() != CodeGenOpt::None)
+    PM.add(createWholeProgramDevirtPass());
+
   if (NoExitRuntime) {
     PM.add(createNoExitRuntimePass());
     // removing atexits opens up globalopt/globaldce opportunities
@@ -4469,6 +6256,16 @@ bool JSTargetMachine::addPassesToEmitFile(
   PM.add(createEmscriptenRemoveLLVMAssumePass());
   PM.add(createEmscriptenExpandBigSwitchesPass());
 
+  // Remove the fences that the Atomics operations around them make redundant.
+  if (EnablePthreads && OptLevel != CodeGenOpt::None)
+    PM.add(createEmscriptenOptimizeAtomicsPass());
+
+  if (DevirtualizeCalls && OptLevel != CodeGenOpt::None)
+    PM.add(createEmscriptenDevirtualizeCallsPass());
+
+  if (EnableOutlining && OptLevel != CodeGenOpt::None)
+    PM.add(createEmscriptenOutlineRepeatedCodePass());
+
   PM.add(new JSWriter(Out, OptLevel));
 
   return false;
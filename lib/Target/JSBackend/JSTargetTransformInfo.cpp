@@ -19,7 +19,10 @@
 #include "llvm/Analysis/TargetTransformInfo.h"
 #include "llvm/Analysis/ValueTracking.h"
 #include "llvm/CodeGen/BasicTTIImpl.h"
+#include "llvm/IR/CallSite.h"
+#include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/Module.h"
+#include "llvm/IR/Operator.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Target/CostTable.h"
@@ -51,6 +54,11 @@ unsigned JSTTIImpl::getRegisterBitWidth(bool Vector) {
 
 static const unsigned Nope = 65536;
 
+// Integers that ExpandI64 splits into 32-bit halves.
+static bool isWideInteger(Type *Ty) {
+  return Ty->isIntegerTy() && Ty->getIntegerBitWidth() > 32;
+}
+
 // Certain types are fine, but some vector types must be avoided at all Costs.
 static bool isOkType(Type *Ty) {
   if (VectorType *VTy = dyn_cast<VectorType>(Ty)) {
@@ -76,6 +84,26 @@ unsigned JSTTIImpl::getArithmeticInstrCost(
   if (!isOkType(Ty))
     return Nope;
 
+  // Integers wider than 32 bits are split into 32-bit halves by ExpandI64.
+  // Bitwise operations just happen on each half, but everything else becomes
+  // a call to a runtime helper, with the high bits returned in tempRet0.
+  if (isWideInteger(Ty)) {
+    switch (Opcode) {
+      case Instruction::And:
+      case Instruction::Or:
+      case Instruction::Xor:
+        return 2;
+      case Instruction::Add:
+      case Instruction::Sub:
+      case Instruction::Shl:
+      case Instruction::LShr:
+      case Instruction::AShr:
+        return 6;
+      default:
+        return 10;
+    }
+  }
+
   if (VectorType *VTy = dyn_cast<VectorType>(Ty)) {
     switch (Opcode) {
       case Instruction::LShr:
@@ -119,3 +147,148 @@ unsigned JSTTIImpl::getCastInstrCost(unsigned Opcode, Type *Dst, Type *Src) {
   return BasicTTIImplBase::getCastInstrCost(Opcode, Dst, Src);
 }
 
+
+// A typical simple JS statement, such as "$x=$y+$z|0;", is around this many
+// bytes, so we count one basic instruction per this many.
+static const unsigned BytesPerInstruction = 12;
+
+unsigned JSTTIImpl::getUserCost(const User *U) {
+  // Intrinsics may lower to nothing or to inline code, which the generic
+  // implementation knows about, and PHIs are modeled as free everywhere.
+  if (isa<IntrinsicInst>(U) || isa<PHINode>(U))
+    return BaseT::getUserCost(U);
+
+  unsigned Bytes = getEmittedBytes(U);
+  if (Bytes == 0)
+    return TTI::TCC_Free;
+  return std::max<unsigned>(TTI::TCC_Basic,
+                            (Bytes + BytesPerInstruction / 2) / BytesPerInstruction);
+}
+
+unsigned JSTTIImpl::getEmittedBytes(const User *U) {
+  unsigned Opcode = Operator::getOpcode(U);
+  Type *Ty = U->getType();
+  Type *OpTy = U->getNumOperands() > 0 ? U->getOperand(0)->getType() : Ty;
+  bool Wide = isWideInteger(Ty) || isWideInteger(OpTy);
+
+  // SIMD operations are calls like "SIMD_Int32x4_add($a,$b)".
+  if (Ty->isVectorTy() || OpTy->isVectorTy())
+    return 30;
+
+  switch (Opcode) {
+    case Instruction::PHI:
+      // "$x=$y;" in each predecessor, unless the registers coalesce.
+      return 6;
+    case Instruction::Alloca:
+      // Static allocas are part of the frame.
+      return 0;
+    case Instruction::BitCast:
+    case Instruction::PtrToInt:
+    case Instruction::IntToPtr:
+      // Pointers are plain integers.
+      return Wide ? 8 : 0;
+    case Instruction::Trunc:
+      // "$x=$y&255;", or nothing when just taking the low half of an i64.
+      return Ty->isIntegerTy(32) ? 0 : 10;
+    case Instruction::ZExt:
+      // "$x=$y&255;", plus a zero high half for an i64.
+      return Wide ? 16 : 10;
+    case Instruction::SExt:
+      // "$x=$y<<24>>24;", plus "($y|0)<0?-1:0" as the high half for an i64.
+      return Wide ? 24 : 14;
+    case Instruction::FPToSI:
+    case Instruction::FPToUI:
+    case Instruction::SIToFP:
+    case Instruction::UIToFP:
+      // "$x=~~$y;" or "$x=+($y|0);", or a runtime helper for an i64.
+      return Wide ? 40 : 12;
+    case Instruction::FPExt:
+    case Instruction::FPTrunc:
+      // "$x=+$y;", or Math_fround with precise float32.
+      return 10;
+    case Instruction::Add:
+    case Instruction::Sub:
+    case Instruction::Shl:
+    case Instruction::LShr:
+    case Instruction::AShr:
+      // "$x=$y+$z|0;", or "$x=_i64Add($a,$b,$c,$d)|0;$h=tempRet0;".
+      return Wide ? 40 : 12;
+    case Instruction::And:
+    case Instruction::Or:
+    case Instruction::Xor:
+      // "$x=$y&$z;", once per half for an i64.
+      return Wide ? 20 : 10;
+    case Instruction::Mul:
+      // "$x=Math_imul($y,$z)|0;", or "___muldi3" for an i64.
+      return Wide ? 44 : 24;
+    case Instruction::UDiv:
+    case Instruction::SDiv:
+    case Instruction::URem:
+    case Instruction::SRem:
+      // "$x=($y|0)/($z|0)&-1;", or "___divdi3" and friends for an i64.
+      return Wide ? 44 : 22;
+    case Instruction::FAdd:
+    case Instruction::FSub:
+    case Instruction::FMul:
+    case Instruction::FDiv:
+    case Instruction::FRem:
+      // "$x=$y+$z;"
+      return 10;
+    case Instruction::ICmp:
+      // "($y|0)<($z|0)", comparing both halves for an i64.
+      return Wide ? 36 : 14;
+    case Instruction::FCmp:
+      // "$y<$z"
+      return 10;
+    case Instruction::Select:
+      // "$x=$c?$y:$z;"
+      return Wide ? 24 : 12;
+    case Instruction::GetElementPtr: {
+      // "$x=$p+8|0;", and "($i<<2)" for each variable index.
+      const GEPOperator *GEP = cast<GEPOperator>(U);
+      if (GEP->hasAllZeroIndices())
+        return 0;
+      unsigned Bytes = 12;
+      for (auto I = GEP->idx_begin(), E = GEP->idx_end(); I != E; ++I) {
+        if (!isa<Constant>(*I))
+          Bytes += 8;
+      }
+      return Bytes;
+    }
+    case Instruction::Load:
+    case Instruction::Store: {
+      // "$x=HEAP32[$p>>2]|0;" or "HEAP32[$p>>2]=$x;". Unaligned accesses are
+      // done one aligned piece at a time, and i64s a half at a time.
+      const Instruction *I = cast<Instruction>(U);
+      Type *AccessTy = Opcode == Instruction::Load ? Ty : OpTy;
+      unsigned Size = AccessTy->isSized() ?
+                      I->getModule()->getDataLayout().getTypeStoreSize(AccessTy) : 4;
+      unsigned Align = Opcode == Instruction::Load ? cast<LoadInst>(I)->getAlignment()
+                                                   : cast<StoreInst>(I)->getAlignment();
+      unsigned Pieces = Wide ? 2 : 1;
+      if (Align && Align < Size)
+        Pieces = Size / Align;
+      return 20 * Pieces;
+    }
+    case Instruction::Call:
+    case Instruction::Invoke: {
+      // "$x=_f($a|0,$b|0)|0;", with coercions on each argument.
+      ImmutableCallSite CS(U);
+      return 10 + 6 * CS.arg_size();
+    }
+    case Instruction::Br:
+      // Unconditional branches are handled by the Relooper's structure,
+      // conditional ones become "if($c){...}".
+      return cast<BranchInst>(U)->isConditional() ? 12 : 0;
+    case Instruction::Switch:
+      // "switch($x|0){case 1:{...}", and a break or label per case.
+      return 14 + 14 * cast<SwitchInst>(U)->getNumCases();
+    case Instruction::Ret:
+      // "return $x|0;"
+      return 12;
+    case Instruction::Unreachable:
+      return 0;
+    default:
+      return BytesPerInstruction;
+  }
+}
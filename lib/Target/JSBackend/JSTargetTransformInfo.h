@@ -90,6 +90,13 @@ public:
                            unsigned AddressSpace);
 
   unsigned getCastInstrCost(unsigned Opcode, Type *Dst, Type *Src);
+
+  unsigned getUserCost(const User *U);
+
+  /// Estimate the size, in bytes of minified JS, of the code emitted for an
+  /// instruction or constant expression, including the asm.js coercions around
+  /// it. Integers wider than 32 bits are costed as ExpandI64 lowers them.
+  static unsigned getEmittedBytes(const User *U);
 };
 
 } // end namespace llvm
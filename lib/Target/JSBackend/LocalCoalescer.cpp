@@ -0,0 +1,373 @@
+//===-- LocalCoalescer.cpp ------------------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the LocalCoalescer class.
+//
+// JSWriter gives every SSA value its own local variable, so large functions
+// declare thousands of them. The LocalCoalescer computes the liveness of those
+// values as JSWriter emits them, and lets values whose live ranges do not
+// overlap share a local, the way a register allocator would.
+//
+// Phi nodes are assigned by copies at the end of each predecessor, which
+// getPhiCode emits one after the other and orders by the names of the phis.
+// A phi therefore may not share a local with another phi of its block, or with
+// any value that is copied into one, except its own incoming value.
+//
+//===----------------------------------------------------------------------===//
+
+#define DEBUG_TYPE "localcoalescer"
+#include "LocalCoalescer.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/Timer.h"
+using namespace llvm;
+
+STATISTIC(NumValues, "Number of values with locals");
+STATISTIC(NumLocalsSaved, "Number of locals saved by sharing them between values");
+
+static const char *TimerGroupName = "LocalCoalescer";
+static const char *TimerGroupDesc = "Local coalescer";
+
+// Whether JSWriter emits I as a single assignment of an expression of its
+// operands. Its local may then be one that an operand dies in, as in
+// "$a = $a + 1 | 0". Other instructions may write their result before they
+// are done reading their operands.
+static bool isSingleAssignment(const Instruction *I) {
+  if (I->getType()->isVectorTy()) return false;
+  for (const Value *Op : I->operands()) {
+    if (Op->getType()->isVectorTy()) return false;
+  }
+  if (const LoadInst *LI = dyn_cast<LoadInst>(I)) {
+    return !LI->isAtomic() && !LI->isVolatile();
+  }
+  return isa<BinaryOperator>(I) || isa<CmpInst>(I) || isa<CastInst>(I) ||
+         isa<GetElementPtrInst>(I) || isa<SelectInst>(I);
+}
+
+// Whether JSWriter emits V as part of its users when they refer to it: the
+// insertelement chains and splats it recognizes, and the sign extensions
+// that vector selects look through.
+static bool isLookedThrough(const Instruction *I) {
+  return I->getType()->isVectorTy() &&
+         (isa<InsertElementInst>(I) || isa<ShuffleVectorInst>(I) || isa<SExtInst>(I));
+}
+
+void LocalCoalescer::addUses(const Value *V, UseList &Uses,
+                             SmallVectorImpl<const Value *> &Visited) {
+  // JSWriter refers to values through their pointer casts, and getPhiCode also
+  // through calls to the argument they return, so look through both.
+  const Value *Stripped[] = { V, V->stripPointerCasts() };
+  if (!isa<CallInst>(V) && !isa<InvokeInst>(V)) Stripped[0] = Stripped[1];
+  for (const Value *S : Stripped) {
+    const Instruction *I = dyn_cast<Instruction>(S);
+    if (!I || is_contained(Visited, I)) continue;
+    Visited.push_back(I);
+    auto It = Indices.find(I);
+    if (It != Indices.end()) {
+      Uses.push_back(It->second);
+    }
+    // Instructions without a local (other than allocas, which are addresses
+    // in the frame) are emitted as part of their users.
+    if ((It == Indices.end() && !isa<AllocaInst>(I)) || isLookedThrough(I)) {
+      for (const Value *Op : I->operands()) {
+        addUses(Op, Uses, Visited);
+      }
+    }
+  }
+}
+
+LocalCoalescer::UseList LocalCoalescer::getUses(const Instruction *I) {
+  UseList Uses;
+  SmallVector<const Value *, 8> Visited;
+  for (const Value *Op : I->operands()) {
+    addUses(Op, Uses, Visited);
+  }
+  return Uses;
+}
+
+LocalCoalescer::UseList LocalCoalescer::getIncoming(const BasicBlock *Pred, const Instruction *Phi) {
+  UseList Uses;
+  SmallVector<const Value *, 8> Visited;
+  const PHINode *P = cast<PHINode>(Phi);
+  for (unsigned i = 0, e = P->getNumIncomingValues(); i != e; ++i) {
+    if (P->getIncomingBlock(i) == Pred) {
+      addUses(P->getIncomingValue(i), Uses, Visited);
+    }
+  }
+  return Uses;
+}
+
+void LocalCoalescer::addInterference(unsigned A, unsigned B) {
+  if (A == B || Types[A] != Types[B]) return;
+  Interference[A].push_back(B);
+  Interference[B].push_back(A);
+}
+
+void LocalCoalescer::makeLive(unsigned V) {
+  if (LivePositions[V] >= 0) return;
+  LivePositions[V] = Live.size();
+  Live.push_back(V);
+}
+
+void LocalCoalescer::makeDead(unsigned V) {
+  int Position = LivePositions[V];
+  if (Position < 0) return;
+  unsigned Last = Live.back();
+  Live[Position] = Last;
+  LivePositions[Last] = Position;
+  Live.pop_back();
+  LivePositions[V] = -1;
+}
+
+void LocalCoalescer::interfereWithLive(unsigned V) {
+  for (unsigned L : Live) {
+    addInterference(V, L);
+  }
+}
+
+// Number the values that have locals, and find the ones that are live across
+// blocks.
+void LocalCoalescer::collectValues(const Function &F) {
+  for (const BasicBlock &BB : F) {
+    for (const Instruction &I : BB) {
+      if (Type *T = GetLocalType(&I)) {
+        Indices[&I] = Values.size();
+        Values.push_back(&I);
+        Types.push_back(T);
+      }
+    }
+  }
+
+  GlobalIndices.assign(Values.size(), -1);
+  auto MarkGlobal = [&](unsigned V) {
+    if (GlobalIndices[V] < 0) {
+      GlobalIndices[V] = Globals.size();
+      Globals.push_back(V);
+    }
+  };
+  for (const BasicBlock &BB : F) {
+    for (const Instruction &I : BB) {
+      if (isa<PHINode>(I)) continue;
+      for (unsigned V : getUses(&I)) {
+        if (Values[V]->getParent() != &BB) MarkGlobal(V);
+      }
+    }
+    SmallPtrSet<const BasicBlock *, 4> Seen;
+    for (const BasicBlock *Succ : successors(&BB)) {
+      if (!Seen.insert(Succ).second) continue;
+      for (const Instruction &I : *Succ) {
+        if (!isa<PHINode>(I)) break;
+        for (unsigned V : getIncoming(&BB, &I)) {
+          if (Values[V]->getParent() != &BB) MarkGlobal(V);
+        }
+      }
+    }
+  }
+}
+
+void LocalCoalescer::computeInterBlockLiveness(const Function &F) {
+  unsigned NumGlobals = Globals.size();
+  for (const BasicBlock &BB : F) {
+    BlockLivenessInfo &BLI = BlockLiveness[&BB];
+    BLI.Gen.resize(NumGlobals);
+    BLI.Kill.resize(NumGlobals);
+    BLI.LiveIn.resize(NumGlobals);
+    BLI.LiveOut.resize(NumGlobals);
+    for (const Instruction &I : BB) {
+      auto It = Indices.find(&I);
+      if (It != Indices.end() && GlobalIndices[It->second] >= 0) {
+        BLI.Kill.set(GlobalIndices[It->second]);
+      }
+      if (isa<PHINode>(I)) continue;
+      for (unsigned V : getUses(&I)) {
+        if (GlobalIndices[V] >= 0 && Values[V]->getParent() != &BB) {
+          BLI.Gen.set(GlobalIndices[V]);
+        }
+      }
+    }
+    // The copies into the phis of successors are at the end of this block.
+    SmallPtrSet<const BasicBlock *, 4> Seen;
+    for (const BasicBlock *Succ : successors(&BB)) {
+      if (!Seen.insert(Succ).second) continue;
+      for (const Instruction &I : *Succ) {
+        if (!isa<PHINode>(I)) break;
+        for (unsigned V : getIncoming(&BB, &I)) {
+          if (GlobalIndices[V] >= 0) BLI.LiveOut.set(GlobalIndices[V]);
+        }
+      }
+    }
+  }
+
+  // Iterate to a fixed point, visiting blocks bottom-up so that most changes
+  // propagate in one pass.
+  bool Changed = true;
+  while (Changed) {
+    Changed = false;
+    for (auto I = F.getBasicBlockList().rbegin(), E = F.getBasicBlockList().rend(); I != E; ++I) {
+      const BasicBlock *BB = &*I;
+      BlockLivenessInfo &BLI = BlockLiveness[BB];
+      for (const BasicBlock *Succ : successors(BB)) {
+        BLI.LiveOut |= BlockLiveness[Succ].LiveIn;
+      }
+      BitVector LiveIn = BLI.LiveOut;
+      LiveIn.reset(BLI.Kill);
+      LiveIn |= BLI.Gen;
+      if (LiveIn != BLI.LiveIn) {
+        BLI.LiveIn = std::move(LiveIn);
+        Changed = true;
+      }
+    }
+  }
+}
+
+// Walk each block bottom-up, making each value interfere with the values that
+// are live where it is assigned.
+void LocalCoalescer::computeInterference(const Function &F) {
+  Interference.resize(Values.size());
+  LivePositions.assign(Values.size(), -1);
+
+  for (const BasicBlock &BB : F) {
+    BlockLivenessInfo &BLI = BlockLiveness[&BB];
+    for (int G = BLI.LiveOut.find_first(); G >= 0; G = BLI.LiveOut.find_next(G)) {
+      makeLive(Globals[G]);
+    }
+
+    // The phi copies at the end of the block write each phi while the values
+    // copied into the other phis, and the condition of the branch, may still
+    // be read.
+    UseList TerminatorUses = getUses(BB.getTerminator());
+    SmallPtrSet<const BasicBlock *, 4> Seen;
+    for (const BasicBlock *Succ : successors(&BB)) {
+      if (!Seen.insert(Succ).second) continue;
+      SmallVector<std::pair<unsigned, UseList>, 4> Phis;
+      for (const Instruction &I : *Succ) {
+        if (!isa<PHINode>(I)) break;
+        UseList Incoming = getIncoming(&BB, &I);
+        for (unsigned V : Incoming) makeLive(V);
+        auto It = Indices.find(&I);
+        if (It != Indices.end()) Phis.push_back(std::make_pair(It->second, std::move(Incoming)));
+      }
+      for (auto &Phi : Phis) {
+        for (auto &Other : Phis) {
+          if (&Other == &Phi) continue;
+          for (unsigned V : Other.second) {
+            if (!is_contained(Phi.second, V)) addInterference(Phi.first, V);
+          }
+        }
+        for (unsigned V : TerminatorUses) {
+          if (!is_contained(Phi.second, V)) addInterference(Phi.first, V);
+        }
+      }
+    }
+
+    SmallVector<unsigned, 8> Phis;
+    for (auto I = BB.rbegin(), E = BB.rend(); I != E; ++I) {
+      if (isa<PHINode>(*I)) {
+        auto It = Indices.find(&*I);
+        if (It != Indices.end()) Phis.push_back(It->second);
+        continue;
+      }
+      UseList Uses = getUses(&*I);
+      auto It = Indices.find(&*I);
+      if (It == Indices.end()) {
+        for (unsigned V : Uses) makeLive(V);
+      } else if (isSingleAssignment(&*I)) {
+        makeDead(It->second);
+        interfereWithLive(It->second);
+        for (unsigned V : Uses) makeLive(V);
+      } else {
+        makeDead(It->second);
+        for (unsigned V : Uses) makeLive(V);
+        interfereWithLive(It->second);
+      }
+    }
+
+    // Phis are all assigned at once, on the way into the block.
+    for (unsigned P : Phis) makeDead(P);
+    for (unsigned P : Phis) {
+      interfereWithLive(P);
+      for (unsigned Q : Phis) addInterference(P, Q);
+    }
+
+    for (unsigned V : Live) LivePositions[V] = -1;
+    Live.clear();
+  }
+}
+
+// Give each value, in function order, the first local of its type that none
+// of the values it interferes with has been given yet.
+void LocalCoalescer::computeRepresentatives() {
+  unsigned N = Values.size();
+  SmallVector<unsigned, 64> Locals; // the representative of each local
+  SmallVector<unsigned, 64> LocalOf(N);
+  SmallVector<unsigned, 64> Taken; // the last value for which a local was taken
+  DenseMap<Type *, SmallVector<unsigned, 8>> LocalsByType;
+  Representatives.resize(N);
+
+  for (unsigned V = 0; V < N; V++) {
+    for (unsigned W : Interference[V]) {
+      if (W < V) Taken[LocalOf[W]] = V + 1;
+    }
+    SmallVector<unsigned, 8> &Candidates = LocalsByType[Types[V]];
+    unsigned Local = Locals.size();
+    for (unsigned L : Candidates) {
+      if (Taken[L] != V + 1) {
+        Local = L;
+        break;
+      }
+    }
+    if (Local == Locals.size()) {
+      Locals.push_back(V);
+      Taken.push_back(0);
+      Candidates.push_back(Local);
+    }
+    LocalOf[V] = Local;
+    Representatives[V] = Locals[Local];
+  }
+
+  NumValues += N;
+  NumLocalsSaved += N - Locals.size();
+}
+
+void LocalCoalescer::analyze(const Function &F, LocalTypeFn LocalType) {
+  NamedRegionTimer Timer("analyze", "Analyze", TimerGroupName, TimerGroupDesc,
+                         TimePassesIsEnabled);
+  GetLocalType = LocalType;
+  collectValues(F);
+  computeInterBlockLiveness(F);
+  computeInterference(F);
+  computeRepresentatives();
+
+  // Only the representatives are needed from here on.
+  BlockLiveness.clear();
+  Interference.clear();
+  GlobalIndices.clear();
+  Globals.clear();
+  LivePositions.clear();
+}
+
+void LocalCoalescer::clear() {
+  Values.clear();
+  Types.clear();
+  Indices.clear();
+  Representatives.clear();
+  GetLocalType = nullptr;
+}
+
+const Value *LocalCoalescer::getRepresentative(const Value *V) const {
+  const Instruction *I = dyn_cast<Instruction>(V);
+  if (!I) return V;
+  auto It = Indices.find(I);
+  if (It == Indices.end()) return V;
+  return Values[Representatives[It->second]];
+}
@@ -0,0 +1,102 @@
+//===-- LocalCoalescer.h --------------------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares the LocalCoalescer class.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef JSBACKEND_LOCALCOALESCER_H
+#define JSBACKEND_LOCALCOALESCER_H
+
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+
+#include <functional>
+#include <vector>
+
+namespace llvm {
+
+class BasicBlock;
+class Function;
+class Instruction;
+class Type;
+class Value;
+
+/// Assign the SSA values of a function to shared local variables.
+class LocalCoalescer {
+public:
+  /// The type of the local that holds an instruction's value, or null if it
+  /// has none. Values whose locals have the same type may share a local.
+  typedef std::function<Type *(const Instruction *)> LocalTypeFn;
+
+private:
+  LocalTypeFn GetLocalType;
+
+  // The values that have locals, in function order, and their positions in
+  // it. Values are identified by their position below.
+  SmallVector<const Instruction *, 64> Values;
+  SmallVector<Type *, 64> Types;
+  DenseMap<const Instruction *, unsigned> Indices;
+
+  // The values read by an instruction, or by the copies into the phis of a
+  // successor, which JSWriter emits at the end of their predecessor.
+  typedef SmallVector<unsigned, 4> UseList;
+  UseList getUses(const Instruction *I);
+  UseList getIncoming(const BasicBlock *Pred, const Instruction *Phi);
+  void addUses(const Value *V, UseList &Uses, SmallVectorImpl<const Value *> &Visited);
+
+  // Values that are live across blocks, and their positions in the per-block
+  // liveness bit vectors. Values only used in their own block are handled by
+  // the intra-block walk alone.
+  std::vector<int> GlobalIndices;
+  SmallVector<unsigned, 32> Globals;
+  struct BlockLivenessInfo {
+    BitVector Gen;
+    BitVector Kill;
+    BitVector LiveIn;
+    BitVector LiveOut;
+  };
+  DenseMap<const BasicBlock *, BlockLivenessInfo> BlockLiveness;
+
+  // The values each value cannot share a local with. Only values of the same
+  // local type are recorded.
+  std::vector<UseList> Interference;
+  void addInterference(unsigned A, unsigned B);
+
+  // The current live set of the intra-block walk, with constant-time removal.
+  SmallVector<unsigned, 32> Live;
+  std::vector<int> LivePositions;
+  void makeLive(unsigned V);
+  void makeDead(unsigned V);
+  void interfereWithLive(unsigned V);
+
+  // For each value, the first value of the local it was given.
+  SmallVector<unsigned, 64> Representatives;
+
+  void collectValues(const Function &F);
+  void computeInterBlockLiveness(const Function &F);
+  void computeInterference(const Function &F);
+  void computeRepresentatives();
+
+public:
+  /// Analyze the given function and prepare for getRepresentative queries.
+  void analyze(const Function &F, LocalTypeFn LocalType);
+
+  /// Reset all stored state.
+  void clear();
+
+  /// Return the value whose local holds V. Values that share a local are all
+  /// represented by the first of them in the function, which names the local.
+  const Value *getRepresentative(const Value *V) const;
+};
+
+} // namespace llvm
+
+#endif
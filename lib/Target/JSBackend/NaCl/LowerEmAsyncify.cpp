@@ -17,8 +17,10 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include "llvm/ADT/SetVector.h"
 #include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Statistic.h"
 #include "llvm/IR/Dominators.h"
 #include "llvm/IR/DataLayout.h"
 #include "llvm/IR/Instructions.h"
@@ -27,6 +29,7 @@
 #include "llvm/IR/Value.h"
 #include "llvm/IR/CallSite.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
 #include "llvm/IR/InstIterator.h"
 #include "llvm/Transforms/NaCl.h"
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
@@ -36,10 +39,19 @@
 #include "llvm/Transforms/Utils/ValueMapper.h"
 #include "llvm/Pass.h"
 
+#include <map>
 #include <vector>
 
+#define DEBUG_TYPE "loweremasyncify"
+
 using namespace llvm;
 
+STATISTIC(NumAsyncCalls, "Number of async calls");
+STATISTIC(NumContextBytesBefore, "Bytes of context for all async calls, if everything live were saved unsorted");
+STATISTIC(NumContextBytes, "Bytes of context for all async calls");
+STATISTIC(NumRematerialized, "Number of context values recomputed rather than saved");
+STATISTIC(NumSharedSaveBlocks, "Number of async calls sharing a context save block with a sibling");
+
 static cl::list<std::string>
 AsyncifyFunctions("emscripten-asyncify-functions",
                   cl::desc("Functions that call one of these functions, directly or indirectly, will be asyncified"),
@@ -81,12 +93,15 @@ namespace {
     typedef DenseMap<Function*, Instructions> FunctionInstructionsMap;
     typedef std::vector<Value*> Values;
     typedef SmallPtrSet<BasicBlock*, 16> BasicBlockSet;
+    typedef SmallPtrSet<Instruction*, 16> InstructionSet;
+    typedef SetVector<Value*> ValueSet;
 
     // all the information we want for an async call
     struct AsyncCallEntry {
       Instruction *AsyncCallInst; // calling an async function
       BasicBlock *AfterCallBlock; // the block we should continue on after getting the return value of AsynCallInst
       CallInst *AllocAsyncCtxInst;  // where we allocate the async ctx before the async call, in the original function
+      Values LiveVariables; // those live across the async call, which the callback must restore
       Values ContextVariables; // those need to be saved and restored for the async call
       StructType *ContextStructType; // The structure constructing all the context variables
       BasicBlock *SaveAsyncCtxBlock; // the block in which we save all the variables
@@ -95,9 +110,24 @@ namespace {
 
     BasicBlockSet FindReachableBlocksFrom(BasicBlock *src);
 
-    // Find everything that we should save and restore for the async call
-    // save them to Entry.ContextVariables
-    void FindContextVariables(AsyncCallEntry & Entry);
+    // Find everything that is live across the async call
+    // save them to Entry.LiveVariables
+    void FindLiveVariables(AsyncCallEntry & Entry);
+
+    // Choose the values that are cheaper to recompute in the callbacks than to save
+    bool IsRematerializable(Instruction *I);
+    void FindRematerializedVariables(std::vector<AsyncCallEntry> & Entries, InstructionSet & Remat);
+
+    // Find what we actually save for the async call: the live variables, with rematerialized
+    // ones replaced by what they are computed from
+    void FindContextVariables(const Values & LiveVariables, const InstructionSet & Remat, ValueSet & Saved);
+    void AddContextVariable(Value *V, const InstructionSet & Remat, ValueSet & Saved);
+
+    // Order the context variables to make the context struct compact, and build its type
+    void LayoutContext(AsyncCallEntry & Entry);
+
+    // In a callback, the value of V at the resume point, from what was loaded from the context
+    Value *RestoreContextVariable(Value *V, DenseMap<Value*, Value*> & Restored, BasicBlock *EntryBlock);
 
     // The essential function
     // F is now in the sync form, transform it into an async form that is valid in JS
@@ -279,7 +309,7 @@ LowerEmAsyncify::BasicBlockSet LowerEmAsyncify::FindReachableBlocksFrom(BasicBlo
   return ReachableBlockSet;
 }
 
-void LowerEmAsyncify::FindContextVariables(AsyncCallEntry & Entry) {
+void LowerEmAsyncify::FindLiveVariables(AsyncCallEntry & Entry) {
   BasicBlock *AfterCallBlock = Entry.AfterCallBlock;
 
   Function & F = *AfterCallBlock->getParent();
@@ -325,13 +355,142 @@ void LowerEmAsyncify::FindContextVariables(AsyncCallEntry & Entry) {
   // restore F
   EntryBlock->eraseFromParent();  
 
-  Entry.ContextVariables.clear();
-  Entry.ContextVariables.reserve(ContextVariables.size());
-  for (SmallPtrSet<Value*, 32>::iterator I = ContextVariables.begin(), E = ContextVariables.end(); I != E; ++I) {
-    Entry.ContextVariables.push_back(*I);
+  // list them in a deterministic order, arguments first and then in the order of definition
+  Entry.LiveVariables.clear();
+  Entry.LiveVariables.reserve(ContextVariables.size());
+  for (Function::arg_iterator AI = F.arg_begin(), AE = F.arg_end(); AI != AE; ++AI) {
+    if (ContextVariables.count(&*AI)) Entry.LiveVariables.push_back(&*AI);
+  }
+  for (inst_iterator I = inst_begin(&F), E = inst_end(&F); I != E; ++I) {
+    if (ContextVariables.count(&*I)) Entry.LiveVariables.push_back(&*I);
   }
 }
 
+bool LowerEmAsyncify::IsRematerializable(Instruction *I) {
+  if (isa<CastInst>(I) || isa<GetElementPtrInst>(I) || isa<CmpInst>(I)) return true;
+  if (BinaryOperator *BO = dyn_cast<BinaryOperator>(I)) {
+    switch (BO->getOpcode()) {
+      case Instruction::UDiv: case Instruction::SDiv:
+      case Instruction::URem: case Instruction::SRem: return false; // may trap
+      default: return true;
+    }
+  }
+  return false;
+}
+
+/*
+ * A cheap value can be recomputed in the callback from what it was computed from, if that is saved anyhow
+ * or is smaller. This is decided for the whole function rather than for each async call: a callback saves
+ * the context of the async calls it makes, so whatever they recompute from must be available in it too.
+ * And it is, as long as a value recomputed at one call is recomputed at all of them.
+ */
+void LowerEmAsyncify::FindRematerializedVariables(std::vector<AsyncCallEntry> & Entries, InstructionSet & Remat) {
+  std::vector<ValueSet> Saved(Entries.size());
+  bool Changed = true;
+  while (Changed) {
+    Changed = false;
+    for (size_t i = 0; i < Entries.size(); ++i) {
+      Saved[i].clear();
+      FindContextVariables(Entries[i].LiveVariables, Remat, Saved[i]);
+    }
+    for (size_t i = 0; i < Entries.size() && !Changed; ++i) {
+      for (ValueSet::iterator VI = Saved[i].begin(), VE = Saved[i].end(); VI != VE; ++VI) {
+        Instruction *I = dyn_cast<Instruction>(*VI);
+        if (!I || !IsRematerializable(I)) continue;
+        uint64_t Size = DL->getTypeAllocSize(I->getType());
+        // wherever it is saved, recomputing it must not add more than it saves
+        bool Profitable = true;
+        for (size_t j = 0; j < Entries.size() && Profitable; ++j) {
+          if (!Saved[j].count(I)) continue;
+          uint64_t Added = 0;
+          unsigned NumAdded = 0;
+          for (unsigned k = 0, NumOperands = I->getNumOperands(); k < NumOperands; ++k) {
+            Value *O = I->getOperand(k);
+            if (isa<Constant>(O) || Saved[j].count(O)) continue;
+            if (Instruction *OI = dyn_cast<Instruction>(O)) {
+              if (Remat.count(OI)) {
+                Profitable = false; // keep it simple, do not recompute on top of what is recomputed but not saved
+                break;
+              }
+            }
+            Added += DL->getTypeAllocSize(O->getType());
+            NumAdded++;
+          }
+          if (NumAdded > 1 || (NumAdded == 1 && Added >= Size)) Profitable = false;
+        }
+        if (Profitable) {
+          Remat.insert(I);
+          Changed = true;
+          break;
+        }
+      }
+    }
+  }
+}
+
+void LowerEmAsyncify::AddContextVariable(Value *V, const InstructionSet & Remat, ValueSet & Saved) {
+  Instruction *I = dyn_cast<Instruction>(V);
+  if (!I || !Remat.count(I)) {
+    Saved.insert(V);
+    return;
+  }
+  for (unsigned i = 0, NumOperands = I->getNumOperands(); i < NumOperands; ++i) {
+    Value *O = I->getOperand(i);
+    if (!isa<Constant>(O)) AddContextVariable(O, Remat, Saved);
+  }
+}
+
+void LowerEmAsyncify::FindContextVariables(const Values & LiveVariables, const InstructionSet & Remat, ValueSet & Saved) {
+  for (Values::const_iterator VI = LiveVariables.begin(), VE = LiveVariables.end(); VI != VE; ++VI) {
+    AddContextVariable(*VI, Remat, Saved);
+  }
+}
+
+void LowerEmAsyncify::LayoutContext(AsyncCallEntry & Entry) {
+  Values &Vars = Entry.ContextVariables;
+  // the callback comes first, then the largest alignments first, so there is no padding between them
+  std::stable_sort(Vars.begin(), Vars.end(), [this](Value *A, Value *B) {
+    return DL->getABITypeAlignment(A->getType()) > DL->getABITypeAlignment(B->getType());
+  });
+  // except after the callback, if the first one has a larger alignment: fill that with the smallest ones
+  uint64_t Offset = DL->getPointerSize();
+  if (!Vars.empty()) {
+    uint64_t End = alignTo(Offset, DL->getABITypeAlignment(Vars[0]->getType()));
+    size_t Filled = 0;
+    while (Filled < Vars.size() - 1) {
+      Type *T = Vars.back()->getType();
+      uint64_t Next = alignTo(Offset, DL->getABITypeAlignment(T)) + DL->getTypeAllocSize(T);
+      if (Next > End) break;
+      Offset = Next;
+      Vars.insert(Vars.begin() + Filled, Vars.back());
+      Vars.pop_back();
+      Filled++;
+    }
+  }
+
+  SmallVector<Type*, 8> Types;
+  Types.push_back(CallbackFunctionType->getPointerTo());
+  for (Values::iterator VI = Vars.begin(), VE = Vars.end(); VI != VE; ++VI) {
+    Types.push_back((*VI)->getType());
+  }
+  Entry.ContextStructType = StructType::get(TheModule->getContext(), Types);
+}
+
+Value *LowerEmAsyncify::RestoreContextVariable(Value *V, DenseMap<Value*, Value*> & Restored, BasicBlock *EntryBlock) {
+  if (isa<Constant>(V)) return V;
+  Value *&R = Restored[V];
+  if (R) return R;
+  // not saved, so it is rematerialized
+  Instruction *I = cast<Instruction>(V)->clone();
+  for (unsigned i = 0, NumOperands = I->getNumOperands(); i < NumOperands; ++i) {
+    I->setOperand(i, RestoreContextVariable(I->getOperand(i), Restored, EntryBlock));
+  }
+  I->setName(V->getName());
+  EntryBlock->getInstList().push_back(I);
+  Restored[V] = I; // R may have been invalidated by the recursion
+  return I;
+}
+
 /*
  * Consider that F contains a call to G, both of which are async:
  *
@@ -467,26 +626,88 @@ void LowerEmAsyncify::transformAsyncFunction(Function &F, Instructions const& As
   // Pass 2
   // analyze the context variables and construct SaveAsyncCtxBlock for each async call
   // also calculate the size of the context and allocate the async context accordingly
+  // sibling async calls that save the same context share a SaveAsyncCtxBlock
+  for (std::vector<AsyncCallEntry>::iterator EI = AsyncCallEntries.begin(), EE = AsyncCallEntries.end();  EI != EE; ++EI) {
+    FindLiveVariables(*EI);
+  }
+  InstructionSet Remat;
+  FindRematerializedVariables(AsyncCallEntries, Remat);
+  DenseMap<Value*, unsigned> DefinitionOrder;
+  for (Function::arg_iterator AI = F.arg_begin(), AE = F.arg_end(); AI != AE; ++AI) {
+    DefinitionOrder[&*AI] = DefinitionOrder.size();
+  }
+  for (inst_iterator I = inst_begin(&F), E = inst_end(&F); I != E; ++I) {
+    DefinitionOrder[&*I] = DefinitionOrder.size();
+  }
+
+  struct SharedSaveAsyncCtx {
+    BasicBlock *Block;
+    PHINode *AsyncCtx, *Callback; // created once the block is shared
+  };
+  std::map<Values, SharedSaveAsyncCtx> SaveAsyncCtxBlocks;
   for (std::vector<AsyncCallEntry>::iterator EI = AsyncCallEntries.begin(), EE = AsyncCallEntries.end();  EI != EE; ++EI) {
     AsyncCallEntry & CurEntry = *EI;
 
-    // Collect everything to be saved
-    FindContextVariables(CurEntry);
+    // Collect everything to be saved, and pack the variables as a struct
+    {
+      ValueSet Saved;
+      FindContextVariables(CurEntry.LiveVariables, Remat, Saved);
+      CurEntry.ContextVariables.assign(Saved.begin(), Saved.end());
+      // in the order of definition, so that the same variables are laid out the same way at every call
+      std::sort(CurEntry.ContextVariables.begin(), CurEntry.ContextVariables.end(), [&](Value *A, Value *B) {
+        return DefinitionOrder[A] < DefinitionOrder[B];
+      });
+      LayoutContext(CurEntry);
+    }
+
+    // fix the size of allocation
+    uint64_t ContextBytes = DL->getTypeStoreSize(CurEntry.ContextStructType);
+    CurEntry.AllocAsyncCtxInst->setOperand(0, ConstantInt::get(I32, ContextBytes));
 
-    // Pack the variables as a struct
     {
-      // TODO: sort them from large memeber to small ones, in order to make the struct compact even when aligned
       SmallVector<Type*, 8> Types;
       Types.push_back(CallbackFunctionType->getPointerTo());
-      for (Values::iterator VI = CurEntry.ContextVariables.begin(), VE = CurEntry.ContextVariables.end(); VI != VE; ++VI) {
+      for (Values::iterator VI = CurEntry.LiveVariables.begin(), VE = CurEntry.LiveVariables.end(); VI != VE; ++VI) {
         Types.push_back((*VI)->getType());
       }
-      CurEntry.ContextStructType = StructType::get(TheModule->getContext(), Types);
+      uint64_t ContextBytesBefore = DL->getTypeStoreSize(StructType::get(TheModule->getContext(), Types));
+      DEBUG(dbgs() << "asyncify: call in " << F.getName() << " saves " << ContextBytes << " context bytes, "
+                   << ContextBytesBefore << " before packing and rematerialization\n");
+      NumAsyncCalls++;
+      NumContextBytesBefore += ContextBytesBefore;
+      NumContextBytes += ContextBytes;
+      for (Values::iterator VI = CurEntry.LiveVariables.begin(), VE = CurEntry.LiveVariables.end(); VI != VE; ++VI) {
+        if (Instruction *I = dyn_cast<Instruction>(*VI)) NumRematerialized += Remat.count(I);
+      }
     }
 
-    // fix the size of allocation
-    CurEntry.AllocAsyncCtxInst->setOperand(0, 
-        ConstantInt::get(I32, DL->getTypeStoreSize(CurEntry.ContextStructType)));
+    BasicBlock *AsyncCallBlock = CurEntry.AsyncCallInst->getParent();
+    std::map<Values, SharedSaveAsyncCtx>::iterator Shared = SaveAsyncCtxBlocks.find(CurEntry.ContextVariables);
+    if (Shared != SaveAsyncCtxBlocks.end()) {
+      // a sibling saves the same context, go to its SaveAsyncCtxBlock instead,
+      // telling it which context and callback to use
+      SharedSaveAsyncCtx &Save = Shared->second;
+      if (!Save.AsyncCtx) {
+        BasicBlock *First = *pred_begin(Save.Block);
+        Instruction *AsyncCtxAddr = &Save.Block->front();
+        StoreInst *StoreCallback = cast<StoreInst>(AsyncCtxAddr->getNextNode()->getNextNode());
+        Save.AsyncCtx = PHINode::Create(I32Ptr, 2, "AsyncCtx", AsyncCtxAddr);
+        Save.AsyncCtx->addIncoming(AsyncCtxAddr->getOperand(0), First);
+        AsyncCtxAddr->setOperand(0, Save.AsyncCtx);
+        Save.Callback = PHINode::Create(CallbackFunctionType->getPointerTo(), 2, "AsyncCallback", AsyncCtxAddr);
+        Save.Callback->addIncoming(StoreCallback->getValueOperand(), First);
+        StoreCallback->setOperand(0, Save.Callback);
+      }
+      Save.AsyncCtx->addIncoming(CurEntry.AllocAsyncCtxInst, AsyncCallBlock);
+      Save.Callback->addIncoming(CurEntry.CallbackFunc, AsyncCallBlock);
+      AsyncCallBlock->getTerminator()->setSuccessor(0, Save.Block);
+      CurEntry.SaveAsyncCtxBlock->eraseFromParent();
+      CurEntry.SaveAsyncCtxBlock = Save.Block;
+      NumSharedSaveBlocks++;
+      continue;
+    }
+    SharedSaveAsyncCtx Save = { CurEntry.SaveAsyncCtxBlock, nullptr, nullptr };
+    SaveAsyncCtxBlocks[CurEntry.ContextVariables] = Save;
 
     // construct SaveAsyncCtxBlock
     {
@@ -534,8 +755,9 @@ void LowerEmAsyncify::transformAsyncFunction(Function &F, Instructions const& As
     // Add the entry block
     // load variables from the context
     // also update VMap for CloneFunction
+    // then recompute the rematerialized ones
     BasicBlock *EntryBlock = BasicBlock::Create(TheModule->getContext(), "AsyncCallbackEntry", CurCallbackFunc);
-    std::vector<LoadInst *> LoadedAsyncVars;
+    DenseMap<Value*, Value*> Restored;
     {
       Type *AsyncCtxAddrTy = CurEntry.ContextStructType->getPointerTo();
       BitCastInst *AsyncCtxAddr = new BitCastInst(&*CurCallbackFunc->arg_begin(), AsyncCtxAddrTy, "AsyncCtx", EntryBlock);
@@ -545,10 +767,14 @@ void LowerEmAsyncify::transformAsyncFunction(Function &F, Instructions const& As
         Indices.push_back(ConstantInt::get(I32, 0));
         Indices.push_back(ConstantInt::get(I32, i + 1)); // the 0th element of AsyncCtx is the callback function
         GetElementPtrInst *AsyncVarAddr = GetElementPtrInst::Create(CurEntry.ContextStructType, AsyncCtxAddr, Indices, "", EntryBlock);
-        LoadedAsyncVars.push_back(new LoadInst(AsyncVarAddr, "", EntryBlock));
+        LoadInst *Loaded = new LoadInst(AsyncVarAddr, "", EntryBlock);
+        Restored[CurEntry.ContextVariables[i]] = Loaded;
         // we want the argument to be replaced by the loaded value
         if (isa<Argument>(CurEntry.ContextVariables[i]))
-          VMap[CurEntry.ContextVariables[i]] = LoadedAsyncVars.back();
+          VMap[CurEntry.ContextVariables[i]] = Loaded;
+      }
+      for (size_t i = 0; i < CurEntry.LiveVariables.size(); ++i) {
+        RestoreContextVariable(CurEntry.LiveVariables[i], Restored, EntryBlock);
       }
     }
 
@@ -630,6 +856,10 @@ void LowerEmAsyncify::transformAsyncFunction(Function &F, Instructions const& As
         // finally we go to the SaveAsyncCtxBlock, to register the callbac, save the local variables and leave
         BasicBlock *MappedSaveAsyncCtxBlock = cast<BasicBlock>(VMap[CurEntry.SaveAsyncCtxBlock]);
         BranchInst::Create(MappedSaveAsyncCtxBlock, NewBlock);
+        // if it is shared with siblings, it is told which context and callback to use
+        for (BasicBlock::iterator I = MappedSaveAsyncCtxBlock->begin(); PHINode *PN = dyn_cast<PHINode>(I); ++I) {
+          PN->addIncoming(PN->getIncomingValueForBlock(MappedAsyncCallBlock), NewBlock);
+        }
       }
     }
 
@@ -637,9 +867,14 @@ void LowerEmAsyncify::transformAsyncFunction(Function &F, Instructions const& As
     // applying loaded variables in the entry block
     {
       BasicBlockSet ReachableBlocks = FindReachableBlocksFrom(ResumeBlock);
-      for (size_t i = 0; i < CurEntry.ContextVariables.size(); ++i) {
-        Value *OrigVar = CurEntry.ContextVariables[i];
+      // what is saved only to recompute something else may still be needed when saving the context again
+      ValueSet Vars;
+      Vars.insert(CurEntry.LiveVariables.begin(), CurEntry.LiveVariables.end());
+      Vars.insert(CurEntry.ContextVariables.begin(), CurEntry.ContextVariables.end());
+      for (ValueSet::iterator VI = Vars.begin(), VE = Vars.end(); VI != VE; ++VI) {
+        Value *OrigVar = *VI;
         if (isa<Argument>(OrigVar)) continue; // already processed
+        Value *RestoredVar = Restored[OrigVar];
         Value *CurVar = VMap[OrigVar];
         assert(CurVar != MappedAsyncCall);
         if (Instruction *Inst = dyn_cast<Instruction>(CurVar)) {
@@ -649,13 +884,13 @@ void LowerEmAsyncify::transformAsyncFunction(Function &F, Instructions const& As
             // TODO: might need to check the safety first
             // TODO: can we create phi directly?
             AllocaInst *Addr = DemoteRegToStack(*Inst, false);
-            new StoreInst(LoadedAsyncVars[i], Addr, EntryBlock);
+            new StoreInst(RestoredVar, Addr, EntryBlock);
             ToPromote.push_back(Addr);
           } else {
             // The parent block is not reachable, which means there is no confliction
             // it's safe to replace Inst with the loaded value
-            assert(Inst != LoadedAsyncVars[i]); // this should only happen when OrigVar is an Argument
-            Inst->replaceAllUsesWith(LoadedAsyncVars[i]); 
+            assert(Inst != RestoredVar); // this should only happen when OrigVar is an Argument
+            Inst->replaceAllUsesWith(RestoredVar); 
           }
         }
       }
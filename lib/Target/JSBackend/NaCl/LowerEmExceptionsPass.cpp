@@ -25,11 +25,19 @@
 //
 //  3) Lower resume to emscripten_resume which receives non-aggregate inputs
 //
+// Before lowering, we infer which functions can never unwind, walking the call
+// graph bottom-up. Invokes of such functions do not need the pre/postinvoke
+// instrumentation (which goes through a JS trampoline) and become plain calls.
+//
 //===----------------------------------------------------------------------===//
 
 #include "llvm/Transforms/Scalar.h"
+#include "llvm/ADT/SCCIterator.h"
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/CallGraph.h"
+#include "llvm/IR/CallSite.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/DerivedTypes.h"
 #include "llvm/IR/Instructions.h"
@@ -49,6 +57,12 @@
 
 using namespace llvm;
 
+#define DEBUG_TYPE "loweremexceptions"
+
+STATISTIC(NumInvokes, "Number of invokes lowered to instrumented calls");
+STATISTIC(NumNoThrowInvokes, "Number of invokes of nothrow callees lowered to plain calls");
+STATISTIC(NumNoThrowFunctions, "Number of functions inferred not to unwind");
+
 static cl::list<std::string>
 Whitelist("emscripten-cpp-exceptions-whitelist",
           cl::desc("Enables C++ exceptions in emscripten (see emscripten EXCEPTION_CATCHING_WHITELIST option)"),
@@ -59,6 +73,10 @@ namespace {
     Function *GetHigh, *PreInvoke, *PostInvoke, *LandingPad, *Resume;
     Module *TheModule;
 
+    bool allowExceptionsIn(const std::set<std::string> &WhitelistSet, Function *F);
+    bool mayUnwind(Function *F, const SmallPtrSetImpl<Function*> &SCC, const std::set<std::string> &WhitelistSet);
+    void inferNoThrow(const std::set<std::string> &WhitelistSet);
+
   public:
     static char ID; // Pass identification, replacement for typeid
     explicit LowerEmExceptions() : ModulePass(ID), GetHigh(NULL), PreInvoke(NULL), PostInvoke(NULL), LandingPad(NULL), Resume(NULL), TheModule(NULL) {
@@ -85,6 +103,79 @@ bool canThrow(Value *V) {
   return true; // not a function, so an indirect call - can throw, we can't tell
 }
 
+static bool isLongjmp(Value *V) {
+  return isa<Function>(V) && V->getName() == "longjmp";
+}
+
+bool LowerEmExceptions::allowExceptionsIn(const std::set<std::string> &WhitelistSet, Function *F) {
+  return WhitelistSet.empty() || (WhitelistSet.count("_" + F->getName().str()) != 0);
+}
+
+// Whether F may let an exception escape, assuming the functions in its SCC do
+// not and using the nounwind attributes already inferred further down the call
+// graph.
+bool LowerEmExceptions::mayUnwind(Function *F, const SmallPtrSetImpl<Function*> &SCC, const std::set<std::string> &WhitelistSet) {
+  // Without a whitelist entry, invokes in F become plain calls, so whatever
+  // they call unwinds straight out of F.
+  bool InvokesCatch = allowExceptionsIn(WhitelistSet, F);
+  for (BasicBlock &BB : *F) {
+    for (Instruction &I : BB) {
+      if (isa<ResumeInst>(I)) return true;
+      CallSite CS(&I);
+      if (!CS) continue;
+      Value *Callee = CS.getCalledValue()->stripPointerCasts();
+      // longjmp is implemented by throwing in JS, and the invokes around a
+      // function that calls it must still catch that, even though it is
+      // declared nounwind.
+      if (isLongjmp(Callee)) return true;
+      if (CS.doesNotThrow()) continue;
+      if (CS.isInvoke() && InvokesCatch) continue; // the landingpad code is part of F and checked like the rest
+      if (!canThrow(Callee)) continue;
+      Function *CalleeF = dyn_cast<Function>(Callee);
+      if (!CalleeF) return true;
+      if (CalleeF->doesNotThrow() || SCC.count(CalleeF)) continue;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Mark as nounwind every defined function that provably never unwinds. SCCs
+// are visited callees first, so each one sees the results for everything it
+// calls outside of itself; an SCC is nounwind only if all its members are.
+void LowerEmExceptions::inferNoThrow(const std::set<std::string> &WhitelistSet) {
+  CallGraph CG(*TheModule);
+  for (scc_iterator<CallGraph*> I = scc_begin(&CG); !I.isAtEnd(); ++I) {
+    SmallPtrSet<Function*, 8> SCC;
+    bool Unknown = false;
+    for (CallGraphNode *Node : *I) {
+      Function *F = Node->getFunction();
+      // The external calling node stands for unknown code, and declarations
+      // and definitions that may be replaced at link time are opaque to us.
+      if (!F || F->isDeclaration() || F->isInterposable()) {
+        Unknown = true;
+        break;
+      }
+      SCC.insert(F);
+    }
+    if (Unknown) continue;
+    bool AllNoThrow = true;
+    for (Function *F : SCC) {
+      if (!F->doesNotThrow() && mayUnwind(F, SCC, WhitelistSet)) {
+        AllNoThrow = false;
+        break;
+      }
+    }
+    if (!AllNoThrow) continue;
+    for (Function *F : SCC) {
+      if (!F->doesNotThrow()) {
+        F->setDoesNotThrow();
+        NumNoThrowFunctions++;
+      }
+    }
+  }
+}
+
 bool LowerEmExceptions::runOnModule(Module &M) {
   TheModule = &M;
 
@@ -126,6 +217,8 @@ bool LowerEmExceptions::runOnModule(Module &M) {
 
   std::set<std::string> WhitelistSet(Whitelist.begin(), Whitelist.end());
 
+  inferNoThrow(WhitelistSet);
+
   bool Changed = false;
 
   unsigned InvokeId = 0;
@@ -136,16 +229,19 @@ bool LowerEmExceptions::runOnModule(Module &M) {
     std::vector<Instruction*> ToErase;
     std::set<LandingPadInst*> LandingPads;
 
-    bool AllowExceptionsInFunc = WhitelistSet.empty() || (WhitelistSet.count("_" + F->getName().str()) != 0);
+    bool AllowExceptionsInFunc = allowExceptionsIn(WhitelistSet, F);
 
     for (Function::iterator BB = F->begin(), E = F->end(); BB != E; ++BB) {
       // check terminator for invokes
       if (InvokeInst *II = dyn_cast<InvokeInst>(BB->getTerminator())) {
         LandingPads.insert(II->getLandingPadInst());
 
-        bool NeedInvoke = AllowExceptionsInFunc && canThrow(II->getCalledValue());
+        Function *Callee = dyn_cast<Function>(II->getCalledValue()->stripPointerCasts());
+        bool NeedInvoke = AllowExceptionsInFunc && canThrow(II->getCalledValue()) &&
+                          !II->doesNotThrow() && !(Callee && Callee->doesNotThrow());
 
         if (NeedInvoke) {
+          NumInvokes++;
           // If we are calling a function that is noreturn, we must remove that attribute. The code we
           // insert here does expect it to return, after we catch the exception.
           if (II->doesNotReturn()) {
@@ -178,6 +274,7 @@ bool LowerEmExceptions::runOnModule(Module &M) {
           BranchInst::Create(II->getUnwindDest(), II->getNormalDest(), Post1, II);
         } else {
           // This can't throw, and we don't need this invoke, just replace it with a call+branch
+          if (AllowExceptionsInFunc && canThrow(II->getCalledValue())) NumNoThrowInvokes++;
           SmallVector<Value*,16> CallArgs(II->op_begin(), II->op_end() - 3);
           CallInst *NewCall = CallInst::Create(II->getCalledValue(),
                                                CallArgs, "", II);
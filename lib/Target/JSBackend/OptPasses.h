@@ -12,11 +12,24 @@
 
 #include "llvm/Pass.h"
 
+#include <string>
+
 namespace llvm {
 
+  class FunctionType;
+  class Type;
+
   extern FunctionPass *createEmscriptenSimplifyAllocasPass();
   extern ModulePass *createEmscriptenRemoveLLVMAssumePass();
   extern FunctionPass *createEmscriptenExpandBigSwitchesPass();
+  extern FunctionPass *createEmscriptenOptimizeAtomicsPass();
+  extern ModulePass *createEmscriptenDevirtualizeCallsPass();
+  extern ModulePass *createEmscriptenOutlineRepeatedCodePass();
+
+  // The letters naming the function table that functions of a type go in, as
+  // in FUNCTION_TABLE_vii. These depend on the codegen options.
+  extern char getJSFunctionSignatureLetter(Type *T);
+  extern std::string getJSFunctionSignature(const FunctionType *F);
 
 } // End llvm namespace
 
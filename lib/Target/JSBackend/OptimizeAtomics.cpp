@@ -0,0 +1,246 @@
+//===-- OptimizeAtomics.cpp - Atomics cleanup for pthreads ------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// With pthreads, every atomic operation is emitted as a call into the JS
+// Atomics API, and a fence as a dummy read-modify-write of address 0,
+//
+//   (Atomics_add(HEAP32, 0, 0)|0) /* fence */
+//
+// All Atomics operations are sequentially consistent, whatever the ordering of
+// the LLVM operation they implement, so that dummy operation does not order
+// anything more than a real Atomics operation right next to it does. This pass
+//
+//  * removes fences that have an Atomics operation (or another fence) next to
+//    them in the same block, with no other memory access in between,
+//  * removes singlethread fences, which only constrain the compiler,
+//  * turns atomic operations on allocas that do not escape into plain loads and
+//    stores, as no other thread can see them.
+//
+//===----------------------------------------------------------------------===//
+
+#include "OptPasses.h"
+
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+
+#include <vector>
+
+#define DEBUG_TYPE "emscripten-optimize-atomics"
+
+namespace llvm {
+
+STATISTIC(NumFencesRemoved, "Number of fences removed");
+STATISTIC(NumAtomicsDemoted, "Number of atomic operations on private memory made plain");
+
+namespace {
+
+struct OptimizeAtomics : public FunctionPass {
+  static char ID; // Pass identification, replacement for typeid
+  OptimizeAtomics() : FunctionPass(ID) {}
+
+  bool runOnFunction(Function &F) override;
+
+  StringRef getPassName() const override { return "OptimizeAtomics"; }
+};
+
+char OptimizeAtomics::ID = 0;
+
+} // end anonymous namespace
+
+static bool isNaClCmpXchg(const Instruction *I) {
+  const IntrinsicInst *II = dyn_cast<IntrinsicInst>(I);
+  return II && II->getIntrinsicID() == Intrinsic::nacl_atomic_cmpxchg;
+}
+
+// Atomics only work on the integer heaps; float atomics are emulated by calls
+// into the runtime.
+static bool isAtomicsType(Type *T) {
+  return T->isPointerTy() || (T->isIntegerTy() && T->getIntegerBitWidth() <= 32);
+}
+
+static bool isAligned(unsigned Alignment, Type *T) {
+  unsigned Bytes = T->isPointerTy() ? 4 : T->getPrimitiveSizeInBits() / 8;
+  return Alignment == 0 || Alignment >= Bytes;
+}
+
+// Whether JSWriter emits I as a single Atomics operation.
+static bool isAtomicsOperation(const Instruction *I) {
+  if (const LoadInst *LI = dyn_cast<LoadInst>(I)) {
+    return (LI->isVolatile() || isStrongerThanUnordered(LI->getOrdering())) &&
+           isAtomicsType(LI->getType()) && isAligned(LI->getAlignment(), LI->getType());
+  }
+  if (const StoreInst *SI = dyn_cast<StoreInst>(I)) {
+    Type *T = SI->getValueOperand()->getType();
+    return (SI->isVolatile() || isStrongerThanUnordered(SI->getOrdering())) &&
+           isAtomicsType(T) && isAligned(SI->getAlignment(), T);
+  }
+  if (const AtomicRMWInst *RMWI = dyn_cast<AtomicRMWInst>(I)) {
+    // 32-bit exchanges are emulated in the runtime.
+    return isAtomicsType(RMWI->getType()) &&
+           !(RMWI->getOperation() == AtomicRMWInst::Xchg && RMWI->getType()->getPrimitiveSizeInBits() == 32);
+  }
+  if (const FenceInst *FI = dyn_cast<FenceInst>(I)) {
+    return FI->getSynchScope() == CrossThread;
+  }
+  return isNaClCmpXchg(I);
+}
+
+// Whether the memory behind an alloca is only ever accessed directly, so that
+// no other thread can reach it. Volatile accesses keep their meaning.
+static bool isThreadPrivate(AllocaInst *AI, std::vector<Instruction*> &Accesses) {
+  std::vector<Value*> Worklist(1, AI);
+  SmallPtrSet<Value*, 8> Visited;
+  while (!Worklist.empty()) {
+    Value *V = Worklist.back();
+    Worklist.pop_back();
+    if (!Visited.insert(V).second) continue;
+    for (User *U : V->users()) {
+      Instruction *I = cast<Instruction>(U);
+      if (isa<BitCastInst>(I) || isa<GetElementPtrInst>(I)) {
+        Worklist.push_back(I);
+      } else if (LoadInst *LI = dyn_cast<LoadInst>(I)) {
+        if (LI->isVolatile()) return false;
+        if (LI->isAtomic()) Accesses.push_back(LI);
+      } else if (StoreInst *SI = dyn_cast<StoreInst>(I)) {
+        if (SI->isVolatile() || SI->getValueOperand() == V) return false;
+        if (SI->isAtomic()) Accesses.push_back(SI);
+      } else if (AtomicRMWInst *RMWI = dyn_cast<AtomicRMWInst>(I)) {
+        if (RMWI->isVolatile() || RMWI->getValOperand() == V) return false;
+        Accesses.push_back(RMWI);
+      } else if (isNaClCmpXchg(I)) {
+        CallInst *CI = cast<CallInst>(I);
+        if (CI->getArgOperand(1) == V || CI->getArgOperand(2) == V) return false;
+        Accesses.push_back(CI);
+      } else if (IntrinsicInst *II = dyn_cast<IntrinsicInst>(I)) {
+        if (II->getIntrinsicID() != Intrinsic::lifetime_start &&
+            II->getIntrinsicID() != Intrinsic::lifetime_end) return false;
+      } else {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+static Value *getRMWResult(IRBuilder<> &Builder, AtomicRMWInst::BinOp Op, Value *Old, Value *Val) {
+  switch (Op) {
+    case AtomicRMWInst::Xchg: return Val;
+    case AtomicRMWInst::Add:  return Builder.CreateAdd(Old, Val);
+    case AtomicRMWInst::Sub:  return Builder.CreateSub(Old, Val);
+    case AtomicRMWInst::And:  return Builder.CreateAnd(Old, Val);
+    case AtomicRMWInst::Nand: return Builder.CreateNot(Builder.CreateAnd(Old, Val));
+    case AtomicRMWInst::Or:   return Builder.CreateOr(Old, Val);
+    case AtomicRMWInst::Xor:  return Builder.CreateXor(Old, Val);
+    case AtomicRMWInst::Max:  return Builder.CreateSelect(Builder.CreateICmpSGT(Old, Val), Old, Val);
+    case AtomicRMWInst::Min:  return Builder.CreateSelect(Builder.CreateICmpSLT(Old, Val), Old, Val);
+    case AtomicRMWInst::UMax: return Builder.CreateSelect(Builder.CreateICmpUGT(Old, Val), Old, Val);
+    case AtomicRMWInst::UMin: return Builder.CreateSelect(Builder.CreateICmpULT(Old, Val), Old, Val);
+    case AtomicRMWInst::BAD_BINOP: break;
+  }
+  llvm_unreachable("Bad atomic operation");
+}
+
+// Replaces an atomic operation on thread private memory with plain accesses.
+static void demote(Instruction *I) {
+  if (LoadInst *LI = dyn_cast<LoadInst>(I)) {
+    LI->setAtomic(AtomicOrdering::NotAtomic);
+    return;
+  }
+  if (StoreInst *SI = dyn_cast<StoreInst>(I)) {
+    SI->setAtomic(AtomicOrdering::NotAtomic);
+    return;
+  }
+  IRBuilder<> Builder(I);
+  Value *Ptr, *Result;
+  if (AtomicRMWInst *RMWI = dyn_cast<AtomicRMWInst>(I)) {
+    Ptr = RMWI->getPointerOperand();
+    Value *Old = Builder.CreateLoad(Ptr);
+    Builder.CreateStore(getRMWResult(Builder, RMWI->getOperation(), Old, RMWI->getValOperand()), Ptr);
+    Result = Old;
+  } else {
+    CallInst *CI = cast<CallInst>(I);
+    Ptr = CI->getArgOperand(0);
+    Value *Old = Builder.CreateLoad(Ptr);
+    Value *Equal = Builder.CreateICmpEQ(Old, CI->getArgOperand(1));
+    Builder.CreateStore(Builder.CreateSelect(Equal, CI->getArgOperand(2), Old), Ptr);
+    Result = Old;
+  }
+  Result->takeName(I);
+  I->replaceAllUsesWith(Result);
+  I->eraseFromParent();
+}
+
+// The next instruction in I's block that accesses memory, or null. Singlethread
+// fences are skipped, as they are removed.
+static Instruction *getNextMemoryAccess(Instruction *I) {
+  for (BasicBlock::iterator It(I->getNextNode()), E = I->getParent()->end(); It != E; ++It) {
+    const FenceInst *FI = dyn_cast<FenceInst>(&*It);
+    if (FI && FI->getSynchScope() == SingleThread) continue;
+    if (It->mayReadOrWriteMemory()) return &*It;
+  }
+  return nullptr;
+}
+
+bool OptimizeAtomics::runOnFunction(Function &F) {
+  bool Changed = false;
+
+  for (Instruction &I : F.getEntryBlock()) {
+    AllocaInst *AI = dyn_cast<AllocaInst>(&I);
+    if (!AI) continue;
+    std::vector<Instruction*> Accesses;
+    if (!isThreadPrivate(AI, Accesses)) continue;
+    for (Instruction *Access : Accesses) {
+      demote(Access);
+      NumAtomicsDemoted++;
+      Changed = true;
+    }
+  }
+
+  std::vector<Instruction*> Dead;
+  for (BasicBlock &BB : F) {
+    // Whether the last memory access we kept is an Atomics operation.
+    bool AfterAtomics = false;
+    for (Instruction &I : BB) {
+      FenceInst *FI = dyn_cast<FenceInst>(&I);
+      if (FI && (FI->getSynchScope() == SingleThread || AfterAtomics)) {
+        Dead.push_back(FI);
+        continue;
+      }
+      if (FI) {
+        Instruction *Next = getNextMemoryAccess(FI);
+        if (Next && isAtomicsOperation(Next)) {
+          Dead.push_back(FI);
+          continue;
+        }
+      }
+      if (I.mayReadOrWriteMemory()) {
+        AfterAtomics = isAtomicsOperation(&I);
+      }
+    }
+  }
+  for (Instruction *I : Dead) {
+    I->eraseFromParent();
+    NumFencesRemoved++;
+  }
+
+  return Changed || !Dead.empty();
+}
+
+//
+
+extern FunctionPass *createEmscriptenOptimizeAtomicsPass() {
+  return new OptimizeAtomics();
+}
+
+} // End llvm namespace
@@ -0,0 +1,464 @@
+//===-- OutlineRepeatedCode.cpp - Code size optimization --------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Finds straight-line instruction sequences that are repeated across the
+// module, and replaces them with calls to a shared helper function, when the
+// JS emitted for the calls and the helper is smaller than the JS emitted for
+// the copies. This runs on fully legalized IR, right before the JSWriter, so
+// the sizes we compare are close to what is actually shipped.
+//
+//===----------------------------------------------------------------------===//
+
+#include "OptPasses.h"
+#include "JSTargetTransformInfo.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Hashing.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instruction.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Transforms/Utils/ValueMapper.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+#define DEBUG_TYPE "outline-repeated-code"
+
+namespace llvm {
+
+STATISTIC(NumHelpers, "Number of helper functions created by outlining");
+STATISTIC(NumSequencesOutlined, "Number of instruction sequences replaced by helper calls");
+STATISTIC(NumInstructionsOutlined, "Number of instructions moved into helper functions");
+
+// Windows are at least this long, or a call is rarely smaller, and at most
+// this long, to bound the number of windows we hash.
+static const unsigned MinLength = 3;
+static const unsigned MaxLength = 16;
+
+// Helpers with many parameters need long calls.
+static const unsigned MaxInputs = 8;
+
+// The size of the call replacing a sequence, "$x=_f($a,$b)|0;" once the
+// helper's name is minified, and the overhead of defining a helper: its
+// header, the coercion of each parameter, a local declaration for each
+// instruction, and the return. These are in the same units as
+// JSTTIImpl::getEmittedBytes.
+static const unsigned CallBytes = 16;
+static const unsigned CallBytesPerInput = 4;
+static const unsigned HelperBytes = 16;
+static const unsigned HelperBytesPerInput = 12;
+static const unsigned HelperBytesPerInstruction = 5;
+static const unsigned HelperReturnBytes = 12;
+
+struct OutlineRepeatedCode : public ModulePass {
+  static char ID; // Pass identification, replacement for typeid
+  OutlineRepeatedCode() : ModulePass(ID) {}
+
+  bool runOnModule(Module &M) override;
+
+  StringRef getPassName() const override { return "OutlineRepeatedCode"; }
+
+private:
+  // A maximal range of consecutive outlinable instructions in a block.
+  struct Run {
+    std::vector<Instruction*> Insts;
+    // For each instruction, the position of its last user in the run, or ~0U
+    // if it is used anywhere outside the run.
+    std::vector<unsigned> LastUse;
+    // Whether each instruction was moved into a helper.
+    std::vector<bool> Claimed;
+  };
+  std::vector<Run> Runs;
+  DenseMap<const Instruction*, unsigned> Positions;
+
+  struct Window {
+    unsigned RunIndex;
+    unsigned Start;
+    unsigned Length;
+  };
+
+  // Everything we need to know to outline a window: the values it reads from
+  // outside, in order of first use, and the position of the single value it
+  // defines that is used afterwards, if any.
+  struct WindowShape {
+    SmallVector<Value*, MaxInputs> Inputs;
+    int Output = -1;
+  };
+
+  struct Candidate {
+    std::vector<Window> Windows;
+    unsigned Bytes;
+    unsigned NumInputs;
+    bool HasOutput;
+    int Benefit;
+  };
+
+  bool getPosition(const Run &R, const Value *V, unsigned &Pos);
+  void collectRuns(Module &M);
+  void hashWindows(std::unordered_map<size_t, std::vector<Window>> &Buckets);
+  bool describe(const Window &W, WindowShape &Shape);
+  bool isEquivalent(const Window &A, const Window &B);
+  unsigned getBytes(const Window &W);
+  static int getBenefit(unsigned Count, unsigned Bytes, unsigned NumInputs,
+                        bool HasOutput, unsigned Length);
+  Function *createHelper(Module &M, const Window &W, const WindowShape &Shape);
+  void replaceWithCall(Function *Helper, const Window &W, const WindowShape &Shape);
+};
+
+char OutlineRepeatedCode::ID = 0;
+
+// Types the JSWriter can pass into and return from a function without
+// changing the code around the call.
+static bool isInterfaceType(Type *Ty) {
+  return Ty->isIntegerTy(32) || Ty->isPointerTy() || Ty->isFloatTy() || Ty->isDoubleTy();
+}
+
+static bool isScalarType(Type *Ty) {
+  return (Ty->isIntegerTy() && Ty->getIntegerBitWidth() <= 32) ||
+         Ty->isPointerTy() || Ty->isFloatTy() || Ty->isDoubleTy();
+}
+
+// Whether an instruction can move into another function without changing
+// behavior: it must be pure or a plain memory access, and not touch the
+// control flow, the stack frame or any value the JSWriter treats specially.
+static bool isOutlinable(const Instruction *I) {
+  if (const LoadInst *LI = dyn_cast<LoadInst>(I)) {
+    if (!LI->isSimple()) return false;
+  } else if (const StoreInst *SI = dyn_cast<StoreInst>(I)) {
+    if (!SI->isSimple()) return false;
+  } else if (!isa<BinaryOperator>(I) && !isa<CmpInst>(I) && !isa<CastInst>(I) &&
+             !isa<SelectInst>(I) && !isa<GetElementPtrInst>(I)) {
+    return false;
+  }
+  if (!I->getType()->isVoidTy() && !isScalarType(I->getType()))
+    return false;
+  for (const Use &U : I->operands()) {
+    if (!isScalarType(U->getType()))
+      return false;
+    // Passing a stack slot to a helper would stop the JSWriter from
+    // nativizing it.
+    if (isa<AllocaInst>(U.get()))
+      return false;
+  }
+  return true;
+}
+
+// Find where V is in R, if it is there and was not outlined. Positions are per
+// run, so check that the instruction at that position really is V.
+bool OutlineRepeatedCode::getPosition(const Run &R, const Value *V, unsigned &Pos) {
+  const Instruction *I = dyn_cast<Instruction>(V);
+  if (!I) return false;
+  auto P = Positions.find(I);
+  if (P == Positions.end() || P->second >= R.Insts.size() ||
+      R.Insts[P->second] != I || R.Claimed[P->second])
+    return false;
+  Pos = P->second;
+  return true;
+}
+
+void OutlineRepeatedCode::collectRuns(Module &M) {
+  for (Function &F : M) {
+    if (F.isDeclaration()) continue;
+    for (BasicBlock &BB : F) {
+      Run Current;
+      for (Instruction &I : BB) {
+        if (isOutlinable(&I)) {
+          Positions[&I] = Current.Insts.size();
+          Current.Insts.push_back(&I);
+          continue;
+        }
+        if (Current.Insts.size() >= MinLength) Runs.push_back(std::move(Current));
+        Current = Run();
+      }
+    }
+  }
+
+  for (unsigned r = 0; r < Runs.size(); r++) {
+    Run &R = Runs[r];
+    R.LastUse.assign(R.Insts.size(), 0);
+    R.Claimed.assign(R.Insts.size(), false);
+    for (unsigned i = 0; i < R.Insts.size(); i++) {
+      for (const User *U : R.Insts[i]->users()) {
+        unsigned Pos;
+        if (!getPosition(R, U, Pos)) {
+          R.LastUse[i] = ~0U;
+          break;
+        }
+        R.LastUse[i] = std::max(R.LastUse[i], Pos);
+      }
+    }
+  }
+}
+
+// Hash every window by its shape, so that windows computing the same thing on
+// possibly different inputs land in the same bucket. Shapes are extended one
+// instruction at a time from each start.
+void OutlineRepeatedCode::hashWindows(std::unordered_map<size_t, std::vector<Window>> &Buckets) {
+  for (unsigned r = 0; r < Runs.size(); r++) {
+    const Run &R = Runs[r];
+    for (unsigned Start = 0; Start + MinLength <= R.Insts.size(); Start++) {
+      DenseMap<const Value*, unsigned> Inputs;
+      hash_code Hash = hash_value(0);
+      unsigned End = std::min<unsigned>(R.Insts.size(), Start + MaxLength);
+      for (unsigned Pos = Start; Pos < End; Pos++) {
+        const Instruction *I = R.Insts[Pos];
+        Hash = hash_combine(Hash, I->getOpcode(), I->getType(), I->getNumOperands());
+        if (const CmpInst *CI = dyn_cast<CmpInst>(I))
+          Hash = hash_combine(Hash, CI->getPredicate());
+        bool TooManyInputs = false;
+        for (const Use &U : I->operands()) {
+          const Value *V = U.get();
+          unsigned DefPos;
+          if (getPosition(R, V, DefPos) && DefPos >= Start) {
+            Hash = hash_combine(Hash, 0, Pos - DefPos);
+          } else if (isa<Constant>(V)) {
+            Hash = hash_combine(Hash, 1, V);
+          } else {
+            unsigned Index = Inputs.insert(std::make_pair(V, Inputs.size())).first->second;
+            Hash = hash_combine(Hash, 2, Index);
+            TooManyInputs |= !isInterfaceType(V->getType()) || Inputs.size() > MaxInputs;
+          }
+        }
+        // A longer window from this start would have the same problem.
+        if (TooManyInputs) break;
+        unsigned Length = Pos - Start + 1;
+        if (Length < MinLength) continue;
+        unsigned Outputs = 0;
+        for (unsigned i = Start; i <= Pos; i++) {
+          if (R.LastUse[i] > Pos) {
+            Outputs++;
+            if (!isInterfaceType(R.Insts[i]->getType())) Outputs = 2;
+          }
+        }
+        if (Outputs > 1) continue;
+        Buckets[hash_combine(Hash, Length)].push_back(Window{r, Start, Length});
+      }
+    }
+  }
+}
+
+bool OutlineRepeatedCode::describe(const Window &W, WindowShape &Shape) {
+  const Run &R = Runs[W.RunIndex];
+  unsigned End = W.Start + W.Length;
+  DenseMap<Value*, unsigned> Seen;
+  for (unsigned Pos = W.Start; Pos < End; Pos++) {
+    if (R.Claimed[Pos]) return false;
+    if (R.LastUse[Pos] >= End && !R.Insts[Pos]->getType()->isVoidTy()) {
+      if (Shape.Output >= 0) return false;
+      Shape.Output = Pos - W.Start;
+    }
+    for (Use &U : R.Insts[Pos]->operands()) {
+      Value *V = U.get();
+      unsigned DefPos;
+      if ((getPosition(R, V, DefPos) && DefPos >= W.Start) || isa<Constant>(V))
+        continue;
+      if (Seen.insert(std::make_pair(V, Shape.Inputs.size())).second)
+        Shape.Inputs.push_back(V);
+    }
+  }
+  return true;
+}
+
+// Whether two windows compute the same thing: the same operations, reading
+// the same constants, the same values from inside the window, and inputs
+// from outside it in the same pattern.
+bool OutlineRepeatedCode::isEquivalent(const Window &A, const Window &B) {
+  if (A.Length != B.Length) return false;
+  const Run &RA = Runs[A.RunIndex], &RB = Runs[B.RunIndex];
+  DenseMap<const Value*, unsigned> InputsA, InputsB;
+  for (unsigned k = 0; k < A.Length; k++) {
+    const Instruction *IA = RA.Insts[A.Start + k], *IB = RB.Insts[B.Start + k];
+    if (!IA->isSameOperationAs(IB) ||
+        IA->getRawSubclassOptionalData() != IB->getRawSubclassOptionalData())
+      return false;
+    if ((RA.LastUse[A.Start + k] >= A.Start + A.Length) !=
+        (RB.LastUse[B.Start + k] >= B.Start + B.Length))
+      return false;
+    for (unsigned o = 0; o < IA->getNumOperands(); o++) {
+      const Value *VA = IA->getOperand(o), *VB = IB->getOperand(o);
+      unsigned PA, PB;
+      bool InA = getPosition(RA, VA, PA) && PA >= A.Start;
+      bool InB = getPosition(RB, VB, PB) && PB >= B.Start;
+      if (InA != InB) return false;
+      if (InA) {
+        if (PA - A.Start != PB - B.Start) return false;
+      } else if (isa<Constant>(VA) || isa<Constant>(VB)) {
+        if (VA != VB) return false;
+      } else {
+        unsigned IndexA = InputsA.insert(std::make_pair(VA, InputsA.size())).first->second;
+        unsigned IndexB = InputsB.insert(std::make_pair(VB, InputsB.size())).first->second;
+        if (IndexA != IndexB) return false;
+      }
+    }
+  }
+  return true;
+}
+
+unsigned OutlineRepeatedCode::getBytes(const Window &W) {
+  const Run &R = Runs[W.RunIndex];
+  unsigned Bytes = 0;
+  for (unsigned Pos = W.Start; Pos < W.Start + W.Length; Pos++)
+    Bytes += JSTTIImpl::getEmittedBytes(R.Insts[Pos]);
+  return Bytes;
+}
+
+// How many bytes of JS we save by replacing Count copies of a sequence with
+// calls to one helper.
+int OutlineRepeatedCode::getBenefit(unsigned Count, unsigned Bytes, unsigned NumInputs,
+                                    bool HasOutput, unsigned Length) {
+  int Before = Count * Bytes;
+  int After = Count * (CallBytes + CallBytesPerInput * NumInputs) +
+              Bytes + HelperBytes + HelperBytesPerInput * NumInputs +
+              HelperBytesPerInstruction * Length + (HasOutput ? HelperReturnBytes : 0);
+  return Before - After;
+}
+
+Function *OutlineRepeatedCode::createHelper(Module &M, const Window &W,
+                                            const WindowShape &Shape) {
+  const Run &R = Runs[W.RunIndex];
+  LLVMContext &C = M.getContext();
+  SmallVector<Type*, MaxInputs> Params;
+  for (Value *V : Shape.Inputs)
+    Params.push_back(V->getType());
+  Type *RetTy = Shape.Output >= 0 ? R.Insts[W.Start + Shape.Output]->getType()
+                                  : Type::getVoidTy(C);
+  Function *Helper = Function::Create(FunctionType::get(RetTy, Params, false),
+                                      GlobalValue::InternalLinkage,
+                                      "emscripten_outlined", &M);
+  Helper->addFnAttr(Attribute::NoUnwind);
+  BasicBlock *Entry = BasicBlock::Create(C, "entry", Helper);
+
+  ValueToValueMapTy VMap;
+  unsigned i = 0;
+  for (Argument &Arg : Helper->args()) {
+    Arg.setName("in");
+    VMap[Shape.Inputs[i++]] = &Arg;
+  }
+  Instruction *Result = nullptr;
+  for (unsigned Pos = W.Start; Pos < W.Start + W.Length; Pos++) {
+    Instruction *Clone = R.Insts[Pos]->clone();
+    Clone->setName(R.Insts[Pos]->getName());
+    Clone->setDebugLoc(DebugLoc());
+    RemapInstruction(Clone, VMap, RF_NoModuleLevelChanges | RF_IgnoreMissingLocals);
+    Entry->getInstList().push_back(Clone);
+    VMap[R.Insts[Pos]] = Clone;
+    if (int(Pos - W.Start) == Shape.Output) Result = Clone;
+  }
+  ReturnInst::Create(C, Result, Entry);
+  return Helper;
+}
+
+void OutlineRepeatedCode::replaceWithCall(Function *Helper, const Window &W,
+                                          const WindowShape &Shape) {
+  Run &R = Runs[W.RunIndex];
+  Instruction *First = R.Insts[W.Start];
+  CallInst *Call = CallInst::Create(Helper, Shape.Inputs, "", First);
+  Call->setDebugLoc(First->getDebugLoc());
+  if (Shape.Output >= 0) {
+    Instruction *Output = R.Insts[W.Start + Shape.Output];
+    Call->takeName(Output);
+    Output->replaceAllUsesWith(Call);
+  }
+  for (unsigned Pos = W.Start + W.Length; Pos-- > W.Start; ) {
+    R.Insts[Pos]->replaceAllUsesWith(UndefValue::get(R.Insts[Pos]->getType()));
+    R.Insts[Pos]->eraseFromParent();
+    R.Claimed[Pos] = true;
+  }
+  NumInstructionsOutlined += W.Length;
+  NumSequencesOutlined++;
+}
+
+bool OutlineRepeatedCode::runOnModule(Module &M) {
+  collectRuns(M);
+
+  std::unordered_map<size_t, std::vector<Window>> Buckets;
+  hashWindows(Buckets);
+
+  // Split buckets into groups of truly equivalent windows, and keep those
+  // that would be worth outlining if every copy was used.
+  std::vector<Candidate> Candidates;
+  for (auto &Bucket : Buckets) {
+    std::vector<Window> &Windows = Bucket.second;
+    while (Windows.size() >= 2) {
+      Candidate Curr;
+      std::vector<Window> Rest;
+      for (const Window &W : Windows) {
+        if (Curr.Windows.empty() || isEquivalent(Curr.Windows[0], W))
+          Curr.Windows.push_back(W);
+        else
+          Rest.push_back(W);
+      }
+      Windows.swap(Rest);
+      if (Curr.Windows.size() < 2) continue;
+      WindowShape Shape;
+      describe(Curr.Windows[0], Shape);
+      Curr.Bytes = getBytes(Curr.Windows[0]);
+      Curr.NumInputs = Shape.Inputs.size();
+      Curr.HasOutput = Shape.Output >= 0;
+      Curr.Benefit = getBenefit(Curr.Windows.size(), Curr.Bytes, Curr.NumInputs,
+                                Curr.HasOutput, Curr.Windows[0].Length);
+      if (Curr.Benefit > 0) Candidates.push_back(std::move(Curr));
+    }
+  }
+  Buckets.clear();
+
+  // Greedily take the most profitable candidates first. A candidate may lose
+  // some copies to the ones before it, in which case it is rechecked.
+  std::stable_sort(Candidates.begin(), Candidates.end(),
+                   [](const Candidate &A, const Candidate &B) {
+                     return A.Benefit > B.Benefit;
+                   });
+  bool Changed = false;
+  for (Candidate &Curr : Candidates) {
+    std::vector<Window> Free;
+    for (const Window &W : Curr.Windows) {
+      // Copies in the same run were found in order, so only the previous one
+      // can overlap.
+      if (!Free.empty() && Free.back().RunIndex == W.RunIndex &&
+          Free.back().Start + Free.back().Length > W.Start)
+        continue;
+      WindowShape Shape;
+      if (!describe(W, Shape)) continue;
+      Free.push_back(W);
+    }
+    if (Free.size() < 2 ||
+        getBenefit(Free.size(), Curr.Bytes, Curr.NumInputs, Curr.HasOutput,
+                   Free[0].Length) <= 0)
+      continue;
+    Function *Helper = nullptr;
+    for (const Window &W : Free) {
+      // Describe each copy right before replacing it, as replacing the one
+      // before it may have changed its inputs.
+      WindowShape Shape;
+      describe(W, Shape);
+      if (!Helper) {
+        Helper = createHelper(M, W, Shape);
+        NumHelpers++;
+      }
+      replaceWithCall(Helper, W, Shape);
+    }
+    Changed = true;
+  }
+
+  Runs.clear();
+  Positions.clear();
+  return Changed;
+}
+
+//
+
+extern ModulePass *createEmscriptenOutlineRepeatedCodePass() {
+  return new OutlineRepeatedCode();
+}
+
+} // End llvm namespace
@@ -7,9 +7,11 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <algorithm>
 #include <list>
 #include <stack>
 #include <string>
+#include <vector>
 
 // uncomment these out to get LLVM errs() debugging support
 //#include <llvm/Support/raw_ostream.h>
@@ -29,8 +31,10 @@ static void PrintDebug(const char *Format, ...);
 
 #define INDENTATION 1
 
+// Output state is per thread, so that several reloopers can render at once.
+
 struct Indenter {
-  static int CurrIndent;
+  static thread_local int CurrIndent;
 
   static void Indent() { CurrIndent++; }
   static void Unindent() { CurrIndent--; }
@@ -39,10 +43,10 @@ struct Indenter {
 static void PrintIndented(const char *Format, ...);
 static void PutIndented(const char *String);
 
-static char *OutputBufferRoot = NULL;
-static char *OutputBuffer = NULL;
-static int OutputBufferSize = 0;
-static int OutputBufferOwned = false;
+static thread_local char *OutputBufferRoot = NULL;
+static thread_local char *OutputBuffer = NULL;
+static thread_local int OutputBufferSize = 0;
+static thread_local int OutputBufferOwned = false;
 
 static int LeftInOutputBuffer() {
   return OutputBufferSize - (OutputBuffer - OutputBufferRoot);
@@ -109,15 +113,15 @@ void PutIndented(const char *String) {
   *OutputBuffer = 0;
 }
 
-static int AsmJS = 0;
+static thread_local int AsmJS = 0;
 
 // Indenter
 
-int Indenter::CurrIndent = 1;
+thread_local int Indenter::CurrIndent = 1;
 
 // Branch
 
-Branch::Branch(const char *ConditionInit, const char *CodeInit) : Ancestor(NULL), Labeled(true) {
+Branch::Branch(const char *ConditionInit, const char *CodeInit) : Ancestor(NULL), Labeled(true), Weight(0) {
   Condition = ConditionInit ? strdup(ConditionInit) : NULL;
   Code = CodeInit ? strdup(CodeInit) : NULL;
 }
@@ -143,12 +147,27 @@ void Branch::Render(Block *Target, bool SetLabel) {
 
 // Block
 
-Block::Block(const char *CodeInit, const char *BranchVarInit) : Parent(NULL), Id(-1), IsCheckedMultipleEntry(false) {
-  Code = strdup(CodeInit);
-  BranchVar = BranchVarInit ? strdup(BranchVarInit) : NULL;
+// Copies a string into an arena
+static const char *ArenaStrdup(llvm::BumpPtrAllocator &Arena, const char *String) {
+  if (!String) return NULL;
+  size_t Size = strlen(String) + 1;
+  char *Copy = Arena.Allocate<char>(Size);
+  memcpy(Copy, String, Size);
+  return Copy;
+}
+
+Block::Block(const char *CodeInit, const char *BranchVarInit, llvm::BumpPtrAllocator *ArenaInit) : BranchesOut(ArenaInit), BranchesIn(ArenaInit), ProcessedBranchesOut(ArenaInit), ProcessedBranchesIn(ArenaInit), Parent(NULL), Id(-1), IsCheckedMultipleEntry(false), Frequency(0), Arena(ArenaInit) {
+  if (Arena) {
+    Code = ArenaStrdup(*Arena, CodeInit);
+    BranchVar = ArenaStrdup(*Arena, BranchVarInit);
+  } else {
+    Code = strdup(CodeInit);
+    BranchVar = BranchVarInit ? strdup(BranchVarInit) : NULL;
+  }
 }
 
 Block::~Block() {
+  if (Arena) return; // our strings and branches go away with the arena
   free(static_cast<void *>(const_cast<char *>(Code)));
   free(static_cast<void *>(const_cast<char *>(BranchVar)));
   for (BlockBranchMap::iterator iter = ProcessedBranchesOut.begin(); iter != ProcessedBranchesOut.end(); iter++) {
@@ -156,9 +175,27 @@ Block::~Block() {
   }
 }
 
-void Block::AddBranchTo(Block *Target, const char *Condition, const char *Code) {
+void Block::AddBranchTo(Block *Target, const char *Condition, const char *Code, uint64_t Weight) {
   assert(!contains(BranchesOut, Target)); // cannot add more than one branch to the same target
-  BranchesOut[Target] = new Branch(Condition, Code);
+  BranchesOut[Target] = NewBranch(Condition, Code, Weight);
+}
+
+Branch *Block::NewBranch(const char *Condition, const char *Code, uint64_t Weight) {
+  Branch *Ret;
+  if (!Arena) {
+    Ret = new Branch(Condition, Code);
+  } else {
+    // Branch's constructor would strdup, so construct without strings and give it arena copies
+    Ret = new (Arena->Allocate<Branch>()) Branch(NULL);
+    Ret->Condition = ArenaStrdup(*Arena, Condition);
+    Ret->Code = ArenaStrdup(*Arena, Code);
+  }
+  Ret->Weight = Weight;
+  return Ret;
+}
+
+void Block::DeleteBranch(Branch *Details) {
+  if (!Arena) delete Details;
 }
 
 void Block::Render(bool InLoop) {
@@ -206,7 +243,7 @@ void Block::Render(bool InLoop) {
   // *must* appear in the Simple (the Simple is the only one reaching the
   // Multiple), so we can remove the Multiple and add its independent groups
   // into the Simple's branches.
-  MultipleShape *Fused = Shape::IsMultiple(Parent->Next);
+  MultipleShape *Fused = Shape::IsSimple(Parent) ? Shape::IsMultiple(Parent->Next) : NULL;
   if (Fused) {
     PrintDebug("Fusing Multiple to Simple\n", 0);
     Parent->Next = Parent->Next->Next;
@@ -233,34 +270,70 @@ void Block::Render(bool InLoop) {
 
   bool useSwitch = BranchVar != NULL;
 
+  // The branches in the order we check them, each with the condition we check for it. The
+  // default comes last, without a condition. When we know how often branches are taken, we
+  // check the likely ones first. The order does not matter otherwise, as conditions do not
+  // overlap (we rely on that too when we omit the conditions of branches with no content).
+  struct CheckedBranch {
+    Block *Target;
+    Branch *Details;
+    const char *Condition;
+  };
+  std::vector<CheckedBranch> Checks;
+  for (BlockBranchMap::iterator iter = ProcessedBranchesOut.begin(); iter != ProcessedBranchesOut.end(); iter++) {
+    if (iter->first == DefaultTarget) continue;
+    assert(iter->second->Condition); // must have a condition if this is not the default target
+    Checks.push_back({ iter->first, iter->second, iter->second->Condition });
+  }
+  if (!useSwitch) {
+    std::stable_sort(Checks.begin(), Checks.end(), [](const CheckedBranch &A, const CheckedBranch &B) {
+      return A.Details->Weight > B.Details->Weight;
+    });
+  }
+  Branch *DefaultDetails = ProcessedBranchesOut[DefaultTarget];
+  Checks.push_back({ DefaultTarget, DefaultDetails, NULL });
+
+  auto GetSetCurrLabel = [&](Block *Target) {
+    return (SetLabel && Target->IsCheckedMultipleEntry) || ForceSetLabel;
+  };
+  auto GetHasFusedContent = [&](Block *Target) {
+    return Fused && contains(Fused->InnerMap, Target->Id);
+  };
+  auto GetHasContent = [&](const CheckedBranch &Check) {
+    return GetSetCurrLabel(Check.Target) || Check.Details->Type != Branch::Direct || GetHasFusedContent(Check.Target) || Check.Details->Code;
+  };
+
+  // In an if-else, the code of the if is what the condition falls through to, so put the likely
+  // side there: if the default is taken more often, check for it with the condition negated.
+  std::string NegatedCondition;
+  if (!useSwitch && Checks.size() == 2 && DefaultDetails->Weight > Checks[0].Details->Weight &&
+      GetHasContent(Checks[0]) && GetHasContent(Checks[1])) {
+    NegatedCondition = std::string("!(") + Checks[0].Condition + ")";
+    std::swap(Checks[0], Checks[1]);
+    Checks[0].Condition = NegatedCondition.c_str();
+    Checks[1].Condition = NULL;
+  }
+
   if (useSwitch) {
     PrintIndented("switch (%s) {\n", BranchVar);
   }
 
   std::string RemainingConditions;
   bool First = !useSwitch; // when using a switch, there is no special first
-  for (BlockBranchMap::iterator iter = ProcessedBranchesOut.begin();; iter++) {
-    Block *Target;
-    Branch *Details;
-    if (iter != ProcessedBranchesOut.end()) {
-      Target = iter->first;
-      if (Target == DefaultTarget) continue; // done at the end
-      Details = iter->second;
-      assert(Details->Condition); // must have a condition if this is not the default target
-    } else {
-      Target = DefaultTarget;
-      Details = ProcessedBranchesOut[DefaultTarget];
-    }
-    bool SetCurrLabel = (SetLabel && Target->IsCheckedMultipleEntry) || ForceSetLabel;
-    bool HasFusedContent = Fused && contains(Fused->InnerMap, Target->Id);
-    bool HasContent = SetCurrLabel || Details->Type != Branch::Direct || HasFusedContent || Details->Code;
-    if (iter != ProcessedBranchesOut.end()) {
+  for (unsigned i = 0; i < Checks.size(); i++) {
+    Block *Target = Checks[i].Target;
+    Branch *Details = Checks[i].Details;
+    const char *Condition = Checks[i].Condition;
+    bool SetCurrLabel = GetSetCurrLabel(Target);
+    bool HasFusedContent = GetHasFusedContent(Target);
+    bool HasContent = GetHasContent(Checks[i]);
+    if (Condition) {
       // If there is nothing to show in this branch, omit the condition
       if (useSwitch) {
-        PrintIndented("%s {\n", Details->Condition);
+        PrintIndented("%s {\n", Condition);
       } else {
         if (HasContent) {
-          PrintIndented("%sif (%s) {\n", First ? "" : "} else ", Details->Condition);
+          PrintIndented("%sif (%s) {\n", First ? "" : "} else ", Condition);
           First = false;
         } else {
           if (RemainingConditions.size() > 0) RemainingConditions += " && ";
@@ -269,7 +342,7 @@ void Block::Render(bool InLoop) {
             RemainingConditions += BranchVar;
             RemainingConditions += " == ";
           }
-          RemainingConditions += Details->Condition;
+          RemainingConditions += Condition;
           RemainingConditions += ")";
         }
       }
@@ -302,14 +375,13 @@ void Block::Render(bool InLoop) {
       Parent->Next->Render(InLoop);
       Parent->Next = NULL;
     }
-    if (useSwitch && iter != ProcessedBranchesOut.end()) {
+    if (useSwitch && Condition) {
       PrintIndented("break;\n");
     }
     if (!First) Indenter::Unindent();
     if (useSwitch) {
       PrintIndented("}\n");
     }
-    if (iter == ProcessedBranchesOut.end()) break;
   }
   if (!First) PrintIndented("}\n");
 
@@ -348,9 +420,16 @@ void MultipleShape::Render(bool InLoop) {
   RenderLoopPrefix();
 
   if (!UseSwitch) {
-    // emit an if-else chain
-    bool First = true;
+    // emit an if-else chain, checking first for the entries we reach most often
+    std::vector<IdShapeMap::iterator> Order;
     for (IdShapeMap::iterator iter = InnerMap.begin(); iter != InnerMap.end(); iter++) {
+      Order.push_back(iter);
+    }
+    std::stable_sort(Order.begin(), Order.end(), [&](IdShapeMap::iterator A, IdShapeMap::iterator B) {
+      return EntryFrequencies[A->first] > EntryFrequencies[B->first];
+    });
+    bool First = true;
+    for (IdShapeMap::iterator iter : Order) {
       if (AsmJS) {
         PrintIndented("%sif ((label|0) == %d) {\n", First ? "" : "else ", iter->first);
       } else {
@@ -404,7 +483,9 @@ void LoopShape::Render(bool InLoop) {
 // EmulatedShape
 
 void EmulatedShape::Render(bool InLoop) {
-  PrintIndented("label = %d;\n", Entry->Id);
+  if (Entry) {
+    PrintIndented("label = %d;\n", Entry->Id);
+  }
   if (Labeled) {
     PrintIndented("L%d: ", Id);
   }
@@ -430,12 +511,19 @@ void EmulatedShape::Render(bool InLoop) {
 
 // Relooper
 
-Relooper::Relooper() : Root(NULL), Emulate(false), MinSize(false), BlockIdCounter(1), ShapeIdCounter(0) { // block ID 0 is reserved for clearings
+Relooper::Relooper() : Root(NULL), Emulate(false), MinSize(false), BlockIdCounter(1), ShapeIdCounter(0), Visits(0) { // block ID 0 is reserved for clearings
 }
 
 Relooper::~Relooper() {
-  for (unsigned i = 0; i < Blocks.size(); i++) delete Blocks[i];
-  for (unsigned i = 0; i < Shapes.size(); i++) delete Shapes[i];
+  // Objects in the arena only need their destructors run, the arena frees their memory
+  for (unsigned i = 0; i < Blocks.size(); i++) {
+    if (Blocks[i]->Arena == &Arena) {
+      Blocks[i]->~Block();
+    } else {
+      delete Blocks[i];
+    }
+  }
+  for (unsigned i = 0; i < Shapes.size(); i++) Shapes[i]->~Shape();
 }
 
 void Relooper::AddBlock(Block *New, int Id) {
@@ -443,6 +531,12 @@ void Relooper::AddBlock(Block *New, int Id) {
   Blocks.push_back(New);
 }
 
+Block *Relooper::AddBlock(const char *Code, const char *BranchVar, int Id) {
+  Block *New = new (Arena.Allocate<Block>()) Block(Code, BranchVar, &Arena);
+  AddBlock(New, Id);
+  return New;
+}
+
 struct RelooperRecursor {
   Relooper *Parent;
   RelooperRecursor(Relooper *ParentInit) : Parent(ParentInit) {}
@@ -453,15 +547,19 @@ typedef std::list<Block*> BlockList;
 void Relooper::Calculate(Block *Entry) {
   // Scan and optimize the input
   struct PreOptimizer : public RelooperRecursor {
-    PreOptimizer(Relooper *Parent) : RelooperRecursor(Parent) {}
+    PreOptimizer(Relooper *Parent) : RelooperRecursor(Parent), Entry(NULL) {}
+    Block *Entry;
     BlockSet Live;
+    BlockSet Irreducible; // Blocks in irreducible loops that should be emulated
 
     void FindLive(Block *Root) {
+      Entry = Root;
       BlockList ToInvestigate;
       ToInvestigate.push_back(Root);
       while (ToInvestigate.size() > 0) {
         Block *Curr = ToInvestigate.front();
         ToInvestigate.pop_front();
+        Parent->Visits++;
         if (contains(Live, Curr)) continue;
         Live.insert(Curr);
         for (BlockBranchMap::iterator iter = Curr->BranchesOut.begin(); iter != Curr->BranchesOut.end(); iter++) {
@@ -492,17 +590,17 @@ void Relooper::Calculate(Block *Entry) {
         PrintDebug("Splitting block %d\n", Original->Id);
         for (BlockSet::iterator iter = Original->BranchesIn.begin(); iter != Original->BranchesIn.end(); iter++) {
           Block *Prior = *iter;
-          Block *Split = new Block(Original->Code, Original->BranchVar);
-          Parent->AddBlock(Split, Original->Id);
+          Block *Split = Parent->AddBlock(Original->Code, Original->BranchVar, Original->Id);
           Split->BranchesIn.insert(Prior);
           Branch *Details = Prior->BranchesOut[Original];
-          Prior->BranchesOut[Split] = new Branch(Details->Condition, Details->Code);
-          delete Details;
+          Split->Frequency = Details->Weight; // this copy runs only when coming from Prior
+          Prior->BranchesOut[Split] = Prior->NewBranch(Details->Condition, Details->Code, Details->Weight);
+          Prior->DeleteBranch(Details);
           Prior->BranchesOut.erase(Original);
           for (BlockBranchMap::iterator iter = Original->BranchesOut.begin(); iter != Original->BranchesOut.end(); iter++) {
             Block *Post = iter->first;
             Branch *Details = iter->second;
-            Split->BranchesOut[Post] = new Branch(Details->Condition, Details->Code);
+            Split->BranchesOut[Post] = Split->NewBranch(Details->Condition, Details->Code, Details->Weight);
             Post->BranchesIn.insert(Split);
           }
           Splits.insert(Split);
@@ -522,6 +620,204 @@ void Relooper::Calculate(Block *Entry) {
       }
       //DebugDump(Live, "after");
     }
+
+    // Finds the strongly connected components of the live blocks that have more than one block,
+    // using Tarjan's algorithm. This is done iteratively, as a recursion could blow the stack
+    // on huge functions. Each component is listed in the order we first reached its blocks.
+    void FindLoops(std::vector<std::vector<Block*> > &Loops) {
+      struct BlockInfo {
+        unsigned Index, LowLink;
+        unsigned StackPos; // where the block is on Stack, while OnStack
+        bool OnStack;
+      };
+      std::unordered_map<Block*, BlockInfo> Infos; // references are stable as this grows
+      std::vector<Block*> Stack;
+      std::vector<std::pair<Block*, BlockBranchMap::iterator> > Work;
+      unsigned Counter = 0;
+      for (BlockSet::iterator iter = Live.begin(); iter != Live.end(); iter++) {
+        Block *Root = *iter;
+        if (contains(Infos, Root)) continue;
+        Work.push_back(std::make_pair(Root, Root->BranchesOut.begin()));
+        Infos[Root] = { Counter, Counter, (unsigned)Stack.size(), true };
+        Counter++;
+        Stack.push_back(Root);
+        while (Work.size() > 0) {
+          Parent->Visits++;
+          Block *Curr = Work.back().first;
+          BlockInfo &CurrInfo = Infos[Curr];
+          if (Work.back().second != Curr->BranchesOut.end()) {
+            Block *Target = (Work.back().second++)->first;
+            std::unordered_map<Block*, BlockInfo>::iterator Known = Infos.find(Target);
+            if (Known == Infos.end()) {
+              Work.push_back(std::make_pair(Target, Target->BranchesOut.begin()));
+              Infos[Target] = { Counter, Counter, (unsigned)Stack.size(), true };
+              Counter++;
+              Stack.push_back(Target);
+            } else if (Known->second.OnStack) {
+              CurrInfo.LowLink = std::min(CurrInfo.LowLink, Known->second.Index);
+            }
+            continue;
+          }
+          Work.pop_back();
+          if (Work.size() > 0) {
+            BlockInfo &ParentInfo = Infos[Work.back().first];
+            ParentInfo.LowLink = std::min(ParentInfo.LowLink, CurrInfo.LowLink);
+          }
+          if (CurrInfo.LowLink != CurrInfo.Index) continue;
+          // Curr is the root of a component, which is everything above it on the stack
+          std::vector<Block*>::iterator Begin = Stack.begin() + CurrInfo.StackPos;
+          for (std::vector<Block*>::iterator iter = Begin; iter != Stack.end(); iter++) {
+            Infos[*iter].OnStack = false;
+          }
+          if (Stack.end() - Begin > 1) {
+            Loops.push_back(std::vector<Block*>(Begin, Stack.end()));
+          }
+          Stack.erase(Begin, Stack.end());
+        }
+      }
+    }
+
+    // Loops that can be entered at more than one block are irreducible, and cannot be expressed
+    // with structured control flow without some help. We can split them, making copies of the
+    // blocks that are reached from the extra entries before getting to the main one, mark them
+    // to be emulated with a label-switch loop, or leave them to become a loop with multiple entries,
+    // whichever costs less code. Note that splitting is only possible if those blocks do not loop
+    // among themselves.
+    void HandleIrreducibleLoops() {
+      // Rough costs in bytes of output, used to choose how to handle each loop below.
+      const unsigned SplitBudget = 100;        // code we will duplicate per extra entry to avoid it; splitting also speeds up the loop
+      const unsigned SplitBudgetMinSize = 30;  // the same when optimizing for size, where only small copies pay off
+      const unsigned EmulatedBlockCost = 20;   // a switch case and its break
+      const unsigned EmulatedBranchCost = 30;  // a label assignment and a continue
+      const unsigned EntryCost = 10;           // a label check per entry, repeated as nested loops check it again
+
+      std::vector<std::vector<Block*> > Loops;
+      FindLoops(Loops);
+
+      for (unsigned i = 0; i < Loops.size(); i++) {
+        BlockSet Members;
+        for (unsigned j = 0; j < Loops[i].size(); j++) {
+          Members.insert(Loops[i][j]);
+        }
+        BlockSet LoopEntries;
+        for (BlockSet::iterator iter = Members.begin(); iter != Members.end(); iter++) {
+          Block *Curr = *iter;
+          if (Curr == Entry) LoopEntries.insert(Curr);
+          for (BlockSet::iterator iter = Curr->BranchesIn.begin(); iter != Curr->BranchesIn.end(); iter++) {
+            if (!contains(Members, *iter)) {
+              LoopEntries.insert(Curr);
+              break;
+            }
+          }
+        }
+        if (LoopEntries.size() <= 1) continue; // a normal loop
+
+        // The main entry is the function entry if it is in here, otherwise the first entry we reached.
+        // Find what can be reached from the other entries without passing through it.
+        Block *Header = contains(LoopEntries, Entry) ? Entry : *LoopEntries.begin();
+        BlockSet ToSplit;
+        BlockList Queue;
+        for (BlockSet::iterator iter = LoopEntries.begin(); iter != LoopEntries.end(); iter++) {
+          if (*iter != Header) Queue.push_back(*iter);
+        }
+        while (Queue.size() > 0) {
+          Block *Curr = Queue.front();
+          Queue.pop_front();
+          Parent->Visits++;
+          if (contains(ToSplit, Curr)) continue;
+          ToSplit.insert(Curr);
+          for (BlockBranchMap::iterator iter = Curr->BranchesOut.begin(); iter != Curr->BranchesOut.end(); iter++) {
+            Block *Target = iter->first;
+            if (Target != Header && contains(Members, Target)) Queue.push_back(Target);
+          }
+        }
+
+        // There are three ways to handle the loop. A multiple-entry loop is structured code, but every
+        // extra entry costs a label assignment on the branches into it and a label check inside it, and
+        // as nested loops can check it again, that grows with the number of entries. Splitting costs the
+        // code we duplicate, and leaves a loop that runs faster as well. Emulating costs about a switch
+        // case per block and a label assignment and continue per branch, which only wins when most of
+        // the loop's blocks are entries anyhow.
+        unsigned Extra = LoopEntries.size() - 1;
+        unsigned SplitSize = 0;
+        for (BlockSet::iterator iter = ToSplit.begin(); iter != ToSplit.end(); iter++) {
+          SplitSize += strlen((*iter)->Code);
+        }
+        if (SplitSize <= (Parent->MinSize ? SplitBudgetMinSize : SplitBudget)*Extra && SplitLoop(ToSplit, Members)) continue;
+        unsigned EmulateSize = 0;
+        for (BlockSet::iterator iter = Members.begin(); iter != Members.end(); iter++) {
+          EmulateSize += EmulatedBlockCost + EmulatedBranchCost*(*iter)->BranchesOut.size();
+        }
+        if (EntryCost*LoopEntries.size()*LoopEntries.size() > EmulateSize) {
+          PrintDebug("Emulating irreducible loop with %d blocks\n", Members.size());
+          for (BlockSet::iterator iter = Members.begin(); iter != Members.end(); iter++) {
+            Irreducible.insert(*iter);
+          }
+        }
+      }
+    }
+
+    // Copies the ToSplit blocks of a loop, and redirects branches from outside of the loop to the copies.
+    // The originals are then reached only from inside the loop. Returns false if we cannot do that,
+    // because ToSplit has a loop of its own, which would remain irreducible among the copies.
+    bool SplitLoop(BlockSet &ToSplit, BlockSet &Members) {
+      // Check for a loop by repeatedly removing blocks with no incoming branches from within ToSplit
+      std::unordered_map<Block*, unsigned> Incoming;
+      BlockList Ready;
+      for (BlockSet::iterator iter = ToSplit.begin(); iter != ToSplit.end(); iter++) {
+        Block *Curr = *iter;
+        unsigned Count = 0;
+        for (BlockSet::iterator iter = Curr->BranchesIn.begin(); iter != Curr->BranchesIn.end(); iter++) {
+          if (contains(ToSplit, *iter)) Count++;
+        }
+        Incoming[Curr] = Count;
+        if (!Count) Ready.push_back(Curr);
+      }
+      unsigned Ordered = 0;
+      while (Ready.size() > 0) {
+        Block *Curr = Ready.front();
+        Ready.pop_front();
+        Ordered++;
+        for (BlockBranchMap::iterator iter = Curr->BranchesOut.begin(); iter != Curr->BranchesOut.end(); iter++) {
+          if (contains(ToSplit, iter->first) && --Incoming[iter->first] == 0) Ready.push_back(iter->first);
+        }
+      }
+      if (Ordered != ToSplit.size()) return false;
+
+      PrintDebug("Splitting irreducible loop, copying %d blocks\n", ToSplit.size());
+      std::unordered_map<Block*, Block*> Copies;
+      for (BlockSet::iterator iter = ToSplit.begin(); iter != ToSplit.end(); iter++) {
+        Block *Original = *iter;
+        Block *Copy = Parent->AddBlock(Original->Code, Original->BranchVar, Original->Id);
+        Copy->Frequency = Original->Frequency;
+        Copies[Original] = Copy;
+        Live.insert(Copy);
+      }
+      for (BlockSet::iterator iter = ToSplit.begin(); iter != ToSplit.end(); iter++) {
+        Block *Original = *iter;
+        Block *Copy = Copies[Original];
+        // The copy branches where the original does, but stays among the copies
+        for (BlockBranchMap::iterator iter = Original->BranchesOut.begin(); iter != Original->BranchesOut.end(); iter++) {
+          Block *Target = contains(ToSplit, iter->first) ? Copies[iter->first] : iter->first;
+          Branch *Details = iter->second;
+          Copy->BranchesOut[Target] = Copy->NewBranch(Details->Condition, Details->Code, Details->Weight);
+          Target->BranchesIn.insert(Copy);
+        }
+        // Branches from outside the loop now go to the copy
+        for (BlockSet::iterator iter = Original->BranchesIn.begin(); iter != Original->BranchesIn.end();) {
+          Block *Prior = *iter;
+          iter++; // carefully increment iter before erasing
+          if (contains(Members, Prior)) continue;
+          Branch *Details = Prior->BranchesOut[Original];
+          Prior->BranchesOut[Copy] = Prior->NewBranch(Details->Condition, Details->Code, Details->Weight);
+          Prior->DeleteBranch(Details);
+          Prior->BranchesOut.erase(Original);
+          Original->BranchesIn.erase(Prior);
+          Copy->BranchesIn.insert(Prior);
+        }
+      }
+      return true;
+    }
   };
   PreOptimizer Pre(this);
   Pre.FindLive(Entry);
@@ -536,11 +832,14 @@ void Relooper::Calculate(Block *Entry) {
   }
 
   if (!Emulate && !MinSize) Pre.SplitDeadEnds();
+  if (!Emulate) Pre.HandleIrreducibleLoops();
 
   // Recursively process the graph
 
   struct Analyzer : public RelooperRecursor {
-    Analyzer(Relooper *Parent) : RelooperRecursor(Parent) {}
+    BlockSet &Irreducible;
+
+    Analyzer(Relooper *Parent, BlockSet &IrreducibleInit) : RelooperRecursor(Parent), Irreducible(IrreducibleInit) {}
 
     // Add a shape to the list of shapes in this Relooper calculation
     void Notice(Shape *New) {
@@ -552,40 +851,59 @@ void Relooper::Calculate(Block *Entry) {
     // will appear
     void GetBlocksOut(Block *Source, BlockSet& Entries, BlockSet *LimitTo=NULL) {
       for (BlockBranchMap::iterator iter = Source->BranchesOut.begin(); iter != Source->BranchesOut.end(); iter++) {
+        Parent->Visits++;
         if (!LimitTo || contains(*LimitTo, iter->first)) {
           Entries.insert(iter->first);
         }
       }
     }
 
+    // Converts/processes a single branch from Prior to Target
+    void SolipsizeBranch(Block *Prior, Block *Target, Branch::FlowType Type, Shape *Ancestor) {
+      Branch *PriorOut = Prior->BranchesOut[Target];
+      PriorOut->Ancestor = Ancestor;
+      PriorOut->Type = Type;
+      if (MultipleShape *Multiple = Shape::IsMultiple(Ancestor)) {
+        Multiple->Breaks++; // We are breaking out of this Multiple, so need a loop
+      }
+      Target->BranchesIn.erase(Prior);
+      Target->ProcessedBranchesIn.insert(Prior);
+      Prior->BranchesOut.erase(Target);
+      Prior->ProcessedBranchesOut[Target] = PriorOut;
+      PrintDebug("  eliminated branch from %d\n", Prior->Id);
+    }
+
     // Converts/processes all branchings to a specific target
     void Solipsize(Block *Target, Branch::FlowType Type, Shape *Ancestor, BlockSet &From) {
       PrintDebug("Solipsizing branches into %d\n", Target->Id);
       DebugDump(From, "  relevant to solipsize: ");
+      // Walk whichever side is smaller. A block that many others branch to (the join
+      // after a huge switch, say) is solipsized once per group of a Multiple with From
+      // being just that group, so always scanning BranchesIn would be quadratic. The
+      // order we process branches in here does not affect the result.
+      if (From.size() < Target->BranchesIn.size()) {
+        for (BlockSet::iterator iter = From.begin(); iter != From.end(); iter++) {
+          Block *Prior = *iter;
+          Parent->Visits++;
+          if (contains(Target->BranchesIn, Prior)) {
+            SolipsizeBranch(Prior, Target, Type, Ancestor);
+          }
+        }
+        return;
+      }
       for (BlockSet::iterator iter = Target->BranchesIn.begin(); iter != Target->BranchesIn.end();) {
         Block *Prior = *iter;
-        if (!contains(From, Prior)) {
-          iter++;
-          continue;
-        }
-        Branch *PriorOut = Prior->BranchesOut[Target];
-        PriorOut->Ancestor = Ancestor;
-        PriorOut->Type = Type;
-        if (MultipleShape *Multiple = Shape::IsMultiple(Ancestor)) {
-          Multiple->Breaks++; // We are breaking out of this Multiple, so need a loop
-        }
         iter++; // carefully increment iter before erasing
-        Target->BranchesIn.erase(Prior);
-        Target->ProcessedBranchesIn.insert(Prior);
-        Prior->BranchesOut.erase(Target);
-        Prior->ProcessedBranchesOut[Target] = PriorOut;
-        PrintDebug("  eliminated branch from %d\n", Prior->Id);
+        Parent->Visits++;
+        if (contains(From, Prior)) {
+          SolipsizeBranch(Prior, Target, Type, Ancestor);
+        }
       }
     }
 
     Shape *MakeSimple(BlockSet &Blocks, Block *Inner, BlockSet &NextEntries) {
       PrintDebug("creating simple block with block #%d\n", Inner->Id);
-      SimpleShape *Simple = new SimpleShape;
+      SimpleShape *Simple = Parent->NewShape<SimpleShape>();
       Notice(Simple);
       Simple->Inner = Inner;
       Inner->Parent = Simple;
@@ -603,7 +921,7 @@ void Relooper::Calculate(Block *Entry) {
 
     Shape *MakeEmulated(BlockSet &Blocks, Block *Entry, BlockSet &NextEntries) {
       PrintDebug("creating emulated block with entry #%d and everything it can reach, %d blocks\n", Entry->Id, Blocks.size());
-      EmulatedShape *Emulated = new EmulatedShape;
+      EmulatedShape *Emulated = Parent->NewShape<EmulatedShape>();
       Notice(Emulated);
       Emulated->Entry = Entry;
       for (BlockSet::iterator iter = Blocks.begin(); iter != Blocks.end(); iter++) {
@@ -616,14 +934,14 @@ void Relooper::Calculate(Block *Entry) {
       return Emulated;
     }
 
-    Shape *MakeLoop(BlockSet &Blocks, BlockSet& Entries, BlockSet &NextEntries) {
-      // Find the inner blocks in this loop. Proceed backwards from the entries until
-      // you reach a seen block, collecting as you go.
-      BlockSet InnerBlocks;
+    // Find the inner blocks in a loop, removing them from Blocks, and the blocks the loop exits to.
+    // Proceed backwards from the entries until you reach a seen block, collecting as you go.
+    void FindLoopBlocks(BlockSet &Blocks, BlockSet& Entries, BlockSet &InnerBlocks, BlockSet &NextEntries) {
       BlockSet Queue = Entries;
       while (Queue.size() > 0) {
         Block *Curr = *(Queue.begin());
         Queue.erase(Queue.begin());
+        Parent->Visits++;
         if (!contains(InnerBlocks, Curr)) {
           // This element is new, mark it as inner and remove from outer
           InnerBlocks.insert(Curr);
@@ -650,11 +968,41 @@ void Relooper::Calculate(Block *Entry) {
         Block *Curr = *iter;
         for (BlockBranchMap::iterator iter = Curr->BranchesOut.begin(); iter != Curr->BranchesOut.end(); iter++) {
           Block *Possible = iter->first;
+          Parent->Visits++;
           if (!contains(InnerBlocks, Possible)) {
             NextEntries.insert(Possible);
           }
         }
       }
+    }
+
+    // Emulates a loop that has more than one entry, which we could not make reducible: its blocks
+    // become cases in a switch on label, in a loop, while the code around it stays structured. Branches
+    // into the loop set label to the block they go to, as with the entries of a Multiple.
+    Shape *MakeEmulatedLoop(BlockSet &Blocks, BlockSet& Entries, BlockSet &NextEntries) {
+      BlockSet InnerBlocks;
+      FindLoopBlocks(Blocks, Entries, InnerBlocks, NextEntries);
+      PrintDebug("creating emulated loop with %d entries and %d blocks\n", Entries.size(), InnerBlocks.size());
+      EmulatedShape *Emulated = Parent->NewShape<EmulatedShape>();
+      Notice(Emulated);
+      for (BlockSet::iterator iter = Entries.begin(); iter != Entries.end(); iter++) {
+        (*iter)->IsCheckedMultipleEntry = true;
+      }
+      for (BlockSet::iterator iter = InnerBlocks.begin(); iter != InnerBlocks.end(); iter++) {
+        Block *Curr = *iter;
+        Emulated->Blocks.insert(Curr);
+        Curr->Parent = Emulated;
+        Solipsize(Curr, Branch::Continue, Emulated, InnerBlocks);
+      }
+      for (BlockSet::iterator iter = NextEntries.begin(); iter != NextEntries.end(); iter++) {
+        Solipsize(*iter, Branch::Break, Emulated, InnerBlocks);
+      }
+      return Emulated;
+    }
+
+    Shape *MakeLoop(BlockSet &Blocks, BlockSet& Entries, BlockSet &NextEntries) {
+      BlockSet InnerBlocks;
+      FindLoopBlocks(Blocks, Entries, InnerBlocks, NextEntries);
 
 #if 0
       // We can avoid multiple next entries by hoisting them into the loop.
@@ -710,7 +1058,7 @@ void Relooper::Calculate(Block *Entry) {
       DebugDump(Blocks, "  outer blocks:");
       DebugDump(NextEntries, "  outer entries:");
 
-      LoopShape *Loop = new LoopShape();
+      LoopShape *Loop = Parent->NewShape<LoopShape>();
       Notice(Loop);
 
       // Solipsize the loop, replacing with break/continue and marking branches as Processed (will not affect later calculations)
@@ -733,19 +1081,21 @@ void Relooper::Calculate(Block *Entry) {
     // ignore directly reaching the entry itself by another entry.
     //   @param Ignore - previous blocks that are irrelevant
     void FindIndependentGroups(BlockSet &Entries, BlockBlockSetMap& IndependentGroups, BlockSet *Ignore=NULL) {
-      typedef std::map<Block*, Block*> BlockBlockMap;
+      typedef std::unordered_map<Block*, Block*> BlockBlockMap;
 
       struct HelperClass {
         BlockBlockSetMap& IndependentGroups;
         BlockBlockMap Ownership; // For each block, which entry it belongs to. We have reached it from there.
+        uint64_t &Visits;
 
-        HelperClass(BlockBlockSetMap& IndependentGroupsInit) : IndependentGroups(IndependentGroupsInit) {}
+        HelperClass(BlockBlockSetMap& IndependentGroupsInit, uint64_t &VisitsInit) : IndependentGroups(IndependentGroupsInit), Visits(VisitsInit) {}
         void InvalidateWithChildren(Block *New) { // TODO: rename New
           BlockList ToInvalidate; // Being in the list means you need to be invalidated
           ToInvalidate.push_back(New);
           while (ToInvalidate.size() > 0) {
             Block *Invalidatee = ToInvalidate.front();
             ToInvalidate.pop_front();
+            Visits++;
             Block *Owner = Ownership[Invalidatee];
             if (contains(IndependentGroups, Owner)) { // Owner may have been invalidated, do not add to IndependentGroups!
               IndependentGroups[Owner].erase(Invalidatee);
@@ -766,7 +1116,7 @@ void Relooper::Calculate(Block *Entry) {
           }
         }
       };
-      HelperClass Helper(IndependentGroups);
+      HelperClass Helper(IndependentGroups, Parent->Visits);
 
       // We flow out from each of the entries, simultaneously.
       // When we reach a new block, we add it as belonging to the one we got to it from.
@@ -788,6 +1138,7 @@ void Relooper::Calculate(Block *Entry) {
         if (!Owner) continue; // we have been invalidated meanwhile after being reached from two entries
         // Add all children
         for (BlockBranchMap::iterator iter = Curr->BranchesOut.begin(); iter != Curr->BranchesOut.end(); iter++) {
+          Parent->Visits++;
           Block *New = iter->first;
           BlockBlockMap::iterator Known = Helper.Ownership.find(New);
           if (Known == Helper.Ownership.end()) {
@@ -819,6 +1170,7 @@ void Relooper::Calculate(Block *Entry) {
         for (BlockSet::iterator iter = CurrGroup.begin(); iter != CurrGroup.end(); iter++) {
           Block *Child = *iter;
           for (BlockSet::iterator iter = Child->BranchesIn.begin(); iter != Child->BranchesIn.end(); iter++) {
+            this->Parent->Visits++;
             Block *Parent = *iter;
             if (Ignore && contains(*Ignore, Parent)) continue;
             if (Helper.Ownership[Parent] != Helper.Ownership[Child]) {
@@ -851,7 +1203,7 @@ void Relooper::Calculate(Block *Entry) {
     Shape *MakeMultiple(BlockSet &Blocks, BlockSet& Entries, BlockBlockSetMap& IndependentGroups, Shape *Prev, BlockSet &NextEntries) {
       PrintDebug("creating multiple block with %d inner groups\n", IndependentGroups.size());
       bool Fused = !!(Shape::IsSimple(Prev));
-      MultipleShape *Multiple = new MultipleShape();
+      MultipleShape *Multiple = Parent->NewShape<MultipleShape>();
       Notice(Multiple);
       BlockSet CurrEntries;
       for (BlockBlockSetMap::iterator iter = IndependentGroups.begin(); iter != IndependentGroups.end(); iter++) {
@@ -871,6 +1223,7 @@ void Relooper::Calculate(Block *Entry) {
             Block *CurrTarget = iter->first;
             BlockBranchMap::iterator Next = iter;
             Next++;
+            Parent->Visits++;
             if (!contains(CurrBlocks, CurrTarget)) {
               NextEntries.insert(CurrTarget);
               Solipsize(CurrTarget, Branch::Break, Multiple, CurrBlocks); 
@@ -879,6 +1232,7 @@ void Relooper::Calculate(Block *Entry) {
           }
         }
         Multiple->InnerMap[CurrEntry->Id] = Process(CurrBlocks, CurrEntries, NULL);
+        Multiple->EntryFrequencies[CurrEntry->Id] = CurrEntry->Frequency;
         // If we are not fused, then our entries will actually be checked
         if (!Fused) {
           CurrEntry->IsCheckedMultipleEntry = true;
@@ -961,6 +1315,7 @@ void Relooper::Calculate(Block *Entry) {
             BlockBlockSetMap::iterator curr = iter++; // iterate carefully, we may delete
             for (BlockSet::iterator iterBranch = Entry->BranchesIn.begin(); iterBranch != Entry->BranchesIn.end(); iterBranch++) {
               Block *Origin = *iterBranch;
+              Parent->Visits++;
               if (!contains(Group, Origin)) {
                 // Reached from outside the group, so we cannot handle this
                 PrintDebug("Cannot handle group with entry %d because of incoming branch from %d\n", Entry->Id, Origin->Id);
@@ -978,6 +1333,9 @@ void Relooper::Calculate(Block *Entry) {
           //       there since we create a Next, and that Next can prevent eliminating a break (since we no longer
           //       naturally reach the same place), which may necessitate a one-time loop, which makes the unnesting
           //       pointless.
+          // When we know block frequencies, we do the same with a group that is entered far less often
+          // than the other, whatever its size, so that the hot path is not nested and the cold code is
+          // kept out of its way, in a region of its own.
           if (IndependentGroups.size() == 2) {
             // Find the smaller one
             BlockBlockSetMap::iterator iter = IndependentGroups.begin();
@@ -986,8 +1344,11 @@ void Relooper::Calculate(Block *Entry) {
             iter++;
             Block *LargeEntry = iter->first;
             int LargeSize = iter->second.size();
-            if (SmallSize != LargeSize) { // ignore the case where they are identical - keep things symmetrical there
-              if (SmallSize > LargeSize) {
+            const uint64_t ColdRatio = 16;
+            bool Cold = SmallEntry->Frequency < LargeEntry->Frequency / ColdRatio ||
+                        LargeEntry->Frequency < SmallEntry->Frequency / ColdRatio;
+            if (SmallSize != LargeSize || Cold) { // ignore the case where they are identical - keep things symmetrical there
+              if (Cold ? SmallEntry->Frequency > LargeEntry->Frequency : SmallSize > LargeSize) {
                 Block *Temp = SmallEntry;
                 SmallEntry = LargeEntry;
                 LargeEntry = Temp; // Note: we did not flip the Sizes too, they are now invalid. TODO: use the smaller size as a limit?
@@ -999,6 +1360,7 @@ void Relooper::Calculate(Block *Entry) {
                 Block *Curr = *iter;
                 for (BlockBranchMap::iterator iter = Curr->BranchesOut.begin(); iter != Curr->BranchesOut.end(); iter++) {
                   Block *Target = iter->first;
+                  Parent->Visits++;
                   if (!contains(SmallGroup, Target)) {
                     DeadEnd = false;
                     break;
@@ -1020,7 +1382,15 @@ void Relooper::Calculate(Block *Entry) {
             Make(MakeMultiple(Blocks, *Entries, IndependentGroups, Prev, *NextEntries));
           }
         }
-        // No independent groups, must be loopable ==> Loop
+        // No independent groups, must be loopable ==> Loop. This loop has several entries, so if
+        // the pre-optimizer decided not to split it, emulate it
+        bool Emulate = false;
+        for (BlockSet::iterator iter = Entries->begin(); iter != Entries->end() && !Emulate; iter++) {
+          Emulate = contains(Irreducible, *iter);
+        }
+        if (Emulate) {
+          Make(MakeEmulatedLoop(Blocks, *Entries, *NextEntries));
+        }
         Make(MakeLoop(Blocks, *Entries, *NextEntries));
       }
     }
@@ -1039,7 +1409,7 @@ void Relooper::Calculate(Block *Entry) {
 
   BlockSet Entries;
   Entries.insert(Entry);
-  Root = Analyzer(this).Process(AllBlocks, Entries, NULL);
+  Root = Analyzer(this, Pre.Irreducible).Process(AllBlocks, Entries, NULL);
   assert(Root);
 
   // Post optimizations
@@ -1058,7 +1428,7 @@ void Relooper::Calculate(Block *Entry) {
       func(shape->Inner);
     #define RECURSE(shape, func) RECURSE_##shape(shape, func);
 
-    #define SHAPE_SWITCH(var, simple, multiple, loop) \
+    #define SHAPE_SWITCH(var, simple, multiple, loop, emulated) \
       if (SimpleShape *Simple = Shape::IsSimple(var)) { \
         (void)Simple; \
         simple; \
@@ -1068,6 +1438,9 @@ void Relooper::Calculate(Block *Entry) {
       } else if (LoopShape *Loop = Shape::IsLoop(var)) { \
         (void)Loop; \
         loop; \
+      } else if (EmulatedShape *Emulated = Shape::IsEmulated(var)) { \
+        (void)Emulated; \
+        emulated; \
       }
 
     // Find the blocks that natural control flow can get us directly to, or through a multiple that we ignore
@@ -1081,6 +1454,7 @@ void Relooper::Calculate(Block *Entry) {
         FollowNaturalFlow(Multiple->Next, Out);
       }, {
         FollowNaturalFlow(Loop->Inner, Out);
+      }, {
       });
     }
 
@@ -1099,6 +1473,7 @@ void Relooper::Calculate(Block *Entry) {
         }
       }, {
         FindNaturals(Loop->Inner, Loop->Inner);
+      }, {
       });
     }
 
@@ -1108,6 +1483,12 @@ void Relooper::Calculate(Block *Entry) {
     void RemoveUnneededFlows(Shape *Root, Shape *Natural=NULL, LoopShape *LastLoop=NULL, unsigned Depth=0) {
       BlockSet NaturalBlocks;
       FollowNaturalFlow(Natural, NaturalBlocks);
+      RemoveUnneededFlows(Root, NaturalBlocks, LastLoop, Depth);
+    }
+
+    // As above, with the blocks natural flow reaches already known. All the inner shapes
+    // of a Multiple share them, so they are found once rather than once per inner shape.
+    void RemoveUnneededFlows(Shape *Root, BlockSet &NaturalBlocks, LoopShape *LastLoop, unsigned Depth) {
       Shape *Next = Root;
       while (Next) {
         Root = Next;
@@ -1175,13 +1556,18 @@ void Relooper::Calculate(Block *Entry) {
             }
           }
         }, {
+          BlockSet NextBlocks;
+          FollowNaturalFlow(Multiple->Next, NextBlocks);
           for (IdShapeMap::iterator iter = Multiple->InnerMap.begin(); iter != Multiple->InnerMap.end(); iter++) {
-            RemoveUnneededFlows(iter->second, Multiple->Next, Multiple->Breaks ? NULL : LastLoop, Depth+1);
+            RemoveUnneededFlows(iter->second, NextBlocks, Multiple->Breaks ? NULL : LastLoop, Depth+1);
           }
           Next = Multiple->Next;
         }, {
           RemoveUnneededFlows(Loop->Inner, Loop->Inner, Loop, Depth+1);
           Next = Loop->Next;
+        }, {
+          // Branches in an emulated loop all go through the label variable, leave them as they are
+          Next = Emulated->Next;
         });
       }
     }
@@ -1254,6 +1640,20 @@ void Relooper::Calculate(Block *Entry) {
           RECURSE(Loop, FindLabeledLoops);
           LoopStack.pop();
           Next = Root->Next;
+        }, {
+          // The blocks are inside the emulated loop and its switch, so every break and continue
+          // they do needs a label, both to the emulated loop and to any shape outside of it
+          for (BlockSet::iterator iter = Emulated->Blocks.begin(); iter != Emulated->Blocks.end(); iter++) {
+            Block *Curr = *iter;
+            for (BlockBranchMap::iterator iter = Curr->ProcessedBranchesOut.begin(); iter != Curr->ProcessedBranchesOut.end(); iter++) {
+              Branch *Details = iter->second;
+              if (Details->Type == Branch::Break || Details->Type == Branch::Continue) {
+                Details->Labeled = true;
+                Shape::IsLabeled(Details->Ancestor)->Labeled = true;
+              }
+            }
+          }
+          Next = Root->Next;
         });
       }
 
@@ -1333,6 +1733,8 @@ void Debugging::Dump(Shape *S, const char *prefix) {
     }
   }, {
     printf("<< Loop\n");
+  }, {
+    printf("<< Emulated with %d blocks\n", (int)Emulated->Blocks.size());
   });
 }
 
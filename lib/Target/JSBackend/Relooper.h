@@ -11,6 +11,7 @@ LLVM.
 #include <assert.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdlib.h>
 
 #ifdef __cplusplus
@@ -19,10 +20,40 @@ LLVM.
 #include <deque>
 #include <set>
 #include <list>
+#include <new>
+#include <unordered_map>
+
+#include "llvm/Support/Allocator.h"
 
 struct Block;
 struct Shape;
 
+// An STL allocator that takes memory from a Relooper's arena, or from the heap
+// if it has none. Arena memory is never given back piecemeal, it is all released
+// at once when the Relooper is destroyed.
+template<typename T>
+struct RelooperAllocator
+{
+  typedef T value_type;
+  template<typename U> struct rebind { typedef RelooperAllocator<U> other; };
+
+  llvm::BumpPtrAllocator *Arena;
+
+  RelooperAllocator(llvm::BumpPtrAllocator *ArenaInit=NULL) : Arena(ArenaInit) {}
+  template<typename U> RelooperAllocator(const RelooperAllocator<U>& other) : Arena(other.Arena) {}
+
+  T *allocate(size_t n) {
+    if (Arena) return static_cast<T*>(Arena->Allocate(n * sizeof(T), alignof(T)));
+    return static_cast<T*>(::operator new(n * sizeof(T)));
+  }
+  void deallocate(T *p, size_t) {
+    if (!Arena) ::operator delete(p);
+  }
+
+  template<typename U> bool operator==(const RelooperAllocator<U>& other) const { return Arena == other.Arena; }
+  template<typename U> bool operator!=(const RelooperAllocator<U>& other) const { return Arena != other.Arena; }
+};
+
 // Info about a branching from one block to another
 struct Branch {
   enum FlowType {
@@ -37,6 +68,8 @@ struct Branch {
   bool Labeled; // If a break or continue, whether we need to use a label
   const char *Condition; // The condition for which we branch. For example, "my_var == 1". Conditions are checked one by one. One of the conditions should have NULL as the condition, in which case it is the default
   const char *Code; // If provided, code that is run right before the branch is taken. This is useful for phis
+  uint64_t Weight; // How often the branch is expected to be taken, relative to the other branches, or 0 if not known.
+                   // Conditional branches that are taken more often are checked first, so conditions must not overlap
 
   Branch(const char *ConditionInit, const char *CodeInit=NULL);
   ~Branch();
@@ -47,14 +80,18 @@ struct Branch {
 
 // like std::set, except that begin() -> end() iterates in the
 // order that elements were added to the set (not in the order
-// of operator<(T, T))
+// of operator<(T, T)). Lookups are hashed, so membership tests
+// and erasure are constant time no matter how large the set is.
 template<typename T>
 struct InsertOrderedSet
 {
-  std::map<T, typename std::list<T>::iterator>  Map;
-  std::list<T>                                  List;
+  typedef std::list<T, RelooperAllocator<T>> ListType;
+  typedef std::pair<const T, typename ListType::iterator> MapValue;
+
+  std::unordered_map<T, typename ListType::iterator, std::hash<T>, std::equal_to<T>, RelooperAllocator<MapValue>> Map;
+  ListType                                      List;
 
-  typedef typename std::list<T>::iterator iterator;
+  typedef typename ListType::iterator iterator;
   iterator begin() { return List.begin(); }
   iterator end() { return List.end(); }
 
@@ -83,14 +120,18 @@ struct InsertOrderedSet
   size_t size() const { return Map.size(); }
 
   void clear() {
-    Map.clear();
+    // Erase element by element: clearing the hash table itself costs time in the
+    // number of buckets, which stays large once the set has been big.
+    for (auto i : List) {
+      Map.erase(i);
+    }
     List.clear();
   }
 
   size_t count(const T& val) const { return Map.count(val); }
 
-  InsertOrderedSet() {}
-  InsertOrderedSet(const InsertOrderedSet& other) {
+  InsertOrderedSet(llvm::BumpPtrAllocator *Arena=NULL) : Map(0, std::hash<T>(), std::equal_to<T>(), Arena), List(Arena) {}
+  InsertOrderedSet(const InsertOrderedSet& other) : Map(0, std::hash<T>(), std::equal_to<T>(), other.List.get_allocator()), List(other.List.get_allocator()) {
     for (auto i : other.List) {
       insert(i); // inserting manually creates proper iterators
     }
@@ -102,12 +143,15 @@ struct InsertOrderedSet
 
 // like std::map, except that begin() -> end() iterates in the
 // order that elements were added to the map (not in the order
-// of operator<(Key, Key))
+// of operator<(Key, Key)). Lookups are hashed, as in InsertOrderedSet.
 template<typename Key, typename T>
 struct InsertOrderedMap
 {
-  std::map<Key, typename std::list<std::pair<Key,T>>::iterator> Map;
-  std::list<std::pair<Key,T>>                                   List;
+  typedef std::list<std::pair<Key,T>, RelooperAllocator<std::pair<Key,T>>> ListType;
+  typedef std::pair<const Key, typename ListType::iterator> MapValue;
+
+  std::unordered_map<Key, typename ListType::iterator, std::hash<Key>, std::equal_to<Key>, RelooperAllocator<MapValue>> Map;
+  ListType                                                      List;
 
   T& operator[](const Key& k) {
     auto it = Map.find(k);
@@ -120,7 +164,7 @@ struct InsertOrderedMap
     return it->second->second;
   }
 
-  typedef typename std::list<std::pair<Key,T>>::iterator iterator;
+  typedef typename ListType::iterator iterator;
   iterator begin() { return List.begin(); }
   iterator end() { return List.end(); }
 
@@ -139,7 +183,7 @@ struct InsertOrderedMap
   size_t size() const { return Map.size(); }
   size_t count(const Key& k) const { return Map.count(k); }
 
-  InsertOrderedMap() {}
+  InsertOrderedMap(llvm::BumpPtrAllocator *Arena=NULL) : Map(0, std::hash<Key>(), std::equal_to<Key>(), Arena), List(Arena) {}
   InsertOrderedMap(InsertOrderedMap& other) {
     abort(); // TODO, watch out for iterators
   }
@@ -169,11 +213,18 @@ struct Block {
   const char *Code; // The string representation of the code in this block. Owning pointer (we copy the input)
   const char *BranchVar; // A variable whose value determines where we go; if this is not NULL, emit a switch on that variable
   bool IsCheckedMultipleEntry; // If true, we are a multiple entry, so reaching us requires setting the label variable
+  uint64_t Frequency; // How often the block is expected to run, in the units of branch weights, or 0 if not known
+  llvm::BumpPtrAllocator *Arena; // If not NULL, the arena of the Relooper that created us. Our strings, branches and branch
+                                 // tables then live there too, and are freed along with it
 
-  Block(const char *CodeInit, const char *BranchVarInit);
+  Block(const char *CodeInit, const char *BranchVarInit, llvm::BumpPtrAllocator *ArenaInit=NULL);
   ~Block();
 
-  void AddBranchTo(Block *Target, const char *Condition, const char *Code=NULL);
+  void AddBranchTo(Block *Target, const char *Condition, const char *Code=NULL, uint64_t Weight=0);
+
+  // Creates and destroys branches owned by this block
+  Branch *NewBranch(const char *Condition, const char *Code, uint64_t Weight=0);
+  void DeleteBranch(Branch *Details);
 
   // Prints out the instructions code and branchings
   void Render(bool InLoop);
@@ -224,7 +275,7 @@ struct Shape {
   static SimpleShape *IsSimple(Shape *It) { return It && It->Type == Simple ? (SimpleShape*)It : NULL; }
   static MultipleShape *IsMultiple(Shape *It) { return It && It->Type == Multiple ? (MultipleShape*)It : NULL; }
   static LoopShape *IsLoop(Shape *It) { return It && It->Type == Loop ? (LoopShape*)It : NULL; }
-  static LabeledShape *IsLabeled(Shape *It) { return IsMultiple(It) || IsLoop(It) ? (LabeledShape*)It : NULL; }
+  static LabeledShape *IsLabeled(Shape *It) { return IsMultiple(It) || IsLoop(It) || IsEmulated(It) ? (LabeledShape*)It : NULL; }
   static EmulatedShape *IsEmulated(Shape *It) { return It && It->Type == Emulated ? (EmulatedShape*)It : NULL; }
 };
 
@@ -253,6 +304,7 @@ struct MultipleShape : public LabeledShape {
   int Breaks; // If we have branches on us, we need a loop (or a switch). This is a counter of requirements,
                      // if we optimize it to 0, the loop is unneeded
   bool UseSwitch; // Whether to switch on label as opposed to an if-else chain
+  std::map<int, uint64_t> EntryFrequencies; // entry block ID -> its Frequency. An if-else chain checks the hottest first
 
   MultipleShape() : LabeledShape(Multiple), Breaks(0), UseSwitch(false) {}
 
@@ -269,13 +321,15 @@ struct LoopShape : public LabeledShape {
   void Render(bool InLoop) override;
 };
 
-// TODO EmulatedShape is only partially functional. Currently it can be used for the
-//      entire set of blocks being relooped, but not subsets.
+// An EmulatedShape is used for the entire set of blocks being relooped in Emulate
+// mode, and otherwise for irreducible loops that we decide not to split, nested
+// like any other shape.
 struct EmulatedShape : public LabeledShape {
-  Block *Entry;
+  Block *Entry; // If not NULL, we set label to it on the way in. Otherwise we have several
+                // entries, and the branches to them set label (see Block::IsCheckedMultipleEntry)
   BlockSet Blocks;
 
-  EmulatedShape() : LabeledShape(Emulated) { Labeled = true; }
+  EmulatedShape() : LabeledShape(Emulated), Entry(NULL) { Labeled = true; }
   void Render(bool InLoop) override;
 };
 
@@ -290,7 +344,10 @@ struct EmulatedShape : public LabeledShape {
 //
 // Implementation details: The Relooper instance has
 // ownership of the blocks and shapes, and frees them when done.
+// Shapes, and blocks created through the Relooper, are placed in
+// its arena, so tearing down a relooped graph is cheap.
 struct Relooper {
+  llvm::BumpPtrAllocator Arena;
   std::deque<Block*> Blocks;
   std::deque<Shape*> Shapes;
   Shape *Root;
@@ -298,19 +355,28 @@ struct Relooper {
   bool MinSize;
   int BlockIdCounter;
   int ShapeIdCounter;
+  uint64_t Visits; // How many times Calculate looked at a block or a branch. This follows its running time, but unlike a timer, it is the same on every run
 
   Relooper();
   ~Relooper();
 
   void AddBlock(Block *New, int Id=-1);
 
+  // Creates a block in our arena and adds it
+  Block *AddBlock(const char *Code, const char *BranchVar, int Id=-1);
+
+  // Creates a shape in our arena. It is destroyed along with us once it is in Shapes
+  template<typename T> T *NewShape() {
+    return new (Arena.Allocate<T>()) T();
+  }
+
   // Calculates the shapes
   void Calculate(Block *Entry);
 
   // Renders the result.
   void Render();
 
-  // Sets the global buffer all printing goes to. Must call this or MakeOutputBuffer.
+  // Sets the buffer all printing on the current thread goes to. Must call this or MakeOutputBuffer.
   // XXX: this is deprecated, see MakeOutputBuffer
   static void SetOutputBuffer(char *Buffer, int Size);
 
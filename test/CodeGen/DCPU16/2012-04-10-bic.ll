@@ -1,6 +1,6 @@
 ; RUN: llc < %s -march=dcpu16 | FileCheck %s
 ; RUN: llc < %s -O0 -march=dcpu16 | FileCheck %s -check-prefix=CHECK-O0
-target datalayout = "e-p:16:16:16-i8:16:16-i16:16:16-i32:16:16-s0:16:16-n16"
+target datalayout = "B16-e-p:16:16:16-i8:16:16-i16:16:16-i32:16:16-s0:16:16-n16"
 target triple = "dcpu16"
 
 define i16 @bic(i16 %a, i16 %b) nounwind readnone {
@@ -14,6 +14,6 @@ entry:
 ; CHECK: AND A, B
 
 ; CHECK-O0: :bic
-; CHECK-O0: XOR C, 0xffff
-; CHECK-O0: AND C, A
-; CHECK-O0: SET A, C
+; CHECK-O0: XOR B, 0xffff
+; CHECK-O0: AND B, A
+; CHECK-O0: SET A, B
@@ -1,5 +1,5 @@
 ; RUN: llc < %s -march=dcpu16 | FileCheck %s
-target datalayout = "e-p:16:16:16-i8:16:16-i16:16:16-i32:16:16-s0:16:16-n16"
+target datalayout = "B16-e-p:16:16:16-i8:16:16-i16:16:16-i32:16:16-s0:16:16-n16"
 target triple = "dcpu16"
 
 define void @am1(i16* %a, i16 %b) nounwind {
@@ -19,7 +19,7 @@ define void @am2(i16 %a) nounwind {
 ; CHECK:		SET     [0x20], A
 
 define void @am3(i16* nocapture %p, i16 %a) nounwind readonly {
-	%1 = getelementptr inbounds i16* %p, i16 2
+	%1 = getelementptr inbounds i16, i16* %p, i16 2
 	store i16 %a, i16* %1
 	ret void
 }
@@ -1,5 +1,5 @@
 ; RUN: llc < %s -march=dcpu16 | FileCheck %s
-target datalayout = "e-p:16:16:16-i8:16:16-i16:16:16-i32:16:16-s0:16:16-n16"
+target datalayout = "B16-e-p:16:16:16-i8:16:16-i16:16:16-i32:16:16-s0:16:16-n16"
 target triple = "dcpu16"
 
 define i16 @simplebranch_le(i16 %x, i16 %y, i16 %z) nounwind readnone {
@@ -21,9 +21,9 @@ return:                                           ; preds = %if.else, %if.then
 }
 ; CHECK: :simplebranch_le
 ; CHECK: IFE A, B
-; CHECK: SET PC, .LBB0_1
+; CHECK: SET PC, LBB0_1
 ; CHECK: IFU A, B
-; CHECK: SET PC, .LBB0_1
+; CHECK: SET PC, LBB0_1
 
 
 define i16 @simplebranch_ule(i16 %x, i16 %y, i16 %z) nounwind readnone {
@@ -45,9 +45,9 @@ return:                                           ; preds = %if.else, %if.then
 }
 ; CHECK: :simplebranch_ule
 ; CHECK: IFE A, B
-; CHECK: SET PC, .LBB1_1
+; CHECK: SET PC, LBB1_1
 ; CHECK: IFL A, B
-; CHECK: SET PC, .LBB1_1
+; CHECK: SET PC, LBB1_1
 
 define i16 @simplebranch_l(i16 %x, i16 %y, i16 %z) nounwind readnone {
 entry:
@@ -68,9 +68,9 @@ return:                                           ; preds = %if.else, %if.then
 }
 ; CHECK: :simplebranch_l
 ; CHECK: IFE A, B
-; CHECK: SET PC, .LBB2_2
+; CHECK: SET PC, LBB2_2
 ; CHECK: IFA A, B
-; CHECK: SET PC, .LBB2_2
+; CHECK: SET PC, LBB2_2
 
 define i16 @simplebranch_ul(i16 %x, i16 %y, i16 %z) nounwind readnone {
 entry:
@@ -91,9 +91,9 @@ return:                                           ; preds = %if.else, %if.then
 }
 ; CHECK: :simplebranch_ul
 ; CHECK: IFE A, B
-; CHECK: SET PC, .LBB3_2
+; CHECK: SET PC, LBB3_2
 ; CHECK: IFG A, B
-; CHECK: SET PC, .LBB3_2
+; CHECK: SET PC, LBB3_2
 
 define i16 @simplebranch_ge(i16 %x, i16 %y, i16 %z) nounwind readnone {
 entry:
@@ -114,9 +114,9 @@ return:                                           ; preds = %if.else, %if.then
 }
 ; CHECK: :simplebranch_ge
 ; CHECK: IFE A, B
-; CHECK: SET PC, .LBB4_1
+; CHECK: SET PC, LBB4_1
 ; CHECK: IFA A, B
-; CHECK: SET PC, .LBB4_1
+; CHECK: SET PC, LBB4_1
 
 define i16 @simplebranch_uge(i16 %x, i16 %y, i16 %z) nounwind readnone {
 entry:
@@ -137,9 +137,9 @@ return:                                           ; preds = %if.else, %if.then
 }
 ; CHECK: :simplebranch_uge
 ; CHECK: IFE A, B
-; CHECK: SET PC, .LBB5_1
+; CHECK: SET PC, LBB5_1
 ; CHECK: IFG A, B
-; CHECK: SET PC, .LBB5_1
+; CHECK: SET PC, LBB5_1
 
 define i16 @simplebranch_g(i16 %x, i16 %y, i16 %z) nounwind readnone {
 entry:
@@ -160,9 +160,9 @@ return:                                           ; preds = %if.else, %if.then
 }
 ; CHECK: :simplebranch_g
 ; CHECK: IFE A, B
-; CHECK: SET PC, .LBB6_2
+; CHECK: SET PC, LBB6_2
 ; CHECK: IFU A, B
-; CHECK: SET PC, .LBB6_2
+; CHECK: SET PC, LBB6_2
 
 define i16 @simplebranch_ug(i16 %x, i16 %y, i16 %z) nounwind readnone {
 entry:
@@ -183,9 +183,9 @@ return:                                           ; preds = %if.else, %if.then
 }
 ; CHECK: :simplebranch_ug
 ; CHECK: IFE A, B
-; CHECK: SET PC, .LBB7_2
+; CHECK: SET PC, LBB7_2
 ; CHECK: IFL A, B
-; CHECK: SET PC, .LBB7_2
+; CHECK: SET PC, LBB7_2
 
 define i16 @simplebranch_e(i16 %x, i16 %y, i16 %z) nounwind readnone {
 entry:
@@ -206,7 +206,7 @@ return:                                           ; preds = %if.else, %if.then
 }
 ; CHECK: :simplebranch_e
 ; CHECK: IFN A, B
-; CHECK: SET PC, .LBB8_2
+; CHECK: SET PC, LBB8_2
 
 define i16 @simplebranch_ne(i16 %x, i16 %y, i16 %z) nounwind readnone {
 entry:
@@ -227,7 +227,7 @@ return:                                           ; preds = %if.else, %if.then
 }
 ; CHECK: :simplebranch_ne
 ; CHECK: IFN A, B
-; CHECK: SET PC, .LBB9_1
+; CHECK: SET PC, LBB9_1
 
 define i16 @imm_branch(i16 %a, i16 %b) nounwind readnone {
 entry:
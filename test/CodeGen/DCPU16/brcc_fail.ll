@@ -1,5 +1,5 @@
 ; RUN: llc -march=dcpu16 < %s | FileCheck %s
-target datalayout = "e-p:16:16:16-i8:16:16-i16:16:16-i32:16:16-s0:16:16-n16"
+target datalayout = "B16-e-p:16:16:16-i8:16:16-i16:16:16-i32:16:16-s0:16:16-n16"
 target triple = "dcpu16"
 
 define i16 @fib(i16 %n) nounwind readnone {
@@ -21,4 +21,4 @@ for.end:                                          ; preds = %for.body, %entry
   ret i16 %cur.0.lcssa
 }
 ; CHECK: :fib
-; CHECK: IFU B, 0x1
+; CHECK: IFU A, 0x1
@@ -0,0 +1,37 @@
+; RUN: llc < %s -march=dcpu16 | FileCheck %s
+target datalayout = "B16-e-p:16:16:16-i8:16:16-i16:16:16-i32:16:16-s0:16:16-n16"
+target triple = "dcpu16"
+
+; i32 division by a constant is a multiplication by a magic number, which
+; uses MUL and EX instead of the runtime library.
+define i32 @udiv10(i32 %a) nounwind readnone {
+entry:
+  %div = udiv i32 %a, 10
+  ret i32 %div
+}
+; CHECK: :udiv10
+; CHECK-NOT: JSR
+; CHECK: MUL
+; CHECK: EX
+; CHECK: SET PC, POP
+
+define i32 @srem7(i32 %a) nounwind readnone {
+entry:
+  %rem = srem i32 %a, 7
+  ret i32 %rem
+}
+; CHECK: :srem7
+; CHECK-NOT: JSR
+; CHECK: MUL
+; CHECK: SET PC, POP
+
+; Other divisions call the runtime library, with the arguments in registers.
+; The high word of %b arrives on the stack and is passed in X.
+define i32 @udiv(i32 %a, i32 %b) nounwind readnone {
+entry:
+  %div = udiv i32 %a, %b
+  ret i32 %div
+}
+; CHECK: :udiv
+; CHECK: SET X, PICK 0x2
+; CHECK-NEXT: JSR __udivsi3
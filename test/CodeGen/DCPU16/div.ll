@@ -1,11 +1,11 @@
 ; RUN: llc < %s -march=dcpu16 | FileCheck %s
-target datalayout = "e-p:16:16:16-i8:16:16-i16:16:16-i32:16:16-s0:16:16-n16"
+target datalayout = "B16-e-p:16:16:16-i8:16:16-i16:16:16-i32:16:16-s0:16:16-n16"
 target triple = "dcpu16"
 
 define i16 @udiv(i16 %a, i16 %b, i16* nocapture %c) nounwind readonly {
 entry:
   %div = udiv i16 %a, %b
-  %0 = load i16* %c, align 2
+  %0 = load i16, i16* %c, align 2
   %div1 = udiv i16 %a, %0
   %div2 = udiv i16 %a, 17
   %add = add i16 %div1, %div
@@ -21,7 +21,7 @@ entry:
 define i16 @sdiv(i16 %a, i16 %b, i16* nocapture %c) nounwind readonly {
 entry:
   %div = sdiv i16 %a, %b
-  %0 = load i16* %c, align 2
+  %0 = load i16, i16* %c, align 2
   %div1 = sdiv i16 %a, %0
   %div2 = sdiv i16 %a, 17
   %add = add i16 %div1, %div
@@ -0,0 +1,32 @@
+; RUN: llc < %s -march=dcpu16 -show-mc-encoding | FileCheck %s
+target datalayout = "B16-e-p:16:16:16-i8:16:16-i16:16:16-i32:16:16-s0:16:16-n16"
+target triple = "dcpu16"
+
+declare void @g()
+
+define i16 @small(i16 %x) nounwind {
+entry:
+  %add = add i16 %x, 3
+  ret i16 %add
+}
+; Small literals are encoded in the instruction word.
+; CHECK: :small
+; CHECK: ADD A, 0x3 ; encoding: [0x90,0x02]
+; CHECK: SET PC, POP ; encoding: [0x63,0x81]
+
+define i16 @large(i16 %x) nounwind {
+entry:
+  %add = add i16 %x, 100
+  ret i16 %add
+}
+; CHECK: :large
+; CHECK: ADD A, 0x64 ; encoding: [0x7c,0x02,0x00,0x64]
+
+define void @call() nounwind {
+entry:
+  call void @g()
+  ret void
+}
+; CHECK: :call
+; CHECK: JSR g ; encoding: [0x7c,0x20,A,A]
+; CHECK-NEXT: ; fixup A - offset: 2, value: g, kind: fixup_dcpu16_word
@@ -0,0 +1,57 @@
+; RUN: llc < %s -march=dcpu16 | FileCheck %s
+target datalayout = "B16-e-p:16:16:16-i8:16:16-i16:16:16-i32:16:16-s0:16:16-n16"
+target triple = "dcpu16"
+
+; A branch around a single instruction is an IF in front of it.
+define i16 @triangle(i16 %x, i16 %y) nounwind readnone {
+entry:
+  %cmp = icmp eq i16 %x, 5
+  br i1 %cmp, label %if.then, label %if.end
+
+if.then:                                          ; preds = %entry
+  %add = add i16 %y, 3
+  br label %if.end
+
+if.end:                                           ; preds = %if.then, %entry
+  %y.addr.0 = phi i16 [ %add, %if.then ], [ %y, %entry ]
+  ret i16 %y.addr.0
+}
+; CHECK: :triangle
+; CHECK-NOT: SET PC, .LBB
+; CHECK: IFE A, 0x5
+; CHECK-NEXT: ADD {{[A-Z]}}, 0x3
+
+; The conditions of an && are a chain of IFs.
+define void @andand(i16 %x, i16 %y, i16* %p) nounwind {
+entry:
+  %cmp = icmp eq i16 %x, 1
+  br i1 %cmp, label %land.lhs.true, label %if.end
+
+land.lhs.true:                                    ; preds = %entry
+  %cmp1 = icmp eq i16 %y, 2
+  br i1 %cmp1, label %if.then, label %if.end
+
+if.then:                                          ; preds = %land.lhs.true
+  store i16 7, i16* %p, align 1
+  br label %if.end
+
+if.end:                                           ; preds = %if.then, %land.lhs.true, %entry
+  ret void
+}
+; CHECK: :andand
+; CHECK-NOT: SET PC, .LBB
+; CHECK: IFE A, 0x1
+; CHECK-NEXT: IFE B, 0x2
+; CHECK-NEXT: SET [C], 0x7
+
+; Bit tests do not need an AND.
+define i16 @bittest(i16 %x, i16 %y, i16 %z) nounwind readnone {
+entry:
+  %and = and i16 %x, 4
+  %tobool = icmp ne i16 %and, 0
+  %cond = select i1 %tobool, i16 %y, i16 %z
+  ret i16 %cond
+}
+; CHECK: :bittest
+; CHECK-NOT: AND
+; CHECK: IFB A, 0x4
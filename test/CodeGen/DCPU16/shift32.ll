@@ -0,0 +1,55 @@
+; RUN: llc < %s -march=dcpu16 | FileCheck %s
+target datalayout = "B16-e-p:16:16:16-i8:16:16-i16:16:16-i32:16:16-s0:16:16-n16"
+target triple = "dcpu16"
+
+; i32 shifts by a variable amount pass the bits between the halves in EX,
+; instead of calling the runtime library.
+define i32 @shl32(i32 %a, i32 %b) nounwind readnone {
+entry:
+  %shl = shl i32 %a, %b
+  ret i32 %shl
+}
+; CHECK: :shl32
+; CHECK-NOT: JSR
+; CHECK: SHL A, C
+; CHECK-NEXT: SET {{[A-Z]}}, EX
+; CHECK: SHL B, C
+; CHECK: BOR B,
+; CHECK: SET PC, POP
+
+define i32 @lshr32(i32 %a, i32 %b) nounwind readnone {
+entry:
+  %shr = lshr i32 %a, %b
+  ret i32 %shr
+}
+; CHECK: :lshr32
+; CHECK-NOT: JSR
+; CHECK: SHR B, C
+; CHECK-NEXT: SET {{[A-Z]}}, EX
+; CHECK: SHR A, C
+; CHECK: BOR A,
+; CHECK: SET PC, POP
+
+; Past 16, the low half of an arithmetic shift is the high one shifted.
+define i32 @ashr32(i32 %a, i32 %b) nounwind readnone {
+entry:
+  %shr = ashr i32 %a, %b
+  ret i32 %shr
+}
+; CHECK: :ashr32
+; CHECK-NOT: JSR
+; CHECK: ASR
+; CHECK: EX
+; CHECK: IFB C, 0x10
+; CHECK: SET PC, POP
+
+; The carry of i32 additions and subtractions is in EX too. The high word of
+; %b is the first stack argument.
+define i32 @sub32(i32 %a, i32 %b) nounwind readnone {
+entry:
+  %sub = sub i32 %a, %b
+  ret i32 %sub
+}
+; CHECK: :sub32
+; CHECK: SUB A, C
+; CHECK-NEXT: SBX B, PICK 0x1
@@ -1,5 +1,5 @@
 ; RUN: llc < %s -march=dcpu16 | FileCheck %s
-target datalayout = "e-p:16:16:16-i8:16:16-i16:16:16-i32:16:16-s0:16:16-n16"
+target datalayout = "B16-e-p:16:16:16-i8:16:16-i16:16:16-i32:16:16-s0:16:16-n16"
 target triple = "dcpu16"
 
 define i16 @switchcase(i16 %c) nounwind readnone {
@@ -34,8 +34,9 @@ sw.epilog:                                        ; preds = %entry, %sw.bb3, %sw
 }
 ; just check that it compiles and that a jumptable gets generated
 ; CHECK: :switchcase
-; CHECK: :.LJTI0_0
-; CHECK: .byte .LBB0_5
-; CHECK: .byte .LBB0_2
-; CHECK: .byte .LBB0_3
-; CHECK: .byte .LBB0_4
+; CHECK: SET PC, [B+JTI0_0]
+; CHECK: :JTI0_0
+; CHECK-NEXT: .dat LBB0_6
+; CHECK-NEXT: .dat LBB0_3
+; CHECK-NEXT: .dat LBB0_4
+; CHECK-NEXT: .dat LBB0_5
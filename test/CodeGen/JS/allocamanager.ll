@@ -150,6 +150,41 @@ if.end10:                                         ; preds = %if.then4, %if.end
   ret void
 }
 
+; Color the biggest allocas first. %small is first in the entry block and
+; could share with %big1, but then %big2, which overlaps %small, would need a
+; slot of its own. Instead the two big buffers share a slot and %small goes on
+; the side.
+
+; CHECK: function _sizes() {
+; CHECK: STACKTOP = STACKTOP + 112|0;
+; CHECK-NEXT: $small = sp + 100|0;
+; CHECK-NEXT: $big1 = sp;
+; CHECK-NOT: $big2 =
+; CHECK: _use(($big1|0));
+; CHECK: _use(($big1|0));
+; CHECK: }
+define void @sizes() #0 {
+entry:
+  %small = alloca [4 x i8], align 4
+  %big1 = alloca [100 x i8], align 4
+  %big2 = alloca [100 x i8], align 4
+  %s = getelementptr [4 x i8], [4 x i8]* %small, i32 0, i32 0
+  %b1 = getelementptr [100 x i8], [100 x i8]* %big1, i32 0, i32 0
+  %b2 = getelementptr [100 x i8], [100 x i8]* %big2, i32 0, i32 0
+  call void @llvm.lifetime.start(i64 100, i8* %b1)
+  call void @use(i8* %b1)
+  call void @llvm.lifetime.end(i64 100, i8* %b1)
+  call void @llvm.lifetime.start(i64 100, i8* %b2)
+  call void @llvm.lifetime.start(i64 4, i8* %s)
+  call void @use(i8* %s)
+  call void @use(i8* %b2)
+  call void @llvm.lifetime.end(i64 4, i8* %s)
+  call void @llvm.lifetime.end(i64 100, i8* %b2)
+  ret void
+}
+
+declare void @use(i8*)
+
 ; Function Attrs: nounwind
 declare i32 @sprintf(i8*, i8*, i8*) #0
 
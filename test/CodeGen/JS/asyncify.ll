@@ -0,0 +1,54 @@
+; RUN: llc -emscripten-asyncify -emscripten-asyncify-functions=sleep < %s | FileCheck %s
+
+; Async contexts save only what is live across the call, recompute cheap
+; values instead of saving them, and are laid out without padding. Sibling
+; calls that save the same context share the code saving it.
+
+target datalayout = "e-p:32:32-i64:64-v128:32:128-n32-S128"
+target triple = "asmjs-unknown-emscripten"
+
+declare void @sleep(i32)
+declare void @use(i32*, double, i32)
+
+; %d is recomputed from %x, which is half the size. Both calls save the same
+; context, in the same block.
+; CHECK-LABEL: function _f(
+; CHECK: _emscripten_alloc_async_context(16,sp)
+; CHECK: _emscripten_alloc_async_context(16,sp)
+; CHECK: HEAP32[$AsyncCtx5>>2] = $AsyncCallback;
+; CHECK: HEAPF32[$0>>2] = $x;
+; CHECK: HEAP32[$1>>2] = $q;
+; CHECK: HEAP32[$2>>2] = $m;
+; CHECK-NOT: HEAPF64
+; CHECK: }
+define i32 @f(i32* %p, i32 %n, float %x) {
+entry:
+  %q = getelementptr i32, i32* %p, i32 4
+  %d = fpext float %x to double
+  %m = mul i32 %n, 3
+  call void @sleep(i32 1)
+  call void @use(i32* %q, double %d, i32 %m)
+  call void @sleep(i32 2)
+  call void @use(i32* %q, double %d, i32 %m)
+  ret i32 %m
+}
+
+; The i32 goes into the hole after the callback pointer, before the doubles.
+; CHECK-LABEL: function _g(
+; CHECK: _emscripten_alloc_async_context(24,sp)
+; CHECK: HEAP32[$AsyncCtx>>2] = 3;
+; CHECK: HEAP32[$0>>2] = $b;
+; CHECK: HEAPF64[$1>>3] = $a;
+; CHECK: HEAPF64[$2>>3] = $c;
+define void @g(double %a, i32 %b, double %c) {
+entry:
+  call void @sleep(i32 3)
+  call void @use(i32* null, double %a, i32 %b)
+  call void @use(i32* null, double %c, i32 %b)
+  ret void
+}
+
+; CHECK-LABEL: function _f__async_cb(
+; CHECK: $2 = +HEAPF32[$1>>2];
+; CHECK: $d = $2;
+; CHECK: _use(($4|0),(+$d),($6|0));
@@ -0,0 +1,69 @@
+; RUN: llc -O2 -emscripten-enable-pthreads < %s | FileCheck %s
+
+; With pthreads, atomic operations use the Atomics API. Fences next to an
+; Atomics operation are removed, atomics on allocas that do not escape become
+; plain accesses, and unordered loads and stores are plain accesses.
+
+target datalayout = "e-p:32:32-i64:64-v128:32:128-n32-S128"
+target triple = "asmjs-unknown-emscripten"
+
+@flag = global i32 0, align 4
+@data = global i32 0, align 4
+
+; CHECK: function _publish(
+; CHECK-NOT: fence
+; CHECK: HEAP32[{{[0-9]+}}] = 1;
+; CHECK-NEXT: Atomics_store(HEAP32,{{[0-9]+}},1)|0;
+; CHECK-NEXT: $v = (Atomics_load(HEAP32,{{[0-9]+}})|0);
+; CHECK-NEXT: $r = (Atomics_add(HEAP32, $p>>2, 1)|0);
+; CHECK-NEXT: $x = (Atomics_compareExchange(HEAP32, $p>>2, 1, 2)|0);
+; CHECK: }
+define i32 @publish(i32* %p) {
+  store i32 1, i32* @data, align 4
+  fence seq_cst
+  store atomic i32 1, i32* @flag seq_cst, align 4
+  fence seq_cst
+  %v = load atomic i32, i32* @flag acquire, align 4
+  %r = atomicrmw add i32* %p, i32 1 seq_cst
+  fence seq_cst
+  %x = cmpxchg i32* %p, i32 1, i32 2 seq_cst seq_cst
+  %y = extractvalue { i32, i1 } %x, 0
+  %s = add i32 %v, %y
+  ret i32 %s
+}
+
+; CHECK: function _local(
+; CHECK-NOT: Atomics
+; CHECK: }
+define i32 @local(i32 %n) {
+  %c = alloca i32, align 4
+  store i32 0, i32* %c, align 4
+  %a = atomicrmw add i32* %c, i32 %n seq_cst
+  %b = atomicrmw umax i32* %c, i32 7 monotonic
+  %x = cmpxchg i32* %c, i32 3, i32 %n seq_cst seq_cst
+  %l = load atomic i32, i32* %c seq_cst, align 4
+  ret i32 %l
+}
+
+; A fence between plain accesses stays, and consecutive fences are merged.
+; CHECK: function _orders(
+; CHECK: (Atomics_add(HEAP32, 0, 0)|0) /* fence */;
+; CHECK-NEXT: HEAP32[$p>>2] = 1;
+; CHECK-NEXT: (Atomics_add(HEAP32, 0, 0)|0) /* fence */;
+; CHECK-NEXT: $u = HEAP32[$p>>2]|0;
+; CHECK-NEXT: $m = (Atomics_load(HEAP32,$p>>2)|0);
+; CHECK-NEXT: HEAP32[$p>>2] = $u;
+; CHECK-NEXT: Atomics_store(HEAP32,$p>>2,$m)|0;
+; CHECK: }
+define void @orders(i32* %p) {
+  fence seq_cst
+  store i32 1, i32* %p, align 4
+  fence singlethread seq_cst
+  fence seq_cst
+  fence seq_cst
+  %u = load atomic i32, i32* %p unordered, align 4
+  %m = load atomic i32, i32* %p monotonic, align 4
+  store atomic i32 %u, i32* %p unordered, align 4
+  store atomic i32 %m, i32* %p monotonic, align 4
+  ret void
+}
@@ -0,0 +1,79 @@
+; RUN: llc -O2 -emscripten-coalesce-locals < %s | FileCheck %s
+
+; Values whose live ranges do not overlap share locals of the same type, each
+; named after its first value. A phi that shares its local with its incoming
+; value needs no copy.
+
+target datalayout = "e-p:32:32-i64:64-v128:32:128-n32-S128"
+target triple = "asmjs-unknown-emscripten"
+
+; CHECK: function _chain($x,$d) {
+; CHECK: var $a = 0, $e = +0, $g = 0, label = 0, sp = 0;
+; CHECK: $a = (($x) + 1)|0;
+; CHECK-NEXT: $a = Math_imul($a, $a)|0;
+; CHECK-NEXT: $a = $a ^ 5;
+; CHECK-NEXT: $e = $d * $d;
+; CHECK-NEXT: $e = $e + +1;
+; CHECK-NEXT: $g = (~~(($e)));
+; CHECK-NEXT: $a = (($a) + ($g))|0;
+; CHECK-NEXT: return ($a|0);
+define i32 @chain(i32 %x, double %d) {
+  %a = add i32 %x, 1
+  %b = mul i32 %a, %a
+  %c = xor i32 %b, 5
+  %e = fmul double %d, %d
+  %f = fadd double %e, 1.0
+  %g = fptosi double %f to i32
+  %h = add i32 %c, %g
+  ret i32 %h
+}
+
+; CHECK: function _loop($n) {
+; CHECK: var $done = 0, $i = 0, $s = 0, label = 0, sp = 0;
+; CHECK: $i = 0;$s = 0;
+; CHECK-NEXT: while(1) {
+; CHECK-NEXT: $s = (($s) + ($i))|0;
+; CHECK-NEXT: $i = (($i) + 1)|0;
+; CHECK-NEXT: $done = ($i|0)==($n|0);
+; CHECK-NEXT: if ($done) {
+; CHECK-NEXT: break;
+; CHECK-NEXT: }
+; CHECK-NEXT: }
+; CHECK-NEXT: return ($s|0);
+define i32 @loop(i32 %n) {
+entry:
+  br label %head
+
+head:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %head ]
+  %s = phi i32 [ 0, %entry ], [ %s.next, %head ]
+  %s.next = add i32 %s, %i
+  %i.next = add i32 %i, 1
+  %done = icmp eq i32 %i.next, %n
+  br i1 %done, label %exit, label %head
+
+exit:
+  ret i32 %s.next
+}
+
+; Phis of the same block never share a local, so swaps still go through
+; temporaries.
+; CHECK: function _swap($n,$x,$y) {
+; CHECK: $b$phi = $a;$a$phi = $b;$b = $b$phi;$a = $a$phi;
+; CHECK: $i = (($a) - ($b))|0;
+define i32 @swap(i32 %n, i32 %x, i32 %y) {
+entry:
+  br label %head
+
+head:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %head ]
+  %a = phi i32 [ %x, %entry ], [ %b, %head ]
+  %b = phi i32 [ %y, %entry ], [ %a, %head ]
+  %i.next = add i32 %i, 1
+  %done = icmp eq i32 %i.next, %n
+  br i1 %done, label %exit, label %head
+
+exit:
+  %r = sub i32 %a, %b
+  ret i32 %r
+}
@@ -0,0 +1,118 @@
+; RUN: llc -O2 -emscripten-devirtualize-calls -emscripten-whole-program-devirt < %s | FileCheck %s
+; RUN: llc -O2 -emscripten-devirtualize-calls -emscripten-whole-program-devirt -emscripten-precise-f32 < %s | FileCheck %s --check-prefix=F32
+; RUN: llc -O2 < %s | FileCheck %s --check-prefix=OFF
+; RUN: llc -O2 -emscripten-whole-program-devirt -emscripten-relocatable -emscripten-emulated-function-pointers -emscripten-global-base=0 < %s | FileCheck %s --check-prefix=RELOC
+
+; An indirect call whose signature has a single address-taken function calls it
+; directly, behind a check of the pointer. Virtual calls with a single target
+; according to type metadata become plain direct calls. Both are off by default.
+
+; OFF-NOT: is_target
+; OFF: function _virtual($a) {
+; OFF: FUNCTION_TABLE_ii[
+
+; A relocatable module is not the whole program, so its virtual calls stay.
+
+; RELOC: function _virtual($a) {
+; RELOC: mftCall_ii($vfn
+
+target datalayout = "e-p:32:32-i64:64-v128:32:128-n32-S128"
+target triple = "asmjs-unknown-emscripten"
+
+%struct.A = type { i32 (...)** }
+
+@fp = global i32 (i32, i32, i32)* @add3, align 4
+@vp = global void (i32, i32)* @a, align 4
+@vp2 = global void (i32, i32)* @b, align 4
+@ffp = global float (float)* @negf, align 4
+@fdp = global double (double)* @negd, align 4
+
+@_ZTV1A = constant { [3 x i8*] } { [3 x i8*] [i8* null, i8* null, i8* bitcast (i32 (%struct.A*)* @_ZN1A1fEv to i8*)] }, align 4, !type !0
+
+define internal i32 @add3(i32 %x, i32 %y, i32 %z) {
+  %s = add i32 %x, %y
+  %t = add i32 %s, %z
+  ret i32 %t
+}
+
+define internal void @a(i32 %x, i32 %y) {
+  ret void
+}
+
+define internal void @b(i32 %x, i32 %y) {
+  ret void
+}
+
+define internal float @negf(float %x) {
+  %r = fsub float -0.0, %x
+  ret float %r
+}
+
+define internal double @negd(double %x) {
+  %r = fsub double -0.0, %x
+  ret double %r
+}
+
+define i32 @_ZN1A1fEv(%struct.A* %this) {
+  ret i32 42
+}
+
+; CHECK: function _monomorphic($x) {
+; CHECK: $is_target = ($f|0)==(1|0);
+; CHECK-NEXT: if ($is_target) {
+; CHECK-NEXT: = (_add3($x,$x,$x)|0);
+; CHECK: } else {
+; CHECK-NEXT: = (FUNCTION_TABLE_iiii[$f & #FM_iiii#]($x,$x,$x)|0);
+; CHECK: }
+define i32 @monomorphic(i32 %x) {
+  %f = load i32 (i32, i32, i32)*, i32 (i32, i32, i32)** @fp, align 4
+  %r = call i32 %f(i32 %x, i32 %x, i32 %x)
+  %s = add i32 %r, 2
+  ret i32 %s
+}
+
+; CHECK: function _polymorphic($x) {
+; CHECK-NOT: is_target
+; CHECK: FUNCTION_TABLE_vii[$f & #FM_vii#]($x,$x);
+; CHECK: }
+define void @polymorphic(i32 %x) {
+  %f = load void (i32, i32)*, void (i32, i32)** @vp, align 4
+  call void %f(i32 %x, i32 %x)
+  ret void
+}
+
+; CHECK: function _virtual($a) {
+; CHECK-NOT: FUNCTION_TABLE
+; CHECK: $call = (__ZN1A1fEv($a)|0);
+; CHECK: }
+define i32 @virtual(%struct.A* %a) {
+  %1 = bitcast %struct.A* %a to i32 (%struct.A*)***
+  %vtable = load i32 (%struct.A*)**, i32 (%struct.A*)*** %1
+  %2 = bitcast i32 (%struct.A*)** %vtable to i8*
+  %3 = call i1 @llvm.type.test(i8* %2, metadata !"_ZTS1A")
+  call void @llvm.assume(i1 %3)
+  %vfn = load i32 (%struct.A*)*, i32 (%struct.A*)** %vtable
+  %call = call i32 %vfn(%struct.A* %a)
+  ret i32 %call
+}
+
+; Without -emscripten-precise-f32 floats and doubles share the dd table, which
+; then has two functions in it.
+
+; CHECK: function _float($x) {
+; CHECK-NOT: is_target
+; CHECK: }
+; F32: function _float($x) {
+; F32: $is_target = ($f|0)==(
+; F32: _negf($x)
+; F32: FUNCTION_TABLE_ff[
+define float @float(float %x) {
+  %f = load float (float)*, float (float)** @ffp, align 4
+  %r = call float %f(float %x)
+  ret float %r
+}
+
+declare i1 @llvm.type.test(i8*, metadata)
+declare void @llvm.assume(i1)
+
+!0 = !{i32 8, !"_ZTS1A"}
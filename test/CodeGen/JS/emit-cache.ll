@@ -0,0 +1,61 @@
+; RUN: rm -rf %t.cache
+; RUN: llc < %s > %t.uncached
+; RUN: llc -emscripten-emit-cache-dir=%t.cache < %s > %t.cold
+; RUN: llc -emscripten-emit-cache-dir=%t.cache < %s > %t.warm
+; RUN: llc -emscripten-emit-cache-dir=%t.cache -emscripten-emit-threads=4 < %s > %t.parallel
+; RUN: diff %t.uncached %t.cold
+; RUN: diff %t.uncached %t.warm
+; RUN: diff %t.uncached %t.parallel
+; RUN: ls %t.cache | count 5
+; RUN: llc -emscripten-precise-f32 < %s > %t.f32
+; RUN: llc -emscripten-precise-f32 -emscripten-emit-cache-dir=%t.cache < %s > %t.f32cached
+; RUN: diff %t.f32 %t.f32cached
+; RUN: FileCheck %s < %t.warm
+; RUN: sed -e 's/^@.str = /@pad = global i32 1\n&/' %s | llc -emscripten-emit-cache-dir=%t.cache | FileCheck %s -check-prefix=MOVED
+
+; Cached functions must get the same function table slots, asm const ids and
+; block addresses as freshly emitted ones, and a function must not be taken
+; from the cache once a global it refers to has moved or the options have
+; changed.
+
+target datalayout = "e-p:32:32-i64:64-v128:32:128-n32-S128"
+target triple = "asmjs-unknown-emscripten"
+
+@.str = private unnamed_addr constant [11 x i8] c"{ Foo(); }\00", align 1
+@.str1 = private unnamed_addr constant [11 x i8] c"{ Bar(); }\00", align 1
+
+declare i32 @emscripten_asm_const_int(i8*, ...)
+
+define void @a(i32 %x) {
+  ret void
+}
+
+; CHECK-LABEL: function _usesa(
+; CHECK: return {{[(]*}}1
+define i32 @usesa() {
+  ret i32 ptrtoint (void (i32)* @a to i32)
+}
+
+; CHECK-LABEL: function _asm(
+; CHECK: _emscripten_asm_const_i(0)|0;
+; CHECK: _emscripten_asm_const_i(1)|0;
+define i32 @asm() {
+  %1 = call i32 (i8*, ...) @emscripten_asm_const_int(i8* getelementptr ([11 x i8], [11 x i8]* @.str, i32 0, i32 0))
+  %2 = call i32 (i8*, ...) @emscripten_asm_const_int(i8* getelementptr ([11 x i8], [11 x i8]* @.str1, i32 0, i32 0))
+  ret i32 %1
+}
+
+; CHECK-LABEL: function _addr(
+; CHECK: return ((19)|0);
+; MOVED-LABEL: function _addr(
+; MOVED: return ((23)|0);
+define i32 @addr() {
+  ret i32 ptrtoint ([11 x i8]* @.str1 to i32)
+}
+
+; CHECK-LABEL: function _half(
+; CHECK: $r = $x * +0.5;
+define float @half(float %x) {
+  %r = fmul float %x, 0.5
+  ret float %r
+}
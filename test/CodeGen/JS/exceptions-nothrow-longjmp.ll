@@ -0,0 +1,31 @@
+; RUN: llc -enable-emscripten-cpp-exceptions < %s | FileCheck %s
+
+; longjmp throws in JS even though it is declared nounwind, so the invokes of
+; a function that calls it keep their instrumentation and run the cleanup.
+
+target datalayout = "e-p:32:32-i64:64-v128:32:128-n32-S128"
+target triple = "asmjs-unknown-emscripten"
+
+%struct.__jmp_buf_tag = type { [6 x i32], i32, [32 x i32] }
+
+declare i32 @__gxx_personality_v0(...)
+declare void @longjmp(%struct.__jmp_buf_tag*, i32) noreturn nounwind
+declare void @cleanup()
+
+define void @jumper(%struct.__jmp_buf_tag* %b) {
+  call void @longjmp(%struct.__jmp_buf_tag* %b, i32 1)
+  unreachable
+}
+
+; CHECK-LABEL: function _caller(
+; CHECK: invoke_vi({{.*}})
+; CHECK: _cleanup()
+define void @caller(%struct.__jmp_buf_tag* %b) personality i32 (...)* @__gxx_personality_v0 {
+  invoke void @jumper(%struct.__jmp_buf_tag* %b) to label %ok unwind label %lpad
+ok:
+  ret void
+lpad:
+  %lp = landingpad { i8*, i32 } cleanup
+  call void @cleanup()
+  resume { i8*, i32 } %lp
+}
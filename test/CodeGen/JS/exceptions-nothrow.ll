@@ -0,0 +1,122 @@
+; RUN: llc -enable-emscripten-cpp-exceptions < %s | FileCheck %s
+; RUN: llc -enable-emscripten-cpp-exceptions -emscripten-cpp-exceptions-whitelist=_caller < %s | FileCheck %s --check-prefix=WHITELIST
+
+; Invokes of functions that provably never unwind become plain calls, while
+; those that may unwind keep the preinvoke/postinvoke instrumentation.
+
+target datalayout = "e-p:32:32-i64:64-v128:32:128-n32-S128"
+target triple = "asmjs-unknown-emscripten"
+
+declare i32 @__gxx_personality_v0(...)
+declare void @external()
+declare void @__cxa_rethrow()
+declare void @declared_nounwind() nounwind
+
+; A leaf.
+define i32 @leaf(i32 %x) {
+  %y = add i32 %x, 1
+  ret i32 %y
+}
+
+; Only calls nothrow functions, and recurses.
+define i32 @recursive(i32 %x) {
+  %c = icmp eq i32 %x, 0
+  br i1 %c, label %done, label %more
+more:
+  %a = call i32 @leaf(i32 %x)
+  %b = call i32 @recursive(i32 %a)
+  call void @declared_nounwind()
+  ret i32 %b
+done:
+  ret i32 0
+}
+
+; Catches everything that @external throws.
+define void @catches() personality i32 (...)* @__gxx_personality_v0 {
+  invoke void @external() to label %ok unwind label %lpad
+ok:
+  ret void
+lpad:
+  %lp = landingpad { i8*, i32 } catch i8* null
+  ret void
+}
+
+; Runs a cleanup and resumes.
+define void @resumes() personality i32 (...)* @__gxx_personality_v0 {
+  invoke void @external() to label %ok unwind label %lpad
+ok:
+  ret void
+lpad:
+  %lp = landingpad { i8*, i32 } cleanup
+  resume { i8*, i32 } %lp
+}
+
+; Rethrows from the handler.
+define void @rethrows() personality i32 (...)* @__gxx_personality_v0 {
+  invoke void @external() to label %ok unwind label %lpad
+ok:
+  ret void
+lpad:
+  %lp = landingpad { i8*, i32 } catch i8* null
+  call void @__cxa_rethrow()
+  unreachable
+}
+
+; Calls through a pointer.
+define void @indirect(void ()* %f) {
+  call void %f()
+  ret void
+}
+
+; May be replaced at link time.
+define weak void @weak() {
+  ret void
+}
+
+; CHECK-LABEL: function _caller(
+; CHECK-NOT: invoke_
+; CHECK: _leaf(1)
+; CHECK-NOT: invoke_
+; CHECK: _recursive(2)
+; CHECK-NOT: invoke_
+; CHECK: _catches()
+; CHECK-NOT: invoke_
+; CHECK: invoke_v({{.*}})
+; CHECK: invoke_v({{.*}})
+; CHECK: invoke_v({{.*}})
+; CHECK: invoke_vi({{.*}})
+; CHECK: invoke_v({{.*}})
+; CHECK-NOT: invoke_
+; CHECK: }
+
+; The invokes in @catches are not instrumented without a whitelist entry, so
+; it no longer catches anything and may unwind.
+; WHITELIST-LABEL: function _caller(
+; WHITELIST-NOT: invoke_
+; WHITELIST: _leaf(1)
+; WHITELIST-NOT: invoke_
+; WHITELIST: _recursive(2)
+; WHITELIST-NOT: invoke_
+; WHITELIST: invoke_v({{.*}})
+define void @caller(void ()* %f) personality i32 (...)* @__gxx_personality_v0 {
+  %a = invoke i32 @leaf(i32 1) to label %b unwind label %lpad
+b:
+  %c = invoke i32 @recursive(i32 2) to label %d unwind label %lpad
+d:
+  invoke void @catches() to label %e unwind label %lpad
+e:
+  invoke void @resumes() to label %g unwind label %lpad
+g:
+  invoke void @rethrows() to label %h unwind label %lpad
+h:
+  invoke void @external() to label %i unwind label %lpad
+i:
+  invoke void @indirect(void ()* %f) to label %j unwind label %lpad
+j:
+  invoke void @weak() to label %k unwind label %lpad
+k:
+  ret void
+lpad:
+  %lp = landingpad { i8*, i32 } catch i8* null
+  ret void
+}
@@ -0,0 +1,56 @@
+; RUN: llc -emscripten-fold-expressions < %s | FileCheck %s
+
+; Values with a single use in their own block are emitted as part of the
+; expression that uses them.
+
+target datalayout = "e-p:32:32-i64:64-v128:32:128-n32-S128"
+target triple = "asmjs-unknown-emscripten"
+
+; CHECK: function _tree($p,$a) {
+; CHECK-NOT: var $
+; CHECK: return ((((((HEAP32[((($p)) + 8|0)>>2]|0) + ($a))|0)*3)|0)|0);
+define i32 @tree(i32* %p, i32 %a) {
+  %g = getelementptr i32, i32* %p, i32 2
+  %x = load i32, i32* %g, align 4
+  %y = add i32 %x, %a
+  %z = mul i32 %y, 3
+  ret i32 %z
+}
+
+; A load is not moved past a store, but may be moved into one.
+; CHECK: function _ordered($p,$q) {
+; CHECK: $x = HEAP32[$p>>2]|0;
+; CHECK-NEXT: HEAP32[$q>>2] = 0;
+; CHECK-NEXT: HEAP32[((($q)) + 4|0)>>2] = ((($x) + (HEAP32[((($p)) + 4|0)>>2]|0))|0);
+define void @ordered(i32* %p, i32* %q) {
+  %x = load i32, i32* %p, align 4
+  store i32 0, i32* %q, align 4
+  %p1 = getelementptr i32, i32* %p, i32 1
+  %y = load i32, i32* %p1, align 4
+  %s = add i32 %x, %y
+  %q1 = getelementptr i32, i32* %q, i32 1
+  store i32 %s, i32* %q1, align 4
+  ret void
+}
+
+; Branch conditions and call arguments take their operands' expressions, but
+; a value used twice keeps its local.
+; CHECK: function _branch($a,$b) {
+; CHECK: $m = Math_imul($a, $b)|0;
+; CHECK-NEXT: if ((($m|0)<(((($a) + 1)|0)|0))) {
+; CHECK: $r = (_g((((($m) + ($b))|0)|0))|0);
+define i32 @branch(i32 %a, i32 %b) {
+entry:
+  %m = mul i32 %a, %b
+  %a1 = add i32 %a, 1
+  %c = icmp slt i32 %m, %a1
+  br i1 %c, label %then, label %else
+then:
+  %s = add i32 %m, %b
+  %r = call i32 @g(i32 %s)
+  ret i32 %r
+else:
+  ret i32 %m
+}
+
+declare i32 @g(i32)
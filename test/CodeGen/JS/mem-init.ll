@@ -0,0 +1,55 @@
+; RUN: llc < %s | FileCheck %s
+; RUN: llc -emscripten-merge-constants=false < %s | FileCheck %s --check-prefix=NOMERGE
+; RUN: llc -emscripten-mem-init-format=base64 < %s | FileCheck %s --check-prefix=BASE64
+; RUN: llc -emscripten-mem-init-format=file -emscripten-mem-init-file=%t.mem < %s | FileCheck %s --check-prefix=FILE
+; RUN: llc -emscripten-layout-globals-by-use < %s | FileCheck %s --check-prefix=BYUSE
+
+; Memory initializer encodings, merging of identical constants, and layout of
+; globals by use.
+
+target datalayout = "e-p:32:32-i64:64-v128:32:128-n32-S128"
+target triple = "asmjs-unknown-emscripten"
+
+; These have different types, so ConstantMerge leaves them alone, but they are
+; the same bytes once flattened.
+@pair.a = private unnamed_addr constant [2 x i32] [i32 1, i32 2], align 4
+@pair.b = private unnamed_addr constant { i32, i32 } { i32 1, i32 2 }, align 4
+@pairs = global [2 x i8*] [i8* bitcast ([2 x i32]* @pair.a to i8*), i8* bitcast ({ i32, i32 }* @pair.b to i8*)], align 4
+
+; A long run of zeros, which base64 leaves out.
+@data = global { [2 x i8], [100 x i8], [2 x i8], [20 x i8] } { [2 x i8] c"\01\02", [100 x i8] zeroinitializer, [2 x i8] c"\03\04", [20 x i8] zeroinitializer }, align 4
+
+@cold = global i32 5, align 4
+@hot = global i32 6, align 4
+
+; CHECK: /* memory initializer */ allocate([1,0,0,0,2,0,0,0,8,0,0,0,8,0,0,0,1,2,0,
+; CHECK-SAME: ,0,3,4,{{(0,)+}}5,0,0,0,6], "i8", ALLOC_NONE, Runtime.GLOBAL_BASE);
+
+; NOMERGE: /* memory initializer */ allocate([1,0,0,0,2,0,0,0,1,0,0,0,2,0,0,0,8,0,0,0,16,0,0,0,1,2,0,
+
+; BASE64: /* memory initializer */ (function(segments) {
+; BASE64: HEAPU8[ptr++] = value >> bits;
+; BASE64: })([0,"AQAAAAIAAAAIAAAACAAAAAEC",118,"AwQAAAAAAAAAAAAAAAAAAAAAAAAAAAUAAAAG"]);
+
+; FILE: /* memory initializer */ memoryInitializer = "mem-init.ll.tmp.mem";
+; FILE-NOT: allocate(
+
+; The zeros at the end of @data are now at the end of memory, and not emitted.
+; BYUSE: /* memory initializer */ allocate([6,0,0,0,5,0,0,0,1,0,0,0,2,0,0,0,16,0,0,0,16,0,0,0,1,2,0,
+; BYUSE-SAME: ,0,3,4], "i8", ALLOC_NONE, Runtime.GLOBAL_BASE);
+
+define i32 @main() {
+entry:
+  br label %loop
+loop:
+  %i = phi i32 [ 0, %entry ], [ %n, %loop ]
+  %v = load i32, i32* @hot
+  %w = add i32 %v, %i
+  store i32 %w, i32* @hot
+  %n = add i32 %i, 1
+  %c = icmp slt i32 %n, 10
+  br i1 %c, label %loop, label %out
+out:
+  %x = load i32, i32* @cold
+  ret i32 %x
+}
@@ -0,0 +1,90 @@
+; RUN: llc -emscripten-outline < %s | FileCheck %s
+
+; Repeated sequences are moved into a shared helper when that is smaller, and
+; inputs from outside the sequence become the helper's parameters.
+
+target datalayout = "e-i1:8:8-i8:8:8-i16:16:16-i32:32:32-i64:64:64-f32:32:32-f64:64:64-p:32:32:32-v128:32:128-n32-S128"
+target triple = "asmjs-unknown-emscripten"
+
+; CHECK: function _a($p,$x) {
+; CHECK: $w = (_emscripten_outlined($p,$x)|0);
+; CHECK-NEXT: $r = (($w) + ($x))|0;
+define i32 @a(i32* %p, i32 %x) {
+entry:
+  %v = load i32, i32* %p, align 4
+  %m = mul i32 %v, %x
+  %s = add i32 %m, 12345
+  %t = xor i32 %s, %v
+  %u = ashr i32 %t, 3
+  %w = mul i32 %u, %u
+  store i32 %w, i32* %p, align 4
+  %r = add i32 %w, %x
+  ret i32 %r
+}
+
+; CHECK: function _b($q,$y) {
+; CHECK: $w = (_emscripten_outlined($q,$y)|0);
+; CHECK-NEXT: $r = (($w) - ($y))|0;
+define i32 @b(i32* %q, i32 %y) {
+entry:
+  %v = load i32, i32* %q, align 4
+  %m = mul i32 %v, %y
+  %s = add i32 %m, 12345
+  %t = xor i32 %s, %v
+  %u = ashr i32 %t, 3
+  %w = mul i32 %u, %u
+  store i32 %w, i32* %q, align 4
+  %r = sub i32 %w, %y
+  ret i32 %r
+}
+
+; CHECK: function _c($q,$y) {
+; CHECK: $w = (_emscripten_outlined($q,$y)|0);
+; CHECK-NEXT: return ($w|0);
+define i32 @c(i32* %q, i32 %y) {
+entry:
+  %v = load i32, i32* %q, align 4
+  %m = mul i32 %v, %y
+  %s = add i32 %m, 12345
+  %t = xor i32 %s, %v
+  %u = ashr i32 %t, 3
+  %w = mul i32 %u, %u
+  store i32 %w, i32* %q, align 4
+  ret i32 %w
+}
+
+; The same operations on a different constant are a different sequence.
+
+; CHECK: function _e($q,$y) {
+; CHECK-NOT: _emscripten_outlined
+; CHECK: return
+define i32 @e(i32* %q, i32 %y) {
+entry:
+  %v = load i32, i32* %q, align 4
+  %m = mul i32 %v, %y
+  %s = add i32 %m, 54321
+  store i32 %s, i32* %q, align 4
+  ret i32 %s
+}
+
+; Short sequences are cheaper to leave where they are.
+
+; CHECK: function _d($x) {
+; CHECK-NOT: _emscripten_outlined
+; CHECK: return
+define i32 @d(i32 %x) {
+entry:
+  %a = add i32 %x, 1
+  %b = mul i32 %a, %a
+  %c = add i32 %b, %x
+  %e = add i32 %x, 1
+  %f = mul i32 %e, %e
+  %g = add i32 %f, %c
+  ret i32 %g
+}
+
+; CHECK: function _emscripten_outlined($in,$in1) {
+; CHECK: $v = HEAP32[$in>>2]|0;
+; CHECK: $m = Math_imul($v, $in1)|0;
+; CHECK: HEAP32[$in>>2] = $w;
+; CHECK: return ($w|0);
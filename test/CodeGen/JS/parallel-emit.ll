@@ -0,0 +1,67 @@
+; RUN: llc < %s > %t.serial
+; RUN: llc -emscripten-emit-threads=4 < %s > %t.parallel
+; RUN: diff %t.serial %t.parallel
+; RUN: FileCheck %s < %t.parallel
+
+; Function table slots, asm const ids and block addresses are handed out in
+; emission order, so emitting function bodies in parallel must not change them.
+
+target datalayout = "e-p:32:32-i64:64-v128:32:128-n32-S128"
+target triple = "asmjs-unknown-emscripten"
+
+@.str = private unnamed_addr constant [11 x i8] c"{ Foo(); }\00", align 1
+@.str1 = private unnamed_addr constant [11 x i8] c"{ Bar(); }\00", align 1
+
+declare i32 @emscripten_asm_const_int(i8*, ...)
+
+define void @a(i32 %x) {
+  ret void
+}
+
+define void @b(i32 %x) {
+  ret void
+}
+
+; CHECK-LABEL: function _usesb(
+; CHECK: return {{[(]*}}1
+define i32 @usesb() {
+  ret i32 ptrtoint (void (i32)* @b to i32)
+}
+
+; CHECK-LABEL: function _usesa(
+; CHECK: return {{[(]*}}2
+define i32 @usesa() {
+  ret i32 ptrtoint (void (i32)* @a to i32)
+}
+
+; CHECK-LABEL: function _asmconsts(
+; CHECK: _emscripten_asm_const_i(0)
+; CHECK: _emscripten_asm_const_i(1)
+define void @asmconsts() {
+  %1 = call i32 (i8*, ...) @emscripten_asm_const_int(i8* getelementptr inbounds ([11 x i8], [11 x i8]* @.str1, i32 0, i32 0))
+  %2 = call i32 (i8*, ...) @emscripten_asm_const_int(i8* getelementptr inbounds ([11 x i8], [11 x i8]* @.str, i32 0, i32 0))
+  ret void
+}
+
+; CHECK-LABEL: function _asmconst(
+; CHECK: _emscripten_asm_const_i(1)
+define void @asmconst() {
+  %1 = call i32 (i8*, ...) @emscripten_asm_const_int(i8* getelementptr inbounds ([11 x i8], [11 x i8]* @.str, i32 0, i32 0))
+  ret void
+}
+
+; CHECK-LABEL: function _indirect(
+; CHECK-DAG: case 1:
+; CHECK-DAG: case 2:
+@addrs = global [2 x i8*] [i8* blockaddress(@indirect, %one), i8* blockaddress(@indirect, %two)]
+
+define i32 @indirect(i32 %x) {
+entry:
+  %p = getelementptr [2 x i8*], [2 x i8*]* @addrs, i32 0, i32 %x
+  %dest = load i8*, i8** %p
+  indirectbr i8* %dest, [label %one, label %two]
+one:
+  ret i32 1
+two:
+  ret i32 2
+}
@@ -0,0 +1,107 @@
+; RUN: llc -emscripten-relooper-profile < %s | FileCheck %s
+
+; The relooper checks for the likely branches first, and keeps cold code out
+; of the way of hot code.
+
+target datalayout = "e-p:32:32-i64:64-v128:32:128-n32-S128"
+target triple = "asmjs-unknown-emscripten"
+
+; The false side is the likely one, so it is the if arm.
+; CHECK: function _ifelse($x) {
+; CHECK: if (!($c)) {
+; CHECK-NEXT: _hot(2);
+; CHECK-NEXT: } else {
+; CHECK-NEXT: _cold(1);
+; CHECK-NEXT: }
+define i32 @ifelse(i32 %x) {
+entry:
+  %c = icmp eq i32 %x, 0
+  br i1 %c, label %a, label %b, !prof !0
+a:
+  call void @cold(i32 1)
+  br label %end
+b:
+  call void @hot(i32 2)
+  br label %end
+end:
+  ret i32 %x
+}
+
+; The exits of a loop are checked for the most frequent first.
+; CHECK: function _exits($p) {
+; CHECK: if ((label|0) == 6) {
+; CHECK-NEXT: _hot(3);
+; CHECK: else if ((label|0) == 5) {
+; CHECK-NEXT: _cold(2);
+; CHECK: else if ((label|0) == 4) {
+; CHECK-NEXT: _cold(1);
+define i32 @exits(i32* %p) {
+entry:
+  br label %head
+head:
+  %i = phi i32 [ 0, %entry ], [ %i1, %next ]
+  %a = getelementptr i32, i32* %p, i32 %i
+  %v = load i32, i32* %a
+  switch i32 %v, label %next [
+    i32 1, label %e1
+    i32 2, label %e2
+    i32 3, label %e3
+  ], !prof !1
+next:
+  %i1 = add i32 %i, 1
+  br label %head
+e1:
+  call void @cold(i32 1)
+  ret i32 1
+e2:
+  call void @cold(i32 2)
+  ret i32 2
+e3:
+  call void @hot(i32 3)
+  ret i32 3
+}
+
+; The cold exit gets a region of its own, even though it is larger than the
+; hot one, which then follows the loop without nesting. The loop keeps going
+; in the if arm.
+; CHECK: function _coldexit($p,$n) {
+; CHECK: if (!($done)) {
+; CHECK-NEXT: $i = $i1;
+; CHECK-NEXT: } else {
+; CHECK-NEXT: break;
+; CHECK-NEXT: }
+; CHECK-NEXT: }
+; CHECK-NEXT: if ((label|0) == 4) {
+; CHECK: return -1;
+; CHECK-NEXT: }
+; CHECK-NEXT: _hot(($i1|0));
+; CHECK-NEXT: return 0;
+define i32 @coldexit(i32* %p, i32 %n) {
+entry:
+  br label %head
+head:
+  %i = phi i32 [ 0, %entry ], [ %i1, %next ]
+  %a = getelementptr i32, i32* %p, i32 %i
+  %v = load i32, i32* %a
+  %bad = icmp slt i32 %v, 0
+  br i1 %bad, label %err, label %next, !prof !0
+next:
+  %i1 = add i32 %i, 1
+  %done = icmp eq i32 %i1, %n
+  br i1 %done, label %out, label %head
+err:
+  call void @cold(i32 %v)
+  call void @cold(i32 %i)
+  call void @cold(i32 %n)
+  call void @cold(i32 %v)
+  ret i32 -1
+out:
+  call void @hot(i32 %i1)
+  ret i32 0
+}
+
+declare void @hot(i32)
+declare void @cold(i32)
+
+!0 = !{!"branch_weights", i32 1, i32 1000}
+!1 = !{!"branch_weights", i32 1000, i32 1, i32 2, i32 100}
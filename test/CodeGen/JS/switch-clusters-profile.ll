@@ -0,0 +1,49 @@
+; RUN: llc -O2 -emscripten-relooper-profile < %s | FileCheck %s
+
+; The weight of the default, and of the cases that go to it, is kept on the
+; edges to the default when a switch is split into clusters, so that a switch
+; which mostly misses its cases checks for the miss first.
+
+target datalayout = "e-p:32:32-i64:64-v128:32:128-n32-S128"
+target triple = "asmjs-unknown-emscripten"
+
+declare void @a()
+declare void @b()
+declare void @c()
+declare void @d()
+
+; CHECK-LABEL: function _dispatch(
+; CHECK: $switch_eq2 = ($x|0)==(100);
+; CHECK-NEXT: if (!($switch_eq2)) {
+; CHECK: $switch_eq7 = ($x|0)==(400);
+; CHECK-NEXT: if (!($switch_eq7)) {
+; CHECK: $switch_eq8 = ($x|0)==(500);
+; CHECK-NEXT: if (!($switch_eq8)) {
+define void @dispatch(i32 %x) {
+entry:
+  switch i32 %x, label %out [
+    i32 0, label %A
+    i32 100, label %B
+    i32 200, label %C
+    i32 300, label %D
+    i32 400, label %A
+    i32 500, label %B
+    i32 600, label %out
+  ], !prof !0
+A:
+  call void @a()
+  br label %out
+B:
+  call void @b()
+  br label %out
+C:
+  call void @c()
+  br label %out
+D:
+  call void @d()
+  br label %out
+out:
+  ret void
+}
+
+!0 = !{!"branch_weights", i32 100000, i32 1, i32 1, i32 1, i32 1, i32 1, i32 1, i32 1000}
@@ -0,0 +1,93 @@
+; RUN: llc -O2 < %s | FileCheck %s
+
+; Switches that are dense enough are left as a single JS switch. Others are
+; split into clusters: dense runs stay JS switches, small runs become bit
+; tests, and the rest range and equality tests, below a binary search.
+
+target datalayout = "e-p:32:32-i64:64-v128:32:128-n32-S128"
+target triple = "asmjs-unknown-emscripten"
+
+declare void @a()
+declare void @b()
+declare void @c()
+declare void @d()
+
+; CHECK-LABEL: function _dense(
+; CHECK-NOT: switch_
+; CHECK: switch ($x|0) {
+; CHECK-NEXT: case 5: case 0:  {
+; CHECK-NOT: switch_
+; CHECK: }
+define void @dense(i32 %x) {
+entry:
+  switch i32 %x, label %out [
+    i32 0, label %A
+    i32 1, label %B
+    i32 2, label %C
+    i32 3, label %D
+    i32 5, label %A
+  ]
+A:
+  call void @a()
+  br label %out
+B:
+  call void @b()
+  br label %out
+C:
+  call void @c()
+  br label %out
+D:
+  call void @d()
+  br label %out
+out:
+  ret void
+}
+
+; CHECK-LABEL: function _clustered(
+; CHECK: $switch_lt = ($x|0)<(200);
+; CHECK: switch ($x|0) {
+; CHECK: case 4: case 0:  {
+; CHECK: switch ($x|0) {
+; CHECK: case 104: case 102: case 100:  {
+; CHECK: $switch_off = (($x) - 200)|0;
+; CHECK-NEXT: $switch_in = ($switch_off>>>0)<=(31);
+; CHECK: $switch_bit = 1 << $switch_off;
+; CHECK-NEXT: $switch_mask = $switch_bit & -2147450879;
+; CHECK: $switch_off3 = (($x) - 5000)|0;
+; CHECK-NEXT: $switch_in4 = ($switch_off3>>>0)<=(2);
+; CHECK: $switch_eq = ($x|0)==(1000000);
+define void @clustered(i32 %x) {
+entry:
+  switch i32 %x, label %out [
+    i32 0, label %A
+    i32 1, label %B
+    i32 2, label %C
+    i32 3, label %D
+    i32 4, label %A
+    i32 100, label %C
+    i32 102, label %C
+    i32 104, label %C
+    i32 110, label %D
+    i32 200, label %C
+    i32 215, label %C
+    i32 231, label %C
+    i32 5000, label %D
+    i32 5001, label %D
+    i32 5002, label %D
+    i32 1000000, label %B
+  ]
+A:
+  call void @a()
+  br label %out
+B:
+  call void @b()
+  br label %out
+C:
+  call void @c()
+  br label %out
+D:
+  call void @d()
+  br label %out
+out:
+  ret void
+}
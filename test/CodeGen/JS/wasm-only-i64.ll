@@ -0,0 +1,45 @@
+; RUN: llc -emscripten-wasm -emscripten-only-wasm < %s | FileCheck %s
+
+; When the output is only ever wasm, i64 values are kept whole instead of
+; being split into i32 pairs by ExpandI64.
+
+target datalayout = "e-i1:8:8-i8:8:8-i16:16:16-i32:32:32-i64:64:64-f32:32:32-f64:64:64-p:32:32:32-v128:32:128-n32-S128"
+target triple = "asmjs-unknown-emscripten"
+
+declare i64 @llvm.bswap.i64(i64)
+declare i64 @mix(i64, i32)
+
+; CHECK: function _hash($p,$i,$seed) {
+; CHECK: $seed = i64($seed);
+; CHECK: $q = (($p) + (i64_trunc($i)<<3)|0);
+; CHECK: $v = load8($q);
+; CHECK: $x = i64_xor($seed,$v);
+; CHECK: $m = i64_mul($x,i64_const(435,256));
+; CHECK: $s = i64_lshr($m,i64_const(13,0));
+; CHECK: $c = (i64(_mix((i64($s)),1)));
+; CHECK: store8($q,$c);
+; CHECK: return (i64($c));
+define i64 @hash(i64* %p, i64 %i, i64 %seed) {
+entry:
+  %q = getelementptr i64, i64* %p, i64 %i
+  %v = load i64, i64* %q, align 8
+  %x = xor i64 %seed, %v
+  %m = mul i64 %x, 1099511628211
+  %s = lshr i64 %m, 13
+  %c = call i64 @mix(i64 %s, i32 1)
+  store i64 %c, i64* %q, align 8
+  ret i64 %c
+}
+
+; Library functions cannot take an i64, so byte swaps are done inline.
+
+; CHECK: function _swap($x) {
+; CHECK-NOT: _llvm_bswap_i64
+; CHECK: $r = i64_or(i64_shl(i64_zext(((i64_trunc($x) << 24) | ((i64_trunc($x) & 65280) << 8) | ((i64_trunc($x) >>> 8) & 65280) | (i64_trunc($x) >>> 24))>>>0),i64_const(32,0)),i64_zext(
+; CHECK-NOT: _llvm_bswap_i64
+; CHECK: }
+define i64 @swap(i64 %x) {
+entry:
+  %r = call i64 @llvm.bswap.i64(i64 %x)
+  ret i64 %r
+}
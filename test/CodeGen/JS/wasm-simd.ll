@@ -0,0 +1,100 @@
+; RUN: llc -emscripten-wasm -emscripten-only-wasm -emscripten-wasm-simd -emscripten-precise-f32 < %s | FileCheck %s
+
+; With -emscripten-wasm-simd, vector operations are emitted as WebAssembly SIMD
+; operations on v128 values rather than as SIMD.js.
+
+target datalayout = "e-p:32:32-i64:64-v128:32:128-n32-S128"
+target triple = "asmjs-unknown-emscripten"
+
+; CHECK: function _arith($a,$b) {
+; CHECK:  $a = v128($a);
+; CHECK:  var $c = i32x4_const(0,0,0,0), $d = i32x4_const(0,0,0,0),
+; CHECK:  $c = i32x4_add($a,$b);
+; CHECK:  $d = i32x4_mul($c,i32x4_const(1,2,3,-4));
+; CHECK:  $e = i32x4_shr_s($d,3);
+; CHECK:  return (v128($e));
+define <4 x i32> @arith(<4 x i32> %a, <4 x i32> %b) {
+  %c = add <4 x i32> %a, %b
+  %d = mul <4 x i32> %c, <i32 1, i32 2, i32 3, i32 -4>
+  %e = ashr <4 x i32> %d, <i32 3, i32 3, i32 3, i32 3>
+  ret <4 x i32> %e
+}
+
+; Floats are constants by their bits, unordered compares are the negation of
+; ordered ones, and selects on masks are bitwise.
+; CHECK: function _float($a,$b) {
+; CHECK:  $c = f32x4_add($a,$b);
+; CHECK:  $d = f32x4_neg($c);
+; CHECK:  $e = f32x4_div($d,i32x4_const(1069547520,1073741824,2143289344,1065353216));
+; CHECK:  $m = v128_not(f32x4_ge($e,$a));
+; CHECK:  $s = v128_bitselect($e,$a,$m);
+define <4 x float> @float(<4 x float> %a, <4 x float> %b) {
+  %c = fadd <4 x float> %a, %b
+  %d = fsub <4 x float> <float -0.0, float -0.0, float -0.0, float -0.0>, %c
+  %e = fdiv <4 x float> %d, <float 1.5, float 2.0, float 0x7FF8000000000000, float 1.0>
+  %m = fcmp ult <4 x float> %e, %a
+  %s = select <4 x i1> %m, <4 x float> %e, <4 x float> %a
+  ret <4 x float> %s
+}
+
+; Saturating arithmetic and min/max idioms become single operations, and the
+; compares and arithmetic they are made of are not emitted.
+; CHECK: function _idioms($a,$b) {
+; CHECK-NOT: i8x16_add(
+; CHECK:  $r = i8x16_add_sat_u($a,$b);
+; CHECK-NOT: i8x16_gt_u(
+; CHECK:  $t = i8x16_sub_sat_u($r,$b);
+; CHECK-NOT: i8x16_lt_s(
+; CHECK:  $mn = i8x16_min_s($t,$a);
+; CHECK:  return (v128($mn));
+define <16 x i8> @idioms(<16 x i8> %a, <16 x i8> %b) {
+  %s = add <16 x i8> %a, %b
+  %o = icmp ult <16 x i8> %s, %a
+  %r = select <16 x i1> %o, <16 x i8> <i8 -1, i8 -1, i8 -1, i8 -1, i8 -1, i8 -1, i8 -1, i8 -1, i8 -1, i8 -1, i8 -1, i8 -1, i8 -1, i8 -1, i8 -1, i8 -1>, <16 x i8> %s
+  %g = icmp ugt <16 x i8> %r, %b
+  %d = sub <16 x i8> %r, %b
+  %t = select <16 x i1> %g, <16 x i8> %d, <16 x i8> zeroinitializer
+  %lt = icmp slt <16 x i8> %t, %a
+  %mn = select <16 x i1> %lt, <16 x i8> %t, <16 x i8> %a
+  ret <16 x i8> %mn
+}
+
+; Shuffles are byte shuffles of both operands, and the splat idiom is a splat.
+; CHECK: function _lanes($a,$b,$n) {
+; CHECK:  $s = i8x16_shuffle($a,$b,0,1,16,17,2,3,18,19,0,0,30,31,14,15,6,7);
+; CHECK:  $sp = i16x8_splat(7);
+; CHECK:  $ins = i16x8_replace_lane($s,3,$x);
+; CHECK:  $sh = i16x8_shl($ins,7);
+; CHECK:  $e = i16x8_extract_lane_s($sh,5)<<16>>16;
+define <8 x i16> @lanes(<8 x i16> %a, <8 x i16> %b, i32 %n) {
+  %s = shufflevector <8 x i16> %a, <8 x i16> %b, <8 x i32> <i32 0, i32 8, i32 1, i32 9, i32 undef, i32 15, i32 7, i32 3>
+  %i = insertelement <8 x i16> undef, i16 7, i32 0
+  %sp = shufflevector <8 x i16> %i, <8 x i16> undef, <8 x i32> zeroinitializer
+  %x = trunc i32 %n to i16
+  %ins = insertelement <8 x i16> %s, i16 %x, i32 3
+  %sh = shl <8 x i16> %ins, %sp
+  %e = extractelement <8 x i16> %sh, i32 5
+  %r = insertelement <8 x i16> %sh, i16 %e, i32 0
+  ret <8 x i16> %r
+}
+
+; Vectors narrower than 128 bits use the partial loads and stores.
+; CHECK: function _memory($p,$q,$r) {
+; CHECK:  $v = v128_load($p,4);
+; CHECK:  $w = v128_load64_zero($q);
+; CHECK:  $i = i32x4_trunc_sat_f32x4_s($s);
+; CHECK:  v128_store(temp_v128_ptr,$i);
+; CHECK:  v128_store64_lane(temp_v128_ptr,$h,0);
+define void @memory(<4 x float>* %p, <2 x float>* %q, <4 x i32>* %r) {
+  %v = load <4 x float>, <4 x float>* %p, align 4
+  %w = load <2 x float>, <2 x float>* %q, align 8
+  %ww = shufflevector <2 x float> %w, <2 x float> undef, <4 x i32> <i32 0, i32 1, i32 0, i32 1>
+  %s = fmul <4 x float> %v, %ww
+  %i = fptosi <4 x float> %s to <4 x i32>
+  store <4 x i32> %i, <4 x i32>* %r, align 16
+  %h = shufflevector <4 x float> %s, <4 x float> undef, <2 x i32> <i32 2, i32 3>
+  store <2 x float> %h, <2 x float>* %q, align 8
+  ret void
+}
+
+; CHECK: "simd": 0,
@@ -0,0 +1,26 @@
+# RUN: llvm-mc -triple dcpu16 -show-encoding %s | FileCheck %s
+
+# CHECK: SET A, B                ; encoding: [0x04,0x01]
+# CHECK: ADD A, 0x3              ; encoding: [0x90,0x02]
+# CHECK: SUB [X+0x4], 0x64       ; encoding: [0x7e,0x63,0x00,0x64,0x00,0x04]
+# CHECK: SET A, PEEK             ; encoding: [0x64,0x01]
+# CHECK: SET PUSH, A             ; encoding: [0x03,0x01]
+# CHECK: SET B, POP              ; encoding: [0x60,0x21]
+# CHECK: IFE A, 0x0              ; encoding: [0x84,0x12]
+# CHECK: STI [I], [J]            ; encoding: [0x3d,0xde]
+# CHECK: JSR A                   ; encoding: [0x00,0x20]
+# CHECK: HWN I                   ; encoding: [0x1a,0x00]
+# CHECK: RFI 0                   ; encoding: [0x85,0x60]
+# CHECK: SET PC, POP             ; encoding: [0x63,0x81]
+        SET A, B
+        ADD A, 3
+        SUB [X+4], 100
+        SET A, PEEK
+        SET PUSH, A
+        SET B, POP
+        IFE A, 0
+        STI [I], [J]
+        JSR A
+        HWN I
+        RFI 0
+        SET PC, POP
@@ -0,0 +1,5 @@
+# RUN: not llvm-mc -triple dcpu16 -filetype=obj %s -o /dev/null 2>&1 | FileCheck %s
+
+# There is no linker to resolve symbols later.
+# CHECK: undefined symbol 'missing' in DCPU16 image
+        SET PC, missing
@@ -0,0 +1,17 @@
+# RUN: llvm-mc -triple dcpu16 -filetype=obj %s -o - | od -A n -t x1 -v | FileCheck %s
+
+# The image is loaded at address 0 and symbols are word addresses: data is at
+# byte 14, word 7, and the common buf follows the 12 words of .text.
+# CHECK: 7c 01 00 07 78 21 00 08 7f 81 00 00 90 02 12 34
+# CHECK-NEXT: 56 78 00 00 7c 41 00 0c
+# CHECK-NOT: {{.}}
+        .text
+start:
+        SET A, data
+        SET B, [data+1]
+        SET PC, start
+        ADD A, 3
+data:
+        .dat 0x1234, 0x5678, start
+        SET C, buf
+        .comm buf, 4, 2
@@ -0,0 +1,160 @@
+//===- JSWriterTest.cpp - Tests for the JS writer -------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/AsmParser/Parser.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Target/TargetOptions.h"
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#ifdef LLVM_ON_UNIX
+#include <sys/resource.h>
+#endif
+
+using namespace llvm;
+
+namespace {
+
+// A module with N functions, N globals, N external globals and N external
+// functions. Every function reads its external global, calls its external
+// function and takes the address of another function, so the writer's name
+// tables (global addresses, externs, indexed functions and function tables)
+// all get N entries. The external globals are declared in reverse order.
+std::string makeModule(unsigned N) {
+  std::string Text;
+  raw_string_ostream OS(Text);
+  OS << "target datalayout = \"e-p:32:32-i64:64-v128:32:128-n32-S128\"\n"
+        "target triple = \"asmjs-unknown-emscripten\"\n";
+  for (unsigned i = 0; i < N; i++) {
+    OS << "@g" << i << " = global i32 " << i << "\n"
+       << "@e" << N - 1 - i << " = external global i32\n"
+       << "declare i32 @ext" << i << "(i32)\n";
+  }
+  for (unsigned i = 0; i < N; i++) {
+    OS << "define i32 @f" << i << "(i32 %x) {\n"
+       << "  %a = load i32, i32* @e" << i << "\n"
+       << "  %b = call i32 @ext" << i << "(i32 %a)\n"
+       << "  %c = add i32 %b, ptrtoint (i32 (i32)* @f" << (i * 7919 + 1) % N
+       << " to i32)\n"
+       << "  store i32 %c, i32* @g" << i << "\n"
+       << "  ret i32 %c\n"
+       << "}\n";
+  }
+  return OS.str();
+}
+
+// Compiles the module to JS and returns the output. Seconds, if given,
+// receives the time the passes took, not counting parsing.
+std::string emitJS(const std::string &IR, double *Seconds = nullptr) {
+  LLVMInitializeJSBackendTargetInfo();
+  LLVMInitializeJSBackendTarget();
+  LLVMInitializeJSBackendTargetMC();
+
+  LLVMContext Context;
+  SMDiagnostic Err;
+  std::unique_ptr<Module> M = parseAssemblyString(IR, Err, Context);
+  EXPECT_TRUE(M != nullptr);
+  if (!M)
+    return std::string();
+
+  std::string Error;
+  const Target *TheTarget =
+      TargetRegistry::lookupTarget(M->getTargetTriple(), Error);
+  EXPECT_TRUE(TheTarget != nullptr) << Error;
+  if (!TheTarget)
+    return std::string();
+  std::unique_ptr<TargetMachine> TM(TheTarget->createTargetMachine(
+      M->getTargetTriple(), "", "", TargetOptions(), None));
+
+  SmallString<0> JS;
+  raw_svector_ostream OS(JS);
+  legacy::PassManager PM;
+  EXPECT_FALSE(
+      TM->addPassesToEmitFile(PM, OS, TargetMachine::CGFT_AssemblyFile));
+  auto Start = std::chrono::steady_clock::now();
+  PM.run(*M);
+  if (Seconds)
+    *Seconds = std::chrono::duration<double>(
+                   std::chrono::steady_clock::now() - Start).count();
+  return JS.str().str();
+}
+
+// Returns the peak resident set size of this process so far, in KB, or 0
+// where that is not known.
+long getPeakRSSKB() {
+#ifdef LLVM_ON_UNIX
+  struct rusage RU;
+  if (::getrusage(RUSAGE_SELF, &RU) == 0) {
+#ifdef __APPLE__
+    return RU.ru_maxrss / 1024; // in bytes on Darwin
+#else
+    return RU.ru_maxrss;
+#endif
+  }
+#endif
+  return 0;
+}
+
+// Returns the quoted names in the metadata list that follows Key.
+std::vector<std::string> getMetadataList(const std::string &JS, StringRef Key) {
+  std::vector<std::string> Names;
+  std::string Prefix = ("\"" + Key + "\": [").str();
+  size_t Start = JS.find(Prefix);
+  if (Start == std::string::npos)
+    return Names;
+  Start += Prefix.size();
+  SmallVector<StringRef, 8> Quoted;
+  StringRef(JS).slice(Start, JS.find(']', Start)).split(Quoted, ", ", -1, false);
+  for (StringRef Name : Quoted)
+    Names.push_back(Name.trim('"').str());
+  return Names;
+}
+
+// The name tables are hashed, so whatever the writer prints from them must
+// still come out in sorted order.
+TEST(JSWriterTest, MetadataIsSorted) {
+  std::string IR = makeModule(100);
+  std::string JS = emitJS(IR);
+  std::vector<std::string> Externs = getMetadataList(JS, "externs");
+  EXPECT_EQ(100u, Externs.size());
+  EXPECT_TRUE(std::is_sorted(Externs.begin(), Externs.end()));
+  EXPECT_EQ(JS, emitJS(IR));
+}
+
+// Not a pass/fail test: records how long emitting takes and the peak RSS of
+// the process at two sizes, ten times apart, so that changes to the writer's
+// name tables can be compared with --gtest_output=xml. Timing on shared
+// machines is too noisy to assert on.
+TEST(JSWriterTest, ReportScaling) {
+  unsigned Size = 1000;
+  for (unsigned i = 0; i < 2; i++, Size *= 10) {
+    double Time;
+    emitJS(makeModule(Size), &Time);
+    std::string Prefix = "Functions" + std::to_string(Size);
+    RecordProperty(Prefix + "Ms", static_cast<int>(Time * 1000));
+    if (long KB = getPeakRSSKB())
+      RecordProperty(Prefix + "PeakRSSKB", static_cast<int>(KB));
+  }
+}
+
+} // end anonymous namespace
@@ -0,0 +1,195 @@
+//===- RelooperTest.cpp - Tests for the Relooper --------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Relooper.h"
+
+#include "gtest/gtest.h"
+
+#include <string>
+#include <vector>
+
+namespace {
+
+// A control flow graph as a list of successor lists, block 0 being the entry.
+typedef std::vector<std::vector<unsigned>> Graph;
+
+// An if/else diamond: 0 -> {1, 2} -> 3.
+Graph makeDiamond() {
+  return Graph{{1, 2}, {3}, {3}, {}};
+}
+
+// A block switching to N cases which all fall through to a common exit.
+Graph makeFlatSwitch(unsigned N) {
+  Graph G(N + 2);
+  for (unsigned i = 1; i <= N; i++) {
+    G[0].push_back(i);
+    G[i].push_back(N + 1);
+  }
+  return G;
+}
+
+// A chain of N/3 if/else diamonds, one after the other.
+Graph makeDiamondChain(unsigned N) {
+  unsigned Count = N / 3;
+  Graph G(3 * Count + 1);
+  for (unsigned i = 0; i < Count; i++) {
+    unsigned Head = 3 * i;
+    G[Head].push_back(Head + 1);
+    G[Head].push_back(Head + 2);
+    G[Head + 1].push_back(Head + 3);
+    G[Head + 2].push_back(Head + 3);
+  }
+  return G;
+}
+
+// An interpreter loop: a dispatch block switching to N handlers, each of which
+// jumps back to the dispatch.
+Graph makeInterpreter(unsigned N) {
+  Graph G(N + 2);
+  G[0].push_back(1);
+  for (unsigned i = 2; i < N + 2; i++) {
+    G[1].push_back(i);
+    G[i].push_back(1);
+  }
+  return G;
+}
+
+// Reloops G and returns the rendered code. Blocks with more than two
+// successors switch on a variable, the rest branch on conditions. Blocks are
+// created in the relooper's arena unless OnHeap is set. Visits, if given,
+// receives the relooper's count of the blocks and branches it looked at.
+std::string reloop(const Graph &G, uint64_t *Visits = nullptr, bool OnHeap = false) {
+  Relooper::MakeOutputBuffer(1024);
+  Relooper R;
+  std::vector<Block*> Blocks;
+  for (unsigned i = 0; i < G.size(); i++) {
+    std::string Code = "b" + std::to_string(i) + "();";
+    const char *BranchVar = G[i].size() > 2 ? "x" : nullptr;
+    if (OnHeap) {
+      Blocks.push_back(new Block(Code.c_str(), BranchVar));
+      R.AddBlock(Blocks.back());
+    } else {
+      Blocks.push_back(R.AddBlock(Code.c_str(), BranchVar));
+    }
+  }
+  // Conditions are copied by the block, so they may live on the stack.
+  for (unsigned i = 0; i < G.size(); i++) {
+    for (unsigned j = 0; j < G[i].size(); j++) {
+      bool Last = j + 1 == G[i].size();
+      std::string Condition = Blocks[i]->BranchVar
+                                  ? "case " + std::to_string(j) + ":"
+                                  : "c" + std::to_string(i) + "_" + std::to_string(j);
+      Blocks[i]->AddBranchTo(Blocks[G[i][j]], Last ? nullptr : Condition.c_str());
+    }
+  }
+  R.Calculate(Blocks[0]);
+  R.Render();
+  if (Visits) {
+    *Visits = R.Visits;
+  }
+  return Relooper::GetOutputBuffer();
+}
+
+TEST(RelooperTest, Diamond) {
+  EXPECT_EQ(" b0();\n"
+            " if (c0_0) {\n"
+            "  b1();\n"
+            " } else {\n"
+            "  b2();\n"
+            " }\n"
+            " b3();\n",
+            reloop(makeDiamond()));
+}
+
+TEST(RelooperTest, Loop) {
+  EXPECT_EQ(" b0();\n"
+            " while(1) {\n"
+            "  b1();\n"
+            "  if (!(c1_0)) {\n"
+            "   break;\n"
+            "  }\n"
+            " }\n"
+            " b2();\n",
+            reloop(Graph{{1}, {1, 2}, {}}));
+}
+
+TEST(RelooperTest, Switch) {
+  EXPECT_EQ(" b0();\n"
+            " switch (x) {\n"
+            " case 0: {\n"
+            "  b1();\n"
+            "  break;\n"
+            " }\n"
+            " case 1: {\n"
+            "  b2();\n"
+            "  break;\n"
+            " }\n"
+            " default: {\n"
+            "  b3();\n"
+            " }\n"
+            " }\n"
+            " b4();\n",
+            reloop(makeFlatSwitch(3)));
+}
+
+unsigned countOf(const std::string &Code, const std::string &What) {
+  unsigned Count = 0;
+  for (size_t Pos = Code.find(What); Pos != std::string::npos; Pos = Code.find(What, Pos + 1)) {
+    Count++;
+  }
+  return Count;
+}
+
+// A loop entered at both of its blocks. The second entry is small, so it is
+// split off rather than emulated.
+TEST(RelooperTest, IrreducibleSplit) {
+  std::string Code = reloop(Graph{{1, 2}, {2}, {1, 3}, {}});
+  EXPECT_EQ(2u, countOf(Code, "b2();"));
+  EXPECT_EQ(0u, countOf(Code, "switch(label"));
+}
+
+// A loop entered at every block, with a cycle among the extra entries so that
+// it cannot be split. Only the loop is emulated, the code around it stays
+// structured and every block is emitted once.
+TEST(RelooperTest, IrreducibleEmulated) {
+  std::string Code = reloop(Graph{{1, 2, 3, 4, 5, 6, 7}, {2}, {3}, {4}, {5, 2}, {6}, {7}, {1, 8}, {}});
+  EXPECT_EQ(1u, countOf(Code, "switch(label|0)"));
+  EXPECT_EQ(1u, countOf(Code, "switch (x)"));
+  for (unsigned i = 0; i <= 8; i++) {
+    EXPECT_EQ(1u, countOf(Code, "b" + std::to_string(i) + "();"));
+  }
+}
+
+TEST(RelooperTest, HeapBlocks) {
+  Graph G = makeDiamondChain(300);
+  EXPECT_EQ(reloop(G), reloop(G, nullptr, /*OnHeap=*/true));
+  G = makeInterpreter(50);
+  EXPECT_EQ(reloop(G), reloop(G, nullptr, /*OnHeap=*/true));
+}
+
+// Shape computation must stay close to linear in the number of blocks on large,
+// flat CFGs such as generated interpreters and switch-based state machines.
+// The relooper counts the blocks and branches it looks at, which is exact, so
+// unlike timing this does not depend on the machine. Each size is ten times
+// the previous one; a quadratic step would visit about a hundred times more.
+TEST(RelooperTest, ScalesLinearly) {
+  Graph (*Makers[])(unsigned) = {makeFlatSwitch, makeDiamondChain, makeInterpreter};
+  for (auto Make : Makers) {
+    uint64_t Visits[3];
+    unsigned Size = 1000;
+    for (uint64_t &V : Visits) {
+      reloop(Make(Size), &V);
+      Size *= 10;
+    }
+    EXPECT_LT(Visits[2], 11 * Visits[1]);
+    EXPECT_LT(Visits[1], 11 * Visits[0]);
+  }
+}
+
+} // end anonymous namespace